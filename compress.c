@@ -0,0 +1,424 @@
+/* compress.c
+   Compress file data sent over the connection.
+
+   Copyright (C) 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#if USE_RCS_ID
+const char compress_rcsid[] = "$Id$";
+#endif
+
+#include <errno.h>
+
+#include "uudefs.h"
+#include "uuconf.h"
+#include "system.h"
+#include "prot.h"
+#include "trans.h"
+
+#if FEATURE_LOCAL_COMPRESS != 0
+
+#include <zlib.h>
+
+/* Files smaller than this are not worth compressing.  */
+#define CCOMPRESS_MIN (512)
+
+/* The size of the buffer used to read or write the file.  */
+#define CCOMPRESS_BUFSIZE (8192)
+
+/* Before compressing a file, we compress the first buffer full on
+   its own at the fastest level.  If that does not shrink to at most
+   ICOMPRESS_RATIO percent of its original size, we don't bother to
+   compress the file.  */
+#define ICOMPRESS_RATIO (90)
+
+/* The state of a file being compressed or decompressed.  */
+
+struct scompress
+{
+  /* TRUE if we are compressing.  */
+  boolean fsend;
+  /* The zlib stream.  */
+  z_stream s;
+  /* The file buffer.  */
+  char ab[CCOMPRESS_BUFSIZE];
+  /* TRUE when we have read the whole file.  */
+  boolean feof;
+  /* TRUE when we have seen the end of the zlib stream.  */
+  boolean fdone;
+  /* TRUE once we have checked whether the data compresses.  */
+  boolean fprobed;
+  /* TRUE if we gave up on compressing the data.  */
+  boolean fstored;
+  /* The time spent compressing or decompressing.  */
+  long isecs;
+  long imicros;
+};
+
+static boolean fcompress_worthwhile P((const char *z, size_t c));
+static void ucompress_time P((struct scompress *q, long isecs,
+			      long imicros));
+
+/* Decide whether to compress a file.  */
+
+boolean
+fcompress_file (struct sdaemon *qdaemon, long int cbytes)
+{
+  return ((qdaemon->ifeatures & FEATURE_COMPRESS) != 0
+	  && qdaemon->qproto->fcompress
+	  && cbytes >= CCOMPRESS_MIN);
+}
+
+/* Set up to compress or decompress a file.  Over a connection which
+   is reliable end to end, such as TCP, the link is probably fast, so
+   we use the fastest compression level; otherwise we use the default
+   level, which compresses better.  */
+
+struct scompress *
+qcompress_start (struct sdaemon *qdaemon, boolean fsend)
+{
+  struct scompress *q;
+  int iret;
+
+  q = (struct scompress *) xmalloc (sizeof (struct scompress));
+  q->fsend = fsend;
+  q->s.zalloc = Z_NULL;
+  q->s.zfree = Z_NULL;
+  q->s.opaque = Z_NULL;
+  q->s.next_in = Z_NULL;
+  q->s.avail_in = 0;
+  q->feof = FALSE;
+  q->fdone = FALSE;
+  q->fprobed = FALSE;
+  q->fstored = FALSE;
+  q->isecs = 0;
+  q->imicros = 0;
+
+  if (fsend)
+    iret = deflateInit (&q->s,
+			((qdaemon->ireliable & UUCONF_RELIABLE_ENDTOEND) != 0
+			 ? Z_BEST_SPEED
+			 : Z_DEFAULT_COMPRESSION));
+  else
+    iret = inflateInit (&q->s);
+  if (iret != Z_OK)
+    {
+      ulog (LOG_ERROR, "%s: %s", fsend ? "deflateInit" : "inflateInit",
+	    q->s.msg != NULL ? q->s.msg : "failed");
+      xfree ((pointer) q);
+      return NULL;
+    }
+
+  return q;
+}
+
+/* See whether a sample of the file compresses well enough to be
+   worth compressing the whole thing.  */
+
+static boolean
+fcompress_worthwhile (const char *z, size_t c)
+{
+  Bytef ab[CCOMPRESS_BUFSIZE + CCOMPRESS_BUFSIZE / 256 + 64];
+  uLongf cout;
+
+  cout = sizeof ab;
+  if (compress2 (ab, &cout, (const Bytef *) z, (uLong) c,
+		 Z_BEST_SPEED) != Z_OK)
+    return TRUE;
+  return cout * 100 <= c * ICOMPRESS_RATIO;
+}
+
+/* Add the time since isecs/imicros to the time spent compressing.  */
+
+static void
+ucompress_time (struct scompress *q, long int isecs, long int imicros)
+{
+  long inowsecs, inowmicros;
+
+  inowsecs = ixsysdep_process_time (&inowmicros);
+  q->isecs += inowsecs - isecs;
+  q->imicros += inowmicros - imicros;
+}
+
+/* Compress data from the file into a buffer.  */
+
+boolean
+fcompress_read (struct scompress *q, openfile_t e, char *zbuf, size_t *pcbuf)
+{
+  long isecs, imicros;
+  int iret;
+
+  if (q->fdone)
+    {
+      *pcbuf = 0;
+      return TRUE;
+    }
+
+  q->s.next_out = (Bytef *) zbuf;
+  q->s.avail_out = *pcbuf;
+
+  isecs = ixsysdep_process_time (&imicros);
+
+  while (q->s.avail_out > 0)
+    {
+      if (q->s.avail_in == 0 && ! q->feof)
+	{
+	  int cread;
+
+	  cread = cfileread (e, q->ab, sizeof q->ab);
+	  if (ffileioerror (e, cread))
+	    {
+	      ulog (LOG_ERROR, "read: %s", strerror (errno));
+	      return FALSE;
+	    }
+	  if (cread == 0)
+	    q->feof = TRUE;
+	  else if (! q->fprobed)
+	    {
+	      /* See whether the data is worth compressing.  If it
+		 isn't, it is presumably already compressed, and we
+		 just copy it into the stream.  Nothing has been
+		 compressed yet, so changing the level can't fail for
+		 lack of room.  */
+	      q->fprobed = TRUE;
+	      if (! fcompress_worthwhile (q->ab, (size_t) cread))
+		{
+		  DEBUG_MESSAGE0 (DEBUG_UUCP_PROTO,
+				  "fcompress_read: Data does not compress; storing it");
+		  iret = deflateParams (&q->s, Z_NO_COMPRESSION,
+					Z_DEFAULT_STRATEGY);
+		  if (iret != Z_OK)
+		    {
+		      ulog (LOG_ERROR, "deflateParams: %s",
+			    q->s.msg != NULL ? q->s.msg : "failed");
+		      return FALSE;
+		    }
+		  q->fstored = TRUE;
+		}
+	    }
+	  q->s.next_in = (Bytef *) q->ab;
+	  q->s.avail_in = cread;
+	}
+
+      iret = deflate (&q->s, q->feof ? Z_FINISH : Z_NO_FLUSH);
+      if (iret == Z_STREAM_END)
+	{
+	  q->fdone = TRUE;
+	  break;
+	}
+      if (iret != Z_OK && iret != Z_BUF_ERROR)
+	{
+	  ulog (LOG_ERROR, "deflate: %s",
+		q->s.msg != NULL ? q->s.msg : "failed");
+	  return FALSE;
+	}
+    }
+
+  ucompress_time (q, isecs, imicros);
+
+  *pcbuf -= q->s.avail_out;
+
+  return TRUE;
+}
+
+/* Decompress data and write it to the file.  */
+
+boolean
+fcompress_write (struct scompress *q, openfile_t e, const char *zdata, size_t cdata)
+{
+  long isecs, imicros;
+
+  q->s.next_in = (Bytef *) zdata;
+  q->s.avail_in = cdata;
+
+  isecs = ixsysdep_process_time (&imicros);
+
+  do
+    {
+      int iret;
+      size_t cout;
+
+      if (q->fdone)
+	{
+	  if (q->s.avail_in == 0)
+	    break;
+	  ulog (LOG_ERROR, "Data after end of compressed data");
+	  return FALSE;
+	}
+
+      q->s.next_out = (Bytef *) q->ab;
+      q->s.avail_out = sizeof q->ab;
+
+      iret = inflate (&q->s, Z_NO_FLUSH);
+      if (iret == Z_STREAM_END)
+	q->fdone = TRUE;
+      else if (iret != Z_OK && iret != Z_BUF_ERROR)
+	{
+	  ulog (LOG_ERROR, "inflate: %s",
+		q->s.msg != NULL ? q->s.msg : "failed");
+	  return FALSE;
+	}
+
+      cout = sizeof q->ab - q->s.avail_out;
+      if (cout > 0)
+	{
+	  int cwrote;
+
+	  cwrote = cfilewrite (e, q->ab, cout);
+	  if (cwrote < 0 || (size_t) cwrote != cout)
+	    {
+	      if (ffileioerror (e, cwrote))
+		ulog (LOG_ERROR, "write: %s", strerror (errno));
+	      else
+		ulog (LOG_ERROR,
+		      "Wrote %d to file when trying to write %lu",
+		      cwrote, (unsigned long) cout);
+	      return FALSE;
+	    }
+	}
+    }
+  while (q->s.avail_in > 0 || q->s.avail_out == 0);
+
+  ucompress_time (q, isecs, imicros);
+
+  return TRUE;
+}
+
+/* See whether we got all the compressed data.  */
+
+boolean
+fcompress_complete (struct scompress *q)
+{
+  return q->fdone;
+}
+
+/* Log the compression ratio.  The percentage is the size of the data
+   on the wire relative to the size of the file.  */
+
+void
+ucompress_log (struct scompress *q)
+{
+  unsigned long cfile, cwire;
+  long isecs, imicros;
+
+  if (q->fsend)
+    {
+      cfile = q->s.total_in;
+      cwire = q->s.total_out;
+    }
+  else
+    {
+      cfile = q->s.total_out;
+      cwire = q->s.total_in;
+    }
+
+  isecs = q->isecs;
+  imicros = q->imicros;
+  while (imicros < 0)
+    {
+      imicros += 1000000;
+      --isecs;
+    }
+  isecs += imicros / 1000000;
+  imicros %= 1000000;
+
+  ulog (LOG_NORMAL,
+	"%s %lu bytes %s %lu (%lu%%%s) in %ld.%03ld seconds",
+	q->fsend ? "Compressed" : "Decompressed",
+	q->fsend ? cfile : cwire,
+	q->fsend ? "to" : "into",
+	q->fsend ? cwire : cfile,
+	cfile == 0 ? 100 : (unsigned long) ((cwire * 100.0) / cfile),
+	q->fstored ? ", incompressible" : "",
+	isecs, imicros / 1000);
+}
+
+/* Free the compression state.  */
+
+void
+ucompress_free (struct scompress *q)
+{
+  if (q == NULL)
+    return;
+  if (q->fsend)
+    (void) deflateEnd (&q->s);
+  else
+    (void) inflateEnd (&q->s);
+  xfree ((pointer) q);
+}
+
+#else /* FEATURE_LOCAL_COMPRESS == 0 */
+
+/* Without zlib we never compress, and we never tell the remote system
+   that we can decompress, so most of these routines are never
+   called.  */
+
+/*ARGSUSED*/
+boolean
+fcompress_file (struct sdaemon *qdaemon ATTRIBUTE_UNUSED, long int cbytes ATTRIBUTE_UNUSED)
+{
+  return FALSE;
+}
+
+/*ARGSUSED*/
+struct scompress *
+qcompress_start (struct sdaemon *qdaemon ATTRIBUTE_UNUSED, boolean fsend ATTRIBUTE_UNUSED)
+{
+  ulog (LOG_ERROR, "Compressed file data not supported");
+  return NULL;
+}
+
+/*ARGSUSED*/
+boolean
+fcompress_read (struct scompress *q ATTRIBUTE_UNUSED, openfile_t e ATTRIBUTE_UNUSED, char *zbuf ATTRIBUTE_UNUSED, size_t *pcbuf ATTRIBUTE_UNUSED)
+{
+  return FALSE;
+}
+
+/*ARGSUSED*/
+boolean
+fcompress_write (struct scompress *q ATTRIBUTE_UNUSED, openfile_t e ATTRIBUTE_UNUSED, const char *zdata ATTRIBUTE_UNUSED, size_t cdata ATTRIBUTE_UNUSED)
+{
+  return FALSE;
+}
+
+/*ARGSUSED*/
+boolean
+fcompress_complete (struct scompress *q ATTRIBUTE_UNUSED)
+{
+  return FALSE;
+}
+
+/*ARGSUSED*/
+void
+ucompress_log (struct scompress *q ATTRIBUTE_UNUSED)
+{
+}
+
+/*ARGSUSED*/
+void
+ucompress_free (struct scompress *q ATTRIBUTE_UNUSED)
+{
+}
+
+#endif /* FEATURE_LOCAL_COMPRESS == 0 */
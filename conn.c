@@ -184,6 +184,9 @@ fconn_close (struct sconnection *qconn, pointer puuconf, struct uuconf_dialer *q
   /* Don't report hangup signals while we're closing.  */
   fLog_sighup = FALSE;
 
+  if (qconn == qWtrace_conn)
+    uconn_trace_stop ();
+
   fret = (*qconn->qcmds->pfclose) (qconn, puuconf, qdialer, fsuccess);
 
   /* Ignore any SIGHUP we may have gotten, and make sure any signal
@@ -232,6 +235,9 @@ fconn_read (struct sconnection *qconn, char *zbuf, size_t *pclen, size_t cmin, i
   fret = (*qconn->qcmds->pfread) (qconn, zbuf, pclen, cmin, ctimeout,
 				  freport);
 
+  if (qconn == qWtrace_conn && fret)
+    uconn_trace_data ('R', zbuf, *pclen);
+
 #if DEBUG > 1
   if (FDEBUGGING (DEBUG_INCOMING))
     udebug_buffer ("fconn_read: Read", zbuf, *pclen);
@@ -247,6 +253,8 @@ fconn_read (struct sconnection *qconn, char *zbuf, size_t *pclen, size_t cmin, i
 boolean
 fconn_write (struct sconnection *qconn, const char *zbuf, size_t clen)
 {
+  boolean fret;
+
 #if DEBUG > 1
   if (FDEBUGGING (DEBUG_OUTGOING))
     udebug_buffer ("fconn_write: Writing", zbuf, clen);
@@ -254,7 +262,12 @@ fconn_write (struct sconnection *qconn, const char *zbuf, size_t clen)
     ulog (LOG_DEBUG, "fconn_write: Writing %lu", (unsigned long) clen);
 #endif
 
-  return (*qconn->qcmds->pfwrite) (qconn, zbuf, clen);
+  fret = (*qconn->qcmds->pfwrite) (qconn, zbuf, clen);
+
+  if (qconn == qWtrace_conn && fret)
+    uconn_trace_data ('W', zbuf, clen);
+
+  return fret;
 }
 
 /* Read and write data.  */
@@ -279,6 +292,13 @@ fconn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite, char *
 
   fret = (*qconn->qcmds->pfio) (qconn, zwrite, pcwrite, zread, pcread);
 
+  if (qconn == qWtrace_conn && fret)
+    {
+      uconn_trace_data ('W', zwrite, *pcwrite);
+      if (*pcread > 0)
+	uconn_trace_data ('R', zread, *pcread);
+    }
+
   DEBUG_MESSAGE4 (DEBUG_PORT,
 		  "fconn_io: Wrote %lu of %lu, read %lu of %lu",
 		  (unsigned long) *pcwrite, (unsigned long) cwrite,
@@ -292,6 +312,235 @@ fconn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite, char *
   return fret;
 }
 
+/* Write data directly from a file to a connection.  Some port types
+   may not support this, in which case we return TRUE having written
+   nothing, and the caller must read the file itself.  */
+
+boolean
+fconn_sendfile (struct sconnection *qconn, openfile_t e, size_t *pclen)
+{
+  boolean (*pfsendfile) P((struct sconnection *, openfile_t, size_t *));
+  boolean fret;
+
+  pfsendfile = qconn->qcmds->pfsendfile;
+  if (pfsendfile == NULL || qconn == qWtrace_conn)
+    {
+      *pclen = 0;
+      return TRUE;
+    }
+
+  fret = (*pfsendfile) (qconn, e, pclen);
+
+  DEBUG_MESSAGE1 (DEBUG_PORT, "fconn_sendfile: Wrote %lu",
+		  (unsigned long) *pclen);
+
+  return fret;
+}
+
+/* Read data from a connection directly into a file.  Some port types
+   may not support this, in which case we return TRUE having read
+   nothing, and the caller must use fconn_read.  */
+
+boolean
+fconn_recvfile (struct sconnection *qconn, openfile_t e, size_t *pclen)
+{
+  boolean (*pfrecvfile) P((struct sconnection *, openfile_t, size_t *));
+  boolean fret;
+
+  pfrecvfile = qconn->qcmds->pfrecvfile;
+  if (pfrecvfile == NULL || qconn == qWtrace_conn)
+    {
+      *pclen = 0;
+      return TRUE;
+    }
+
+  fret = (*pfrecvfile) (qconn, e, pclen);
+
+  DEBUG_MESSAGE1 (DEBUG_PORT, "fconn_recvfile: Read %lu",
+		  (unsigned long) *pclen);
+
+  return fret;
+}
+
+/* Write several pieces of data to the connection.  If the port type
+   can't do this, we write each piece separately.  */
+
+boolean
+fconn_writev (struct sconnection *qconn, const struct sconn_iov *qiov, int ciov)
+{
+  boolean (*pfwritev) P((struct sconnection *, const struct sconn_iov *,
+			 int));
+  boolean fret;
+  int i;
+
+#if DEBUG > 1
+  for (i = 0; i < ciov; i++)
+    {
+      if (FDEBUGGING (DEBUG_OUTGOING))
+	udebug_buffer ("fconn_writev: Writing", qiov[i].zbuf, qiov[i].clen);
+      else if (FDEBUGGING (DEBUG_PORT))
+	ulog (LOG_DEBUG, "fconn_writev: Writing %lu",
+	      (unsigned long) qiov[i].clen);
+    }
+#endif
+
+  pfwritev = qconn->qcmds->pfwritev;
+  if (pfwritev != NULL)
+    fret = (*pfwritev) (qconn, qiov, ciov);
+  else
+    {
+      fret = TRUE;
+      for (i = 0; i < ciov; i++)
+	{
+	  if (qiov[i].clen > 0
+	      && ! (*qconn->qcmds->pfwrite) (qconn, qiov[i].zbuf,
+					     qiov[i].clen))
+	    {
+	      fret = FALSE;
+	      break;
+	    }
+	}
+    }
+
+  if (qconn == qWtrace_conn && fret)
+    {
+      size_t c;
+
+      c = 0;
+      for (i = 0; i < ciov; i++)
+	c += qiov[i].clen;
+      uconn_trace_iov (qiov, ciov, c);
+    }
+
+  return fret;
+}
+
+/* Read and write data, with the data to write in pieces.  If the port
+   type can't do this, we pass each piece to pfio in turn, stopping
+   when the read buffer fills up.  */
+
+boolean
+fconn_iov (struct sconnection *qconn, const struct sconn_iov *qiov, int ciov, size_t *pcwrite, char *zread, size_t *pcread)
+{
+  boolean (*pfiov) P((struct sconnection *, const struct sconn_iov *,
+		      int, size_t *, char *, size_t *));
+  boolean fret;
+  int i;
+#if DEBUG > 1
+  size_t cwrite = 0;
+#endif
+  size_t cread = *pcread;
+
+#if DEBUG > 1
+  for (i = 0; i < ciov; i++)
+    {
+      cwrite += qiov[i].clen;
+      if (FDEBUGGING (DEBUG_OUTGOING))
+	udebug_buffer ("fconn_iov: Writing", qiov[i].zbuf, qiov[i].clen);
+    }
+#endif
+
+  pfiov = qconn->qcmds->pfiov;
+  if (pfiov != NULL)
+    fret = (*pfiov) (qconn, qiov, ciov, pcwrite, zread, pcread);
+  else
+    {
+      size_t cleft;
+
+      fret = TRUE;
+      *pcwrite = 0;
+      *pcread = 0;
+      cleft = cread;
+      for (i = 0; i < ciov && cleft > 0; i++)
+	{
+	  size_t cdid, cgot;
+
+	  if (qiov[i].clen == 0)
+	    continue;
+	  cdid = qiov[i].clen;
+	  cgot = cleft;
+	  if (! (*qconn->qcmds->pfio) (qconn, qiov[i].zbuf, &cdid,
+				       zread + *pcread, &cgot))
+	    {
+	      fret = FALSE;
+	      break;
+	    }
+	  *pcwrite += cdid;
+	  *pcread += cgot;
+	  cleft -= cgot;
+	  if (cdid < qiov[i].clen)
+	    break;
+	}
+    }
+
+  if (qconn == qWtrace_conn && fret)
+    {
+      uconn_trace_iov (qiov, ciov, *pcwrite);
+      if (*pcread > 0)
+	uconn_trace_data ('R', zread, *pcread);
+    }
+
+  DEBUG_MESSAGE4 (DEBUG_PORT,
+		  "fconn_iov: Wrote %lu of %lu, read %lu of %lu",
+		  (unsigned long) *pcwrite, (unsigned long) cwrite,
+		  (unsigned long) *pcread, (unsigned long) cread);
+
+#if DEBUG > 1
+  if (*pcread > 0 && FDEBUGGING (DEBUG_INCOMING))
+    udebug_buffer ("fconn_iov: Read", zread, *pcread);
+#endif
+
+  return fret;
+}
+
+/* Write what can be written to a connection without waiting.  If
+   the port type can't do this, we write everything.  */
+
+boolean
+fconn_trywrite (struct sconnection *qconn, const struct sconn_iov *qiov, int ciov, size_t *pcwrite)
+{
+  boolean (*pftrywrite) P((struct sconnection *, const struct sconn_iov *,
+			   int, size_t *));
+  boolean fret;
+  int i;
+
+  pftrywrite = qconn->qcmds->pftrywrite;
+  if (pftrywrite == NULL)
+    {
+      *pcwrite = 0;
+      for (i = 0; i < ciov; i++)
+	*pcwrite += qiov[i].clen;
+      return fconn_writev (qconn, qiov, ciov);
+    }
+
+  fret = (*pftrywrite) (qconn, qiov, ciov, pcwrite);
+
+  if (qconn == qWtrace_conn && fret)
+    uconn_trace_iov (qiov, ciov, *pcwrite);
+
+#if DEBUG > 1
+  if (fret && FDEBUGGING (DEBUG_OUTGOING))
+    {
+      size_t cleft;
+
+      cleft = *pcwrite;
+      for (i = 0; i < ciov && cleft > 0; i++)
+	{
+	  size_t c;
+
+	  c = qiov[i].clen < cleft ? qiov[i].clen : cleft;
+	  udebug_buffer ("fconn_trywrite: Writing", qiov[i].zbuf, c);
+	  cleft -= c;
+	}
+    }
+  else
+    DEBUG_MESSAGE1 (DEBUG_PORT, "fconn_trywrite: Wrote %lu",
+		    (unsigned long) *pcwrite);
+#endif
+
+  return fret;
+}
+
 /* Send a break character to a connection.  Some port types may not
    support break characters, in which case we just return TRUE.  */
 
@@ -100,6 +100,20 @@ enum txonxoffsetting
   XONXOFF_ON
 };
 
+/* A piece of data to be written by fconn_writev or fconn_iov.  This is
+   like struct iovec, which not every system has.  */
+struct sconn_iov
+{
+  /* Data to write.  */
+  const char *zbuf;
+  /* Number of bytes to write.  */
+  size_t clen;
+};
+
+/* The largest number of pieces which may be passed to fconn_writev
+   or fconn_iov in one call.  */
+#define CCONN_IOV_MAX (8)
+
 /* A command table holds the functions which implement actions for
    each different kind of connection.  */
 
@@ -150,6 +164,17 @@ struct sconncmds
      *pcwrite is the number of bytes written.  */
   boolean (*pfio) P((struct sconnection *qconn, const char *zwrite,
 		     size_t *pcwrite, char *zread, size_t *pcread));
+  /* Write several pieces of data to the connection as though they
+     were one buffer, ideally with a single system call.  This field
+     may be NULL.  */
+  boolean (*pfwritev) P((struct sconnection *qconn,
+			 const struct sconn_iov *qiov, int ciov));
+  /* Like pfio, but the data to write is given in pieces as for
+     pfwritev.  *pcwrite is the total number of bytes written.  This
+     field may be NULL.  */
+  boolean (*pfiov) P((struct sconnection *qconn,
+		      const struct sconn_iov *qiov, int ciov,
+		      size_t *pcwrite, char *zread, size_t *pcread));
   /* Send a break character.  This field may be NULL.  */
   boolean (*pfbreak) P((struct sconnection *qconn));
   /* Change the connection setting.  This field may be NULL.  */
@@ -164,6 +189,26 @@ struct sconncmds
   boolean (*pfchat) P((struct sconnection *qconn, char **pzprog));
   /* Get the baud rate of a connection.  This field may be NULL.  */
   long (*pibaud) P((struct sconnection *qconn));
+  /* Write data directly from a file to the connection.  When called
+     *pclen is the maximum number of bytes to write; on successful
+     return it is the number written, which is zero if this could not
+     be done.  This field may be NULL.  */
+  boolean (*pfsendfile) P((struct sconnection *qconn, openfile_t e,
+			   size_t *pclen));
+  /* Read data which has already arrived directly into a file.  When
+     called *pclen is the maximum number of bytes to read; on
+     successful return it is the number read, which is zero if no
+     data was waiting or if this could not be done.  This field may be
+     NULL.  */
+  boolean (*pfrecvfile) P((struct sconnection *qconn, openfile_t e,
+			   size_t *pclen));
+  /* Write as much data as can be written without waiting.  The data
+     is given in pieces as for pfwritev.  On successful return
+     *pcwrite is the number of bytes written, which may be zero.  This
+     field may be NULL.  */
+  boolean (*pftrywrite) P((struct sconnection *qconn,
+			   const struct sconn_iov *qiov, int ciov,
+			   size_t *pcwrite));
 };
 
 /* Connection functions.  */
@@ -244,6 +289,47 @@ extern boolean fconn_write P((struct sconnection *qconn, const char *zbuf,
 extern boolean fconn_io P((struct sconnection *qconn, const char *zwrite,
 			   size_t *pcwrite, char *zread, size_t *pcread));
 
+/* Write data directly from a file to a connection, without copying it
+   through a buffer.  The data starts at the current position of e,
+   which is advanced past it.
+   *pclen on call -- maximum number of bytes to write
+   *pclen on successful return -- number of bytes written, or zero if
+     the port type can not do this or e is at end of file.  */
+extern boolean fconn_sendfile P((struct sconnection *qconn, openfile_t e,
+				 size_t *pclen));
+
+/* Read data from a connection directly into a file, without copying it
+   through a buffer.  The data is written at the current position of
+   e, which is advanced past it.  This does not wait for data.
+   *pclen on call -- maximum number of bytes to read
+   *pclen on successful return -- number of bytes read, or zero if the
+     port type can not do this or no data has arrived.  */
+extern boolean fconn_recvfile P((struct sconnection *qconn, openfile_t e,
+				 size_t *pclen));
+
+/* Write several pieces of data to a connection.  This is the same as
+   calling fconn_write on each piece in turn, except that a port may
+   send them all with a single system call (this also keeps TCP from
+   sending a packet header in a segment of its own).  No more than
+   CCONN_IOV_MAX pieces may be passed.  */
+extern boolean fconn_writev P((struct sconnection *qconn,
+			       const struct sconn_iov *qiov, int ciov));
+
+/* Read and write to a connection, as fconn_io, with the data to
+   write given in pieces as for fconn_writev.
+   *pcwrite on successful return -- total number of bytes written.  */
+extern boolean fconn_iov P((struct sconnection *qconn,
+			    const struct sconn_iov *qiov, int ciov,
+			    size_t *pcwrite, char *zread, size_t *pcread));
+
+/* Write to a connection without waiting, as fconn_writev, except
+   that only as much is written as the connection will take at once.
+   If the port type can not do this, all the data is written.
+   *pcwrite on successful return -- number of bytes written.  */
+extern boolean fconn_trywrite P((struct sconnection *qconn,
+				 const struct sconn_iov *qiov, int ciov,
+				 size_t *pcwrite));
+
 /* Send a break character to a connection.  */
 extern boolean fconn_break P((struct sconnection *qconn));
 
@@ -289,6 +375,34 @@ extern boolean fconn_dial_sequence P((struct sconnection *qconn,
 				      struct uuconf_dialer *qdialer,
 				      enum tdialerfound *ptdialerfound));
 
+/* Start recording everything read from and written to a connection
+   in the file zfile (see wire.c).  The fcaller argument is TRUE if we
+   placed the call.  Only one connection may be traced at a time.
+   While a connection is traced, fconn_sendfile and fconn_recvfile do
+   nothing, so that all the data is seen.  */
+extern boolean fconn_trace_start P((struct sconnection *qconn,
+				    const char *zfile, boolean fcaller));
+
+/* Stop tracing.  This is called by fconn_close.  */
+extern void uconn_trace_stop P((void));
+
+/* The connection being traced, or NULL.  */
+extern struct sconnection *qWtrace_conn;
+
+/* Record data read ('R') or written ('W') on the traced connection,
+   and data written in pieces, of which only the first c bytes were
+   written.  */
+extern void uconn_trace_data P((int btype, const char *z, size_t c));
+extern void uconn_trace_iov P((const struct sconn_iov *qiov, int ciov,
+			       size_t c));
+
+/* Initialize a connection which replays a trace made by
+   fconn_trace_start.  Reads return the recorded data without
+   waiting, and writes are compared against the recorded writes.  The
+   fcaller argument must match the side which made the trace.  */
+extern boolean fconn_replay_init P((struct sconnection *qconn,
+				    const char *zfile, boolean fcaller));
+
 /* Dialing out on a modem is partially system independent.  This is
    the modem dialing routine.  */
 extern boolean fmodem_dial P((struct sconnection *qconn, pointer puuconf,
@@ -324,4 +438,39 @@ extern boolean fsysdep_tli_init P((struct sconnection *qconn));
 #endif
 extern boolean fsysdep_pipe_init P((struct sconnection *qconn));
 
+/* Wait for something to happen on one of several connections.
+   pafread[i] on call -- whether to wait for data from pqconns[i]
+   pafread[i] on return -- whether data (or end of file) is waiting
+   iwrite -- index of a connection to wait to write to, or -1
+   *pfwrite on return -- whether pqconns[iwrite] can be written to
+   ctimeout -- timeout in seconds; 0 just checks
+   Everything is FALSE on return if the timeout expired.  */
+extern boolean fsysdep_conn_poll P((struct sconnection **pqconns,
+				    int cconns, boolean *pafread,
+				    int iwrite, boolean *pfwrite,
+				    int ctimeout));
+
+#if HAVE_TCP
+/* Extra TCP connections which carry the file data of a conversation
+   alongside qconn, which must be a TCP socket (see prote.c).  The
+   called system listens on a new port on the address it was called
+   at, and sets ztoken (which must be CTCP_STREAM_TOKEN + 1 bytes) to
+   a random string which the caller must send on each connection.  */
+#define CTCP_STREAM_TOKEN (32)
+extern boolean fsysdep_tcp_stream_listen P((struct sconnection *qconn,
+					    struct sconnection *qlisten,
+					    int *piport, char *ztoken));
+/* Accept a connection on qlisten, which has been seen to be ready by
+   fsysdep_conn_poll.  It must come from the same host as qconn.  */
+extern boolean fsysdep_tcp_stream_accept P((struct sconnection *qlisten,
+					    struct sconnection *qconn,
+					    struct sconnection *qnew));
+/* Connect to port iport on the host at the other end of qconn.  */
+extern boolean fsysdep_tcp_stream_connect P((struct sconnection *qconn,
+					     int iport,
+					     struct sconnection *qnew));
+/* Close and free a connection made by one of the above.  */
+extern void usysdep_tcp_stream_close P((struct sconnection *qconn));
+#endif
+
 #endif /* ! defined (CONN_H) */
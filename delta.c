@@ -0,0 +1,876 @@
+/* delta.c
+   Send a file as the differences from an old copy on the remote system.
+
+   Copyright (C) 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#if USE_RCS_ID
+const char delta_rcsid[] = "$Id$";
+#endif
+
+#include <errno.h>
+
+#include "uudefs.h"
+#include "uuconf.h"
+#include "system.h"
+#include "prot.h"
+#include "trans.h"
+
+/* This is a variant of the rsync algorithm.  The receiving system
+   splits its old copy of the file, the basis, into blocks, and sends
+   a weak rolling checksum and a CRC of each block in its reply to
+   the S command.  The sending system looks for those blocks at every
+   byte position of the new file, and sends a stream of records in
+   place of the file data:
+
+   'L' followed by a four byte length and that many bytes of the file;
+   'B' followed by a four byte block number and a four byte count,
+       meaning that many blocks of the basis starting at that block;
+   'E' followed by the four byte CRC of the whole file and its size
+       as two four byte halves, which ends the stream.
+
+   All numbers are sent most significant byte first.  The receiving
+   system rebuilds the file in its temporary file, and checks the CRC
+   and the size at the end.  */
+
+/* Files smaller than this are always sent whole.  */
+#define CDELTA_MIN (16384)
+
+/* The smallest block size.  */
+#define CDELTA_BLOCK_MIN (2048)
+
+/* The largest number of blocks we split a basis into.  Larger files
+   get larger blocks, which keeps the reply to the S command to at
+   most sixteen times this many characters.  */
+#define CDELTA_MAX_BLOCKS (2048)
+
+/* The largest block size.  This limits the size of the basis we will
+   use to CDELTA_MAX_BLOCKS times this, and the memory the sender
+   needs to hold a window.  */
+#define CDELTA_BLOCK_MAX (1024 * 1024)
+
+/* The longest literal run we hold before sending it.  */
+#define CDELTA_LITERAL (32768)
+
+/* The size of the buffer used to copy blocks out of the basis.  */
+#define CDELTA_BUFSIZE (8192)
+
+/* The state of a file being sent or received as a delta.  */
+
+struct sdelta
+{
+  /* TRUE if we are sending.  */
+  boolean fsend;
+  /* The block size.  */
+  long cblock;
+  /* The number of blocks.  */
+  long cblocks;
+  /* The weak checksum and the CRC of each block.  */
+  unsigned long *paiweak;
+  unsigned long *paicrc;
+  /* When sending, a hash table of the blocks by weak checksum; each
+     entry is a block number plus one, and painext chains blocks with
+     the same hash.  */
+  long *paihash;
+  long *painext;
+  unsigned long ihashmask;
+  /* When sending, the file data.  Bytes from istart to ipos are a
+     pending literal run, the window being checked starts at ipos,
+     and the data ends at iend.  */
+  char *zbuf;
+  size_t cbuf;
+  size_t istart;
+  size_t ipos;
+  size_t iend;
+  /* The weak checksum of the window, in two halves, and whether it
+     is valid.  */
+  unsigned long isuma;
+  unsigned long isumb;
+  boolean fsum;
+  /* TRUE when we have read the whole file.  */
+  boolean feof;
+  /* When sending, a pending run of matched blocks; crun is zero if
+     there is none.  */
+  long irun;
+  long crun;
+  /* When sending, encoded records waiting to be sent.  */
+  char *zout;
+  size_t iout;
+  size_t cout;
+  /* When receiving, the basis, its size and the current position
+     in it.  */
+  openfile_t ebasis;
+  long cbasis;
+  long ibasis;
+  /* When receiving, the record header collected so far, and the
+     number of literal bytes still to come.  */
+  char abhdr[13];
+  size_t chdr;
+  unsigned long cliteral;
+  /* The CRC of the file so far.  */
+  unsigned long icrc;
+  /* TRUE when we have seen the end of the stream.  */
+  boolean fdone;
+  /* TRUE if the rebuilt file did not match.  */
+  boolean fbad;
+  /* The size of the file, of the stream, of the signatures and of
+     the data taken from the basis.  */
+  unsigned long cfile;
+  unsigned long cwire;
+  unsigned long csigs;
+  unsigned long cmatched;
+};
+
+static struct sdelta *qdelta_alloc P((boolean fsend, long cblock,
+				      long cblocks));
+static void udelta_sum P((struct sdelta *q, const char *z));
+static void udelta_put P((char *z, unsigned long i));
+static unsigned long idelta_get P((const char *z));
+static void udelta_flush_run P((struct sdelta *q));
+static void udelta_flush_literal P((struct sdelta *q));
+static boolean fdelta_encode P((struct sdelta *q, openfile_t e));
+static long idelta_match P((struct sdelta *q));
+static boolean fdelta_copy P((struct sdelta *q, openfile_t e,
+			      unsigned long iblock, unsigned long cblocks));
+
+/* Decide whether to offer to send a file as a delta.  */
+
+boolean
+fdelta_file (struct sdaemon *qdaemon, const char *zto, long int cbytes)
+{
+  return ((qdaemon->ifeatures & FEATURE_DELTA) != 0
+	  && qdaemon->qproto->fcompress
+	  && cbytes >= CDELTA_MIN
+	  && ! fspool_file (zto));
+}
+
+/* Allocate the state for a delta.  */
+
+static struct sdelta *
+qdelta_alloc (boolean fsend, long int cblock, long int cblocks)
+{
+  struct sdelta *q;
+
+  q = (struct sdelta *) xmalloc (sizeof (struct sdelta));
+  q->fsend = fsend;
+  q->cblock = cblock;
+  q->cblocks = cblocks;
+  q->paiweak = (unsigned long *) xmalloc ((size_t) cblocks
+					  * sizeof (unsigned long));
+  q->paicrc = (unsigned long *) xmalloc ((size_t) cblocks
+					 * sizeof (unsigned long));
+  q->paihash = NULL;
+  q->painext = NULL;
+  q->ihashmask = 0;
+  q->zbuf = NULL;
+  q->cbuf = 0;
+  q->istart = 0;
+  q->ipos = 0;
+  q->iend = 0;
+  q->isuma = 0;
+  q->isumb = 0;
+  q->fsum = FALSE;
+  q->feof = FALSE;
+  q->irun = 0;
+  q->crun = 0;
+  q->zout = NULL;
+  q->iout = 0;
+  q->cout = 0;
+  q->ebasis = EFILECLOSED;
+  q->cbasis = 0;
+  q->ibasis = 0;
+  q->chdr = 0;
+  q->cliteral = 0;
+  q->icrc = ICRCINIT;
+  q->fdone = FALSE;
+  q->fbad = FALSE;
+  q->cfile = 0;
+  q->cwire = 0;
+  q->csigs = 0;
+  q->cmatched = 0;
+  return q;
+}
+
+/* Compute the weak checksum of the block at z from scratch.  */
+
+static void
+udelta_sum (struct sdelta *q, const char *z)
+{
+  const unsigned char *pb;
+  unsigned long ia, ib;
+  long i;
+
+  pb = (const unsigned char *) z;
+  ia = 0;
+  ib = 0;
+  for (i = 0; i < q->cblock; i++)
+    {
+      ia += pb[i];
+      ib += (unsigned long) (q->cblock - i) * pb[i];
+    }
+  q->isuma = ia & 0xffff;
+  q->isumb = ib & 0xffff;
+}
+
+#define IDELTA_WEAK(q) ((q)->isuma | ((q)->isumb << 16))
+
+/* Store and fetch four byte numbers.  */
+
+static void
+udelta_put (char *z, unsigned long i)
+{
+  z[0] = (char) ((i >> 24) & 0xff);
+  z[1] = (char) ((i >> 16) & 0xff);
+  z[2] = (char) ((i >> 8) & 0xff);
+  z[3] = (char) (i & 0xff);
+}
+
+static unsigned long
+idelta_get (const char *z)
+{
+  return ((((unsigned long) (z[0] & 0xff)) << 24)
+	  | (((unsigned long) (z[1] & 0xff)) << 16)
+	  | (((unsigned long) (z[2] & 0xff)) << 8)
+	  | ((unsigned long) (z[3] & 0xff)));
+}
+
+/* Open an old copy of a file we are about to receive, and compute
+   the signatures to send in our reply.  This returns NULL if there
+   is no usable old copy.  */
+
+struct sdelta *
+qdelta_rec_start (const struct uuconf_system *qsys, const char *zbasis,
+		  char **pzsigs)
+{
+  long cbasis, cblock, cblocks, i;
+  openfile_t e;
+  struct sdelta *q;
+  char *zbuf, *zsigs, *zput;
+
+  *pzsigs = NULL;
+
+  cbasis = csysdep_size (zbasis);
+  if (cbasis < CDELTA_MIN
+      || cbasis / CDELTA_MAX_BLOCKS > CDELTA_BLOCK_MAX
+      || fsysdep_directory (zbasis))
+    return NULL;
+
+  e = esysdep_open_send (qsys, zbasis, TRUE, (const char *) NULL);
+  if (! ffileisopen (e))
+    return NULL;
+
+  cblock = (cbasis + CDELTA_MAX_BLOCKS - 1) / CDELTA_MAX_BLOCKS;
+  if (cblock < CDELTA_BLOCK_MIN)
+    cblock = CDELTA_BLOCK_MIN;
+  /* A short block at the end is left out, since it could never
+     match a whole window.  */
+  cblocks = cbasis / cblock;
+
+  q = qdelta_alloc (FALSE, cblock, cblocks);
+  q->ebasis = e;
+  q->cbasis = cbasis;
+
+  /* The reply is " D", the block size, a space, and sixteen hex
+     digits for each block.  */
+  zsigs = zbufalc ((size_t) cblocks * 16 + 30);
+  sprintf (zsigs, " D %ld ", cblock);
+  zput = zsigs + strlen (zsigs);
+
+  zbuf = zbufalc ((size_t) cblock);
+  for (i = 0; i < cblocks; i++)
+    {
+      long cgot;
+
+      cgot = 0;
+      while (cgot < cblock)
+	{
+	  int cread;
+
+	  cread = cfileread (e, zbuf + cgot, (size_t) (cblock - cgot));
+	  if (ffileioerror (e, cread))
+	    {
+	      ulog (LOG_ERROR, "read: %s", strerror (errno));
+	      break;
+	    }
+	  if (cread == 0)
+	    break;
+	  cgot += cread;
+	}
+      if (cgot < cblock)
+	{
+	  /* The file changed under us; just send the whole file.  */
+	  ubuffree (zbuf);
+	  ubuffree (zsigs);
+	  udelta_free (q);
+	  return NULL;
+	}
+
+      udelta_sum (q, zbuf);
+      q->paiweak[i] = IDELTA_WEAK (q);
+      q->paicrc[i] = icrc (zbuf, (size_t) cblock, ICRCINIT);
+      sprintf (zput, "%08lx%08lx", q->paiweak[i], q->paicrc[i]);
+      zput += 16;
+    }
+  ubuffree (zbuf);
+
+  q->ibasis = cblocks * cblock;
+  q->csigs = (unsigned long) (zput - zsigs);
+  *pzsigs = zsigs;
+
+  DEBUG_MESSAGE3 (DEBUG_UUCP_PROTO,
+		  "qdelta_rec_start: %s: %ld blocks of %ld bytes",
+		  zbasis, cblocks, cblock);
+
+  return q;
+}
+
+/* Set up to send a file as a delta, given the signatures from the
+   reply to the S command.  The argument points just after the " D".
+   This returns NULL if the signatures can not be parsed.  */
+
+struct sdelta *
+qdelta_send_start (const char *zsigs)
+{
+  const char *zstart;
+  char *zend;
+  long cblock, cblocks, i;
+  unsigned long chash;
+  struct sdelta *q;
+
+  zstart = zsigs;
+  cblock = strtol ((char *) zsigs, &zend, 10);
+  if (cblock < CDELTA_BLOCK_MIN || *zend != ' ')
+    return NULL;
+  zsigs = zend + 1;
+  cblocks = (long) (strlen (zsigs) / 16);
+  if (cblocks <= 0 || strlen (zsigs) % 16 != 0)
+    return NULL;
+
+  /* We never ask for more than this, so something is wrong with the
+     other side.  The receiver is expecting a delta, so we send one
+     which doesn't use the basis at all.  */
+  if (cblock > CDELTA_BLOCK_MAX || cblocks > CDELTA_MAX_BLOCKS)
+    {
+      ulog (LOG_ERROR, "Delta signatures out of range; sending whole file");
+      q = qdelta_alloc (TRUE, (long) CDELTA_BLOCK_MIN, 0L);
+      q->csigs = (unsigned long) (strlen (zstart) + sizeof " D " - 1);
+      q->cbuf = CDELTA_LITERAL + 2 * (size_t) CDELTA_BLOCK_MIN;
+      q->zbuf = (char *) xmalloc (q->cbuf);
+      q->zout = (char *) xmalloc (q->cbuf + 32);
+      return q;
+    }
+
+  q = qdelta_alloc (TRUE, cblock, cblocks);
+  q->csigs = (unsigned long) (strlen (zstart) + sizeof " D " - 1);
+
+  chash = 1;
+  while (chash < (unsigned long) cblocks * 2)
+    chash <<= 1;
+  q->ihashmask = chash - 1;
+  q->paihash = (long *) xmalloc (chash * sizeof (long));
+  q->painext = (long *) xmalloc ((size_t) cblocks * sizeof (long));
+  for (i = 0; i < (long) chash; i++)
+    q->paihash[i] = 0;
+
+  for (i = 0; i < cblocks; i++)
+    {
+      char ab[9];
+
+      memcpy (ab, zsigs + i * 16, 8);
+      ab[8] = '\0';
+      q->paiweak[i] = strtoul (ab, &zend, 16);
+      if (*zend != '\0')
+	break;
+      memcpy (ab, zsigs + i * 16 + 8, 8);
+      q->paicrc[i] = strtoul (ab, &zend, 16);
+      if (*zend != '\0')
+	break;
+    }
+  if (i < cblocks)
+    {
+      udelta_free (q);
+      return NULL;
+    }
+
+  /* Chain the blocks in reverse so that a lookup finds the lowest
+     numbered block first.  */
+  for (i = cblocks - 1; i >= 0; i--)
+    {
+      unsigned long ih;
+
+      ih = (q->paiweak[i] ^ (q->paiweak[i] >> 16)) & q->ihashmask;
+      q->painext[i] = q->paihash[ih];
+      q->paihash[ih] = i + 1;
+    }
+
+  q->cbuf = CDELTA_LITERAL + 2 * (size_t) cblock;
+  q->zbuf = (char *) xmalloc (q->cbuf);
+  q->zout = (char *) xmalloc (q->cbuf + 32);
+
+  return q;
+}
+
+/* Add a record for the pending run of blocks to the output.  */
+
+static void
+udelta_flush_run (struct sdelta *q)
+{
+  char *z;
+
+  if (q->crun == 0)
+    return;
+  z = q->zout + q->cout;
+  z[0] = 'B';
+  udelta_put (z + 1, (unsigned long) q->irun);
+  udelta_put (z + 5, (unsigned long) q->crun);
+  q->cout += 9;
+  q->crun = 0;
+}
+
+/* Add a record for the pending literal run to the output.  */
+
+static void
+udelta_flush_literal (struct sdelta *q)
+{
+  size_t c;
+  char *z;
+
+  c = q->ipos - q->istart;
+  if (c == 0)
+    return;
+  udelta_flush_run (q);
+  z = q->zout + q->cout;
+  z[0] = 'L';
+  udelta_put (z + 1, (unsigned long) c);
+  memcpy (z + 5, q->zbuf + q->istart, c);
+  q->cout += c + 5;
+  q->istart = q->ipos;
+}
+
+/* See whether the window at ipos matches a block of the basis,
+   returning the block number or -1.  We try the block after the
+   pending run first, since files tend to change in small places.  */
+
+static long
+idelta_match (struct sdelta *q)
+{
+  unsigned long iweak, icrcwin;
+  boolean fcrc;
+  long i;
+
+  iweak = IDELTA_WEAK (q);
+  fcrc = FALSE;
+  icrcwin = 0;
+
+  i = q->crun > 0 ? q->irun + q->crun : q->cblocks;
+  if (i < q->cblocks && q->paiweak[i] == iweak)
+    {
+      icrcwin = icrc (q->zbuf + q->ipos, (size_t) q->cblock, ICRCINIT);
+      fcrc = TRUE;
+      if (q->paicrc[i] == icrcwin)
+	return i;
+    }
+
+  for (i = q->paihash[(iweak ^ (iweak >> 16)) & q->ihashmask] - 1;
+       i >= 0;
+       i = q->painext[i] - 1)
+    {
+      if (q->paiweak[i] != iweak)
+	continue;
+      if (! fcrc)
+	{
+	  icrcwin = icrc (q->zbuf + q->ipos, (size_t) q->cblock, ICRCINIT);
+	  fcrc = TRUE;
+	}
+      if (q->paicrc[i] == icrcwin)
+	return i;
+    }
+
+  return -1;
+}
+
+/* Read more of the file and add at least one record to the output,
+   or finish the stream.  */
+
+static boolean
+fdelta_encode (struct sdelta *q, openfile_t e)
+{
+  size_t cblock;
+
+  cblock = (size_t) q->cblock;
+
+  while (q->cout == 0)
+    {
+      long i;
+
+      /* Keep a whole window plus the byte after it in the buffer, if
+	 the file has that much.  */
+      if (! q->feof && q->iend - q->ipos <= cblock)
+	{
+	  int cread;
+
+	  if (q->istart > 0)
+	    {
+	      memmove (q->zbuf, q->zbuf + q->istart, q->iend - q->istart);
+	      q->ipos -= q->istart;
+	      q->iend -= q->istart;
+	      q->istart = 0;
+	    }
+	  cread = cfileread (e, q->zbuf + q->iend, q->cbuf - q->iend);
+	  if (ffileioerror (e, cread))
+	    {
+	      ulog (LOG_ERROR, "read: %s", strerror (errno));
+	      return FALSE;
+	    }
+	  if (cread == 0)
+	    q->feof = TRUE;
+	  else
+	    {
+	      q->icrc = icrc (q->zbuf + q->iend, (size_t) cread, q->icrc);
+	      q->cfile += cread;
+	      q->iend += cread;
+	    }
+	  continue;
+	}
+
+      /* Without any blocks everything is a literal.  */
+      if (q->cblocks == 0)
+	{
+	  q->ipos = q->iend;
+	  if (! q->feof)
+	    {
+	      udelta_flush_literal (q);
+	      continue;
+	    }
+	}
+
+      if (q->iend - q->ipos < cblock)
+	{
+	  char *z;
+
+	  /* The rest of the file is too short to match anything.  */
+	  q->ipos = q->iend;
+	  udelta_flush_literal (q);
+	  udelta_flush_run (q);
+	  z = q->zout + q->cout;
+	  z[0] = 'E';
+	  udelta_put (z + 1, q->icrc);
+	  udelta_put (z + 5, (q->cfile >> 16) >> 16);
+	  udelta_put (z + 9, q->cfile & 0xffffffffUL);
+	  q->cout += 13;
+	  q->fdone = TRUE;
+	  break;
+	}
+
+      if (! q->fsum)
+	{
+	  udelta_sum (q, q->zbuf + q->ipos);
+	  q->fsum = TRUE;
+	}
+
+      i = idelta_match (q);
+      if (i >= 0)
+	{
+	  udelta_flush_literal (q);
+	  if (q->crun > 0 && i != q->irun + q->crun)
+	    udelta_flush_run (q);
+	  if (q->crun == 0)
+	    q->irun = i;
+	  ++q->crun;
+	  q->ipos += cblock;
+	  q->istart = q->ipos;
+	  q->fsum = FALSE;
+	  q->cmatched += cblock;
+	  continue;
+	}
+
+      if (q->ipos + cblock >= q->iend)
+	{
+	  /* We are at the end of the file.  */
+	  q->ipos = q->iend;
+	  continue;
+	}
+
+      /* Roll the window forward one byte.  */
+      {
+	unsigned long bout, bin;
+
+	bout = (unsigned long) (q->zbuf[q->ipos] & 0xff);
+	bin = (unsigned long) (q->zbuf[q->ipos + cblock] & 0xff);
+	q->isuma = (q->isuma - bout + bin) & 0xffff;
+	q->isumb = (q->isumb - (unsigned long) cblock * bout + q->isuma)
+		    & 0xffff;
+      }
+      ++q->ipos;
+
+      if (q->ipos - q->istart >= CDELTA_LITERAL)
+	udelta_flush_literal (q);
+    }
+
+  return TRUE;
+}
+
+/* Read data from the file e and encode it into zbuf, which holds
+   *pcbuf bytes.  This sets *pcbuf to the number of bytes stored,
+   which is zero only when the whole stream has been sent.  */
+
+boolean
+fdelta_read (struct sdelta *q, openfile_t e, char *zbuf, size_t *pcbuf)
+{
+  size_t cwant, cgot;
+
+  cwant = *pcbuf;
+  cgot = 0;
+  while (cgot < cwant)
+    {
+      size_t c;
+
+      if (q->iout >= q->cout)
+	{
+	  q->iout = 0;
+	  q->cout = 0;
+	  if (q->fdone)
+	    break;
+	  if (! fdelta_encode (q, e))
+	    return FALSE;
+	  continue;
+	}
+
+      c = q->cout - q->iout;
+      if (c > cwant - cgot)
+	c = cwant - cgot;
+      memcpy (zbuf + cgot, q->zout + q->iout, c);
+      q->iout += c;
+      cgot += c;
+    }
+
+  q->cwire += cgot;
+  *pcbuf = cgot;
+  return TRUE;
+}
+
+/* Copy cblocks blocks starting at iblock from the basis to the file
+   being received.  */
+
+static boolean
+fdelta_copy (struct sdelta *q, openfile_t e, unsigned long iblock,
+	     unsigned long cblocks)
+{
+  long istart, cleft;
+  char ab[CDELTA_BUFSIZE];
+
+  if (iblock >= (unsigned long) q->cblocks
+      || cblocks > (unsigned long) q->cblocks - iblock)
+    {
+      ulog (LOG_ERROR, "Bad block reference in delta data");
+      return FALSE;
+    }
+
+  istart = (long) iblock * q->cblock;
+  if (istart != q->ibasis)
+    {
+      if (! ffileseek (q->ebasis, istart))
+	{
+	  ulog (LOG_ERROR, "seek: %s", strerror (errno));
+	  return FALSE;
+	}
+      q->ibasis = istart;
+    }
+
+  cleft = (long) cblocks * q->cblock;
+  while (cleft > 0)
+    {
+      int cread, cwrote;
+
+      cread = cfileread (q->ebasis, ab,
+			 cleft < (long) sizeof ab ? (size_t) cleft : sizeof ab);
+      if (ffileioerror (q->ebasis, cread) || cread == 0)
+	{
+	  if (cread == 0)
+	    ulog (LOG_ERROR, "Old copy of file changed during delta");
+	  else
+	    ulog (LOG_ERROR, "read: %s", strerror (errno));
+	  return FALSE;
+	}
+
+      cwrote = cfilewrite (e, ab, (size_t) cread);
+      if (cwrote != cread)
+	{
+	  if (ffileioerror (e, cwrote))
+	    ulog (LOG_ERROR, "write: %s", strerror (errno));
+	  else
+	    ulog (LOG_ERROR, "Wrote %d to file when trying to write %d",
+		  cwrote, cread);
+	  return FALSE;
+	}
+
+      q->icrc = icrc (ab, (size_t) cread, q->icrc);
+      q->cfile += cread;
+      q->cmatched += cread;
+      q->ibasis += cread;
+      cleft -= cread;
+    }
+
+  return TRUE;
+}
+
+/* Decode delta data received from the remote system and write the
+   file it describes.  */
+
+boolean
+fdelta_write (struct sdelta *q, openfile_t e, const char *zdata, size_t cdata)
+{
+  q->cwire += cdata;
+
+  while (cdata > 0)
+    {
+      size_t cneed;
+
+      if (q->fdone)
+	{
+	  ulog (LOG_ERROR, "Data after end of delta data");
+	  return FALSE;
+	}
+
+      if (q->cliteral > 0)
+	{
+	  size_t c;
+	  int cwrote;
+
+	  c = cdata;
+	  if (c > q->cliteral)
+	    c = (size_t) q->cliteral;
+	  cwrote = cfilewrite (e, (char *) zdata, c);
+	  if (cwrote < 0 || (size_t) cwrote != c)
+	    {
+	      if (ffileioerror (e, cwrote))
+		ulog (LOG_ERROR, "write: %s", strerror (errno));
+	      else
+		ulog (LOG_ERROR,
+		      "Wrote %d to file when trying to write %lu",
+		      cwrote, (unsigned long) c);
+	      return FALSE;
+	    }
+	  q->icrc = icrc (zdata, c, q->icrc);
+	  q->cfile += c;
+	  q->cliteral -= c;
+	  zdata += c;
+	  cdata -= c;
+	  continue;
+	}
+
+      q->abhdr[q->chdr++] = *zdata++;
+      --cdata;
+
+      switch (q->abhdr[0])
+	{
+	case 'L':
+	  cneed = 5;
+	  break;
+	case 'B':
+	  cneed = 9;
+	  break;
+	case 'E':
+	  cneed = 13;
+	  break;
+	default:
+	  ulog (LOG_ERROR, "Bad record in delta data");
+	  return FALSE;
+	}
+      if (q->chdr < cneed)
+	continue;
+      q->chdr = 0;
+
+      switch (q->abhdr[0])
+	{
+	case 'L':
+	  q->cliteral = idelta_get (q->abhdr + 1);
+	  break;
+	case 'B':
+	  if (! fdelta_copy (q, e, idelta_get (q->abhdr + 1),
+			     idelta_get (q->abhdr + 5)))
+	    return FALSE;
+	  break;
+	case 'E':
+	  q->fdone = TRUE;
+	  if (idelta_get (q->abhdr + 1) != (q->icrc & 0xffffffffUL)
+	      || idelta_get (q->abhdr + 5) != ((q->cfile >> 16) >> 16)
+	      || idelta_get (q->abhdr + 9) != (q->cfile & 0xffffffffUL))
+	    q->fbad = TRUE;
+	  break;
+	}
+    }
+
+  return TRUE;
+}
+
+/* See whether we got all the delta data, and whether the file we
+   rebuilt from it is the one the remote system has.  */
+
+boolean
+fdelta_complete (struct sdelta *q, const char **pzerr)
+{
+  if (! q->fdone)
+    *pzerr = "delta data truncated";
+  else if (q->fbad)
+    *pzerr = "file rebuilt from delta does not match";
+  else
+    return TRUE;
+  return FALSE;
+}
+
+/* Log how much sending the file as a delta saved.  The saving is the
+   size of the file less the size of the delta data and of the
+   signatures sent the other way.  */
+
+void
+udelta_log (struct sdelta *q)
+{
+  long csaved;
+
+  csaved = (long) q->cfile - (long) q->cwire - (long) q->csigs;
+  ulog (LOG_NORMAL,
+	"%s %lu bytes %s a delta of %lu bytes (%lu matched, %lu in signatures, %ld bytes saved)",
+	q->fsend ? "Sent" : "Rebuilt",
+	q->cfile,
+	q->fsend ? "as" : "from",
+	q->cwire, q->cmatched, q->csigs, csaved);
+}
+
+/* Free the delta state.  */
+
+void
+udelta_free (struct sdelta *q)
+{
+  if (q == NULL)
+    return;
+  if (ffileisopen (q->ebasis))
+    (void) ffileclose (q->ebasis);
+  xfree ((pointer) q->paiweak);
+  xfree ((pointer) q->paicrc);
+  xfree ((pointer) q->paihash);
+  xfree ((pointer) q->painext);
+  xfree ((pointer) q->zbuf);
+  xfree ((pointer) q->zout);
+  xfree ((pointer) q);
+}
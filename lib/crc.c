@@ -92,8 +92,189 @@ static const unsigned long aicrc32tab[] = { /* CRC polynomial 0xedb88320 */
 #define IUPDC32(b, ick) \
   (aicrc32tab[((int) (ick) ^ (b)) & 0xff] ^ (((ick) >> 8) & 0x00ffffffL))
 
+/* The CRC is computed by one of several routines, all of which
+   produce exactly the same result as running IUPDC32 over each byte.
+   The first call to icrc picks the fastest one the processor
+   supports, and later calls go straight to it through pficrc.
+
+   We can use the carry-less multiply instructions on x86 (PCLMULQDQ)
+   and the CRC instructions on ARMv8, but only with a gcc new enough
+   to let us compile individual functions for those instruction sets
+   without changing the flags used for the rest of the program.  */
+
+#if GCC_VERSION >= 4009 && (defined (__x86_64__) || defined (__i386__))
+#define CRC_CLMUL 1
+#else
+#define CRC_CLMUL 0
+#endif
+
+#if (GCC_VERSION >= 6000 && defined (__aarch64__) \
+     && defined (__AARCH64EL__) && defined (__linux__))
+#define CRC_ARMV8 1
+#else
+#define CRC_ARMV8 0
+#endif
+
+#if CRC_CLMUL
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#endif
+
+#if CRC_ARMV8
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+static unsigned long icrc_dispatch P((const unsigned char *z, size_t c,
+				      unsigned long ick));
+static unsigned long icrc_bytes P((const unsigned char *z, size_t c,
+				   unsigned long ick));
+static unsigned long icrc_slice8 P((const unsigned char *z, size_t c,
+				    unsigned long ick));
+#if CRC_CLMUL
+static unsigned long icrc_clmul P((const unsigned char *z, size_t c,
+				   unsigned long ick));
+#endif
+#if CRC_ARMV8
+static unsigned long icrc_armv8 P((const unsigned char *z, size_t c,
+				   unsigned long ick));
+#endif
+
+/* The routine icrc calls, and its name for debugging messages.  */
+static unsigned long (*pficrc) P((const unsigned char *z, size_t c,
+				  unsigned long ick)) = icrc_dispatch;
+static const char *zPcrc_name = "table";
+
+/* Whether the processor supports the hardware routines, as found by
+   icrc_dispatch.  */
+#if CRC_CLMUL
+static boolean fPcrc_clmul;
+#endif
+#if CRC_ARMV8
+static boolean fPcrc_armv8;
+#endif
+
+/* Tables for the slice-by-8 routine.  aicrc32slice[k][b] is the CRC
+   of the byte b followed by k zero bytes, so aicrc32slice[0] is just
+   aicrc32tab.  They are built from aicrc32tab by icrc_dispatch.  */
+static unsigned long aicrc32slice[8][256];
+
+/* Below this many bytes the simple loop is as fast as anything else;
+   the 'i' protocol computes a lot of four byte header checksums.  */
+#define CCRC_SMALL (16)
+
 unsigned long
 icrc (const char *z, size_t c, long unsigned int ick)
+{
+  if (c < CCRC_SMALL)
+    return icrc_bytes ((const unsigned char *) z, c, ick);
+  return (*pficrc) ((const unsigned char *) z, c, ick);
+}
+
+/* Return the name of the CRC routine in use.  */
+
+const char *
+zcrc_name (void)
+{
+  if (pficrc == icrc_dispatch)
+    (void) icrc_dispatch ((const unsigned char *) NULL, (size_t) 0,
+			  (unsigned long) 0);
+  return zPcrc_name;
+}
+
+/* Make icrc use the routine with the given name, as returned by
+   zcrc_name.  This is for tstsum, which compares the speed of the
+   routines.  It returns FALSE if the routine is not available on this
+   processor.  */
+
+boolean
+fcrc_select (const char *zname)
+{
+  /* Build the tables and check the processor.  */
+  (void) zcrc_name ();
+
+  if (strcmp (zname, "table") == 0)
+    {
+      pficrc = icrc_bytes;
+      zPcrc_name = "table";
+    }
+  else if (strcmp (zname, "slice-by-8") == 0)
+    {
+      pficrc = icrc_slice8;
+      zPcrc_name = "slice-by-8";
+    }
+#if CRC_CLMUL
+  else if (strcmp (zname, "pclmulqdq") == 0 && fPcrc_clmul)
+    {
+      pficrc = icrc_clmul;
+      zPcrc_name = "pclmulqdq";
+    }
+#endif
+#if CRC_ARMV8
+  else if (strcmp (zname, "armv8-crc32") == 0 && fPcrc_armv8)
+    {
+      pficrc = icrc_armv8;
+      zPcrc_name = "armv8-crc32";
+    }
+#endif
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Pick a CRC routine, and then use it.  */
+
+static unsigned long
+icrc_dispatch (const unsigned char *z, size_t c, long unsigned int ick)
+{
+  int i, k;
+
+  for (i = 0; i < 256; i++)
+    aicrc32slice[0][i] = aicrc32tab[i];
+  for (k = 1; k < 8; k++)
+    for (i = 0; i < 256; i++)
+      aicrc32slice[k][i] = IUPDC32 (0, aicrc32slice[k - 1][i]);
+
+  pficrc = icrc_slice8;
+  zPcrc_name = "slice-by-8";
+
+#if CRC_CLMUL
+  {
+    unsigned int ieax, iebx, iecx, iedx;
+
+    /* PCLMULQDQ is bit 1 of %ecx, SSE4.1 is bit 19.  */
+    if (__get_cpuid (1, &ieax, &iebx, &iecx, &iedx)
+	&& (iecx & (1 << 1)) != 0
+	&& (iecx & (1 << 19)) != 0)
+      {
+	fPcrc_clmul = TRUE;
+	pficrc = icrc_clmul;
+	zPcrc_name = "pclmulqdq";
+      }
+  }
+#endif
+
+#if CRC_ARMV8
+  if ((getauxval (AT_HWCAP) & HWCAP_CRC32) != 0)
+    {
+      fPcrc_armv8 = TRUE;
+      pficrc = icrc_armv8;
+      zPcrc_name = "armv8-crc32";
+    }
+#endif
+
+  return (*pficrc) (z, c, ick);
+}
+
+/* The original byte at a time loop.  */
+
+static unsigned long
+icrc_bytes (const unsigned char *z, size_t c, long unsigned int ick)
 {
   while (c > 4)
     {
@@ -107,3 +288,209 @@ icrc (const char *z, size_t c, long unsigned int ick)
     ick = IUPDC32 (*z++, ick);
   return ick;
 }
+
+/* Process eight bytes at a time with eight table lookups that do not
+   depend on each other.  The bytes are assembled by hand so that this
+   works on any byte order and alignment.  */
+
+static unsigned long
+icrc_slice8 (const unsigned char *z, size_t c, long unsigned int ick)
+{
+  if (c == 0)
+    return ick;
+
+  ick &= (unsigned long) 0xffffffffL;
+  while (c >= 8)
+    {
+      unsigned long i;
+
+      i = ick ^ ((unsigned long) z[0]
+		 | ((unsigned long) z[1] << 8)
+		 | ((unsigned long) z[2] << 16)
+		 | ((unsigned long) z[3] << 24));
+      ick = (aicrc32slice[7][i & 0xff]
+	     ^ aicrc32slice[6][(i >> 8) & 0xff]
+	     ^ aicrc32slice[5][(i >> 16) & 0xff]
+	     ^ aicrc32slice[4][(i >> 24) & 0xff]
+	     ^ aicrc32slice[3][z[4]]
+	     ^ aicrc32slice[2][z[5]]
+	     ^ aicrc32slice[1][z[6]]
+	     ^ aicrc32slice[0][z[7]]);
+      z += 8;
+      c -= 8;
+    }
+
+  return icrc_bytes (z, c, ick);
+}
+
+#if CRC_CLMUL
+
+/* Fold 64 bytes at a time with carry-less multiplication, as
+   described in Intel's paper "Fast CRC Computation for Generic
+   Polynomials Using PCLMULQDQ Instruction", and then do a Barrett
+   reduction down to 32 bits.  The constants are the bit-reflected
+   ones given at the end of that paper.  Whatever is left over after
+   the last multiple of 16 bytes goes through the slice-by-8 code.  */
+
+static unsigned long
+icrc_clmul (const unsigned char *z, size_t c, long unsigned int ick)
+     __attribute__ ((__target__ ("pclmul,sse4.1")));
+
+static unsigned long
+icrc_clmul (const unsigned char *z, size_t c, long unsigned int ick)
+{
+  static const unsigned long long aik1k2[2] __attribute__ ((__aligned__ (16)))
+    = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+  static const unsigned long long aik3k4[2] __attribute__ ((__aligned__ (16)))
+    = { 0x01751997d0ULL, 0x00ccaa009eULL };
+  static const unsigned long long aik5k0[2] __attribute__ ((__aligned__ (16)))
+    = { 0x0163cd6124ULL, 0x0000000000ULL };
+  static const unsigned long long aipoly[2] __attribute__ ((__aligned__ (16)))
+    = { 0x01db710641ULL, 0x01f7011641ULL };
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+  __m128i y5, y6, y7, y8;
+
+  if (c < 64)
+    return icrc_slice8 (z, c, ick);
+
+  x1 = _mm_loadu_si128 ((const __m128i *) (z + 0x00));
+  x2 = _mm_loadu_si128 ((const __m128i *) (z + 0x10));
+  x3 = _mm_loadu_si128 ((const __m128i *) (z + 0x20));
+  x4 = _mm_loadu_si128 ((const __m128i *) (z + 0x30));
+
+  x1 = _mm_xor_si128 (x1, _mm_cvtsi32_si128 ((int) (ick & 0xffffffffL)));
+
+  x0 = _mm_load_si128 ((const __m128i *) aik1k2);
+
+  z += 64;
+  c -= 64;
+
+  /* Fold four blocks of 16 bytes in parallel.  */
+  while (c >= 64)
+    {
+      x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+      x6 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+      x7 = _mm_clmulepi64_si128 (x3, x0, 0x00);
+      x8 = _mm_clmulepi64_si128 (x4, x0, 0x00);
+
+      x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+      x2 = _mm_clmulepi64_si128 (x2, x0, 0x11);
+      x3 = _mm_clmulepi64_si128 (x3, x0, 0x11);
+      x4 = _mm_clmulepi64_si128 (x4, x0, 0x11);
+
+      y5 = _mm_loadu_si128 ((const __m128i *) (z + 0x00));
+      y6 = _mm_loadu_si128 ((const __m128i *) (z + 0x10));
+      y7 = _mm_loadu_si128 ((const __m128i *) (z + 0x20));
+      y8 = _mm_loadu_si128 ((const __m128i *) (z + 0x30));
+
+      x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x5), y5);
+      x2 = _mm_xor_si128 (_mm_xor_si128 (x2, x6), y6);
+      x3 = _mm_xor_si128 (_mm_xor_si128 (x3, x7), y7);
+      x4 = _mm_xor_si128 (_mm_xor_si128 (x4, x8), y8);
+
+      z += 64;
+      c -= 64;
+    }
+
+  /* Fold the four blocks into one.  */
+  x0 = _mm_load_si128 ((const __m128i *) aik3k4);
+
+  x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+  x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+  x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+  x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x4), x5);
+
+  /* Fold in any remaining blocks of 16 bytes.  */
+  while (c >= 16)
+    {
+      x2 = _mm_loadu_si128 ((const __m128i *) z);
+
+      x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+      x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+
+      z += 16;
+      c -= 16;
+    }
+
+  /* Fold 128 bits down to 64 bits.  */
+  x2 = _mm_clmulepi64_si128 (x1, x0, 0x10);
+  x3 = _mm_setr_epi32 (~0, 0, ~0, 0);
+  x1 = _mm_srli_si128 (x1, 8);
+  x1 = _mm_xor_si128 (x1, x2);
+
+  x0 = _mm_loadl_epi64 ((const __m128i *) aik5k0);
+
+  x2 = _mm_srli_si128 (x1, 4);
+  x1 = _mm_and_si128 (x1, x3);
+  x1 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+  x1 = _mm_xor_si128 (x1, x2);
+
+  /* Barrett reduction down to 32 bits.  */
+  x0 = _mm_load_si128 ((const __m128i *) aipoly);
+
+  x2 = _mm_and_si128 (x1, x3);
+  x2 = _mm_clmulepi64_si128 (x2, x0, 0x10);
+  x2 = _mm_and_si128 (x2, x3);
+  x2 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+  x1 = _mm_xor_si128 (x1, x2);
+
+  ick = (unsigned long) (unsigned int) _mm_extract_epi32 (x1, 1);
+
+  return icrc_slice8 (z, c, ick);
+}
+
+#endif /* CRC_CLMUL */
+
+#if CRC_ARMV8
+
+/* The ARMv8 CRC32 instructions use the same bit-reflected polynomial
+   as aicrc32tab, and like IUPDC32 they do not invert the CRC.  */
+
+static unsigned long
+icrc_armv8 (const unsigned char *z, size_t c, long unsigned int ick)
+     __attribute__ ((__target__ ("+crc")));
+
+static unsigned long
+icrc_armv8 (const unsigned char *z, size_t c, long unsigned int ick)
+{
+  unsigned int i;
+
+  if (c == 0)
+    return ick;
+
+  i = (unsigned int) ick;
+  while (c > 0 && ((unsigned long) z & 7) != 0)
+    {
+      i = __crc32b (i, *z++);
+      --c;
+    }
+  while (c >= 32)
+    {
+      i = __crc32d (i, ((const unsigned long long *) z)[0]);
+      i = __crc32d (i, ((const unsigned long long *) z)[1]);
+      i = __crc32d (i, ((const unsigned long long *) z)[2]);
+      i = __crc32d (i, ((const unsigned long long *) z)[3]);
+      z += 32;
+      c -= 32;
+    }
+  while (c >= 8)
+    {
+      i = __crc32d (i, *(const unsigned long long *) z);
+      z += 8;
+      c -= 8;
+    }
+  while (c-- != 0)
+    i = __crc32b (i, *z++);
+
+  return (unsigned long) i;
+}
+
+#endif /* CRC_ARMV8 */
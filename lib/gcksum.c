@@ -0,0 +1,129 @@
+/* gcksum.c
+   The 'g' protocol checksum.
+
+   Copyright (C) 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#if USE_RCS_ID
+const char gcksum_rcsid[] = "$Id$";
+#endif
+
+#include "prot.h"
+
+static __inline__ void ugchecksum_block P((const char *z, size_t cblock,
+					   size_t c, unsigned long *pichk1,
+					   unsigned long *pichk2));
+
+/* Compute the 'g' protocol checksum.  This is unfortunately rather
+   awkward.  This is the most time consuming code in the entire
+   program.  It's also not a great checksum, since it can be fooled
+   by some single bit errors.  */
+
+/* The checksum is a chain of dependent additions and rotations, so
+   there is nothing to be gained by trying to do several bytes at
+   once.  What we can do is avoid the data dependent branch of the
+   original code, which the processor can not predict on data with
+   many zero bytes.  Although the checksum variables grow beyond 16
+   bits, only the low 16 bits of each of them affect the result, so
+   we keep ichk1 masked and can express the two cases of the original
+   code as one, which the compiler can turn into a conditional
+   move.
+
+   When the byte is not zero, the original code masked ichk1, added
+   the byte, added ichk1 ^ c to ichk2, and then XORed ichk2 into ichk1
+   if the addition carried out of 16 bits.  When the byte is zero,
+   adding it does nothing and ichk2 is always XORed in.  So we XOR in
+   ichk2 if the addition carried or if the byte was zero.
+
+   The value c is the number of bytes left in the whole packet,
+   including the current one, so a packet split around the end of the
+   receive buffer can be handled as two separate blocks.  */
+
+#define ITERATION \
+      ichk1 = ((ichk1 << 1) | (ichk1 >> 15)) & 0xffff; \
+      b = BUCHAR (*z++); \
+      ichk1 += b; \
+      ichk2 += ichk1 ^ c; \
+      ichk1 = (((ichk1 >> 16) | (b == 0)) ? ichk1 ^ ichk2 : ichk1) & 0xffff; \
+      --c
+
+/* Run the checksum over a block of cblock bytes, where c is the
+   number of bytes remaining in the packet at the start of the
+   block.  */
+
+static __inline__ void
+ugchecksum_block (register const char *z, size_t cblock, register size_t c,
+		  unsigned long *pichk1, unsigned long *pichk2)
+{
+  register unsigned int ichk1, b;
+  register unsigned long ichk2;
+
+  ichk1 = (unsigned int) *pichk1;
+  ichk2 = *pichk2;
+
+  while (cblock >= 4)
+    {
+      ITERATION;
+      ITERATION;
+      ITERATION;
+      ITERATION;
+      cblock -= 4;
+    }
+  while (cblock-- != 0)
+    {
+      ITERATION;
+    }
+
+  *pichk1 = ichk1;
+  *pichk2 = ichk2;
+}
+
+int
+igchecksum (register const char *z, register size_t c)
+{
+  unsigned long ichk1, ichk2;
+
+  ichk1 = 0xffff;
+  ichk2 = 0;
+
+  ugchecksum_block (z, c, c, &ichk1, &ichk2);
+
+  return ichk1 & 0xffff;
+}
+
+/* Compute the checksum of a block which is split around the end of
+   the receive buffer, without copying it.  */
+
+int
+igchecksum2 (const char *zfirst, size_t cfirst, const char *zsecond, size_t csecond)
+{
+  unsigned long ichk1, ichk2;
+
+  ichk1 = 0xffff;
+  ichk2 = 0;
+
+  ugchecksum_block (zfirst, cfirst, cfirst + csecond, &ichk1, &ichk2);
+  ugchecksum_block (zsecond, csecond, csecond, &ichk1, &ichk2);
+
+  return ichk1 & 0xffff;
+}
@@ -0,0 +1,267 @@
+/* jesc.c
+   Encode and decode the byte indices of the 'j' protocol.
+
+   Copyright (C) 1992, 1994, 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#if USE_RCS_ID
+const char jesc_rcsid[] = "$Id$";
+#endif
+
+#include "prot.h"
+
+/* The format of the byte indices is described at the start of
+   protj.c.  These routines are here rather than there so that tstsum
+   can check and time them.  */
+
+/* Amount to offset the bytes in the byte index by.  */
+#define INDEX_OFFSET (32)
+
+/* Maximum value of INDEX-LOW, before offsetting.  */
+#define INDEX_MAX_LOW (32)
+
+/* Maximum value of INDEX-HIGH, before offsetting. */
+#define INDEX_MAX_HIGH (94)
+
+/* Skip to the first byte in a buffer which we must avoid, returning
+   zend if there is none.  Most bytes need not be avoided, so we check
+   four at a time, without branching between them, before looking at
+   them one by one.  */
+
+#define ZJSKIP(abavoid, zput, zend) \
+  do \
+    { \
+      while ((zend) - (zput) >= 4 \
+	     && (abavoid[(unsigned char) (zput)[0]] \
+		 | abavoid[(unsigned char) (zput)[1]] \
+		 | abavoid[(unsigned char) (zput)[2]] \
+		 | abavoid[(unsigned char) (zput)[3]]) == 0) \
+	(zput) += 4; \
+      while ((zput) < (zend) && abavoid[(unsigned char) *(zput)] == 0) \
+	++(zput); \
+    } \
+  while (0)
+
+/* Return the offset of the first byte in a buffer which is marked in
+   the table abavoid, or c if there is none.  */
+
+size_t
+cjskip (const char *abavoid, const char *z, size_t c)
+{
+  const char *zscan, *zend;
+
+  zscan = z;
+  zend = z + c;
+  ZJSKIP (abavoid, zscan, zend);
+  return zscan - z;
+}
+
+/* Copy csend bytes to zbuf, changing each byte marked in abavoid and
+   putting a byte index for it after the data.  The caller has
+   already found the first byte to change, at offset ifirst.  Since
+   each byte of data is sent as exactly one byte, we copy all the data
+   at once and then fix up the bytes which must be avoided.  This
+   returns the number of bytes of data and byte indices; zbuf must
+   have room for csend * 3 bytes.  */
+
+size_t
+cjencode (const char *abavoid, const char *zsend, size_t csend,
+	  size_t ifirst, char *zbuf)
+{
+  char *zput, *zindex, *zend;
+
+  memcpy (zbuf, zsend, csend);
+  zindex = zbuf + csend;
+  zend = zbuf + csend;
+  zput = zbuf + ifirst;
+
+  while (TRUE)
+    {
+      char b;
+      boolean f128, f32;
+      int i, ihigh, ilow;
+
+      ZJSKIP (abavoid, zput, zend);
+      if (zput >= zend)
+	break;
+
+      b = *zput;
+
+      if ((b & 0x80) == 0)
+	f128 = FALSE;
+      else
+	{
+	  b &=~ 0x80;
+	  f128 = TRUE;
+	}
+      if (b >= 32 && b != 127)
+	f32 = FALSE;
+      else
+	{
+	  b ^= 0x20;
+	  f32 = TRUE;
+	}
+
+      /* We must now put the byte index into the buffer.  The byte
+	 index is encoded similarly to the length of the actual data,
+	 but the byte index also encodes the operations that must be
+	 performed on the byte.  The first byte in the index is the
+	 most significant bits.  If we only had to subtract 128 from
+	 the byte, we use the second byte directly.  If we had to xor
+	 the byte with 32, we add 32 to the second byte index.  If we
+	 had to perform both operations, we add 64 to the second byte
+	 index.  However, if we had to perform both operations, and
+	 the second byte index was 31, then after adding 64 and
+	 offsetting by 32 we would come up with 127, which we are not
+	 permitted to use.  Therefore, in this special case we set the
+	 first byte of the index to 126 and put the original first
+	 byte into the second byte position instead.  This is why we
+	 could not permit the high byte of the length of the actual
+	 data to be 126.  We can get away with the switch because both
+	 the value of the second byte index (31) and the operations to
+	 perform (both) are known.  */
+      i = zput - zbuf;
+      ihigh = i / INDEX_MAX_LOW;
+      ilow = i % INDEX_MAX_LOW;
+
+      if (f128 && ! f32)
+	;
+      else if (f32 && ! f128)
+	ilow += INDEX_MAX_LOW;
+      else
+	{
+	  /* Both operations had to be performed.  */
+	  if (ilow != INDEX_MAX_LOW - 1)
+	    ilow += 2 * INDEX_MAX_LOW;
+	  else
+	    {
+	      ilow = ihigh;
+	      ihigh = INDEX_MAX_HIGH;
+	    }
+	}
+
+      *zindex++ = ihigh + INDEX_OFFSET;
+      *zindex++ = ilow + INDEX_OFFSET;
+      *zput++ = b;
+    }
+
+  return zindex - zbuf;
+}
+
+/* Decode a byte index, setting iset to the index of the byte in the
+   data, f128 if 128 must be added to the byte, and f32 if it must be
+   exclusive or'red with 32.  If the high byte is the special value
+   126, then the low byte is actually the high byte and both
+   operations are performed.  */
+
+#define IJINDEX(bhigh, blow, f128, f32, iset) \
+  do \
+    { \
+      int ihigh, ilow; \
+ \
+      ihigh = (bhigh) - INDEX_OFFSET; \
+      ilow = (blow) - INDEX_OFFSET; \
+      (f128) = TRUE; \
+      (f32) = TRUE; \
+      if (ihigh == INDEX_MAX_HIGH) \
+	(iset) = ilow * INDEX_MAX_LOW + INDEX_MAX_LOW - 1; \
+      else \
+	{ \
+	  (iset) = ihigh * INDEX_MAX_LOW + ilow % INDEX_MAX_LOW; \
+	  if (ilow < INDEX_MAX_LOW) \
+	    (f32) = FALSE; \
+	  else if (ilow < 2 * INDEX_MAX_LOW) \
+	    (f128) = FALSE; \
+	} \
+    } \
+  while (0)
+
+/* Undo the encoding of cdata bytes at zdata, using the cindex bytes
+   of byte indices which follow them, and zero out the byte indices.
+   A bad index means a corrupt packet, which the 'i' protocol checksum
+   will catch; we just make sure we don't write outside the data.  */
+
+void
+ujdecode (char *zdata, int cdata, int cindex)
+{
+  char *zidx, *zidxend;
+
+  zidx = zdata + cdata;
+  zidxend = zidx + cindex;
+  while (zidx < zidxend)
+    {
+      int iset;
+      boolean f128, f32;
+
+      IJINDEX (zidx[0], zidx[1], f128, f32, iset);
+      zidx += 2;
+
+      if (iset < 0 || iset >= cdata)
+	continue;
+
+      if (f128)
+	zdata[iset] |= 0x80;
+      if (f32)
+	zdata[iset] ^= 0x20;
+    }
+  bzero (zdata + cdata, (size_t) cindex);
+}
+
+/* The same, for a packet which starts at index idata in the circular
+   buffer zbuf of cbuf bytes, and which may wrap around the end.  */
+
+void
+ujdecode_ring (char *zbuf, int cbuf, int idata, int cdata, int cindex)
+{
+  int iindex;
+
+  iindex = (idata + cdata) % cbuf;
+  while (cindex > 0)
+    {
+      char bhigh, blow;
+      int iset;
+      boolean f128, f32;
+
+      bhigh = zbuf[iindex];
+      zbuf[iindex] = 0;
+      iindex = (iindex + 1) % cbuf;
+      blow = zbuf[iindex];
+      zbuf[iindex] = 0;
+      iindex = (iindex + 1) % cbuf;
+      cindex -= 2;
+
+      IJINDEX (bhigh, blow, f128, f32, iset);
+
+      if (iset < 0 || iset >= cdata)
+	continue;
+
+      /* Now iset is the index from the start of the data to the byte
+	 to modify; adjust it to an index in zbuf.  */
+      iset = (idata + iset) % cbuf;
+
+      if (f128)
+	zbuf[iset] |= 0x80;
+      if (f32)
+	zbuf[iset] ^= 0x20;
+    }
+}
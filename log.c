@@ -103,6 +103,15 @@ static FILE *eLstats;
 /* Whether we've tried to open the statistics file.  */
 static boolean fLstats_tried;
 
+/* Protocol statistics file name.  */
+static const char *zLprotstatsfile;
+
+/* The open protocol statistics file.  */
+static FILE *eLprotstats;
+
+/* Whether we've tried to open the protocol statistics file.  */
+static boolean fLprotstats_tried;
+
 /* The array of signals.  The elements are only set to TRUE by the
    default signal handler.  They are only set to FALSE if we don't
    care whether we got the signal or not.  */
@@ -158,6 +167,10 @@ ulog_to_file (pointer puuconf, boolean ffile)
   if (iuuconf != UUCONF_SUCCESS)
     ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
 
+  iuuconf = uuconf_protstatsfile (puuconf, &zLprotstatsfile);
+  if (iuuconf != UUCONF_SUCCESS)
+    ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
+
   fLfile = ffile;
 }
 
@@ -732,7 +745,32 @@ ustats (boolean fsucceeded, const char *zuser, const char *zsystem, boolean fsen
 #endif
 }
 
-/* Close the statistics file.  */
+/* Write a line to the protocol statistics file.  Unlike the other
+   files, the format of this one does not depend on the type of
+   logging, since it is only meant to be read by programs.  */
+
+void
+ustats_protocol (const char *zrecord)
+{
+  if (eLprotstats == NULL)
+    {
+      if (fLprotstats_tried)
+	return;
+      fLprotstats_tried = TRUE;
+      eLprotstats = esysdep_fopen (zLprotstatsfile, TRUE, TRUE, TRUE);
+      if (eLprotstats == NULL)
+	return;
+    }
+
+  fprintf (eLprotstats, "%s\n", zrecord);
+  (void) fflush (eLprotstats);
+
+#if CLOSE_LOGFILES
+  ustats_close ();
+#endif
+}
+
+/* Close the statistics file and the protocol statistics file.  */
 
 void
 ustats_close (void)
@@ -744,6 +782,13 @@ ustats_close (void)
       eLstats = NULL;
       fLstats_tried = FALSE;
     }
+  if (eLprotstats != NULL)
+    {
+      if (fclose (eLprotstats) != 0)
+	ulog (LOG_ERROR, "fclose: %s", strerror (errno));
+      eLprotstats = NULL;
+      fLprotstats_tried = FALSE;
+    }
 }
 
 /* Return the date and time in a form used for a log entry.  */
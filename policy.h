@@ -479,9 +479,14 @@
    SPOOLDIR_ULTRIX -- Use an Ultrix style spool directory
    SPOOLDIR_SVR4 -- Use a System V Release 4 spool directory
    SPOOLDIR_TAYLOR -- Use a new style spool directory
+   SPOOLDIR_HASHED -- Like SPOOLDIR_TAYLOR, but spread the command and
+                      data files for each system over 256 subdirectories
 
    If you are not worried about compatibility with a currently running
-   UUCP, use SPOOLDIR_TAYLOR.  */
+   UUCP, use SPOOLDIR_TAYLOR.  If a single system may have hundreds of
+   thousands of jobs queued at once, use SPOOLDIR_HASHED; the uuspool
+   program will move an existing SPOOLDIR_TAYLOR spool directory into
+   the new layout, or back again.  */
 #define SPOOLDIR_V2 0
 #define SPOOLDIR_BSD42 0
 #define SPOOLDIR_BSD43 0
@@ -489,6 +494,7 @@
 #define SPOOLDIR_ULTRIX 0
 #define SPOOLDIR_SVR4 0
 #define SPOOLDIR_TAYLOR 1
+#define SPOOLDIR_HASHED 0
 
 /* The status file generated by UUCP can use either the traditional
    HDB upper case comments or new easier to read lower case comments.
@@ -610,6 +616,18 @@
    FREE_SPACE_DELTA to 0.  */
 #define FREE_SPACE_DELTA (10240)
 
+/* While a file which may be restarted is being received, Taylor UUCP
+   will periodically flush it to disk and write a checkpoint recording
+   how much of it has been received, along with a CRC of that data.
+   If the conversation is lost, the next conversation will restart the
+   file from the checkpoint, after checking the CRC.  A checkpoint is
+   written each time CHECKPOINT_DELTA bytes are received, and when the
+   conversation is lost.  Lower values of CHECKPOINT_DELTA lose less
+   of the file if the system crashes, but spend more time writing to
+   the disk.  To only write a checkpoint when the conversation is
+   lost, set CHECKPOINT_DELTA to 0.  */
+#define CHECKPOINT_DELTA (4194304)
+
 /* It is possible for an execute job to request to be executed using
    sh(1), rather than execve(2).  This is such a security risk, it is
    being disabled by default; to allow such jobs, set the following
@@ -636,9 +654,28 @@
    crashes.  However, not all systems have the fsync call, and it is
    always less efficient to use it.  Note that some versions of SCO
    Unix, and possibly other systems, make fsync a synonym for sync,
-   which is extremely inefficient.  */
+   which is extremely inefficient.  When uucp --batch or uux --batch
+   queues many jobs at once, the spool files of a batch are instead
+   forced out together at the end of the batch, using syncfs if it is
+   available.  */
 #define FSYNC_ON_CLOSE 0
 
+/* If FSYNC_ON_CLOSE is set, uucico forces each file it receives out
+   to disk before telling the sending system that the file arrived.
+   When receiving many small files, such as mail, most of the time
+   can go to waiting for the disk.  If you set FSYNC_GROUP to a number
+   larger than 1, uucico will instead sync up to that many received
+   files at once, and only then send their confirmations, so nothing
+   is confirmed before it is safely on disk.  This is only done with
+   a protocol which supports channels, such as 'i', since otherwise
+   the sending system waits for each confirmation before going on to
+   the next file; the number of files synced at once is also limited
+   by the number of channels.  Files on the same file system as the
+   spool directory are synced together using syncfs if it is
+   available, or sync if it is not; other files are still synced one
+   at a time.  */
+#define FSYNC_GROUP 0
+
 #if HAVE_TAYLOR_LOGGING
 
 /* The default log file when using HAVE_TAYLOR_LOGGING.  When using
@@ -655,6 +692,14 @@
 /* #define STATFILE "/var/spool/uucp/Stats" */
 /* #define STATFILE "/var/log/uucp/Stats" */
 
+/* The default protocol statistics file when using
+   HAVE_TAYLOR_LOGGING.  When using HAVE_TAYLOR_CONFIG, this may be
+   overridden by the ``protstatfile'' command in the configuration
+   file.  */
+#define PROTSTATFILE "/usr/spool/uucp/Protstats"
+/* #define PROTSTATFILE "/var/spool/uucp/Protstats" */
+/* #define PROTSTATFILE "/var/log/uucp/Protstats" */
+
 /* The default debugging file when using HAVE_TAYLOR_LOGGING.  When
    using HAVE_TAYLOR_CONFIG, this may be overridden by the
    ``debugfile'' command in the configuration file.  */
@@ -676,6 +721,11 @@
    command in the configuration file.  */
 #define STATFILE "/usr/spool/uucp/SYSLOG"
 
+/* The default protocol statistics file when using HAVE_V2_LOGGING.
+   When using HAVE_TAYLOR_CONFIG, this may be overridden by the
+   ``protstatfile'' command in the configuration file.  */
+#define PROTSTATFILE "/usr/spool/uucp/PROTSTAT"
+
 /* The default debugging file when using HAVE_V2_LOGGING.  When using
    HAVE_TAYLOR_CONFIG, this may be overridden by the ``debugfile''
    command in the configuration file.  */
@@ -699,6 +749,11 @@
    command in the configuration file.  */
 #define STATFILE "/usr/spool/uucp/.Admin/xferstats"
 
+/* The default protocol statistics file when using HAVE_HDB_LOGGING.
+   When using HAVE_TAYLOR_CONFIG, this may be overridden by the
+   ``protstatfile'' command in the configuration file.  */
+#define PROTSTATFILE "/usr/spool/uucp/.Admin/protstats"
+
 /* The default debugging file when using HAVE_HDB_LOGGING.  When using
    HAVE_TAYLOR_CONFIG, this may be overridden by the ``debugfile''
    command in the configuration file.  */
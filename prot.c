@@ -35,11 +35,33 @@ const char prot_rcsid[] = "$Id$";
 #include "system.h"
 #include "conn.h"
 #include "prot.h"
+#include "trans.h"
 
 /* Variables visible to the protocol-specific routines.  */
 
-/* Buffer to hold received data.  */
-char abPrecbuf[CRECBUFLEN];
+/* Counters for the current conversation.  */
+struct sprotstats sPstats;
+
+/* Buffer to hold received data.  This normally points to
+   abPrecstatic, but uprecbuf_mirror and uprecbuf_adjust may replace
+   it.  */
+static char abPrecstatic[CRECBUFLEN_DEFAULT];
+char *abPrecbuf = abPrecstatic;
+
+/* The size of abPrecbuf.  */
+int cPrecbuflen = CRECBUFLEN_DEFAULT;
+
+/* The largest size abPrecbuf may grow to.  */
+int cPrecbuf_max = CRECBUFLEN_MAX;
+
+/* The number of bytes abPrecbuf must be able to hold.  */
+int cPrecbuf_min;
+
+/* Whether abPrecbuf may be resized.  */
+boolean fPrecfixed;
+
+/* Whether abPrecbuf is mirrored.  */
+boolean fPrecmirror;
 
 /* Index of start of data in abPrecbuf.  */
 int iPrecstart;
@@ -47,6 +69,290 @@ int iPrecstart;
 /* Index of end of data (first byte not included in data) in abPrecbuf.  */
 int iPrecend;
 
+/* Statistics about the receive buffer.  We record the largest amount
+   of data ever held, and the number of reads which filled the buffer
+   up.  The _recent versions are reset by uprecbuf_adjust each time
+   it makes a decision.  */
+static long cPrecreads;
+static long cPrecfills;
+static long cPrecfill_percent;
+static int cPrecpeak;
+static int cPrecreads_recent;
+static int cPrecfills_recent;
+static int cPrecpeak_recent;
+
+/* The number of times in a row uprecbuf_adjust has found the buffer
+   mostly empty.  */
+static int cPrecquiet;
+
+/* The most recent smoothed round trip time in milliseconds, as
+   measured by urtt_sample, or 0 if the protocol does not measure it.
+   uprecbuf_adjust multiplies this by the rate at which data arrived
+   since its last decision to estimate the bandwidth-delay product of
+   the link.  The time and byte count of that decision are kept
+   here; fPrectimed is TRUE once they have been set.  */
+static long iPrecrtt;
+static boolean fPrectimed;
+static long iPrecsecs;
+static long iPrecmicros;
+static long cPrecwire;
+
+/* The number of reads uprecbuf_adjust waits for between decisions.  */
+#define CPRECREADS (16)
+
+/* The number of times in a row the buffer must be found mostly empty
+   before it is shrunk.  */
+#define CPRECQUIET (8)
+
+/* Don't let the receive buffer parameter get too large, since the
+   indices into the buffer are ints.  */
+#define CRECBUFLEN_LIMIT (16 * 1024 * 1024)
+
+static size_t cprecbuf_room P((void));
+static void uprecbuf_note P((void));
+static void uprecbuf_adjust P((void));
+
+/* Switch to a mirrored receive buffer if we can.  */
+
+void
+uprecbuf_mirror (void)
+{
+  char *z;
+
+  if (fPrecmirror || iPrecstart != iPrecend)
+    return;
+
+  z = zsysdep_mirror_alloc ((size_t) CRECBUFLEN);
+  if (z != NULL)
+    {
+      abPrecbuf = z;
+      iPrecstart = iPrecend = 0;
+      fPrecmirror = TRUE;
+      DEBUG_MESSAGE0 (DEBUG_PORT,
+		      "uprecbuf_mirror: Using mirrored receive buffer");
+    }
+}
+
+/* Return the amount of data which may be read into the receive
+   buffer starting at iPrecend.  We always leave one byte free, so
+   that iPrecstart == iPrecend means the buffer is empty.  If the
+   buffer is not mirrored, we can not read past the end.  */
+
+static size_t
+cprecbuf_room (void)
+{
+  size_t c;
+
+  if (iPrecend < iPrecstart)
+    c = iPrecstart - iPrecend - 1;
+  else if (fPrecmirror)
+    c = CRECBUFLEN - (iPrecend - iPrecstart) - 1;
+  else
+    {
+      c = CRECBUFLEN - iPrecend;
+      if (iPrecstart == 0)
+	--c;
+    }
+  return c;
+}
+
+/* Record statistics after reading data into the receive buffer.  */
+
+static void
+uprecbuf_note (void)
+{
+  int c;
+
+  c = iPrecend - iPrecstart;
+  if (c < 0)
+    c += CRECBUFLEN;
+
+  ++cPrecreads;
+  ++cPrecreads_recent;
+  cPrecfill_percent += (long) c * 100 / CRECBUFLEN;
+  if (c > cPrecpeak)
+    cPrecpeak = c;
+  if (c > cPrecpeak_recent)
+    cPrecpeak_recent = c;
+  if (c == CRECBUFLEN - 1)
+    {
+      ++cPrecfills;
+      ++cPrecfills_recent;
+    }
+}
+
+/* Resize the receive buffer.  If it filled up since the last check,
+   or got more than half full, the remote system is sending faster
+   than we are processing the data, or the link has a large
+   bandwidth-delay product, so we double the size.  We also double it
+   if the bandwidth-delay product estimated from the round trip time
+   is more than half the buffer, since then a protocol with a large
+   window can have more data in flight than we can take in one read.
+   If it stays mostly empty for a while, and the estimate is small,
+   we halve it.  This is only called by
+   freceive_data; the protocols do not hold on to positions in the
+   buffer other than iPrecstart and iPrecend at that point, so we can
+   move any data we have to the start of the new buffer.  */
+
+static void
+uprecbuf_adjust (void)
+{
+  int cmin, cmax, cnew, cdata;
+  long cbdp;
+  char *znew;
+
+  if (fPrecfixed)
+    return;
+
+  /* The protocol may need room for a large packet, whatever the
+     ``receive-buffer'' parameter says.  Keep the size a power of two
+     multiple of the default, so that a mirrored buffer is always a
+     multiple of the page size.  */
+  cmin = CRECBUFLEN_DEFAULT;
+  while (cmin <= cPrecbuf_min && cmin < CRECBUFLEN_LIMIT)
+    cmin *= 2;
+
+  cmax = cPrecbuf_max;
+  if (cmax > CRECBUFLEN_LIMIT)
+    cmax = CRECBUFLEN_LIMIT;
+  if (cmax < cmin)
+    cmax = cmin;
+
+  if (CRECBUFLEN < cmin)
+    cnew = cmin;
+  else
+    {
+      if (cmax == cmin && CRECBUFLEN == cmin)
+	return;
+
+      if (cPrecreads_recent < CPRECREADS)
+	return;
+
+      cbdp = 0;
+      if (iPrecrtt > 0)
+	{
+	  long isecs, imicros, imillis, cbytes;
+
+	  isecs = ixsysdep_process_time (&imicros);
+	  imillis = ((isecs - iPrecsecs) * 1000
+		     + (imicros - iPrecmicros) / 1000);
+	  cbytes = sPstats.cwire_received - cPrecwire;
+	  if (fPrectimed && imillis > 0 && cbytes > 0)
+	    {
+	      /* Divide first, so that a long can't overflow.  */
+	      cbdp = cbytes / imillis * iPrecrtt;
+	      DEBUG_MESSAGE3 (DEBUG_PROTO,
+			      "uprecbuf_adjust: %ld bytes in %ld ms, bandwidth-delay product %ld",
+			      cbytes, imillis, cbdp);
+	    }
+	  iPrecsecs = isecs;
+	  iPrecmicros = imicros;
+	  cPrecwire = sPstats.cwire_received;
+	  fPrectimed = TRUE;
+	}
+
+      cnew = CRECBUFLEN;
+      if (cPrecfills_recent > 0
+	  || cPrecpeak_recent > CRECBUFLEN / 2
+	  || cbdp > CRECBUFLEN / 2)
+	{
+	  cnew *= 2;
+	  cPrecquiet = 0;
+	}
+      else if (cPrecpeak_recent < CRECBUFLEN / 8
+	       && cbdp < CRECBUFLEN / 8)
+	{
+	  ++cPrecquiet;
+	  if (cPrecquiet >= CPRECQUIET)
+	    {
+	      cnew /= 2;
+	      cPrecquiet = 0;
+	    }
+	}
+      else
+	cPrecquiet = 0;
+
+      cPrecreads_recent = 0;
+      cPrecfills_recent = 0;
+      cPrecpeak_recent = 0;
+
+      while (cnew > cmax && cnew > cmin)
+	cnew /= 2;
+      if (cnew < cmin)
+	cnew = cmin;
+    }
+
+  cdata = iPrecend - iPrecstart;
+  if (cdata < 0)
+    cdata += CRECBUFLEN;
+
+  if (cnew == CRECBUFLEN || cdata >= cnew)
+    return;
+
+  if (fPrecmirror)
+    znew = zsysdep_mirror_alloc ((size_t) cnew);
+  else if (cnew == CRECBUFLEN_DEFAULT)
+    znew = abPrecstatic;
+  else
+    znew = (char *) malloc ((size_t) cnew);
+  if (znew == NULL)
+    return;
+
+  DEBUG_MESSAGE2 (DEBUG_PROTO,
+		  "uprecbuf_adjust: Changing receive buffer from %d to %d",
+		  CRECBUFLEN, cnew);
+
+  if (iPrecend >= iPrecstart)
+    memcpy (znew, abPrecbuf + iPrecstart, (size_t) cdata);
+  else
+    {
+      int cfirst;
+
+      cfirst = CRECBUFLEN - iPrecstart;
+      memcpy (znew, abPrecbuf + iPrecstart, (size_t) cfirst);
+      memcpy (znew + cfirst, abPrecbuf, (size_t) iPrecend);
+    }
+
+  if (fPrecmirror)
+    usysdep_mirror_free (abPrecbuf, (size_t) CRECBUFLEN);
+  else if (abPrecbuf != abPrecstatic)
+    free ((pointer) abPrecbuf);
+
+  abPrecbuf = znew;
+  cPrecbuflen = cnew;
+  iPrecstart = 0;
+  iPrecend = cdata;
+}
+
+/* Report receive buffer statistics.  We only bother if the buffer
+   was allowed to grow or if it ever filled up.  */
+
+void
+uprecbuf_shutdown (void)
+{
+  if (cPrecreads > 0
+      && (cPrecbuf_max > CRECBUFLEN_DEFAULT || cPrecfills > 0))
+    ulog (LOG_NORMAL,
+	  "Receive buffer: size %d, peak %d, average %ld%% full, filled %ld of %ld reads",
+	  CRECBUFLEN, cPrecpeak, cPrecfill_percent / cPrecreads,
+	  cPrecfills, cPrecreads);
+
+  cPrecreads = 0;
+  cPrecfills = 0;
+  cPrecfill_percent = 0;
+  cPrecpeak = 0;
+  cPrecreads_recent = 0;
+  cPrecfills_recent = 0;
+  cPrecpeak_recent = 0;
+  cPrecquiet = 0;
+  iPrecrtt = 0;
+  fPrectimed = FALSE;
+
+  /* Reset the protocol parameter to its default value.  */
+  cPrecbuf_max = CRECBUFLEN_MAX;
+  cPrecbuf_min = 0;
+}
+
 /* We want to output and input at the same time, if supported on this
    machine.  If we have something to send, we send it all while
    accepting a large amount of data.  Once we have sent everything we
@@ -56,6 +362,8 @@ int iPrecend;
 boolean
 fsend_data (struct sconnection *qconn, const char *zsend, size_t csend, boolean fdoread)
 {
+  sPstats.cwire_sent += csend;
+
   if (! fdoread)
     return fconn_write (qconn, zsend, csend);
 
@@ -63,15 +371,7 @@ fsend_data (struct sconnection *qconn, const char *zsend, size_t csend, boolean
     {
       size_t crec, csent;
 
-      if (iPrecend < iPrecstart)
-	crec = iPrecstart - iPrecend - 1;
-      else
-	{
-	  crec = CRECBUFLEN - iPrecend;
-	  if (iPrecstart == 0)
-	    --crec;
-	}
-
+      crec = cprecbuf_room ();
       if (crec == 0)
 	return fconn_write (qconn, zsend, csend);
 
@@ -84,11 +384,82 @@ fsend_data (struct sconnection *qconn, const char *zsend, size_t csend, boolean
       zsend += csent;
 
       iPrecend = (iPrecend + crec) % CRECBUFLEN;
+      sPstats.cwire_received += crec;
+
+      if (crec > 0)
+	uprecbuf_note ();
     }
 
   return TRUE;
 }
 
+/* Send a packet given in pieces.  This works just like fsend_data,
+   except that the pieces are handed to the connection together.  */
+
+boolean
+fsend_datav (struct sconnection *qconn, const struct sconn_iov *qiov, int ciov, boolean fdoread)
+{
+  struct sconn_iov as[CCONN_IOV_MAX];
+  int iiov;
+
+  /* We can't gather more pieces than this, so send them one at a
+     time.  */
+  if (ciov > CCONN_IOV_MAX)
+    {
+      for (iiov = 0; iiov < ciov; iiov++)
+	if (! fsend_data (qconn, qiov[iiov].zbuf, qiov[iiov].clen, fdoread))
+	  return FALSE;
+      return TRUE;
+    }
+
+  for (iiov = 0; iiov < ciov; iiov++)
+    sPstats.cwire_sent += qiov[iiov].clen;
+
+  if (! fdoread)
+    return fconn_writev (qconn, qiov, ciov);
+
+  memcpy (as, qiov, ciov * sizeof (struct sconn_iov));
+  iiov = 0;
+
+  while (iiov < ciov)
+    {
+      size_t crec, csent;
+
+      if (as[iiov].clen == 0)
+	{
+	  ++iiov;
+	  continue;
+	}
+
+      crec = cprecbuf_room ();
+      if (crec == 0)
+	return fconn_writev (qconn, as + iiov, ciov - iiov);
+
+      if (! fconn_iov (qconn, as + iiov, ciov - iiov, &csent,
+		       abPrecbuf + iPrecend, &crec))
+	return FALSE;
+
+      while (iiov < ciov && csent >= as[iiov].clen)
+	{
+	  csent -= as[iiov].clen;
+	  ++iiov;
+	}
+      if (iiov < ciov)
+	{
+	  as[iiov].zbuf += csent;
+	  as[iiov].clen -= csent;
+	}
+
+      iPrecend = (iPrecend + crec) % CRECBUFLEN;
+      sPstats.cwire_received += crec;
+
+      if (crec > 0)
+	uprecbuf_note ();
+    }
+
+  return TRUE;
+}
+
 /* Read data from the other system when we have nothing to send.  The
    argument cneed is the amount of data the caller wants, and ctimeout
    is the timeout in seconds.  The function sets *pcrec to the amount
@@ -101,17 +472,13 @@ fsend_data (struct sconnection *qconn, const char *zsend, size_t csend, boolean
 boolean
 freceive_data (struct sconnection *qconn, size_t cneed, size_t *pcrec, int ctimeout, boolean freport)
 {
+  /* This is a safe time to change the size of the buffer.  */
+  uprecbuf_adjust ();
+
   /* Set *pcrec to the maximum amount of data we can read.  fconn_read
      expects *pcrec to be the buffer size, and sets it to the amount
      actually received.  */
-  if (iPrecend < iPrecstart)
-    *pcrec = iPrecstart - iPrecend - 1;
-  else
-    {
-      *pcrec = CRECBUFLEN - iPrecend;
-      if (iPrecstart == 0)
-	--(*pcrec);
-    }
+  *pcrec = cprecbuf_room ();
 
 #if DEBUG > 0
   /* If we have no room in the buffer, we're in trouble.  The
@@ -130,6 +497,12 @@ freceive_data (struct sconnection *qconn, size_t cneed, size_t *pcrec, int ctime
     return FALSE;
 
   iPrecend = (iPrecend + *pcrec) % CRECBUFLEN;
+  sPstats.cwire_received += *pcrec;
+
+  if (*pcrec > 0)
+    uprecbuf_note ();
+  else if (ctimeout > 0)
+    ++sPstats.ctimeouts;
 
   return TRUE;
 }
@@ -165,6 +538,166 @@ breceive_char (struct sconnection *qconn, int ctimeout, boolean freport)
   return BUCHAR (b);
 }
 
+/* Initialize a round trip time estimator.  */
+
+void
+urtt_init (struct srtt *q, int cmin, int cmax)
+{
+  if (cmin < 1)
+    cmin = 1;
+  if (cmax < cmin)
+    cmax = cmin;
+
+  q->isrtt = 0;
+  q->irttvar = 0;
+  q->csamples = 0;
+  q->ctimeout = cmax;
+  q->cmin = cmin;
+  q->cmax = cmax;
+  q->iseq = -1;
+}
+
+/* Start timing a packet, unless we are already timing one.  */
+
+void
+urtt_start (struct srtt *q, int iseq)
+{
+  if (q->iseq != -1)
+    return;
+  q->iseq = iseq;
+  q->isecs = ixsysdep_process_time (&q->imicros);
+}
+
+/* The packet we were timing has been acknowledged.  Update the
+   smoothed round trip time and mean deviation, and set the timeout
+   to their sum, with the deviation weighted by four.  */
+
+void
+urtt_sample (struct srtt *q)
+{
+  long isecs, imicros;
+  long irtt, ierr, irto;
+  long c;
+  int ibucket;
+
+  if (q->iseq == -1)
+    return;
+  q->iseq = -1;
+
+  isecs = ixsysdep_process_time (&imicros);
+  irtt = (isecs - q->isecs) * 1000 + (imicros - q->imicros) / 1000;
+  if (irtt < 0)
+    irtt = 0;
+
+  if (q->csamples == 0)
+    {
+      q->isrtt = irtt << 3;
+      q->irttvar = irtt << 1;
+    }
+  else
+    {
+      ierr = irtt - (q->isrtt >> 3);
+      q->isrtt += ierr;
+      if (ierr < 0)
+	ierr = - ierr;
+      q->irttvar += ierr - (q->irttvar >> 2);
+    }
+  ++q->csamples;
+
+  iPrecrtt = q->isrtt >> 3;
+
+  for (ibucket = 0, c = irtt;
+       c > 0 && ibucket < CPSTATS_RTT - 1;
+       ++ibucket, c >>= 1)
+    ;
+  ++sPstats.artt[ibucket];
+
+  irto = (q->isrtt >> 3) + q->irttvar;
+  q->ctimeout = (int) ((irto + 999) / 1000);
+  if (q->ctimeout < q->cmin)
+    q->ctimeout = q->cmin;
+  else if (q->ctimeout > q->cmax)
+    q->ctimeout = q->cmax;
+
+  DEBUG_MESSAGE4 (DEBUG_PROTO,
+		  "urtt_sample: rtt %ld srtt %ld rttvar %ld timeout %d",
+		  irtt, q->isrtt >> 3, q->irttvar >> 2, q->ctimeout);
+}
+
+/* Stop timing a packet.  */
+
+void
+urtt_cancel (struct srtt *q)
+{
+  q->iseq = -1;
+}
+
+/* A timeout occurred.  Back off until we get a new measurement.  */
+
+void
+urtt_backoff (struct srtt *q)
+{
+  q->iseq = -1;
+  q->ctimeout *= 2;
+  if (q->ctimeout > q->cmax)
+    q->ctimeout = q->cmax;
+
+  DEBUG_MESSAGE3 (DEBUG_PROTO | DEBUG_ABNORMAL,
+		  "urtt_backoff: srtt %ld rttvar %ld timeout %d",
+		  q->isrtt >> 3, q->irttvar >> 2, q->ctimeout);
+}
+
+/* Clear the counters at the start of a conversation.  */
+
+void
+upstats_clear (void)
+{
+  bzero (&sPstats, sizeof sPstats);
+}
+
+/* Write the counters for a conversation to the protocol statistics
+   file.  The record is a single line of name=value pairs, so that a
+   program can easily read it.  */
+
+void
+upstats_write (const struct sdaemon *qdaemon, boolean fsucceeded)
+{
+  char *z, *zend;
+  int i;
+
+  z = zbufalc (strlen (qdaemon->qsys->uuconf_zname) + 400
+	       + CPSTATS_RTT * 12);
+  sprintf (z, "time=%ld system=%s protocol=%c caller=%s status=%s",
+	   ixsysdep_time ((long *) NULL), qdaemon->qsys->uuconf_zname,
+	   qdaemon->qproto->bname, qdaemon->fcaller ? "yes" : "no",
+	   fsucceeded ? "ok" : "failed");
+  zend = z + strlen (z);
+  sprintf (zend, " packets-sent=%ld packets-received=%ld packets-resent=%ld",
+	   sPstats.csent_packets, sPstats.crec_packets,
+	   sPstats.cresent_packets);
+  zend += strlen (zend);
+  sprintf (zend,
+	   " wire-sent=%ld wire-received=%ld data-sent=%ld data-received=%ld",
+	   sPstats.cwire_sent, sPstats.cwire_received,
+	   sPstats.cdata_sent, sPstats.cdata_received);
+  zend += strlen (zend);
+  sprintf (zend,
+	   " naks-sent=%ld naks-received=%ld timeouts=%ld window-full=%ld",
+	   sPstats.cnaks_sent, sPstats.cnaks_received,
+	   sPstats.ctimeouts, sPstats.cwindow_full);
+  zend += strlen (zend);
+  strcpy (zend, " rtt-ms=");
+  zend += strlen (zend);
+  for (i = 0; i < CPSTATS_RTT; i++)
+    {
+      sprintf (zend, i == 0 ? "%ld" : ",%ld", sPstats.artt[i]);
+      zend += strlen (zend);
+    }
+
+  ustats_protocol (z);
+  ubuffree (z);
+}
+
 /* Send mail about a file transfer.  We send to the given mailing
    address if there is one, otherwise to the user.  */
 
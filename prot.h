@@ -33,6 +33,7 @@
    header file.  */
 struct sdaemon;
 struct sconnection;
+struct sconn_iov;
 struct stransfer;
 #endif
 
@@ -50,6 +51,10 @@ struct sprotocol
   int cchans;
   /* Whether files may be reliably restarted using this protocol.  */
   boolean frestart;
+  /* Whether file data may be compressed.  This is FALSE if the
+     protocol needs to know the number of bytes it will send, or
+     repositions the file itself.  */
+  boolean fcompress;
   /* Protocol parameter commands.  */
   struct uuconf_cmdtab *qcmds;
   /* A routine to start the protocol.  If *pzlog is set to be
@@ -81,6 +86,15 @@ struct sprotocol
   boolean (*pffile) P((struct sdaemon *qdaemon, struct stransfer *qtrans,
 		       boolean fstart, boolean fsend, long cbytes,
 		       boolean *pfhandled));
+  /* Send data directly from the file e, which is positioned at ipos,
+     without reading it into a buffer from pzgetspace.  This sets
+     *pcdata to the number of bytes sent.  If that is zero, the data
+     must be sent using pzgetspace and pfsenddata instead; this is
+     always the case at the end of the file.  This is never used for
+     compressed data.  May be NULL.  */
+  boolean (*pfsendfile) P((struct sdaemon *qdaemon, openfile_t e,
+			   size_t *pcdata, int ilocal, int iremote,
+			   long ipos));
 };
 
 /* Send data to the other system.  If the fread argument is TRUE, this
@@ -92,6 +106,16 @@ extern boolean fsend_data P((struct sconnection *qconn,
 			     const char *zsend, size_t csend,
 			     boolean fdoread));
 
+/* Send a packet made up of several pieces of data (typically a
+   header, the data, and a trailer) to the other system, as though
+   they were in one buffer.  This lets a protocol send a packet with a
+   single system call without first copying the data next to the
+   header.  No more than CCONN_IOV_MAX pieces may be passed.  The
+   fdoread argument is as for fsend_data.  Returns FALSE on error.  */
+extern boolean fsend_datav P((struct sconnection *qconn,
+			      const struct sconn_iov *qiov, int ciov,
+			      boolean fdoread));
+
 /* Receive data from the other system when there is no data to send.
    The cneed argument is the amount of data desired and the ctimeout
    argument is the timeout in seconds.  This will set *pcrec to the
@@ -113,6 +137,48 @@ extern int breceive_char P((struct sconnection *qconn,
 /* Compute a 32 bit CRC of a data buffer, given an initial CRC.  */
 extern unsigned long icrc P((const char *z, size_t c, unsigned long ick));
 
+/* Return the name of the routine icrc uses on this processor, for
+   debugging messages.  */
+extern const char *zcrc_name P((void));
+
+/* Make icrc use the named routine, if this processor supports it.
+   This is only used to compare the routines.  */
+extern boolean fcrc_select P((const char *zname));
+
+/* Compute the 'g' protocol checksum of a buffer.  */
+extern int igchecksum P((const char *z, size_t c));
+
+/* Compute the 'g' protocol checksum of a packet which is split in
+   two, such as one which wraps around the end of the receive
+   buffer.  */
+extern int igchecksum2 P((const char *zfirst, size_t cfirst,
+			  const char *zsecond, size_t csecond));
+
+/* The largest number of data bytes in a 'j' protocol packet, as
+   determined by the byte indices.  */
+#define CJMAXPACKSIZE ((125 - 32) * 32 + 31)
+
+/* Return the offset of the first byte in a buffer which the 'j'
+   protocol must avoid, given a table indexed by unsigned character
+   which is non-zero for such bytes.  Return c if there is none.  */
+extern size_t cjskip P((const char *abavoid, const char *z, size_t c));
+
+/* Copy data for a 'j' protocol packet to zbuf, changing the bytes
+   which must be avoided and adding byte indices for them after the
+   data.  ifirst is the value cjskip returned.  Return the number of
+   bytes of data and byte indices.  */
+extern size_t cjencode P((const char *abavoid, const char *zsend,
+			  size_t csend, size_t ifirst, char *zbuf));
+
+/* Undo cjencode on cdata bytes of data followed by cindex bytes of
+   byte indices, and zero out the byte indices.  */
+extern void ujdecode P((char *zdata, int cdata, int cindex));
+
+/* The same, for a packet starting at index idata in a circular buffer
+   of cbuf bytes, which may wrap around the end of the buffer.  */
+extern void ujdecode_ring P((char *zbuf, int cbuf, int idata, int cdata,
+			     int cindex));
+
 /* The initial CRC value to use for a new buffer.  */
 #if ANSI_C
 #define ICRCINIT (0xffffffffUL)
@@ -120,11 +186,51 @@ extern unsigned long icrc P((const char *z, size_t c, unsigned long ick));
 #define ICRCINIT ((unsigned long) 0xffffffffL)
 #endif
 
-/* The size of the receive buffer.  */
-#define CRECBUFLEN (16384)
+/* The initial, and smallest, size of the receive buffer.  */
+#define CRECBUFLEN_DEFAULT (16384)
+
+/* The default for the largest size to which the receive buffer may
+   grow.  */
+#define CRECBUFLEN_MAX (262144)
+
+/* The size of the receive buffer.  This is not a constant, because
+   freceive_data may change it when the buffer is empty.  */
+extern int cPrecbuflen;
+#define CRECBUFLEN (cPrecbuflen)
+
+/* The largest size to which the receive buffer may grow (protocol
+   parameter ``receive-buffer'').  This is shared by all the
+   protocols.  */
+extern int cPrecbuf_max;
+
+/* The number of bytes the receive buffer must be able to hold.  A
+   protocol which uses packets larger than about half of
+   CRECBUFLEN_DEFAULT sets this when it starts, and freceive_data will
+   grow the buffer accordingly.  */
+extern int cPrecbuf_min;
+
+/* If this is TRUE, the receive buffer is never resized.  The 'j'
+   protocol sets this, because it keeps undecoded data in the buffer
+   beyond iPrecend.  */
+extern boolean fPrecfixed;
 
 /* Buffer to hold received data.  */
-extern char abPrecbuf[CRECBUFLEN];
+extern char *abPrecbuf;
+
+/* If this is TRUE, abPrecbuf is followed in memory by a second copy
+   of itself, so any CRECBUFLEN bytes starting in abPrecbuf may be
+   accessed without worrying about wrapping around the end.  */
+extern boolean fPrecmirror;
+
+/* Try to make abPrecbuf a mirrored buffer.  This must be called
+   before any data is received.  Since the memory would be shared
+   with child processes, it should not be called by a program which
+   forks and keeps using the connection in both processes.  */
+extern void uprecbuf_mirror P((void));
+
+/* Report statistics about the receive buffer at the end of a call,
+   and reset the ``receive-buffer'' protocol parameter.  */
+extern void uprecbuf_shutdown P((void));
 
 /* Index of start of data in abPrecbuf.  */
 extern int iPrecstart;
@@ -132,6 +238,102 @@ extern int iPrecstart;
 /* Index of end of data (first byte not included in data) in abPrecbuf.  */
 extern int iPrecend;
 
+/* Round trip time estimation, used by the 'g' and 'i' protocols to
+   decide how long to wait for an acknowledgement before resending a
+   packet.  This follows Jacobson's algorithm, using Karn's rule: a
+   packet is only timed if it is not resent, and each timeout doubles
+   the wait until a new measurement is made.  One packet is timed at
+   a time.  Times are measured in milliseconds, but the timeout is
+   rounded up to whole seconds, since that is what the connection
+   routines support.  */
+
+struct srtt
+{
+  /* Smoothed round trip time in milliseconds, times 8.  */
+  long isrtt;
+  /* Smoothed mean deviation in milliseconds, times 4.  */
+  long irttvar;
+  /* Number of measurements made.  */
+  long csamples;
+  /* Current timeout in seconds, including any backoff.  */
+  int ctimeout;
+  /* Smallest and largest timeout to use, in seconds.  */
+  int cmin;
+  int cmax;
+  /* Sequence number of the packet being timed, or -1 if none, and
+     the time at which it was sent.  */
+  int iseq;
+  long isecs;
+  long imicros;
+};
+
+/* Initialize a round trip time estimator.  Until a measurement is
+   made the timeout is cmax.  */
+extern void urtt_init P((struct srtt *q, int cmin, int cmax));
+
+/* Note that packet iseq is being sent, and time it if no other packet
+   is being timed.  */
+extern void urtt_start P((struct srtt *q, int iseq));
+
+/* Note that the packet being timed has been acknowledged, and update
+   the estimate.  */
+extern void urtt_sample P((struct srtt *q));
+
+/* Forget about the packet being timed, because it is being resent.  */
+extern void urtt_cancel P((struct srtt *q));
+
+/* Note that a timeout occurred, and double the timeout.  */
+extern void urtt_backoff P((struct srtt *q));
+
+/* Counters kept for each conversation.  These are cheap enough to
+   keep all the time.  Bytes on the wire and timeouts are counted by
+   fsend_data, fsend_datav and freceive_data, data received by
+   fgot_data, and round trip times by urtt_sample; the protocols
+   count everything else.  At the end of the conversation floop
+   writes them as a single record to the protocol statistics file.  */
+
+/* Number of buckets in the round trip time histogram.  Bucket 0
+   counts times of less than 1 millisecond, bucket i counts times of
+   at least 2^(i-1) and less than 2^i milliseconds, and the last
+   bucket counts any longer times.  */
+#define CPSTATS_RTT (16)
+
+struct sprotstats
+{
+  /* Packets sent and received, not counting packets which were
+     resent.  A protocol without packets counts each write or each
+     block of data.  */
+  long csent_packets;
+  long crec_packets;
+  /* Packets resent.  */
+  long cresent_packets;
+  /* Bytes written to and read from the connection.  */
+  long cwire_sent;
+  long cwire_received;
+  /* Bytes of commands and file data sent and received.  */
+  long cdata_sent;
+  long cdata_received;
+  /* Negative acknowledgements (rejects) sent and received.  */
+  long cnaks_sent;
+  long cnaks_received;
+  /* Number of times we waited for data and none arrived.  */
+  long ctimeouts;
+  /* Number of times we had to wait before sending because the
+     window was full.  */
+  long cwindow_full;
+  /* Round trip time histogram.  */
+  long artt[CPSTATS_RTT];
+};
+
+extern struct sprotstats sPstats;
+
+/* Clear the counters at the start of a conversation.  */
+extern void upstats_clear P((void));
+
+/* Write the counters to the protocol statistics file.  */
+extern void upstats_write P((const struct sdaemon *qdaemon,
+			     boolean fsucceeded));
+
 /* There are a couple of variables and functions that are shared by
    the 'i' and 'j' protocols (the 'j' protocol is just a wrapper
    around the 'i' protocol).  These belong in a separate header file,
@@ -217,6 +419,9 @@ extern boolean fewait P((struct sdaemon *qdaemon));
 extern boolean fefile P((struct sdaemon *qdaemon, struct stransfer *qtrans,
 			 boolean fstart, boolean fsend, long cbytes,
 			 boolean *pfhandled));
+extern boolean fesendfile P((struct sdaemon *qdaemon, openfile_t e,
+			     size_t *pcdata, int ilocal, int iremote,
+			     long ipos));
 
 /* Prototypes for 'i' protocol functions.  */
 
@@ -45,14 +45,51 @@ const char prote_rcsid[] = "$Id$";
    The 'e' protocol does no error checking whatsoever and thus
    requires an end-to-end verified eight bit communication line, such
    as is provided by TCP.  Using it with a modem is inadvisable, since
-   errors can occur between the modem and the computer.  */
+   errors can occur between the modem and the computer.
+
+   When both systems support it and the streams protocol parameter
+   is set, the calling system opens extra TCP connections to the
+   called system when the protocol starts, and file data is striped
+   across them: each file goes over one of the streams, picked by its
+   channel number, while commands stay on the original connection.
+   Everything is then sent in chunks, each starting with an
+   CECHUNKLEN byte header:
+       byte 0: 'C' for a command or 'D' for file data
+       byte 1: the sender's local channel number
+       byte 2: the sender's remote channel number
+       byte 3: zero
+       bytes 4-7: length of the data which follows, big endian
+       bytes 8-11: file position of the data, or 0xffffffff
+   A data chunk of length zero marks the end of a file.  Since each
+   stream carries several files in turn, this works much like a
+   protocol with multiple channels, such as 'i'.  */
 
 /* The buffer size we use.  */
-#define CEBUFSIZE (CRECBUFLEN / 2)
+#define CEBUFSIZE (CRECBUFLEN_DEFAULT / 2)
+
+/* The most extra connections we will open.  */
+#define CESTREAMS_MAX (8)
+
+/* The length of a chunk header when using streams.  */
+#define CECHUNKLEN (12)
+
+/* The size of the receive buffer for each stream.  */
+#define CESTREAMBUF (65536)
+
+/* The length of the string sent on a new stream to identify it.  */
+#define CESTREAMID (CTCP_STREAM_TOKEN + 8)
 
 /* The size of the initial file size message.  */
 #define CEFRAMELEN (20)
 
+/* The most data we move in one go when moving it directly between
+   the file and the connection.  */
+#define CEDIRECTSIZE (65536)
+
+/* Whether to move file data directly between the file and the
+   connection when the port supports it.  */
+#define FZERO_COPY (TRUE)
+
 /* A pointer to the buffer we will use.  */
 static char *zEbuf;
 
@@ -65,16 +102,91 @@ static long cEbytes;
 /* The timeout we use.  */
 static int cEtimeout = 120;
 
+/* Whether to use sendfile and splice for file data.  */
+static boolean fEzero_copy = FZERO_COPY;
+
+/* The number of extra connections to open (the streams protocol
+   parameter).  */
+static int cEstreams;
+
+/* Information kept for each connection when using streams.  Element
+   zero is the original connection.  */
+struct sestream
+{
+  /* The connection.  */
+  struct sconnection *qconn;
+  /* Storage for the connection, other than for element zero.  */
+  struct sconnection sconn;
+  /* Data which has been received; CESTREAMBUF bytes.  */
+  char *zbuf;
+  /* The unprocessed data runs from cstart to cend.  */
+  size_t cstart;
+  size_t cend;
+  /* The bytes left in the chunk being received, or -1 if we are
+     waiting for a header.  */
+  long cleft;
+  /* Whether the chunk being received is a command.  */
+  boolean fcmd;
+  /* Channel numbers of the chunk being received, from our point of
+     view.  */
+  int ilocal;
+  int iremote;
+  /* File position of the next byte of the chunk, or -1.  */
+  long ipos;
+  /* TRUE while the buffer is being processed, so that it is not
+     processed again or moved while we are sending something.  */
+  boolean fbusy;
+  /* TRUE while a chunk is being written, so that nothing else is
+     written until it is done.  */
+  boolean fwriting;
+  /* TRUE if the remote system has closed the connection.  */
+  boolean fclosed;
+};
+
+static struct sestream asEstreams[CESTREAMS_MAX + 1];
+
+/* The number of elements of asEstreams in use; zero if we are not
+   using streams.  */
+static int cEactive;
+
+/* Set when some received data means that fewait should return.  The
+   data may be processed while we are sending something.  */
+static boolean fEexit;
+
 struct uuconf_cmdtab asEproto_params[] =
 {
   { "timeout", UUCONF_CMDTABTYPE_INT, (pointer) &cEtimeout, NULL },
+  { "zero-copy", UUCONF_CMDTABTYPE_BOOLEAN, (pointer) &fEzero_copy,
+      NULL },
+  { "receive-buffer", UUCONF_CMDTABTYPE_INT, (pointer) &cPrecbuf_max,
+      NULL },
+  { "streams", UUCONF_CMDTABTYPE_INT, (pointer) &cEstreams, NULL },
   { NULL, 0, NULL, NULL }
 };
 
-/* Local function.  */
+/* Local functions.  */
 
 static boolean feprocess_data P((struct sdaemon *qdaemon, boolean *pfexit,
 				 size_t *pcneed));
+static boolean fereceive_string P((struct sdaemon *qdaemon, char *z,
+				   size_t c));
+static boolean festart_streams P((struct sdaemon *qdaemon, char **pzlog));
+static boolean feopen_streams P((struct sdaemon *qdaemon, int cstreams,
+				 const char *zreply));
+static boolean feaccept_streams P((struct sdaemon *qdaemon, int cstreams));
+static void ueuse_streams P((struct sdaemon *qdaemon, int cstreams,
+			     char **pzlog));
+static void ueclose_streams P((void));
+static boolean feread_stream P((int istream));
+static boolean fepoll_streams P((int iwrite, boolean *pfwrite,
+				 int ctimeout, boolean *pfgot));
+static boolean feprocess_stream P((struct sdaemon *qdaemon, int istream,
+				   boolean fstop));
+static boolean feprocess_streams P((struct sdaemon *qdaemon,
+				    boolean fstop));
+static boolean fesend_chunk P((struct sdaemon *qdaemon, int istream,
+			       int bchunk, int ilocal, int iremote,
+			       const char *zdata, size_t cdata, long ipos));
 
 /* Start the protocol.  */
 
@@ -87,9 +199,403 @@ festart (struct sdaemon *qdaemon, char **pzlog)
     return FALSE;
   zEbuf = (char *) xmalloc (CEBUFSIZE);
   fEfile = FALSE;
+  cEactive = 0;
+  fEexit = FALSE;
   usysdep_sleep (2);
+
+  if ((qdaemon->ifeatures & FEATURE_LOCAL_STREAMS) != 0
+      && (qdaemon->ireliable & UUCONF_RELIABLE_FULLDUPLEX) != 0)
+    return festart_streams (qdaemon, pzlog);
+
+  return TRUE;
+}
+
+/* Read a null terminated string sent while the protocol is starting,
+   before any commands.  */
+
+static boolean
+fereceive_string (struct sdaemon *qdaemon, char *z, size_t c)
+{
+  size_t i;
+
+  i = 0;
+  while (TRUE)
+    {
+      int b;
+
+      b = breceive_char (qdaemon->qconn, cEtimeout, TRUE);
+      if (b == -2)
+	return FALSE;
+      if (b == -1)
+	{
+	  ulog (LOG_ERROR, "Timed out waiting for data");
+	  return FALSE;
+	}
+      if (i < c - 1)
+	z[i++] = (char) b;
+      if (b == '\0')
+	break;
+    }
+  z[i] = '\0';
+
+  DEBUG_MESSAGE1 (DEBUG_PROTO, "fereceive_string: Got \"%s\"", z);
+
+  return TRUE;
+}
+
+/* Agree on the number of streams to use.  The calling system asks for
+   the number it wants with "streams N".  If that is not zero, the
+   called system answers with "streams M PORT TOKEN", where M is no
+   larger than N, or with "streams 0".  The calling system connects M
+   times to PORT, sending TOKEN and the stream number on each
+   connection, and then reports how many it managed with another
+   "streams M", or "streams 0" if anything went wrong.  */
+
+static boolean
+festart_streams (struct sdaemon *qdaemon, char **pzlog)
+{
+  char ab[sizeof "streams" + 3 * 20 + CTCP_STREAM_TOKEN];
+  int cstreams;
+
+  if (qdaemon->fcaller)
+    {
+      struct sconnection *qconn;
+      char *zend;
+
+      qconn = qdaemon->qconn;
+      cstreams = cEstreams;
+      if (cstreams > CESTREAMS_MAX)
+	cstreams = CESTREAMS_MAX;
+      if (cstreams < 0
+	  || qconn->qport == NULL
+	  || qconn->qport->uuconf_ttype != UUCONF_PORTTYPE_TCP)
+	cstreams = 0;
+
+      sprintf (ab, "streams %d", cstreams);
+      if (! fsend_data (qconn, ab, strlen (ab) + 1, TRUE))
+	return FALSE;
+      if (cstreams == 0)
+	return TRUE;
+
+      if (! fereceive_string (qdaemon, ab, sizeof ab))
+	return FALSE;
+      if (strncmp (ab, "streams ", sizeof "streams " - 1) != 0)
+	{
+	  ulog (LOG_ERROR, "Bad streams reply \"%s\"", ab);
+	  return FALSE;
+	}
+      cstreams = (int) strtol (ab + sizeof "streams " - 1, &zend, 10);
+      if (cstreams <= 0)
+	return TRUE;
+
+      if (! feopen_streams (qdaemon, cstreams, zend))
+	cstreams = 0;
+
+      sprintf (ab, "streams %d", cstreams);
+      if (! fsend_data (qconn, ab, strlen (ab) + 1, TRUE))
+	{
+	  ueclose_streams ();
+	  return FALSE;
+	}
+    }
+  else
+    {
+      if (! fereceive_string (qdaemon, ab, sizeof ab))
+	return FALSE;
+      if (strncmp (ab, "streams ", sizeof "streams " - 1) != 0)
+	{
+	  ulog (LOG_ERROR, "Bad streams request \"%s\"", ab);
+	  return FALSE;
+	}
+      cstreams = (int) strtol (ab + sizeof "streams " - 1,
+			       (char **) NULL, 10);
+      if (cstreams <= 0)
+	return TRUE;
+
+      if (cstreams > cEstreams)
+	cstreams = cEstreams;
+      if (cstreams > CESTREAMS_MAX)
+	cstreams = CESTREAMS_MAX;
+      if (cstreams < 0)
+	cstreams = 0;
+
+      if (! feaccept_streams (qdaemon, cstreams))
+	return FALSE;
+      if (cEactive == 0)
+	return TRUE;
+      cstreams = cEactive - 1;
+    }
+
+  ueuse_streams (qdaemon, cstreams, pzlog);
+
+  return TRUE;
+}
+
+/* Connect to the called system for each stream, given the rest of
+   its reply after the number of streams.  This returns FALSE if the
+   streams could not be made, in which case we carry on without
+   them.  */
+
+static boolean
+feopen_streams (struct sdaemon *qdaemon, int cstreams, const char *zreply)
+{
+#if HAVE_TCP
+  char *zend;
+  int iport;
+  const char *ztoken;
+  int i;
+
+  iport = (int) strtol ((char *) zreply, &zend, 10);
+  while (*zend == ' ')
+    ++zend;
+  ztoken = zend;
+  if (iport <= 0 || strlen (ztoken) != CTCP_STREAM_TOKEN
+      || cstreams > CESTREAMS_MAX)
+    {
+      ulog (LOG_ERROR, "Bad streams reply");
+      return FALSE;
+    }
+
+  for (i = 1; i <= cstreams; i++)
+    {
+      struct sestream *q;
+      char ab[CESTREAMID];
+
+      q = &asEstreams[i];
+      if (! fsysdep_tcp_stream_connect (qdaemon->qconn, iport, &q->sconn))
+	break;
+      q->qconn = &q->sconn;
+      cEactive = i + 1;
+
+      bzero (ab, sizeof ab);
+      sprintf (ab, "%s %d", ztoken, i);
+      if (! fconn_write (q->qconn, ab, sizeof ab))
+	break;
+    }
+
+  if (i <= cstreams)
+    {
+      ueclose_streams ();
+      return FALSE;
+    }
+
   return TRUE;
+#else /* ! HAVE_TCP */
+  return FALSE;
+#endif /* ! HAVE_TCP */
+}
+
+/* Wait for the calling system to connect for each stream.  If
+   something goes wrong before the calling system has been told where
+   to connect, we just don't use streams, but after that we must fail
+   the call.  */
+
+static boolean
+feaccept_streams (struct sdaemon *qdaemon, int cstreams)
+{
+#if HAVE_TCP
+  struct sconnection slisten;
+  char ztoken[CTCP_STREAM_TOKEN + 1];
+  char ab[sizeof "streams" + 3 * 20 + CTCP_STREAM_TOKEN];
+  int iport;
+  int c;
+  long iend;
+  boolean fret;
+
+  if (cstreams > 0
+      && ! fsysdep_tcp_stream_listen (qdaemon->qconn, &slisten, &iport,
+				      ztoken))
+    cstreams = 0;
+
+  if (cstreams == 0)
+    strcpy (ab, "streams 0");
+  else
+    sprintf (ab, "streams %d %d %s", cstreams, iport, ztoken);
+  if (! fsend_data (qdaemon->qconn, ab, strlen (ab) + 1, TRUE))
+    {
+      if (cstreams > 0)
+	usysdep_tcp_stream_close (&slisten);
+      return FALSE;
+    }
+  if (cstreams == 0)
+    return TRUE;
+
+  fret = FALSE;
+
+  if (! fereceive_string (qdaemon, ab, sizeof ab))
+    goto out;
+  c = -1;
+  if (strncmp (ab, "streams ", sizeof "streams " - 1) == 0)
+    c = (int) strtol (ab + sizeof "streams " - 1, (char **) NULL, 10);
+  if (c == 0)
+    {
+      fret = TRUE;
+      goto out;
+    }
+  if (c != cstreams)
+    {
+      ulog (LOG_ERROR, "Bad streams message \"%s\"", ab);
+      goto out;
+    }
+
+  /* Anybody who can reach the port may connect to it, so a bad
+     connection is just closed, and we keep waiting for the right
+     ones until the timeout runs out.  */
+  iend = ixsysdep_time ((long *) NULL) + cEtimeout;
+  c = 0;
+  while (c < cstreams)
+    {
+      struct sconnection *qlisten, snew;
+      boolean fready;
+      char abid[CESTREAMID + 1];
+      size_t cid;
+      int i;
+      long cleft;
+
+      cleft = iend - ixsysdep_time ((long *) NULL);
+      if (cleft <= 0)
+	{
+	  ulog (LOG_ERROR, "Timed out waiting for stream connection");
+	  goto out;
+	}
+
+      qlisten = &slisten;
+      fready = TRUE;
+      if (! fsysdep_conn_poll (&qlisten, 1, &fready, -1, (boolean *) NULL,
+			       (int) cleft))
+	goto out;
+      if (! fready)
+	{
+	  ulog (LOG_ERROR, "Timed out waiting for stream connection");
+	  goto out;
+	}
+      if (! fsysdep_tcp_stream_accept (&slisten, qdaemon->qconn, &snew))
+	continue;
+
+      cleft = iend - ixsysdep_time ((long *) NULL);
+      if (cleft <= 0)
+	cleft = 1;
+      cid = CESTREAMID;
+      if (! fconn_read (&snew, abid, &cid, CESTREAMID, (int) cleft, TRUE)
+	  || cid != CESTREAMID)
+	{
+	  ulog (LOG_ERROR, "Bad stream connection");
+	  usysdep_tcp_stream_close (&snew);
+	  continue;
+	}
+      abid[CESTREAMID] = '\0';
+
+      i = 0;
+      if (strncmp (abid, ztoken, CTCP_STREAM_TOKEN) == 0
+	  && abid[CTCP_STREAM_TOKEN] == ' ')
+	i = (int) strtol (abid + CTCP_STREAM_TOKEN + 1, (char **) NULL, 10);
+      if (i <= 0 || i > cstreams || asEstreams[i].qconn != NULL)
+	{
+	  ulog (LOG_ERROR, "Bad stream connection");
+	  usysdep_tcp_stream_close (&snew);
+	  continue;
+	}
+
+      asEstreams[i].sconn = snew;
+      asEstreams[i].qconn = &asEstreams[i].sconn;
+      ++c;
+    }
+
+  cEactive = cstreams + 1;
+  fret = TRUE;
+
+ out:
+  usysdep_tcp_stream_close (&slisten);
+  if (! fret)
+    {
+      cEactive = cstreams + 1;
+      ueclose_streams ();
+    }
+  return fret;
+#else /* ! HAVE_TCP */
+  return fsend_data (qdaemon->qconn, "streams 0", sizeof "streams 0", TRUE);
+#endif /* ! HAVE_TCP */
+}
+
+/* Start using the streams which have been set up.  Anything already
+   read from the original connection moves to its stream buffer.  */
+
+static void
+ueuse_streams (struct sdaemon *qdaemon, int cstreams, char **pzlog)
+{
+  int i;
+
+  asEstreams[0].qconn = qdaemon->qconn;
+  for (i = 0; i <= cstreams; i++)
+    {
+      struct sestream *q;
+
+      q = &asEstreams[i];
+      q->zbuf = (char *) xmalloc (CESTREAMBUF);
+      q->cstart = 0;
+      q->cend = 0;
+      q->cleft = -1;
+      q->fbusy = FALSE;
+      q->fwriting = FALSE;
+      q->fclosed = FALSE;
+    }
+  cEactive = cstreams + 1;
+
+  while (iPrecstart != iPrecend && asEstreams[0].cend < CESTREAMBUF)
+    {
+      asEstreams[0].zbuf[asEstreams[0].cend++] = abPrecbuf[iPrecstart];
+      iPrecstart = (iPrecstart + 1) % CRECBUFLEN;
+    }
+
+  /* Each stream is a channel, as far as the rest of the code is
+     concerned.  There is no point to pipelining on top of that.  */
+  qdaemon->cchans = cstreams;
+  qdaemon->cstreams = cstreams;
+  qdaemon->fpipeline = FALSE;
+
+  *pzlog = zbufalc (sizeof "protocol 'e' with  streams" + 20);
+  sprintf (*pzlog, "protocol 'e' with %d streams", cstreams);
 }
+
+/* Close any extra connections and free the stream buffers.  Anything
+   left over on the original connection goes back to abPrecbuf, where
+   uucico will look for the end of the conversation.  */
+
+static void
+ueclose_streams (void)
+{
+  int i;
+
+  if (cEactive > 0 && asEstreams[0].zbuf != NULL)
+    {
+      struct sestream *q;
+
+      q = &asEstreams[0];
+      while (q->cstart < q->cend
+	     && (iPrecend + 1) % CRECBUFLEN != iPrecstart)
+	{
+	  abPrecbuf[iPrecend] = q->zbuf[q->cstart++];
+	  iPrecend = (iPrecend + 1) % CRECBUFLEN;
+	}
+    }
+
+  for (i = 0; i < cEactive; i++)
+    {
+      struct sestream *q;
+
+      q = &asEstreams[i];
+#if HAVE_TCP
+      if (i > 0 && q->qconn != NULL)
+	usysdep_tcp_stream_close (q->qconn);
+#endif
+      q->qconn = NULL;
+      xfree ((pointer) q->zbuf);
+      q->zbuf = NULL;
+    }
+
+  cEactive = 0;
+}
+
 
 /* Stop the protocol.  */
 
@@ -97,21 +603,30 @@ festart (struct sdaemon *qdaemon, char **pzlog)
 boolean 
 feshutdown (struct sdaemon *qdaemon ATTRIBUTE_UNUSED ATTRIBUTE_UNUSED)
 {
+  ueclose_streams ();
   xfree ((pointer) zEbuf);
   zEbuf = NULL;
   cEtimeout = 120;
+  fEzero_copy = FZERO_COPY;
+  cEstreams = 0;
   return TRUE;
 }
 
 /* Send a command string.  We send everything up to and including the
    null byte.   */
 
-/*ARGSUSED*/
 boolean
-fesendcmd (struct sdaemon *qdaemon, const char *z, int ilocal ATTRIBUTE_UNUSED ATTRIBUTE_UNUSED, int iremote ATTRIBUTE_UNUSED ATTRIBUTE_UNUSED)
+fesendcmd (struct sdaemon *qdaemon, const char *z, int ilocal, int iremote)
 {
   DEBUG_MESSAGE1 (DEBUG_UUCP_PROTO, "fesendcmd: Sending command \"%s\"", z);
 
+  ++sPstats.csent_packets;
+  sPstats.cdata_sent += strlen (z) + 1;
+
+  if (cEactive > 0)
+    return fesend_chunk (qdaemon, 0, 'C', ilocal, iremote, z,
+			 strlen (z) + 1, (long) -1);
+
   return fsend_data (qdaemon->qconn, z, strlen (z) + 1, TRUE);
 }
 
@@ -130,10 +645,25 @@ zegetspace (struct sdaemon *qdaemon ATTRIBUTE_UNUSED ATTRIBUTE_UNUSED, size_t *p
    preceding the buffer.  This allows us to send the entire block with
    header bytes in a single call.  */
 
-/*ARGSIGNORED*/
 boolean
-fesenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRIBUTE_UNUSED ATTRIBUTE_UNUSED, int iremote ATTRIBUTE_UNUSED ATTRIBUTE_UNUSED, long int ipos ATTRIBUTE_UNUSED ATTRIBUTE_UNUSED)
+fesenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal, int iremote, long int ipos)
 {
+  ++sPstats.csent_packets;
+  sPstats.cdata_sent += cdata;
+
+  if (cEactive > 0)
+    {
+      int ichan;
+
+      /* Send each file over the stream picked by the channel number
+	 of whichever side asked for it.  */
+      ichan = ilocal > 0 ? ilocal : iremote;
+      if (ichan <= 0)
+	ichan = 1;
+      return fesend_chunk (qdaemon, (ichan - 1) % (cEactive - 1) + 1, 'D',
+			   ilocal, iremote, zdata, cdata, ipos);
+    }
+
 #if DEBUG > 0
   /* Keep track of the number of bytes we send out to make sure it all
      adds up.  */
@@ -150,6 +680,42 @@ fesenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRI
   return fsend_data (qdaemon->qconn, zdata, cdata, FALSE);
 }
 
+/* Send data straight from the file, if the connection supports it.
+   Since 'e' sends the file as a single block with no framing, we
+   don't need to look at the data at all.  */
+
+/*ARGSUSED*/
+boolean
+fesendfile (struct sdaemon *qdaemon, openfile_t e, size_t *pcdata, int ilocal ATTRIBUTE_UNUSED, int iremote ATTRIBUTE_UNUSED, long int ipos ATTRIBUTE_UNUSED)
+{
+  /* Data sent over streams needs a chunk header.  */
+  if (! fEzero_copy || cEactive > 0)
+    {
+      *pcdata = 0;
+      return TRUE;
+    }
+
+  *pcdata = CEDIRECTSIZE;
+  if (! fconn_sendfile (qdaemon->qconn, e, pcdata))
+    return FALSE;
+
+  /* This doesn't go through fsend_data.  */
+  ++sPstats.csent_packets;
+  sPstats.cdata_sent += *pcdata;
+  sPstats.cwire_sent += *pcdata;
+
+#if DEBUG > 0
+  cEbytes -= *pcdata;
+  if (cEbytes < 0)
+    {
+      ulog (LOG_ERROR, "Protocol 'e' internal error");
+      return FALSE;
+    }
+#endif
+
+  return TRUE;
+}
+
 /* Process data and return the amount we need in *pfneed.  */
 
 static boolean
@@ -183,6 +749,7 @@ feprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
 			  "feprocess_data: Got %d command bytes",
 			  cfirst);
 
+	  ++sPstats.crec_packets;
 	  if (! fgot_data (qdaemon, abPrecbuf + iPrecstart,
 			   (size_t) cfirst, (const char *) NULL, (size_t) 0,
 			   -1, -1, (long) -1, TRUE, pfexit))
@@ -263,6 +830,7 @@ feprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
 		      "feprocess_data: Got %d data bytes",
 		      clen);
 
+      ++sPstats.crec_packets;
       if (! fgot_data (qdaemon, abPrecbuf + iPrecstart,
 		       (size_t) cfirst, abPrecbuf, (size_t) (clen - cfirst),
 		       -1, -1, (long) -1, TRUE, pfexit))
@@ -284,6 +852,42 @@ feprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
       cinbuf -= clen;
     }
 
+  /* The receive buffer is empty.  Move as much of the rest of the file
+     as has already arrived straight into the file.  */
+  while (fEzero_copy && cEbytes > 0)
+    {
+      size_t cmax, cgot;
+
+      cmax = CEDIRECTSIZE;
+      if ((long) cmax > cEbytes)
+	cmax = (size_t) cEbytes;
+
+      if (! fgot_file_data (qdaemon, cmax, &cgot))
+	return FALSE;
+      if (cgot == 0)
+	break;
+
+      /* This doesn't go through freceive_data.  */
+      ++sPstats.crec_packets;
+      sPstats.cwire_received += cgot;
+
+      DEBUG_MESSAGE1 (DEBUG_PROTO,
+		      "feprocess_data: Moved %lu data bytes directly",
+		      (unsigned long) cgot);
+
+      cEbytes -= cgot;
+
+      if (cEbytes == 0)
+	{
+	  if (! fgot_data (qdaemon, abPrecbuf, (size_t) 0,
+			   (const char *) NULL, (size_t) 0,
+			   -1, -1, (long) -1, TRUE, pfexit))
+	    return FALSE;
+	  if (*pfexit)
+	    return TRUE;
+	}
+    }
+
   if (pcneed != NULL)
     {
       if (cEbytes > CRECBUFLEN / 2)
@@ -301,6 +905,30 @@ feprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
 boolean
 fewait (struct sdaemon *qdaemon)
 {
+  if (cEactive > 0)
+    {
+      while (TRUE)
+	{
+	  boolean fgot;
+
+	  if (! feprocess_streams (qdaemon, TRUE))
+	    return FALSE;
+	  if (fEexit)
+	    {
+	      fEexit = FALSE;
+	      return TRUE;
+	    }
+
+	  if (! fepoll_streams (-1, (boolean *) NULL, cEtimeout, &fgot))
+	    return FALSE;
+	  if (! fgot)
+	    {
+	      ulog (LOG_ERROR, "Timed out waiting for data");
+	      return FALSE;
+	    }
+	}
+    }
+
   while (TRUE)
     {
       boolean fexit;
@@ -330,6 +958,11 @@ fefile (struct sdaemon *qdaemon, struct stransfer *qtrans ATTRIBUTE_UNUSED ATTRI
 {
   *pfhandled = FALSE;
 
+  /* When using streams every piece of data is framed, and several
+     files may be moving at once.  */
+  if (cEactive > 0)
+    return TRUE;
+
   if (fstart)
     {
       if (fsend)
@@ -369,3 +1002,365 @@ fefile (struct sdaemon *qdaemon, struct stransfer *qtrans ATTRIBUTE_UNUSED ATTRI
 
   return TRUE;
 }
+
+/* Read whatever has arrived on a stream into its buffer.  The caller
+   knows that something is there.  */
+
+static boolean
+feread_stream (int istream)
+{
+  struct sestream *q;
+  size_t c;
+
+  q = &asEstreams[istream];
+
+  /* Move the unprocessed data to the start of the buffer, unless it
+     is being processed; fgot_data may be holding on to it.  */
+  if (! q->fbusy && q->cstart > 0)
+    {
+      if (q->cend > q->cstart)
+	memmove (q->zbuf, q->zbuf + q->cstart, q->cend - q->cstart);
+      q->cend -= q->cstart;
+      q->cstart = 0;
+    }
+
+  c = CESTREAMBUF - q->cend;
+  if (c == 0)
+    return TRUE;
+
+  /* The streams are all closed at the end of the conversation, and
+     one may be seen to close before the last command arrives.  Only
+     the original connection closing is an error.  */
+  if (! fconn_read (q->qconn, q->zbuf + q->cend, &c, (size_t) 1, cEtimeout,
+		    istream == 0))
+    {
+      if (istream == 0)
+	return FALSE;
+      DEBUG_MESSAGE1 (DEBUG_PROTO, "feread_stream: Stream %d closed",
+		      istream);
+      q->fclosed = TRUE;
+      return TRUE;
+    }
+
+  q->cend += c;
+  sPstats.cwire_received += c;
+
+  return TRUE;
+}
+
+/* Wait for data to arrive on any stream which has room for it, and
+   read it.  If iwrite is not -1, also wait until that stream can be
+   written to, and set *pfwrite accordingly.  *pfgot is set if
+   anything was read.  */
+
+static boolean
+fepoll_streams (int iwrite, boolean *pfwrite, int ctimeout, boolean *pfgot)
+{
+  struct sconnection *aqconns[CESTREAMS_MAX + 1];
+  boolean afread[CESTREAMS_MAX + 1];
+  int i;
+
+  for (i = 0; i < cEactive; i++)
+    {
+      struct sestream *q;
+
+      q = &asEstreams[i];
+      aqconns[i] = q->qconn;
+      afread[i] = (! q->fclosed
+		   && (q->cend < CESTREAMBUF
+		       || (! q->fbusy && q->cstart > 0)));
+    }
+
+  if (! fsysdep_conn_poll (aqconns, cEactive, afread, iwrite, pfwrite,
+			   ctimeout))
+    return FALSE;
+
+  *pfgot = FALSE;
+  for (i = 0; i < cEactive; i++)
+    {
+      if (afread[i])
+	{
+	  if (! feread_stream (i))
+	    return FALSE;
+	  *pfgot = TRUE;
+	}
+    }
+
+  return TRUE;
+}
+
+/* Pass the data in a stream buffer to fgot_data.  File data for a
+   transfer which has not been set up yet stays where it is; the
+   command which starts the transfer is on the original connection,
+   and may not have been read yet.  Likewise a command waits while
+   the end of an earlier file on the same channel is still on its
+   way over another stream.  If fstop is TRUE, we stop when fewait
+   should return.  */
+
+static boolean
+feprocess_stream (struct sdaemon *qdaemon, int istream, boolean fstop)
+{
+  struct sestream *q;
+  boolean fret;
+
+  q = &asEstreams[istream];
+  if (q->fbusy)
+    return TRUE;
+  q->fbusy = TRUE;
+
+  /* Once we are hanging up, anything more on the original
+     connection belongs to uucico; see ueclose_streams.  */
+  fret = TRUE;
+  while ((! fstop || ! fEexit) && ! qdaemon->fhangup)
+    {
+      size_t c;
+
+      if (q->cleft < 0)
+	{
+	  const unsigned char *pu;
+	  unsigned long ipos;
+
+	  if (q->cend - q->cstart < CECHUNKLEN)
+	    break;
+
+	  pu = (const unsigned char *) q->zbuf + q->cstart;
+	  if (pu[0] != 'C' && pu[0] != 'D')
+	    {
+	      ulog (LOG_ERROR, "Protocol 'e' bad chunk type %d on stream %d",
+		    pu[0], istream);
+	      fret = FALSE;
+	      break;
+	    }
+	  q->fcmd = pu[0] == 'C';
+	  q->ilocal = pu[2];
+	  q->iremote = pu[1];
+
+	  /* The channel numbers are used as array indices by the
+	     transfer code, so they must be within the channels we
+	     agreed on (there are fewer streams than IMAX_CHAN).  File
+	     data must belong to some channel.  */
+	  if (q->ilocal >= cEactive
+	      || q->iremote >= cEactive
+	      || (! q->fcmd && q->ilocal == 0 && q->iremote == 0))
+	    {
+	      ulog (LOG_ERROR,
+		    "Protocol 'e' bad channel %d %d on stream %d",
+		    q->ilocal, q->iremote, istream);
+	      fret = FALSE;
+	      break;
+	    }
+
+	  q->cleft = (((long) pu[4] << 24) | ((long) pu[5] << 16)
+		      | ((long) pu[6] << 8) | (long) pu[7]);
+	  ipos = (((unsigned long) pu[8] << 24) | ((unsigned long) pu[9] << 16)
+		  | ((unsigned long) pu[10] << 8) | (unsigned long) pu[11]);
+	  if (ipos == 0xffffffffUL)
+	    q->ipos = -1;
+	  else
+	    q->ipos = (long) ipos;
+
+	  if (q->cleft == 0 && ! q->fcmd)
+	    {
+	      /* The end of a file.  */
+	      if (! fgot_data_ready (q->ilocal, q->iremote, FALSE))
+		{
+		  q->cleft = -1;
+		  break;
+		}
+	      q->cstart += CECHUNKLEN;
+	      q->cleft = -1;
+	      DEBUG_MESSAGE1 (DEBUG_PROTO,
+			      "feprocess_stream: End of file on stream %d",
+			      istream);
+	      if (! fgot_data (qdaemon, q->zbuf, (size_t) 0,
+			       (const char *) NULL, (size_t) 0,
+			       q->ilocal, q->iremote, q->ipos, TRUE,
+			       &fEexit))
+		{
+		  fret = FALSE;
+		  break;
+		}
+	      continue;
+	    }
+
+	  q->cstart += CECHUNKLEN;
+	}
+
+      c = q->cend - q->cstart;
+      if ((long) c > q->cleft)
+	c = (size_t) q->cleft;
+      if (c == 0)
+	{
+	  if (q->cleft == 0)
+	    {
+	      q->cleft = -1;
+	      continue;
+	    }
+	  break;
+	}
+
+      if (! fgot_data_ready (q->ilocal, q->iremote, q->fcmd))
+	break;
+
+      DEBUG_MESSAGE3 (DEBUG_PROTO,
+		      "feprocess_stream: Got %lu %s bytes on stream %d",
+		      (unsigned long) c, q->fcmd ? "command" : "data",
+		      istream);
+
+      q->cstart += c;
+      q->cleft -= c;
+      ++sPstats.crec_packets;
+      if (! fgot_data (qdaemon, q->zbuf + q->cstart - c, c,
+		       (const char *) NULL, (size_t) 0,
+		       q->ilocal, q->iremote, q->ipos, TRUE, &fEexit))
+	{
+	  fret = FALSE;
+	  break;
+	}
+      if (q->ipos != -1)
+	q->ipos += c;
+      if (q->cleft == 0)
+	q->cleft = -1;
+    }
+
+  q->fbusy = FALSE;
+  return fret;
+}
+
+/* Process all the stream buffers, the original connection first, as
+   long as any progress is made.  */
+
+static boolean
+feprocess_streams (struct sdaemon *qdaemon, boolean fstop)
+{
+  boolean fprogress;
+
+  do
+    {
+      int i;
+
+      fprogress = FALSE;
+      for (i = 0; i < cEactive && (! fstop || ! fEexit); i++)
+	{
+	  size_t cstart;
+	  long cleft;
+
+	  cstart = asEstreams[i].cstart;
+	  cleft = asEstreams[i].cleft;
+	  if (! feprocess_stream (qdaemon, i, fstop))
+	    return FALSE;
+	  if (asEstreams[i].cstart != cstart || asEstreams[i].cleft != cleft)
+	    fprogress = TRUE;
+	}
+    }
+  while (fprogress && (! fstop || ! fEexit));
+
+  return TRUE;
+}
+
+/* Send a chunk over a stream.  If the stream can not take it all at
+   once, read from all the streams while we wait, so that the remote
+   system is never stuck waiting for us to read while we are waiting
+   for it.  We process what we read unless we are in the middle of
+   writing a command; processing data may lead to sending a command,
+   and commands must not be mixed up.  */
+
+static boolean
+fesend_chunk (struct sdaemon *qdaemon, int istream, int bchunk, int ilocal, int iremote, const char *zdata, size_t cdata, long ipos)
+{
+  struct sestream *q;
+  char ab[CECHUNKLEN];
+  unsigned long iupos;
+  struct sconn_iov as[2];
+  int iiov;
+  boolean fgot;
+
+  q = &asEstreams[istream];
+  if (q->fwriting)
+    {
+      ulog (LOG_ERROR, "Protocol 'e' internal error: stream %d busy",
+	    istream);
+      return FALSE;
+    }
+
+  DEBUG_MESSAGE3 (DEBUG_PROTO,
+		  "fesend_chunk: Sending %lu %s bytes on stream %d",
+		  (unsigned long) cdata, bchunk == 'C' ? "command" : "data",
+		  istream);
+
+  iupos = ipos < 0 ? 0xffffffffUL : (unsigned long) ipos;
+  ab[0] = (char) bchunk;
+  ab[1] = (char) ilocal;
+  ab[2] = (char) iremote;
+  ab[3] = 0;
+  ab[4] = (char) ((cdata >> 24) & 0xff);
+  ab[5] = (char) ((cdata >> 16) & 0xff);
+  ab[6] = (char) ((cdata >> 8) & 0xff);
+  ab[7] = (char) (cdata & 0xff);
+  ab[8] = (char) ((iupos >> 24) & 0xff);
+  ab[9] = (char) ((iupos >> 16) & 0xff);
+  ab[10] = (char) ((iupos >> 8) & 0xff);
+  ab[11] = (char) (iupos & 0xff);
+
+  as[0].zbuf = ab;
+  as[0].clen = CECHUNKLEN;
+  as[1].zbuf = zdata;
+  as[1].clen = cdata;
+  iiov = 0;
+
+  /* The streams are written directly, not through fsend_data.  */
+  sPstats.cwire_sent += CECHUNKLEN + cdata;
+
+  q->fwriting = TRUE;
+  while (TRUE)
+    {
+      size_t cdid;
+      boolean fwrite;
+
+      if (! fconn_trywrite (q->qconn, as + iiov, 2 - iiov, &cdid))
+	{
+	  q->fwriting = FALSE;
+	  return FALSE;
+	}
+      while (iiov < 2 && cdid >= as[iiov].clen)
+	{
+	  cdid -= as[iiov].clen;
+	  ++iiov;
+	}
+      if (iiov >= 2)
+	break;
+      as[iiov].zbuf += cdid;
+      as[iiov].clen -= cdid;
+
+      if (! fepoll_streams (istream, &fwrite, cEtimeout, &fgot))
+	{
+	  q->fwriting = FALSE;
+	  return FALSE;
+	}
+      if (! fwrite && ! fgot)
+	{
+	  ulog (LOG_ERROR, "Timed out sending data");
+	  q->fwriting = FALSE;
+	  return FALSE;
+	}
+      if (fgot
+	  && ! asEstreams[0].fwriting
+	  && ! feprocess_streams (qdaemon, FALSE))
+	{
+	  q->fwriting = FALSE;
+	  return FALSE;
+	}
+    }
+  q->fwriting = FALSE;
+
+  /* Look at anything which has come in, so that replies are seen
+     while we are sending a long file.  */
+  if (! fepoll_streams (-1, (boolean *) NULL, 0, &fgot))
+    return FALSE;
+  if (fgot
+      && ! asEstreams[0].fwriting
+      && ! feprocess_streams (qdaemon, FALSE))
+    return FALSE;
+
+  return TRUE;
+}
@@ -117,6 +117,8 @@ struct uuconf_cmdtab asFproto_params[] =
 {
   { "timeout", UUCONF_CMDTABTYPE_INT, (pointer) &cFtimeout, NULL },
   { "retries", UUCONF_CMDTABTYPE_INT, (pointer) &cFmaxretries, NULL },
+  { "receive-buffer", UUCONF_CMDTABTYPE_INT, (pointer) &cPrecbuf_max,
+      NULL },
   { NULL, 0, NULL, NULL }
 };
 
@@ -174,6 +176,10 @@ ffshutdown (struct sdaemon *qdaemon ATTRIBUTE_UNUSED)
 {
   xfree ((pointer) zFbuf);
   zFbuf = NULL;
+  /* A file retry is the closest thing this protocol has to a
+     negative acknowledgement.  */
+  sPstats.cnaks_sent = cFrec_retries;
+  sPstats.cnaks_received = cFsend_retries;
   ulog (LOG_NORMAL,
 	"Protocol 'f': sent %ld bytes for %ld, received %ld bytes for %ld",
 	cFsent_bytes, cFsent_data, cFrec_bytes, cFrec_data);
@@ -203,6 +209,8 @@ ffsendcmd (struct sdaemon *qdaemon, const char *z, int ilocal ATTRIBUTE_UNUSED,
   memcpy (zalc, z, clen);
   zalc[clen] = '\r';
   zalc[clen + 1] = '\0';
+  ++sPstats.csent_packets;
+  sPstats.cdata_sent += clen + 1;
   fret = fsend_data (qdaemon->qconn, zalc, clen + 1, TRUE);
   ubuffree (zalc);
   return fret;
@@ -233,6 +241,8 @@ ffsenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRI
   register unsigned int itmpchk;
       
   cFsent_data += cdata;
+  ++sPstats.csent_packets;
+  sPstats.cdata_sent += cdata;
 
   ze = ab;
   itmpchk = iFcheck;
@@ -338,6 +348,7 @@ ffprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
 		  iPrecstart = (i + 1) % CRECBUFLEN;
 		  if (pcneed != NULL)
 		    *pcneed = 0;
+		  ++sPstats.crec_packets;
 		  return fgot_data (qdaemon, abPrecbuf + istart,
 				    (size_t) (i - istart + 1),
 				    (const char *) NULL, (size_t) 0,
@@ -349,6 +360,7 @@ ffprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
 			  "ffprocess_data: Got %d command bytes",
 			  i - iPrecstart);
 
+	  ++sPstats.crec_packets;
 	  if (! fgot_data (qdaemon, abPrecbuf + iPrecstart,
 			   (size_t) (i - iPrecstart),
 			   (const char *) NULL, (size_t) 0,
@@ -411,6 +423,7 @@ ffprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
 		      /* Don't count the checksum in the received bytes.  */
 		      cFrec_bytes += zfrom - zstart - 2;
 		      cFrec_data += zto - zstart;
+		      ++sPstats.crec_packets;
 		      if (! fgot_data (qdaemon, zstart,
 				       (size_t) (zto - zstart),
 				       (const char *) NULL, (size_t) 0,
@@ -492,6 +505,7 @@ ffprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
 			  (int) (zto - zstart));
 
 	  cFrec_data += zto - zstart;
+	  ++sPstats.crec_packets;
 	  if (! fgot_data (qdaemon, zstart, (size_t) (zto - zstart),
 			   (const char *) NULL, (size_t) 0,
 			   -1, -1, (long) -1, TRUE, pfexit))
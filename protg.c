@@ -172,9 +172,15 @@ const char protg_rcsid[] = "$Id$";
 #define CEXCHANGE_INIT_RETRIES (4)
 
 /* The timeout to use when waiting for a packet.  Protocol parameter
-   ``timeout''.  */
+   ``timeout''.  When we are waiting for an acknowledgement, we
+   normally use a shorter timeout based on the measured round trip
+   time, but never longer than this.  */
 #define CTIMEOUT (10)
 
+/* The smallest timeout to use when waiting for an acknowledgement.
+   Protocol parameter ``min-timeout''.  */
+#define CMIN_TIMEOUT (1)
+
 /* The number of times to retry waiting for a packet.  Each time the
    timeout fails we send a copy of our last data packet or a reject
    message for the packet we expect from the other side, depending on
@@ -254,6 +260,23 @@ static int iGforced_remote_packsize = IREMOTE_PACKSIZE;
 /* Recieved control byte.  */
 static int iGpacket_control;
 
+/* Whether the other side supports selective retransmission
+   (FEATURE_GSRJ).  If it does, we resend just the packet named in an
+   SRJ packet, and the other side may keep packets which arrive after
+   a missing one.  */
+static boolean fGselective;
+
+/* Whether we keep packets which arrive after a missing packet, and
+   send an SRJ for each missing packet rather than an RJ.  We only do
+   this if the other side supports it and our receive window is no
+   larger than CMAXSELWINDOW.  With a larger window we could not tell
+   a new packet from a retransmission of one we have already
+   received, since the sequence numbers are only three bits long.  */
+static boolean fGselective_rec;
+
+/* Largest receive window which permits selective retransmission.  */
+#define CMAXSELWINDOW ((CMAXWINDOW + 1) / 2)
+
 /* Number of times to retry the initial handshake.  Protocol parameter
    ``startup-retries''.  */
 static int cGstartup_retries = CSTARTUP_RETRIES;
@@ -270,6 +293,14 @@ static int cGexchange_init_timeout = CEXCHANGE_INIT_TIMEOUT;
    ``timeout''.  */
 static int cGtimeout = CTIMEOUT;
 
+/* Smallest timeout (seconds) when waiting for an acknowledgement.
+   Protocol parameter ``min-timeout''.  */
+static int cGmin_timeout = CMIN_TIMEOUT;
+
+/* Round trip time estimate, used to choose the timeout when waiting
+   for an acknowledgement.  */
+static struct srtt sGrtt;
+
 /* Maximum number of timeouts when receiving a data packet or
    acknowledgement.  Protocol parameter ``retries''.  */
 static int cGretries = CRETRIES;
@@ -303,6 +334,7 @@ struct uuconf_cmdtab asGproto_params[] =
   { "init-retries", UUCONF_CMDTABTYPE_INT, (pointer) &cGexchange_init_retries,
       NULL },
   { "timeout", UUCONF_CMDTABTYPE_INT, (pointer) &cGtimeout, NULL },
+  { "min-timeout", UUCONF_CMDTABTYPE_INT, (pointer) &cGmin_timeout, NULL },
   { "retries", UUCONF_CMDTABTYPE_INT, (pointer) &cGretries, NULL },
   { "garbage", UUCONF_CMDTABTYPE_INT, (pointer) &cGgarbage_data, NULL },
   { "errors", UUCONF_CMDTABTYPE_INT, (pointer) &cGmax_errors, NULL },
@@ -313,6 +345,8 @@ struct uuconf_cmdtab asGproto_params[] =
       (pointer) &iGforced_remote_packsize, NULL },
   { "short-packets", UUCONF_CMDTABTYPE_BOOLEAN, (pointer) &fGshort_packets,
       NULL },
+  { "receive-buffer", UUCONF_CMDTABTYPE_INT, (pointer) &cPrecbuf_max,
+      NULL },
   { NULL, 0, NULL, NULL }
 };
 
@@ -351,6 +385,17 @@ static long cGremote_rejects;
    and increments this variable.  */
 static long cGremote_duprrs;
 
+/* Number of packets we have resent because the receiver sent an SRJ
+   (these are also counted in cGresent_packets).  */
+static long cGselective_resent;
+
+/* Number of SRJ packets we have sent.  */
+static long cGselective_requests;
+
+/* Number of packets we received out of order and kept until the
+   missing packets arrived.  */
+static long cGselective_kept;
+
 /* The error level.  This is the total number of errors as adjusted by
    cGerror_decay.  */
 static long cGerror_level;
@@ -386,9 +431,19 @@ static boolean fgprocess_data P((struct sdaemon *qdaemon, boolean fdoacks,
 				 boolean *pffound));
 static boolean fginit_sendbuffers P((boolean fallocate));
 static boolean fgcheck_errors P((struct sdaemon *qdaemon));
-static int igchecksum P((const char *zdata, size_t clen));
-static int igchecksum2 P((const char *zfirst, size_t cfirst,
-			  const char *zsecond, size_t csecond));
+static void ugfree_recbuffers P((void));
+static boolean fgsave_packet P((int icontrol, const char *zfirst,
+				int cfirst, const char *zsecond,
+				int csecond));
+static boolean fgsend_srjs P((struct sdaemon *qdaemon, boolean fagain,
+			      boolean *pfsent));
+static boolean fgdeliver P((struct sdaemon *qdaemon, int icontrol,
+			    const char *zfirst, int cfirst,
+			    const char *zsecond, int csecond,
+			    boolean fdoacks, boolean *pffound,
+			    boolean *pfexit));
+static boolean fgdeliver_saved P((struct sdaemon *qdaemon, boolean fdoacks,
+				  boolean *pffound, boolean *pfexit));
 
 /* Start the protocol.  This requires a three way handshake.  Both sides
    must send and receive an INITA packet, an INITB packet, and an INITC
@@ -423,9 +478,17 @@ fgstart (struct sdaemon *qdaemon, char **pzlog)
   cGbad_order = 0;
   cGremote_rejects = 0;
   cGremote_duprrs = 0;
+  cGselective_resent = 0;
+  cGselective_requests = 0;
+  cGselective_kept = 0;
   cGerror_level = 0;
   cGexpect_bad_order = 0;
 
+  fGselective = (qdaemon->ifeatures & FEATURE_GSRJ) != 0;
+  ugfree_recbuffers ();
+
+  urtt_init (&sGrtt, cGmin_timeout, cGtimeout);
+
   /* We must determine the segment size based on the packet size
      which may have been modified by a protocol parameter command.
      A segment size of 2^n is passed as n - 5.  */
@@ -451,6 +514,13 @@ fgstart (struct sdaemon *qdaemon, char **pzlog)
       iGrequest_winsize = IWINDOW;
     }
 
+  fGselective_rec = fGselective && iGrequest_winsize <= CMAXSELWINDOW;
+
+  DEBUG_MESSAGE2 (DEBUG_PROTO,
+		  "fgstart: Selective retransmission: send %s, receive %s",
+		  fGselective ? "yes" : "no",
+		  fGselective_rec ? "yes" : "no");
+
   fgota = FALSE;
   fgotb = FALSE;
   for (i = 0; i < cGstartup_retries; i++)
@@ -489,9 +559,13 @@ fgstart (struct sdaemon *qdaemon, char **pzlog)
       iGremote_packsize = 1 << (iGremote_segsize + 5);
 
       /* If the user requested us to force specific remote window and
-	 packet sizes, do so now.  */
+	 packet sizes, do so now.  If the other side supports
+	 selective retransmission, it may be relying on us not to
+	 exceed the window it asked for, so we never force a larger
+	 one.  */
       if (iGforced_remote_winsize > 0
-	  && iGforced_remote_winsize <= CMAXWINDOW)
+	  && iGforced_remote_winsize <= CMAXWINDOW
+	  && (! fGselective || iGforced_remote_winsize <= iGremote_winsize))
 	iGremote_winsize = iGforced_remote_winsize;
 
       if (iGforced_remote_packsize >= 32
@@ -686,6 +760,10 @@ fgshutdown (struct sdaemon *qdaemon)
      them may have not been sent yet if the connection failed in the
      middle (the ones that counted for cGdelayed_packets).  I don't
      think it's worth being precise.  */
+  sPstats.csent_packets = cGsent_packets;
+  sPstats.cresent_packets = cGresent_packets - cGdelayed_packets;
+  sPstats.crec_packets = cGrec_packets;
+  sPstats.cnaks_received = cGremote_rejects + cGremote_duprrs;
   ulog (LOG_NORMAL,
 	"Protocol '%c' packets: sent %ld, resent %ld, received %ld",
 	qdaemon->qproto->bname, cGsent_packets,
@@ -699,6 +777,16 @@ fgshutdown (struct sdaemon *qdaemon)
 	  "Errors: header %ld, checksum %ld, order %ld, remote rejects %ld",
 	  cGbad_hdr, cGbad_checksum, cGbad_order,
 	  cGremote_duprrs + cGremote_rejects);
+  if (cGselective_resent != 0
+      || cGselective_requests != 0
+      || cGselective_kept != 0)
+    ulog (LOG_NORMAL,
+	  "Selective retransmission: resent %ld, requested %ld, kept %ld",
+	  cGselective_resent, cGselective_requests, cGselective_kept);
+
+  ugfree_recbuffers ();
+  fGselective = FALSE;
+  fGselective_rec = FALSE;
 
   /* Reset all the parameters to their default values, so that the
      protocol parameters used for this connection do not affect the
@@ -709,6 +797,7 @@ fgshutdown (struct sdaemon *qdaemon)
   cGexchange_init_timeout = CEXCHANGE_INIT_TIMEOUT;
   cGexchange_init_retries = CEXCHANGE_INIT_RETRIES;
   cGtimeout = CTIMEOUT;
+  cGmin_timeout = CMIN_TIMEOUT;
   cGretries = CRETRIES;
   cGgarbage_data = CGARBAGE;
   cGmax_errors = CERRORS;
@@ -833,6 +922,117 @@ fginit_sendbuffers (boolean fallocate)
   return TRUE;
 }
 
+/* When selective retransmission is in use, we keep packets which
+   arrive after a missing packet until the missing packet has been
+   resent.  As with the send buffers, there is one buffer for each
+   sequence number.  aiGrecsaved holds the control byte of the packet
+   kept in each buffer, or -1 if there is none.  afGrequested records
+   whether we have sent an SRJ for a missing packet, so that we don't
+   ask for it every time another packet arrives.  The buffers are
+   allocated when first needed.  */
+
+static char *azGrecbuffers[CSENDBUFFERS];
+static int acGreclen[CSENDBUFFERS];
+static int aiGrecsaved[CSENDBUFFERS];
+static boolean afGrequested[CSENDBUFFERS];
+
+static void
+ugfree_recbuffers (void)
+{
+  int i;
+
+  for (i = 0; i < CSENDBUFFERS; i++)
+    {
+      xfree ((pointer) azGrecbuffers[i]);
+      azGrecbuffers[i] = NULL;
+      aiGrecsaved[i] = -1;
+      afGrequested[i] = FALSE;
+    }
+}
+
+/* Keep a packet which arrived out of order.  This returns FALSE if
+   the packet could not be kept, in which case the caller should treat
+   it as the classic protocol does.  */
+
+static boolean
+fgsave_packet (int icontrol, const char *zfirst, int cfirst, const char *zsecond, int csecond)
+{
+  int iseq;
+
+  iseq = CONTROL_XXX (icontrol);
+
+  if (aiGrecsaved[iseq] != -1)
+    {
+      DEBUG_MESSAGE1 (DEBUG_PROTO | DEBUG_ABNORMAL,
+		      "fgsave_packet: Already have packet %d", iseq);
+      return TRUE;
+    }
+
+  if (cfirst + csecond > CMAXDATA)
+    return FALSE;
+
+  if (azGrecbuffers[iseq] == NULL)
+    {
+      azGrecbuffers[iseq] = (char *) malloc (CMAXDATA);
+      if (azGrecbuffers[iseq] == NULL)
+	return FALSE;
+    }
+
+  memcpy (azGrecbuffers[iseq], zfirst, (size_t) cfirst);
+  if (csecond > 0)
+    memcpy (azGrecbuffers[iseq] + cfirst, zsecond, (size_t) csecond);
+  acGreclen[iseq] = cfirst + csecond;
+  aiGrecsaved[iseq] = icontrol;
+  afGrequested[iseq] = FALSE;
+  ++cGselective_kept;
+
+  DEBUG_MESSAGE2 (DEBUG_PROTO | DEBUG_ABNORMAL,
+		  "fgsave_packet: Keeping packet %d; expected %d",
+		  iseq, INEXTSEQ (iGrecseq));
+
+  return TRUE;
+}
+
+/* Send an SRJ for each missing packet before the last packet we have
+   kept.  If fagain is FALSE, skip packets we have already asked for.
+   If pfsent is not NULL, set *pfsent to whether any SRJ was sent.  */
+
+static boolean
+fgsend_srjs (struct sdaemon *qdaemon, boolean fagain, boolean *pfsent)
+{
+  int clast, i;
+
+  if (pfsent != NULL)
+    *pfsent = FALSE;
+
+  clast = 0;
+  for (i = 2; i <= iGrequest_winsize; i++)
+    if (aiGrecsaved[(iGrecseq + i) & 07] != -1)
+      clast = i;
+
+  for (i = 1; i < clast; i++)
+    {
+      int iseq;
+
+      iseq = (iGrecseq + i) & 07;
+      if (aiGrecsaved[iseq] != -1
+	  || (afGrequested[iseq] && ! fagain))
+	continue;
+
+      DEBUG_MESSAGE1 (DEBUG_PROTO | DEBUG_ABNORMAL,
+		      "fgsend_srjs: Asking for packet %d", iseq);
+
+      if (! fgsend_control (qdaemon, SRJ, iseq))
+	return FALSE;
+      afGrequested[iseq] = TRUE;
+      ++cGselective_requests;
+      if (pfsent != NULL)
+	*pfsent = TRUE;
+    }
+
+  return TRUE;
+}
+
 /* Allocate a packet to send out.  The return value of this function
    must be filled in and passed to fgsenddata, or discarded.  This
    will ensure that the buffers and iGsendseq stay in synch.  Set
@@ -859,6 +1059,9 @@ fgsenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRI
   size_t csize;
   int iclr1, iclr2;
   unsigned short icheck;
+  boolean fwaited;
+
+  sPstats.cdata_sent += cdata;
 
   /* Set the initial length bytes.  See the description at the definition
      of SHORTDATA, above.  */
@@ -941,9 +1144,15 @@ fgsenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRI
      sequence numbers are actually 8 apart, since the packet could not
      have been acknowledged before it was sent; this can happen when
      the window size is 7.  */
+  fwaited = FALSE;
   while (iGsendseq == iGremote_ack
 	 || CSEQDIFF (iGsendseq, iGremote_ack) > iGremote_winsize)
     {
+      if (! fwaited)
+	{
+	  ++sPstats.cwindow_full;
+	  fwaited = TRUE;
+	}
       if (! fgwait_for_packet (qdaemon, TRUE, cGtimeout, cGretries))
 	return FALSE;
     }
@@ -986,6 +1195,8 @@ fgsenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRI
 		  "fgsenddata: Sending packet %d (%d bytes)",
 		  CONTROL_XXX (z[IFRAME_CONTROL]), (int) cdata);
 
+  urtt_start (&sGrtt, CONTROL_XXX (z[IFRAME_CONTROL]));
+
   return fsend_data (qdaemon->qconn, z, CFRAMELEN + csize, TRUE);
 }
 
@@ -994,7 +1205,8 @@ fgsenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRI
    packet is retransmitted to make sure the retransmission does not
    confuse the other side.  It returns a pointer to the start of the
    packet, skipping the bytes that may be unused at the start of
-   azGsendbuffers[iseq].  */
+   azGsendbuffers[iseq].  Since an ack may be for either copy of a
+   resent packet, we stop timing the round trip.  */
 
 static char *
 zgadjust_ack (int iseq)
@@ -1002,6 +1214,8 @@ zgadjust_ack (int iseq)
   register char *z;
   unsigned short icheck;
 
+  urtt_cancel (&sGrtt);
+
   z = azGsendbuffers[iseq];
   if (*z == '\0')
     ++z;
@@ -1055,6 +1269,9 @@ fgsend_control (struct sdaemon *qdaemon, int ixxx, int iyyy)
 	  azGcontrol[ixxx], iyyy);
 #endif
 
+  if (ixxx == RJ || ixxx == SRJ)
+    ++sPstats.cnaks_sent;
+
   ab[IFRAME_DLE] = DLE;
   ab[IFRAME_K] = KCONTROL;
 
@@ -1106,6 +1323,7 @@ fgwait_for_packet (struct sdaemon *qdaemon, boolean freturncontrol, int ctimeout
       size_t cneed = 0;
       boolean ffound;
       size_t crec;
+      boolean fadaptive;
   
       if (! fgprocess_data (qdaemon, TRUE, freturncontrol, &fexit,
 			    &cneed, &ffound))
@@ -1132,7 +1350,19 @@ fgwait_for_packet (struct sdaemon *qdaemon, boolean freturncontrol, int ctimeout
 	    }
 	}
 
-      if (! freceive_data (qdaemon->qconn, cneed, &crec, ctimeout, TRUE))
+      /* If we are waiting for an acknowledgement, use the timeout
+	 based on the round trip time, if it is shorter.  Timeouts
+	 which are shorter than requested only back off the round trip
+	 time estimate; they don't count against the retries.  We only
+	 do this if the other side supports selective retransmission,
+	 since older systems don't acknowledge a duplicate packet,
+	 and would only respond when their own timeout expired.  */
+      fadaptive = (fGselective
+		   && INEXTSEQ (iGremote_ack) != iGsendseq
+		   && sGrtt.ctimeout < ctimeout);
+
+      if (! freceive_data (qdaemon->qconn, cneed, &crec,
+			   fadaptive ? sGrtt.ctimeout : ctimeout, TRUE))
 	return FALSE;
 
       cgarbage += crec;
@@ -1162,12 +1392,17 @@ fgwait_for_packet (struct sdaemon *qdaemon, boolean freturncontrol, int ctimeout
 	  /* The read timed out.  If we have an unacknowledged packet,
 	     send it again.  Otherwise, send an RJ with the last
 	     packet we received correctly.  */
-	  ++ctimeouts;
-	  if (ctimeouts > cretries)
+	  if (fadaptive)
+	    urtt_backoff (&sGrtt);
+	  else
 	    {
-	      if (cretries > 0)
-		ulog (LOG_ERROR, "Timed out waiting for packet");
-	      return FALSE;
+	      ++ctimeouts;
+	      if (ctimeouts > cretries)
+		{
+		  if (cretries > 0)
+		    ulog (LOG_ERROR, "Timed out waiting for packet");
+		  return FALSE;
+		}
 	    }
 
 	  if (INEXTSEQ (iGremote_ack) != iGsendseq)
@@ -1190,6 +1425,8 @@ fgwait_for_packet (struct sdaemon *qdaemon, boolean freturncontrol, int ctimeout
 	    }
 	  else
 	    {
+	      boolean fsent;
+
 	      /* Send all pending acks first, to avoid confusing
 		 the other side.  */
 	      if (iGlocal_ack != iGrecseq)
@@ -1197,8 +1434,20 @@ fgwait_for_packet (struct sdaemon *qdaemon, boolean freturncontrol, int ctimeout
 		  if (! fgsend_acks (qdaemon))
 		    return FALSE;
 		}
-	      if (! fgsend_control (qdaemon, RJ, iGrecseq))
-		return FALSE;
+
+	      /* If we are keeping out of order packets, ask again for
+		 the missing ones.  Otherwise send an RJ.  */
+	      fsent = FALSE;
+	      if (fGselective_rec)
+		{
+		  if (! fgsend_srjs (qdaemon, TRUE, &fsent))
+		    return FALSE;
+		}
+	      if (! fsent)
+		{
+		  if (! fgsend_control (qdaemon, RJ, iGrecseq))
+		    return FALSE;
+		}
 	    }
 	}
     }
@@ -1245,6 +1494,14 @@ fggot_ack (struct sdaemon *qdaemon, int iack)
   if (iack < iGremote_ack)
     uwindow_acked (qdaemon, FALSE);
 
+  /* If this acknowledges the packet we are timing, update the round
+     trip time estimate.  */
+  if (sGrtt.iseq != -1
+      && sGrtt.iseq != iGremote_ack
+      && (CSEQDIFF (sGrtt.iseq, iGremote_ack)
+	  <= CSEQDIFF (iack, iGremote_ack)))
+    urtt_sample (&sGrtt);
+
   iGremote_ack = iack;
 
   if (iGretransmit_seq == -1)
@@ -1325,6 +1582,21 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
   if (pffound != NULL)
     *pffound = FALSE;
 
+  /* If we kept packets which are now in order, but were told to exit
+     before we could pass them on, do so now.  */
+  if (fGselective_rec && aiGrecsaved[INEXTSEQ (iGrecseq)] != -1)
+    {
+      if (! fgdeliver_saved (qdaemon, fdoacks, pffound, pfexit))
+	return FALSE;
+      if (*pfexit)
+	return TRUE;
+      if (freturncontrol)
+	{
+	  *pfexit = TRUE;
+	  return TRUE;
+	}
+    }
+
   while (iPrecstart != iPrecend)
     {
       char ab[CFRAMELEN];
@@ -1341,7 +1613,12 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
 
 	  cfirst = iPrecend - iPrecstart;
 	  if (cfirst < 0)
-	    cfirst = CRECBUFLEN - iPrecstart;
+	    {
+	      if (fPrecmirror)
+		cfirst += CRECBUFLEN;
+	      else
+		cfirst = CRECBUFLEN - iPrecstart;
+	    }
 
 	  zdle = memchr (abPrecbuf + iPrecstart, DLE, (size_t) cfirst);
 
@@ -1351,9 +1628,10 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
 	      continue;
 	    }
 
-	  /* We don't need % CRECBUFLEN here because zdle - (abPrecbuf
-	     + iPrecstart) < cfirst <= CRECBUFLEN - iPrecstart.  */
-	  iPrecstart += zdle - (abPrecbuf + iPrecstart);
+	  /* If the buffer is mirrored, zdle may be in the second copy,
+	     so we need % CRECBUFLEN here.  */
+	  iPrecstart = ((iPrecstart + (zdle - (abPrecbuf + iPrecstart)))
+			% CRECBUFLEN);
 	}
 
       /* Get the first six bytes into ab.  */
@@ -1404,7 +1682,8 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
 
       /* The zfirst and cfirst pair point to the first set of data for
 	 this packet; the zsecond and csecond point to the second set,
-	 in case the packet wraps around the end of the buffer.  */
+	 in case the packet wraps around the end of the buffer.  If the
+	 buffer is mirrored, the packet never wraps.  */
       zfirst = abPrecbuf + iPrecstart + CFRAMELEN;
       cfirst = 0;
       zsecond = NULL;
@@ -1469,7 +1748,7 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
 	    }
 	  
 	  /* Set up the data pointers and compute the checksum.  */
-	  if (iPrecend >= iPrecstart)
+	  if (iPrecend >= iPrecstart || fPrecmirror)
 	    cfirst = cwant;
 	  else
 	    {
@@ -1537,8 +1816,26 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
 		}
 
 	      /* If this is the packet we wanted, tell the sender that
-		 it failed.  */
-	      if (CONTROL_XXX (ab[IFRAME_CONTROL]) == INEXTSEQ (iGrecseq))
+		 it failed.  If we are keeping out of order packets,
+		 ask for just this packet, whether or not it is the
+		 one we wanted.  */
+	      if (fGselective_rec)
+		{
+		  int iseq, cdiff;
+
+		  iseq = CONTROL_XXX (ab[IFRAME_CONTROL]);
+		  cdiff = CSEQDIFF (iseq, iGrecseq);
+		  if (cdiff >= 1
+		      && cdiff <= iGrequest_winsize
+		      && aiGrecsaved[iseq] == -1)
+		    {
+		      if (! fgsend_control (qdaemon, SRJ, iseq))
+			return FALSE;
+		      afGrequested[iseq] = TRUE;
+		      ++cGselective_requests;
+		    }
+		}
+	      else if (CONTROL_XXX (ab[IFRAME_CONTROL]) == INEXTSEQ (iGrecseq))
 		{
 		  if (! fgsend_control (qdaemon, RJ, iGrecseq))
 		    return FALSE;
@@ -1563,9 +1860,12 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
       /* Annoyingly, some UUCP packages appear to send an RR packet
 	 rather than an RJ packet when they want a packet to be
 	 resent.  If we get a duplicate RR and we've never seen an RJ,
-	 we treat the RR as an RJ.  */
+	 we treat the RR as an RJ.  A system which supports selective
+	 retransmission sends a duplicate RR when it sees a duplicate
+	 packet, so we don't do this for one.  */
       fduprr = FALSE;
       if (cGremote_rejects == 0
+	  && ! fGselective
 	  && CONTROL_TT (ab[IFRAME_CONTROL]) == CONTROL
 	  && CONTROL_XXX (ab[IFRAME_CONTROL]) == RR
 	  && iGremote_ack == CONTROL_YYY (ab[IFRAME_CONTROL])
@@ -1596,6 +1896,31 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
 	{
 	  if (CONTROL_XXX (ab[IFRAME_CONTROL]) != INEXTSEQ (iGrecseq))
 	    {
+	      /* If we are keeping out of order packets, and this
+		 packet is within the window, keep it and ask for the
+		 packets we missed.  */
+	      if (fGselective_rec)
+		{
+		  int cdiff;
+
+		  cdiff = CSEQDIFF (CONTROL_XXX (ab[IFRAME_CONTROL]),
+				    iGrecseq);
+		  if (cdiff > 1
+		      && cdiff <= iGrequest_winsize
+		      && fgsave_packet (ab[IFRAME_CONTROL] & 0xff,
+					zfirst, cfirst, zsecond, csecond))
+		    {
+		      if (iGrecseq != iGlocal_ack)
+			{
+			  if (! fgsend_acks (qdaemon))
+			    return FALSE;
+			}
+		      if (! fgsend_srjs (qdaemon, FALSE, (boolean *) NULL))
+			return FALSE;
+		      continue;
+		    }
+		}
+
 	      /* We got the wrong packet number.  */
 	      DEBUG_MESSAGE2 (DEBUG_PROTO | DEBUG_ABNORMAL,
 			      "fgprocess_data: Got packet %d; expected %d",
@@ -1616,98 +1941,31 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
 		 side to get back in synch, but that may confuse some
 		 Telebit modems and does little good in any case,
 		 since the other side will probably just ignore it
-		 anyhow (that's what this code does).  */
+		 anyhow (that's what this code does).  However, if the
+		 other side supports selective retransmission, it
+		 expects an RR, since it may be resending the packet
+		 because our ack was lost.  */
+	      if (fGselective)
+		{
+		  if (iGrecseq != iGlocal_ack)
+		    {
+		      if (! fgsend_acks (qdaemon))
+			return FALSE;
+		    }
+		  else if (! fgsend_control (qdaemon, RR, iGrecseq))
+		    return FALSE;
+		}
 	      continue;
 	    }
 
 	  /* We got the packet we expected.  */
-	  ++cGrec_packets;
-	  if (cGerror_level > 0
-	      && cGrec_packets % cGerror_decay == 0)
-	    --cGerror_level;
-	  cGexpect_bad_order = 0;
-
-	  iGrecseq = INEXTSEQ (iGrecseq);
-
-	  DEBUG_MESSAGE1 (DEBUG_PROTO,
-			  "fgprocess_data: Got packet %d", iGrecseq);
-
-	  /* Tell the caller that we found something.  */
-	  if (pffound != NULL)
-	    *pffound = TRUE;
-
-	  /* If we are supposed to do acknowledgements here, send back
-	     an RR packet.  */
-	  if (fdoacks)
-	    {
-	      if (! fgsend_acks (qdaemon))
-		return FALSE;
-	    }
-
-	  /* If this is a short data packet, adjust the data pointers
-	     and lengths.  */
-	  if (CONTROL_TT (ab[IFRAME_CONTROL]) == SHORTDATA)
-	    {
-	      int cshort, cmove;
-
-	      if ((zfirst[0] & 0x80) == 0)
-		{
-		  cshort = zfirst[0] & 0xff;
-		  cmove = 1;
-		}
-	      else
-		{
-		  int cbyte2;
-
-		  if (cfirst > 1)
-		    cbyte2 = zfirst[1] & 0xff;
-		  else
-		    cbyte2 = zsecond[0] & 0xff;
-		  cshort = (zfirst[0] & 0x7f) + (cbyte2 << 7);
-		  cmove = 2;
-		}
-
-	      DEBUG_MESSAGE1 (DEBUG_PROTO,
-			      "fgprocess_data: Packet short by %d",
-			      cshort);
-
-	      /* Adjust the start of the buffer for the bytes used
-		 by the count.  */
-	      if (cfirst > cmove)
-		{
-		  zfirst += cmove;
-		  cfirst -= cmove;
-		}
-	      else
-		{
-		  zfirst = zsecond + (cmove - cfirst);
-		  cfirst = csecond - (cmove - cfirst);
-		  csecond = 0;
-		}
-
-	      /* Adjust the length of the buffer for the bytes we are
-		 not supposed to consider.  */
-	      cshort -= cmove;
-	      if (csecond >= cshort)
-		csecond -= cshort;
-	      else
-		{
-		  cfirst -= cshort - csecond;
-		  csecond = 0;
-		}
-
-#if DEBUG > 0
-	      /* This should not happen, but just in case.  */
-	      if (cfirst < 0)
-		cfirst = 0;
-#endif
-	    }
+	  if (! fgdeliver (qdaemon, ab[IFRAME_CONTROL] & 0xff,
+			   zfirst, cfirst, zsecond, csecond,
+			   fdoacks, pffound, pfexit))
+	    return FALSE;
 
-	  if (! fgot_data (qdaemon, zfirst, (size_t) cfirst,
-			   zsecond, (size_t) csecond,
-			   -1, -1, (long) -1,
-			   INEXTSEQ (iGremote_ack) == iGsendseq,
-			   pfexit))
+	  /* Pass on any kept packets which are now in order.  */
+	  if (! fgdeliver_saved (qdaemon, fdoacks, pffound, pfexit))
 	    return FALSE;
 
 	  /* If fgot_data told us that we were finished, get out.  */
@@ -1786,18 +2044,35 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
 	    }
 	  break;
 	case SRJ:
-	  /* Selectively reject a particular packet.  This is not used
-	     by UUCP, but it's easy to support.  */
+	  /* Selectively reject a particular packet.  This is only sent
+	     if both sides support selective retransmission, but it's
+	     easy to support in any case.  We resend just the named
+	     packet, and only if it has not yet been acknowledged.  */
 	  DEBUG_MESSAGE1 (DEBUG_PROTO | DEBUG_ABNORMAL,
 			  "fgprocess_data: Selective reject of %d",
 			  CONTROL_YYY (ab[IFRAME_CONTROL]));
 	  {
+	    int iseq;
 	    char *zpack;
 
+	    iseq = CONTROL_YYY (ab[IFRAME_CONTROL]);
+	    if (iseq == iGremote_ack
+		|| (CSEQDIFF (iseq, iGremote_ack)
+		    >= CSEQDIFF (iGsendseq, iGremote_ack)))
+	      {
+		DEBUG_MESSAGE1 (DEBUG_PROTO | DEBUG_ABNORMAL,
+				"fgprocess_data: Packet %d not outstanding",
+				iseq);
+		break;
+	      }
+
 	    ++cGresent_packets;
+	    ++cGselective_resent;
 	    ++cGremote_rejects;
 	    ++cGerror_level;
-	    zpack = zgadjust_ack (CONTROL_YYY (ab[IFRAME_CONTROL]));
+	    if (! fgcheck_errors (qdaemon))
+	      return FALSE;
+	    zpack = zgadjust_ack (iseq);
 	    if (! fsend_data (qdaemon->qconn, zpack,
 			      CFRAMELEN + CPACKLEN (zpack),
 			      TRUE))
@@ -1827,102 +2102,132 @@ fgprocess_data (struct sdaemon *qdaemon, boolean fdoacks, boolean freturncontrol
   return TRUE;
 }
 
-/* Compute the 'g' protocol checksum.  This is unfortunately rather
-   awkward.  This is the most time consuming code in the entire
-   program.  It's also not a great checksum, since it can be fooled
-   by some single bit errors.  */
-
-/* Sorry about this knavery, but it speeds up the VAX code
-   significantly.  It would be better to rewrite the whole routine in
-   assembler.  */
-#ifdef __GNUC__
-#ifdef __vax__
-#define VAX_ASM 1
-#endif
-#endif
-
-#if VAX_ASM
-#define ROTATE(i) \
-  asm ("cvtwl %1,%0\n\trotl $1,%0,%0" : "=g" (i) : "g" (i))
-#else
-#define ROTATE(i) i += i + ((i & 0x8000) >> 15)
-#endif
+/* Pass the data of the packet we expected on to fgot_data.  The
+   arguments are as for fgprocess_data, with icontrol being the
+   control byte of the packet and zfirst, cfirst, zsecond and csecond
+   describing its data.  */
 
-#define ITERATION \
-      /* Rotate ichk1 left.  */ \
-      ROTATE (ichk1); \
- \
-      /* The guts of the checksum.  */ \
-      b = BUCHAR (*z++); \
-      if (b != 0) \
-	{ \
-	  ichk1 &= 0xffff; \
-	  ichk1 += b; \
-	  ichk2 += ichk1 ^ c; \
-	  if ((ichk1 >> 16) != 0) \
-	    ichk1 ^= ichk2; \
-	} \
-      else \
-	{ \
-	  ichk2 += ichk1 ^ c; \
-	  ichk1 ^= ichk2; \
-	} \
- \
-      --c
-
-static int
-igchecksum (register const char *z, register size_t c)
+static boolean
+fgdeliver (struct sdaemon *qdaemon, int icontrol, const char *zfirst, int cfirst, const char *zsecond, int csecond, boolean fdoacks, boolean *pffound, boolean *pfexit)
 {
-  register unsigned long ichk1, ichk2;
+  ++cGrec_packets;
+  if (cGerror_level > 0
+      && cGrec_packets % cGerror_decay == 0)
+    --cGerror_level;
+  cGexpect_bad_order = 0;
 
-  ichk1 = 0xffff;
-  ichk2 = 0;
+  iGrecseq = INEXTSEQ (iGrecseq);
+  afGrequested[iGrecseq] = FALSE;
 
-  do
-    {
-      register unsigned int b;
+  DEBUG_MESSAGE1 (DEBUG_PROTO,
+		  "fgdeliver: Got packet %d", iGrecseq);
 
-      ITERATION;
-      ITERATION;
-      ITERATION;
-      ITERATION;
+  /* Tell the caller that we found something.  */
+  if (pffound != NULL)
+    *pffound = TRUE;
+
+  /* If we are supposed to do acknowledgements here, send back
+     an RR packet.  */
+  if (fdoacks)
+    {
+      if (! fgsend_acks (qdaemon))
+	return FALSE;
     }
-  while (c > 0);
 
-  return ichk1 & 0xffff;
-}
+  /* If this is a short data packet, adjust the data pointers
+     and lengths.  */
+  if (CONTROL_TT (icontrol) == SHORTDATA)
+    {
+      int cshort, cmove;
 
-/* We use a separate function compute the checksum if the block is
-   split around the end of the receive buffer since it occurs much
-   less frequently and the checksum is already high up in the
-   profiles.  These functions are almost identical, and this one
-   actually only has a few more instructions in the inner loop.  */
+      if ((zfirst[0] & 0x80) == 0)
+	{
+	  cshort = zfirst[0] & 0xff;
+	  cmove = 1;
+	}
+      else
+	{
+	  int cbyte2;
 
-static int
-igchecksum2 (const char *zfirst, size_t cfirst, const char *zsecond, size_t csecond)
-{
-  register unsigned long ichk1, ichk2;
-  register const char *z;
-  register size_t c;
+	  if (cfirst > 1)
+	    cbyte2 = zfirst[1] & 0xff;
+	  else
+	    cbyte2 = zsecond[0] & 0xff;
+	  cshort = (zfirst[0] & 0x7f) + (cbyte2 << 7);
+	  cmove = 2;
+	}
 
-  z = zfirst;
-  c = cfirst + csecond;
+      DEBUG_MESSAGE1 (DEBUG_PROTO,
+		      "fgdeliver: Packet short by %d",
+		      cshort);
 
-  ichk1 = 0xffff;
-  ichk2 = 0;
+      /* Adjust the start of the buffer for the bytes used
+	 by the count.  */
+      if (cfirst > cmove)
+	{
+	  zfirst += cmove;
+	  cfirst -= cmove;
+	}
+      else
+	{
+	  zfirst = zsecond + (cmove - cfirst);
+	  cfirst = csecond - (cmove - cfirst);
+	  csecond = 0;
+	}
 
-  do
+      /* Adjust the length of the buffer for the bytes we are
+	 not supposed to consider.  */
+      cshort -= cmove;
+      if (csecond >= cshort)
+	csecond -= cshort;
+      else
+	{
+	  cfirst -= cshort - csecond;
+	  csecond = 0;
+	}
+
+#if DEBUG > 0
+      /* This should not happen, but just in case.  */
+      if (cfirst < 0)
+	cfirst = 0;
+#endif
+    }
+
+  if (! fgot_data (qdaemon, zfirst, (size_t) cfirst,
+		   zsecond, (size_t) csecond,
+		   -1, -1, (long) -1,
+		   INEXTSEQ (iGremote_ack) == iGsendseq,
+		   pfexit))
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Pass on any packets we kept which are now in order.  This stops if
+   fgot_data sets *pfexit; the remaining packets will be passed on by
+   the next call to fgprocess_data.  */
+
+static boolean
+fgdeliver_saved (struct sdaemon *qdaemon, boolean fdoacks, boolean *pffound, boolean *pfexit)
+{
+  while (fGselective_rec && ! *pfexit)
     {
-      register unsigned int b;
+      int iseq, icontrol;
 
-      ITERATION;
+      iseq = INEXTSEQ (iGrecseq);
+      icontrol = aiGrecsaved[iseq];
+      if (icontrol == -1)
+	break;
+      aiGrecsaved[iseq] = -1;
 
-      /* If the first buffer has been finished, switch to the second.  */
-      --cfirst;
-      if (cfirst == 0)
-	z = zsecond;
+      DEBUG_MESSAGE1 (DEBUG_PROTO, "fgdeliver_saved: Using kept packet %d",
+		      iseq);
+
+      if (! fgdeliver (qdaemon, icontrol, azGrecbuffers[iseq],
+		       acGreclen[iseq], (const char *) NULL, 0,
+		       fdoacks, pffound, pfexit))
+	return FALSE;
     }
-  while (c > 0);
 
-  return ichk1 & 0xffff;
+  return TRUE;
 }
@@ -66,6 +66,23 @@ const char proti_rcsid[] = "$Id$";
    If the data length is not 0, this is followed by the data and a 32
    bit CRC checksum.
 
+   If both sides support it (FEATURE_IWIDE), the 'i' protocol uses a
+   wide header instead, which permits much larger windows and
+   packets:
+
+   Intro byte           8 bits          byte 1
+   Packet number       16 bits          bytes 2-3
+   Packet ack          16 bits          bytes 4-5
+   Local channel        3 bits          byte 6
+   Remote channel       3 bits
+   Packet type          3 bits          byte 7
+   Direction            1 bit
+   Data length         16 bits          bytes 8-9
+   Header check         8 bits          byte 10
+
+   The header check is the exclusive or of all the bytes between the
+   intro byte and the header check, in either case.
+
    The following packet types are defined:
 
    SYNC  Initialize the connection
@@ -75,7 +92,7 @@ const char proti_rcsid[] = "$Id$";
    SPOS  Set file position
    CLOSE Close the connection
    */
-
+
 /* The offsets of the bytes in the packet header.  */
 
 #define IHDR_INTRO (0)
@@ -98,24 +115,60 @@ const char proti_rcsid[] = "$Id$";
 #define FHDRCON_GETCALLER(i1, i2) (((i1) & (1 << 4)) != 0)
 #define CHDRCON_GETBYTES(i1, i2) ((((i1) & 0x0f) << 8) | ((i2) & 0xff))
 
-/* Macros for the IHDR_CHECK field.  */
-#define IHDRCHECK_VAL(qdaemon, zhdr)				\
-  (((zhdr[IHDR_LOCAL]						\
-     ^ zhdr[IHDR_REMOTE]					\
-     ^ zhdr[IHDR_CONTENTS1]					\
-     ^ zhdr[IHDR_CONTENTS2])					\
-    & 0xff)							\
-   ^ ((qdaemon->ifeatures & FEATURE_ICOMPL)			\
-      ? 0xff							\
-      : 0))
-
-/* Length of the packet header.  */
-#define CHDRLEN (6)
+/* The offsets of the bytes in a wide packet header.  */
+
+#define IWHDR_LOCAL (1)
+#define IWHDR_REMOTE (3)
+#define IWHDR_CHANS (5)
+#define IWHDR_TYPE (6)
+#define IWHDR_BYTES (7)
+#define IWHDR_CHECK (9)
+
+/* Macros to get and set a two byte value in a wide packet header.  */
+#define IWHDR_GET16(z) ((((z)[0] & 0xff) << 8) | ((z)[1] & 0xff))
+#define UWHDR_SET16(z, i) \
+  (void) ((z)[0] = (((i) >> 8) & 0xff), (z)[1] = ((i) & 0xff))
+
+/* Length of the packet header.  This is CNARROWHDRLEN or CWIDEHDRLEN,
+   depending on whether we are using wide headers.  */
+#define CNARROWHDRLEN (6)
+#define CWIDEHDRLEN (10)
+#define CHDRLEN (cIhdrlen)
+
+/* The largest header length, used to size buffers.  */
+#define CMAXHDRLEN CWIDEHDRLEN
+
+/* Macros to get values from a packet header of either type.  */
+#define IHDR_GETLOCALSEQ(z) \
+  (fIwide ? IWHDR_GET16 ((z) + IWHDR_LOCAL) : IHDRWIN_GETSEQ ((z)[IHDR_LOCAL]))
+#define IHDR_GETLOCALCHAN(z) \
+  (fIwide ? ((z)[IWHDR_CHANS] >> 3) & 0x07 : IHDRWIN_GETCHAN ((z)[IHDR_LOCAL]))
+#define IHDR_GETREMOTESEQ(z) \
+  (fIwide \
+   ? IWHDR_GET16 ((z) + IWHDR_REMOTE) \
+   : IHDRWIN_GETSEQ ((z)[IHDR_REMOTE]))
+#define IHDR_GETREMOTECHAN(z) \
+  (fIwide ? (z)[IWHDR_CHANS] & 0x07 : IHDRWIN_GETCHAN ((z)[IHDR_REMOTE]))
+#define THDR_GETTYPE(z) \
+  (fIwide \
+   ? ((z)[IWHDR_TYPE] >> 5) & 0x07 \
+   : THDRCON_GETTYPE ((z)[IHDR_CONTENTS1], (z)[IHDR_CONTENTS2]))
+#define FHDR_GETCALLER(z) \
+  (fIwide \
+   ? ((z)[IWHDR_TYPE] & (1 << 4)) != 0 \
+   : FHDRCON_GETCALLER ((z)[IHDR_CONTENTS1], (z)[IHDR_CONTENTS2]))
+#define CHDR_GETBYTES(z) \
+  (fIwide \
+   ? IWHDR_GET16 ((z) + IWHDR_BYTES) \
+   : CHDRCON_GETBYTES ((z)[IHDR_CONTENTS1], (z)[IHDR_CONTENTS2]))
+
+/* The header check byte is always the last byte of the header.  */
+#define IHDR_GETCHECK(z) ((z)[CHDRLEN - 1] & 0xff)
 
 /* Amount of space to skip between start of packet and actual data.
    This is used to make the actual data longword aligned, to encourage
    good performance when copying data into the buffer.  */
-#define CHDRSKIPLEN (CHDRLEN + (sizeof (long) - CHDRLEN % sizeof (long)))
+#define CHDRSKIPLEN (CMAXHDRLEN + (sizeof (long) - CMAXHDRLEN % sizeof (long)))
 
 /* Amount of space to skip between memory buffer and header.  */
 #define CHDROFFSET (CHDRSKIPLEN - CHDRLEN)
@@ -151,18 +204,33 @@ const char proti_rcsid[] = "$Id$";
 /* Largest possible packet size.  */
 #define IMAXPACKSIZE ((1 << 12) - 1)
 
+/* Largest possible packet size with wide headers.  */
+#define IMAXWIDEPACKSIZE ((1 << 16) - 1)
+
 /* Largest possible sequence number (plus 1).  */
 #define IMAXSEQ 32
 
+/* Largest possible sequence number (plus 1) with wide headers.  */
+#define IMAXWIDESEQ (1 << 16)
+
 /* Get the next sequence number given a sequence number.  */
-#define INEXTSEQ(i) (((i) + 1) & (IMAXSEQ - 1))
+#define INEXTSEQ(i) (((i) + 1) & (iImaxseq - 1))
 
 /* Get the previous sequence number given a sequence number.  */
-#define IPREVSEQ(i) (((i) + IMAXSEQ - 1) & (IMAXSEQ - 1))
+#define IPREVSEQ(i) (((i) + iImaxseq - 1) & (iImaxseq - 1))
 
 /* Compute i1 - i2 in sequence space (i.e., the number of packets from
    i2 to i1).  */
-#define CSEQDIFF(i1, i2) (((i1) + IMAXSEQ - (i2)) & (IMAXSEQ - 1))
+#define CSEQDIFF(i1, i2) (((i1) + iImaxseq - (i2)) & (iImaxseq - 1))
+
+/* The packet buffers are kept in rings which are indexed by the
+   sequence number modulo the ring size.  The ring sizes are powers of
+   two no larger than the sequence space, and are large enough to hold
+   every packet in a window, so consecutive sequence numbers never
+   share a slot.  With narrow headers both rings have IMAXSEQ
+   slots.  */
+#define ISENDSLOT(i) ((i) & (cIsendslots - 1))
+#define IRECSLOT(i) ((i) & (cIrecslots - 1))
 
 /* Largest possible channel number (plus 1).  */
 #define IMAXICHAN (8)
@@ -174,6 +242,12 @@ const char proti_rcsid[] = "$Id$";
 /* Default window size to request (protocol parameter ``window'').  */
 #define IREQUEST_WINSIZE (16)
 
+/* Largest number of bytes we will buffer for the window of packets
+   we send.  The remote system picks the window and packet sizes, and
+   with wide headers it could otherwise ask for some four gigabytes
+   of send buffers.  */
+#define CMAXSENDWINDOW (4 * 1024 * 1024)
+
 /* Default timeout to use when sending the SYNC packet (protocol
    parameter ``sync-timeout'').  */
 #define CSYNC_TIMEOUT (10)
@@ -183,9 +257,15 @@ const char proti_rcsid[] = "$Id$";
 #define CSYNC_RETRIES (6)
 
 /* Default timeout to use when waiting for a packet (protocol
-   parameter ``timeout'').  */
+   parameter ``timeout'').  When we are waiting for an
+   acknowledgement, we normally use a shorter timeout based on the
+   measured round trip time.  */
 #define CTIMEOUT (10)
 
+/* Default smallest timeout to use when waiting for an acknowledgement
+   (protocol parameter ``min-timeout'').  */
+#define CMIN_TIMEOUT (1)
+
 /* Default number of times to retry sending a packet before giving up
    (protocol parameter ``retries'').  */
 #define CRETRIES (6)
@@ -207,6 +287,15 @@ const char proti_rcsid[] = "$Id$";
 
 /* Local variables.  */
 
+/* Whether we are using wide headers.  */
+static boolean fIwide;
+
+/* The length of the packet header.  */
+static int cIhdrlen = CNARROWHDRLEN;
+
+/* The size of the sequence number space.  */
+static int iImaxseq = IMAXSEQ;
+
 /* Packet size to request (protocol parameter ``packet-size'').  */
 static int iIrequest_packsize = IREQUEST_PACKSIZE;
 
@@ -246,6 +335,14 @@ static int cItimeout = CTIMEOUT;
    connection speed.  */
 static int cIwindow_timeout = CTIMEOUT;
 
+/* Smallest timeout to use when waiting for an acknowledgement
+   (protocol parameter ``min-timeout'').  */
+static int cImin_timeout = CMIN_TIMEOUT;
+
+/* Round trip time estimate, used to choose the timeout when waiting
+   for an acknowledgement.  */
+static struct srtt sIrtt;
+
 /* Number of times to retry sending a packet before giving up
    (protocol parameter ``retries'').  */
 static int cIretries = CRETRIES;
@@ -301,16 +398,20 @@ static long iIrecpos;
 /* TRUE if closing the connection.  */
 static boolean fIclosing;
 
-/* Array of sent packets indexed by packet number.  */
-static char *azIsendbuffers[IMAXSEQ];
+/* Array of sent packets indexed by ISENDSLOT of the packet number,
+   and the number of entries in it.  */
+static char **azIsendbuffers;
+static int cIsendslots;
 
 /* Array of received packets that we aren't ready to process yet,
-   indexed by packet number.  */
-static char *azIrecbuffers[IMAXSEQ];
+   indexed by IRECSLOT of the packet number, and the number of
+   entries in it.  */
+static char **azIrecbuffers;
+static int cIrecslots;
 
-/* For each packet sequence number, record whether we sent a NAK for
-   the packet.  */
-static boolean afInaked[IMAXSEQ];
+/* For each received packet sequence number, record whether we sent a
+   NAK for the packet.  This is also indexed by IRECSLOT.  */
+static boolean *afInaked;
 
 /* Number of SYNC packets received (used only to detect whether one
    was received).  */
@@ -351,6 +452,7 @@ struct uuconf_cmdtab asIproto_params[] =
   { "sync-retries", UUCONF_CMDTABTYPE_INT, (pointer) &cIsync_retries,
       NULL },
   { "timeout", UUCONF_CMDTABTYPE_INT, (pointer) &cItimeout, NULL },
+  { "min-timeout", UUCONF_CMDTABTYPE_INT, (pointer) &cImin_timeout, NULL },
   { "retries", UUCONF_CMDTABTYPE_INT, (pointer) &cIretries, NULL },
   { "errors", UUCONF_CMDTABTYPE_INT, (pointer) &cIerrors, NULL },
   { "error-decay", UUCONF_CMDTABTYPE_INT, (pointer) &cIerror_decay, NULL },
@@ -359,11 +461,20 @@ struct uuconf_cmdtab asIproto_params[] =
      it is convenient for the 'i' and 'j' protocols to share the same
      protocol parameter table.  */
   { "avoid", UUCONF_CMDTABTYPE_STRING, (pointer) &zJavoid_parameter, NULL },
+  { "receive-buffer", UUCONF_CMDTABTYPE_INT, (pointer) &cPrecbuf_max,
+      NULL },
   { NULL, 0, NULL, NULL }
 };
 
 /* Local functions.  */
 
+static int iiheader_check P((struct sdaemon *qdaemon, const char *zhdr));
+static void uiset_header P((struct sdaemon *qdaemon, char *zhdr, int ttype,
+			    int iseq, int ilocal, size_t cbytes));
+static void uiset_ack P((struct sdaemon *qdaemon, char *zhdr, int iseq,
+			 int iremote));
+static int cislots P((int cwindow));
+static void uifree_buffers P((void));
 static boolean finak P((struct sdaemon *qdaemon, int iseq));
 static boolean firesend P((struct sdaemon *qdaemon));
 static boolean fiwindow_wait P((struct sdaemon *qdaemon));
@@ -380,13 +491,84 @@ static boolean fiprocess_packet P((struct sdaemon *qdaemon,
 				   const char *zsecond, int csecond,
 				   boolean *pfexit));
 
+/* Compute the header check byte.  */
+
+static int
+iiheader_check (struct sdaemon *qdaemon, const char *zhdr)
+{
+  int i, ival;
+
+  ival = 0;
+  for (i = IHDR_LOCAL; i < CHDRLEN - 1; i++)
+    ival ^= zhdr[i];
+  ival &= 0xff;
+  if ((qdaemon->ifeatures & FEATURE_ICOMPL) != 0)
+    ival ^= 0xff;
+  return ival;
+}
+
+/* Set up a packet header, except for the ack and the header check,
+   which are set by uiset_ack.  */
+
+static void
+uiset_header (struct sdaemon *qdaemon, char *zhdr, int ttype, int iseq, int ilocal, size_t cbytes)
+{
+  zhdr[IHDR_INTRO] = IINTRO;
+  if (! fIwide)
+    {
+      zhdr[IHDR_LOCAL] = IHDRWIN_SET (iseq, ilocal);
+      zhdr[IHDR_CONTENTS1] = IHDRCON_SET1 (ttype, qdaemon->fcaller, cbytes);
+      zhdr[IHDR_CONTENTS2] = IHDRCON_SET2 (ttype, qdaemon->fcaller, cbytes);
+    }
+  else
+    {
+      UWHDR_SET16 (zhdr + IWHDR_LOCAL, iseq);
+      zhdr[IWHDR_CHANS] = ilocal << 3;
+      zhdr[IWHDR_TYPE] = (ttype << 5) | (qdaemon->fcaller ? (1 << 4) : 0);
+      UWHDR_SET16 (zhdr + IWHDR_BYTES, cbytes);
+    }
+}
+
+/* Set the ack field of a packet header, and the header check.  */
+
+static void
+uiset_ack (struct sdaemon *qdaemon, char *zhdr, int iseq, int iremote)
+{
+  if (! fIwide)
+    zhdr[IHDR_REMOTE] = IHDRWIN_SET (iseq, iremote);
+  else
+    {
+      UWHDR_SET16 (zhdr + IWHDR_REMOTE, iseq);
+      zhdr[IWHDR_CHANS] = (zhdr[IWHDR_CHANS] & ~0x07) | iremote;
+    }
+  zhdr[CHDRLEN - 1] = iiheader_check (qdaemon, zhdr);
+}
+
+/* Return the number of slots to use in a packet ring for a window of
+   cwindow packets.  We need room for the window, the packet being
+   built, and the extra packet used by an SPOS.  */
+
+static int
+cislots (int cwindow)
+{
+  int c;
+
+  c = IMAXSEQ;
+  while (c < cwindow + 2 && c < iImaxseq)
+    c <<= 1;
+  return c;
+}
+
 /* The 'i' protocol start routine.  The work is done in a routine
-   which is also called by the 'j' protocol start routine.  */
+   which is also called by the 'j' protocol start routine.  We permit
+   wide packets, which fijstart will only use if the remote system
+   supports them.  */
 
 boolean
 fistart (struct sdaemon *qdaemon, char **pzlog)
 {
-  return fijstart (qdaemon, pzlog, IMAXPACKSIZE, fsend_data, freceive_data);
+  return fijstart (qdaemon, pzlog, IMAXWIDEPACKSIZE, fsend_data,
+		   freceive_data);
 }
 
 /* Start the protocol.  This routine is called by both the 'i' and 'j'
@@ -395,22 +577,46 @@ fistart (struct sdaemon *qdaemon, char **pzlog)
    until we receive a SYNC packet from the remote system.  The first
    two bytes of the data contents of a SYNC packet are the maximum
    packet size we want to receive (high byte, low byte), and the next
-   byte is the maximum window size we want to use.  */
+   byte is the maximum window size we want to use.  With wide headers
+   the window size is two bytes (high byte, low byte).  The last byte
+   is the number of channels.
+
+   If imaxpacksize is larger than IMAXPACKSIZE, the caller can handle
+   wide packets, and we use wide headers if the remote system supports
+   them.  */
 
 boolean
 fijstart (struct sdaemon *qdaemon, char **pzlog, int imaxpacksize, boolean (*pfsend) (struct sconnection *, const char *, size_t, boolean), boolean (*pfreceive) (struct sconnection *, size_t, size_t *, int, boolean))
 {
-  char ab[CHDRLEN + 4 + CCKSUMLEN];
+  char ab[CMAXHDRLEN + 5 + CCKSUMLEN];
+  char *zsync;
+  int csync;
   unsigned long icksum;
   int ctries;
   int csyncs;
   long ibaud;
+  int i;
 
   *pzlog = NULL;
 
   pfIsend = pfsend;
   pfIreceive = pfreceive;
 
+  fIwide = (imaxpacksize > IMAXPACKSIZE
+	    && (qdaemon->ifeatures & FEATURE_IWIDE) != 0);
+  if (fIwide)
+    {
+      cIhdrlen = CWIDEHDRLEN;
+      iImaxseq = IMAXWIDESEQ;
+    }
+  else
+    {
+      cIhdrlen = CNARROWHDRLEN;
+      iImaxseq = IMAXSEQ;
+      if (imaxpacksize > IMAXPACKSIZE)
+	imaxpacksize = IMAXPACKSIZE;
+    }
+
   if (iIforced_remote_packsize <= 0
       || iIforced_remote_packsize > imaxpacksize)
     iIforced_remote_packsize = 0;
@@ -441,13 +647,18 @@ fijstart (struct sdaemon *qdaemon, char **pzlog, int imaxpacksize, boolean (*pfs
       iIrequest_packsize = imaxpacksize;
     }
 
-  /* The maximum permissible window size is 16.  Otherwise the
-     protocol can get confused because a duplicated packet may arrive
-     out of order.  If the window size is large in such a case, the
-     duplicate packet may be treated as a packet in the upcoming
-     window, causing the protocol to assume that all intermediate
-     packets have been lost, leading to immense confusion.  */
-  if (iIrequest_winsize < 0 || iIrequest_winsize > IMAXSEQ / 2)
+  /* The maximum permissible window size is half the sequence space,
+     which is 16 with narrow headers.  Otherwise the protocol can get
+     confused because a duplicated packet may arrive out of order.  If
+     the window size is large in such a case, the duplicate packet may
+     be treated as a packet in the upcoming window, causing the
+     protocol to assume that all intermediate packets have been lost,
+     leading to immense confusion.  With wide headers we need a window
+     size to know how many packets to buffer, so 0 is not
+     permitted.  */
+  if (iIrequest_winsize < 0
+      || iIrequest_winsize > iImaxseq / 2
+      || (fIwide && iIrequest_winsize == 0))
     {
       ulog (LOG_ERROR, "Illegal protocol '%c' window size; using %d",
 	    qdaemon->qproto->bname, IREQUEST_WINSIZE);
@@ -458,17 +669,45 @@ fijstart (struct sdaemon *qdaemon, char **pzlog, int imaxpacksize, boolean (*pfs
   if (cIack_frequency <= 0 || cIack_frequency >= iIrequest_winsize)
     cIack_frequency = iIrequest_winsize / 2;
 
-  ab[IHDR_INTRO] = IINTRO;
-  ab[IHDR_LOCAL] = ab[IHDR_REMOTE] = IHDRWIN_SET (0, 0);
-  ab[IHDR_CONTENTS1] = IHDRCON_SET1 (SYNC, qdaemon->fcaller, 4);
-  ab[IHDR_CONTENTS2] = IHDRCON_SET2 (SYNC, qdaemon->fcaller, 4);
-  ab[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, ab);
-  ab[CHDRLEN + 0] = (iIrequest_packsize >> 8) & 0xff;
-  ab[CHDRLEN + 1] = iIrequest_packsize & 0xff;
-  ab[CHDRLEN + 2] = iIrequest_winsize;
-  ab[CHDRLEN + 3] = qdaemon->cchans;
-  icksum = icrc (ab + CHDRLEN, 4, ICRCINIT);
-  UCKSUM_SET (ab + CHDRLEN + 4, icksum);
+  /* Make sure the receive buffer can hold a couple of the largest
+     packets the remote system may send.  */
+  cPrecbuf_min = 2 * (CHDRLEN + iIrequest_packsize + CCKSUMLEN);
+
+  /* Set up the ring of received packets now, since the remote system
+     may start sending data before we see its SYNC packet.  */
+  cIrecslots = cislots (iIrequest_winsize);
+  azIrecbuffers = (char **) xmalloc (cIrecslots * sizeof (char *));
+  afInaked = (boolean *) xmalloc (cIrecslots * sizeof (boolean));
+  for (i = 0; i < cIrecslots; i++)
+    {
+      azIrecbuffers[i] = NULL;
+      afInaked[i] = FALSE;
+    }
+  azIsendbuffers = NULL;
+  cIsendslots = 0;
+
+  csync = fIwide ? 5 : 4;
+  uiset_header (qdaemon, ab, SYNC, 0, 0, (size_t) csync);
+  uiset_ack (qdaemon, ab, 0, 0);
+  zsync = ab + CHDRLEN;
+  zsync[0] = (iIrequest_packsize >> 8) & 0xff;
+  zsync[1] = iIrequest_packsize & 0xff;
+  if (! fIwide)
+    {
+      zsync[2] = iIrequest_winsize;
+      zsync[3] = qdaemon->cchans;
+    }
+  else
+    {
+      zsync[2] = (iIrequest_winsize >> 8) & 0xff;
+      zsync[3] = iIrequest_winsize & 0xff;
+      zsync[4] = qdaemon->cchans;
+    }
+  icksum = icrc (zsync, (size_t) csync, ICRCINIT);
+  UCKSUM_SET (zsync + csync, icksum);
+
+  DEBUG_MESSAGE2 (DEBUG_PROTO, "fijstart: Using %s CRC routine%s",
+		  zcrc_name (), fIwide ? "; wide headers" : "");
 
   /* The static cIsyncs is incremented each time a SYNC packet is
      received.  */
@@ -483,9 +722,12 @@ fijstart (struct sdaemon *qdaemon, char **pzlog, int imaxpacksize, boolean (*pfs
 		      "fistart: Sending SYNC packsize %d winsize %d channels %d",
 		      iIrequest_packsize, iIrequest_winsize, qdaemon->cchans);
 
-      if (! (*pfIsend) (qdaemon->qconn, ab, CHDRLEN + 4 + CCKSUMLEN,
+      if (! (*pfIsend) (qdaemon->qconn, ab, CHDRLEN + csync + CCKSUMLEN,
 			TRUE))
-	return FALSE;
+	{
+	  uifree_buffers ();
+	  return FALSE;
+	}
 
       if (fiwait_for_packet (qdaemon, cIsync_timeout, 0, FALSE,
 			     &ftimedout))
@@ -496,17 +738,36 @@ fijstart (struct sdaemon *qdaemon, char **pzlog, int imaxpacksize, boolean (*pfs
       else
 	{
 	  if (! ftimedout)
-	    return FALSE;
+	    {
+	      uifree_buffers ();
+	      return FALSE;
+	    }
 
 	  ++ctries;
 	  if (ctries > cIsync_retries)
 	    {
 	      ulog (LOG_ERROR, "Protocol startup failed");
+	      uifree_buffers ();
 	      return FALSE;
 	    }
 	}
     }
 
+  /* Keep the send buffers to a reasonable size, whatever the remote
+     system asked for.  */
+  if (iIremote_packsize > imaxpacksize)
+    iIremote_packsize = imaxpacksize;
+  if (iIremote_packsize > 0
+      && iIremote_winsize > CMAXSENDWINDOW / iIremote_packsize)
+    {
+      iIremote_winsize = CMAXSENDWINDOW / iIremote_packsize;
+      if (iIremote_winsize < 1)
+	iIremote_winsize = 1;
+      DEBUG_MESSAGE1 (DEBUG_PROTO | DEBUG_ABNORMAL,
+		      "fijstart: Limiting remote window to %d",
+		      iIremote_winsize);
+    }
+
   /* Calculate the window timeout.  */
   ibaud = iconn_baud (qdaemon->qconn);
   if (ibaud == 0)
@@ -530,9 +791,11 @@ fijstart (struct sdaemon *qdaemon, char **pzlog, int imaxpacksize, boolean (*pfs
 	 some flexibility.  We get more flexibility because it is
 	 quite likely that by the time we have finished sending out
 	 the last packet in a window, the first one has already been
-	 received by the remote system.  */
-      cIwindow_timeout = ((5 * iIremote_packsize * iIremote_winsize) / ibaud
-			  + cItimeout);
+	 received by the remote system.  With wide headers the product
+	 may not fit in an int.  */
+      cIwindow_timeout = (int) (((long) 5 * iIremote_packsize
+				 * iIremote_winsize) / ibaud
+				+ cItimeout);
     }
 
   /* If we are the callee, bump both timeouts by one, to make it less
@@ -543,17 +806,19 @@ fijstart (struct sdaemon *qdaemon, char **pzlog, int imaxpacksize, boolean (*pfs
       ++cIwindow_timeout;
     }
 
+  /* The round trip time estimate may never exceed the window
+     timeout.  */
+  urtt_init (&sIrtt, cImin_timeout, cIwindow_timeout);
+
   /* We got a SYNC packet; set up packet buffers to use.  */
-  if (iIremote_packsize > imaxpacksize)
-    iIremote_packsize = imaxpacksize;
+  cIsendslots = cislots (iIremote_winsize);
+  azIsendbuffers = (char **) xmalloc (cIsendslots * sizeof (char *));
   do
     {
       int iseq;
 
-      for (iseq = 0; iseq < IMAXSEQ; iseq++)
+      for (iseq = 0; iseq < cIsendslots; iseq++)
 	{
-	  azIrecbuffers[iseq] = NULL;
-	  afInaked[iseq] = FALSE;
 	  azIsendbuffers[iseq] = (char *) malloc (iIremote_packsize
 						  + CHDRSKIPLEN
 						  + CCKSUMLEN);
@@ -567,16 +832,17 @@ fijstart (struct sdaemon *qdaemon, char **pzlog, int imaxpacksize, boolean (*pfs
 	    }
 	}
 
-      if (iseq >= IMAXSEQ)
+      if (iseq >= cIsendslots)
 	{
 	  *pzlog =
 	    zbufalc (sizeof "protocol '' sending packet/window / receiving /"
-		     + 64);
+		     + sizeof " (wide headers)" + 64);
 	  sprintf (*pzlog,
-		   "protocol '%c' sending packet/window %d/%d receiving %d/%d",
+		   "protocol '%c' sending packet/window %d/%d receiving %d/%d%s",
 		   qdaemon->qproto->bname, (int) iIremote_packsize,
 		   (int) iIremote_winsize, (int) iIrequest_packsize,
-		   (int) iIrequest_winsize);
+		   (int) iIrequest_winsize,
+		   fIwide ? " (wide headers)" : "");
 
 	  iIalc_packsize = iIremote_packsize;
 
@@ -591,9 +857,41 @@ fijstart (struct sdaemon *qdaemon, char **pzlog, int imaxpacksize, boolean (*pfs
 	"'%c' protocol startup failed; insufficient memory for packets",
 	qdaemon->qproto->bname);
 
+  /* We didn't manage to allocate any send buffers.  */
+  cIsendslots = 0;
+  uifree_buffers ();
+
   return FALSE;
 }
-
+
+/* Free the packet buffers.  */
+
+static void
+uifree_buffers (void)
+{
+  int i;
+
+  if (azIsendbuffers != NULL)
+    {
+      for (i = 0; i < cIsendslots; i++)
+	free ((pointer) azIsendbuffers[i]);
+      xfree ((pointer) azIsendbuffers);
+      azIsendbuffers = NULL;
+    }
+  cIsendslots = 0;
+
+  if (azIrecbuffers != NULL)
+    {
+      for (i = 0; i < cIrecslots; i++)
+	ubuffree (azIrecbuffers[i]);
+      xfree ((pointer) azIrecbuffers);
+      azIrecbuffers = NULL;
+    }
+  xfree ((pointer) afInaked);
+  afInaked = NULL;
+  cIrecslots = 0;
+}
+
 /* Shut down the protocol.  We can be fairly informal about this,
    since we know that the upper level protocol has already exchanged
    hangup messages.  If we didn't know that, we would have to make
@@ -607,20 +905,26 @@ fishutdown (struct sdaemon *qdaemon)
 
   fIclosing = TRUE;
 
+  sPstats.csent_packets = cIsent_packets;
+  sPstats.cresent_packets = cIresent_packets;
+  sPstats.crec_packets = cIreceived_packets;
+  sPstats.cnaks_received = cIremote_rejects;
+
   z = zigetspace (qdaemon, &clen) - CHDRLEN;
 
-  z[IHDR_INTRO] = IINTRO;
-  z[IHDR_LOCAL] = IHDRWIN_SET (iIsendseq, 0);
-  z[IHDR_REMOTE] = IHDRWIN_SET (iIrecseq, 0);
+  uiset_header (qdaemon, z, CLOSE, iIsendseq, 0, (size_t) 0);
+  uiset_ack (qdaemon, z, iIrecseq, 0);
   iIlocal_ack = iIrecseq;
-  z[IHDR_CONTENTS1] = IHDRCON_SET1 (CLOSE, qdaemon->fcaller, 0);
-  z[IHDR_CONTENTS2] = IHDRCON_SET2 (CLOSE, qdaemon->fcaller, 0);
-  z[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, z);
 
   DEBUG_MESSAGE0 (DEBUG_PROTO, "fishutdown: Sending CLOSE");
 
   if (! (*pfIsend) (qdaemon->qconn, z, CHDRLEN, FALSE))
-    return FALSE;
+    {
+      uifree_buffers ();
+      return FALSE;
+    }
+
+  uifree_buffers ();
 
   ulog (LOG_NORMAL,
 	"Protocol '%c' packets: sent %ld, resent %ld, received %ld",
@@ -642,6 +946,7 @@ fishutdown (struct sdaemon *qdaemon)
   cIsync_retries = CSYNC_RETRIES;
   cItimeout = CTIMEOUT;
   cIwindow_timeout = CTIMEOUT;
+  cImin_timeout = CMIN_TIMEOUT;
   cIretries = CRETRIES;
   cIerrors = CERRORS;
   cIerror_decay = CERROR_DECAY;
@@ -692,17 +997,14 @@ fisendcmd (struct sdaemon *qdaemon, const char *z, int ilocal, int iremote)
 static boolean
 finak (struct sdaemon *qdaemon, int iseq)
 {
-  char abnak[CHDRLEN];
+  char abnak[CMAXHDRLEN];
 
-  abnak[IHDR_INTRO] = IINTRO;
-  abnak[IHDR_LOCAL] = IHDRWIN_SET (iseq, 0);
-  abnak[IHDR_REMOTE] = IHDRWIN_SET (iIrecseq, 0);
+  uiset_header (qdaemon, abnak, NAK, iseq, 0, (size_t) 0);
+  uiset_ack (qdaemon, abnak, iIrecseq, 0);
   iIlocal_ack = iIrecseq;
-  abnak[IHDR_CONTENTS1] = IHDRCON_SET1 (NAK, qdaemon->fcaller, 0);
-  abnak[IHDR_CONTENTS2] = IHDRCON_SET2 (NAK, qdaemon->fcaller, 0);
-  abnak[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, abnak);
 
-  afInaked[iseq] = TRUE;
+  afInaked[IRECSLOT (iseq)] = TRUE;
+  ++sPstats.cnaks_sent;
 
   DEBUG_MESSAGE1 (DEBUG_PROTO | DEBUG_ABNORMAL,
 		  "finak: Sending NAK %d", iseq);
@@ -729,22 +1031,20 @@ firesend (struct sdaemon *qdaemon)
   DEBUG_MESSAGE1 (DEBUG_PROTO | DEBUG_ABNORMAL,
 		  "firesend: Resending packet %d", iseq);
 
+  /* An ack may now be for either copy, so stop timing.  */
+  urtt_cancel (&sIrtt);
+
   /* Update the received sequence number.  */
-  zhdr = azIsendbuffers[iseq] + CHDROFFSET;
-  if (IHDRWIN_GETSEQ (zhdr[IHDR_REMOTE]) != iIrecseq)
+  zhdr = azIsendbuffers[ISENDSLOT (iseq)] + CHDROFFSET;
+  if (IHDR_GETREMOTESEQ (zhdr) != iIrecseq)
     {
-      int iremote;
-
-      iremote = IHDRWIN_GETCHAN (zhdr[IHDR_REMOTE]);
-      zhdr[IHDR_REMOTE] = IHDRWIN_SET (iIrecseq, iremote);
-      zhdr[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, zhdr);
+      uiset_ack (qdaemon, zhdr, iIrecseq, IHDR_GETREMOTECHAN (zhdr));
       iIlocal_ack = iIrecseq;
     }
 
   ++cIresent_packets;
 
-  clen = CHDRCON_GETBYTES (zhdr[IHDR_CONTENTS1],
-			   zhdr[IHDR_CONTENTS2]);
+  clen = CHDR_GETBYTES (zhdr);
 
   return (*pfIsend) (qdaemon->qconn, zhdr,
 		     CHDRLEN + clen + (clen > 0 ? CCKSUMLEN : 0),
@@ -759,6 +1059,7 @@ fiwindow_wait (struct sdaemon *qdaemon)
 {
   /* iIsendseq is the sequence number we are sending, and iIremote_ack
      is the last sequence number acknowledged by the remote. */
+  ++sPstats.cwindow_full;
   while (CSEQDIFF (iIsendseq, iIremote_ack) > iIremote_winsize)
     {
       /* If a NAK is lost, it is possible for the other side to be
@@ -785,7 +1086,7 @@ char *
 zigetspace (struct sdaemon *qdaemon ATTRIBUTE_UNUSED, size_t *pclen)
 {
   *pclen = iIremote_packsize;
-  return azIsendbuffers[iIsendseq] + CHDRSKIPLEN;
+  return azIsendbuffers[ISENDSLOT (iIsendseq)] + CHDRSKIPLEN;
 }
 
 /* Send a data packet.  The zdata argument will always point to value
@@ -805,6 +1106,8 @@ fisenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal, int
     ulog (LOG_FATAL, "fisenddata: ilocal %d iremote %d", ilocal, iremote);
 #endif
 
+  sPstats.cdata_sent += cdata;
+
   /* If we are changing the file position, we must send an SPOS
      packet.  */
   if (ipos != iIsendpos && ipos != (long) -1)
@@ -816,18 +1119,14 @@ fisenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal, int
 	 to be next sequence number.  However, the data we have been
 	 given is currently in the next sequence number buffer.  So we
 	 shuffle the buffers around.  */
-      inext = INEXTSEQ (iIsendseq);
+      inext = ISENDSLOT (INEXTSEQ (iIsendseq));
       zspos = azIsendbuffers[inext];
       azIsendbuffers[inext] = zdata - CHDRSKIPLEN;
-      azIsendbuffers[iIsendseq] = zspos;
+      azIsendbuffers[ISENDSLOT (iIsendseq)] = zspos;
       zspos += CHDROFFSET;
 
-      zspos[IHDR_INTRO] = IINTRO;
-      zspos[IHDR_LOCAL] = IHDRWIN_SET (iIsendseq, 0);
-      zspos[IHDR_CONTENTS1] = IHDRCON_SET1 (SPOS, qdaemon->fcaller,
-					    CCKSUMLEN);
-      zspos[IHDR_CONTENTS2] = IHDRCON_SET2 (SPOS, qdaemon->fcaller,
-					    CCKSUMLEN);
+      uiset_header (qdaemon, zspos, SPOS, iIsendseq, 0,
+		    (size_t) CCKSUMLEN);
       UCKSUM_SET (zspos + CHDRLEN, (unsigned long) ipos);
       icksum = icrc (zspos + CHDRLEN, CCKSUMLEN, ICRCINIT);
       UCKSUM_SET (zspos + CHDRLEN + CCKSUMLEN, icksum);
@@ -840,10 +1139,9 @@ fisenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal, int
 	    return FALSE;
 	}
 
-      /* Fill in IHDR_REMOTE with the correct value of iIrecseq.  */
-      zspos[IHDR_REMOTE] = IHDRWIN_SET (iIrecseq, 0);
+      /* Fill in the ack with the correct value of iIrecseq.  */
+      uiset_ack (qdaemon, zspos, iIrecseq, 0);
       iIlocal_ack = iIrecseq;
-      zspos[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, zspos);
 
       DEBUG_MESSAGE1 (DEBUG_PROTO, "fisenddata: Sending SPOS %ld",
 		      ipos);
@@ -857,10 +1155,7 @@ fisenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal, int
     }
 
   zhdr = zdata - CHDRLEN;
-  zhdr[IHDR_INTRO] = IINTRO;
-  zhdr[IHDR_LOCAL] = IHDRWIN_SET (iIsendseq, ilocal);
-  zhdr[IHDR_CONTENTS1] = IHDRCON_SET1 (DATA, qdaemon->fcaller, cdata);
-  zhdr[IHDR_CONTENTS2] = IHDRCON_SET2 (DATA, qdaemon->fcaller, cdata);
+  uiset_header (qdaemon, zhdr, DATA, iIsendseq, ilocal, cdata);
 
   /* Compute and set the checksum.  */
   if (cdata > 0)
@@ -879,16 +1174,17 @@ fisenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal, int
 	return FALSE;
     }
 
-  /* We only fill in IHDR_REMOTE now, since only now do know the
-     correct value of iIrecseq.  */
-  zhdr[IHDR_REMOTE] = IHDRWIN_SET (iIrecseq, iremote);
+  /* We only fill in the ack now, since only now do know the correct
+     value of iIrecseq.  */
+  uiset_ack (qdaemon, zhdr, iIrecseq, iremote);
   iIlocal_ack = iIrecseq;
-  zhdr[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, zhdr);
 
   DEBUG_MESSAGE4 (DEBUG_PROTO,
 		  "fisenddata: Sending packet %d size %d local %d remote %d",
 		  iIsendseq, (int) cdata, ilocal, iremote);		  
 
+  urtt_start (&sIrtt, iIsendseq);
+
   iIsendseq = INEXTSEQ (iIsendseq);
   ++cIsent_packets;
 
@@ -938,6 +1234,7 @@ fiwait_for_packet (struct sdaemon *qdaemon, int ctimeout, int cretries, boolean
       boolean fexit, ffound;
       size_t cneed;
       size_t crec;
+      boolean fadaptive;
 
       if (! fiprocess_data (qdaemon, &fexit, &ffound, &cneed))
 	return FALSE;
@@ -951,7 +1248,15 @@ fiwait_for_packet (struct sdaemon *qdaemon, int ctimeout, int cretries, boolean
       DEBUG_MESSAGE1 (DEBUG_PROTO, "fiwait_for_packet: Need %d bytes",
 		      (int) cneed);
 
-      if (! (*pfIreceive) (qdaemon->qconn, cneed, &crec, ctimeout, TRUE))
+      /* If we are waiting for an acknowledgement, use the timeout
+	 based on the round trip time, if it is shorter.  Timeouts
+	 which are shorter than requested only back off the round trip
+	 time estimate; they don't count against the retries.  */
+      fadaptive = (INEXTSEQ (iIremote_ack) != iIsendseq
+		   && sIrtt.ctimeout < ctimeout);
+
+      if (! (*pfIreceive) (qdaemon->qconn, cneed, &crec,
+			   fadaptive ? sIrtt.ctimeout : ctimeout, TRUE))
 	return FALSE;
 
       if (crec != 0)
@@ -978,19 +1283,24 @@ fiwait_for_packet (struct sdaemon *qdaemon, int ctimeout, int cretries, boolean
 	  int i;
 
 	  /* We timed out on the read.  */
-	  ++ctimeouts;
-	  if (ctimeouts > cretries)
+	  if (fadaptive)
+	    urtt_backoff (&sIrtt);
+	  else
 	    {
-	      if (cretries > 0)
-		ulog (LOG_ERROR, "Timed out waiting for packet");
-	      if (pftimedout != NULL)
-		*pftimedout = TRUE;
-	      return FALSE;
+	      ++ctimeouts;
+	      if (ctimeouts > cretries)
+		{
+		  if (cretries > 0)
+		    ulog (LOG_ERROR, "Timed out waiting for packet");
+		  if (pftimedout != NULL)
+		    *pftimedout = TRUE;
+		  return FALSE;
+		}
 	    }
 
 	  /* Clear out the list of packets we have sent NAKs for.  We
 	     should have seen some sort of response by now.  */
-	  for (i = 0; i < IMAXSEQ; i++)
+	  for (i = 0; i < cIrecslots; i++)
 	    afInaked[i] = FALSE;
 
 	  /* Send a NAK for the packet we want, and, if we have an
@@ -1018,24 +1328,30 @@ ficheck_errors (struct sdaemon *qdaemon)
       /* Try shrinking the packet size.  */
       if (iIrequest_packsize > 400)
 	{
-	  char absync[CHDRLEN + 3 + CCKSUMLEN];
+	  char absync[CMAXHDRLEN + 4 + CCKSUMLEN];
+	  char *zsync;
+	  int csync;
 	  unsigned long icksum;
 
 	  /* Don't bother sending the number of channels in this
 	     packet.  */
 	  iIrequest_packsize /= 2;
-	  absync[IHDR_INTRO] = IINTRO;
-	  absync[IHDR_LOCAL] = IHDRWIN_SET (0, 0);
-	  absync[IHDR_REMOTE] = IHDRWIN_SET (iIrecseq, 0);
+	  csync = fIwide ? 4 : 3;
+	  uiset_header (qdaemon, absync, SYNC, 0, 0, (size_t) csync);
+	  uiset_ack (qdaemon, absync, iIrecseq, 0);
 	  iIlocal_ack = iIrecseq;
-	  absync[IHDR_CONTENTS1] = IHDRCON_SET1 (SYNC, qdaemon->fcaller, 3);
-	  absync[IHDR_CONTENTS2] = IHDRCON_SET2 (SYNC, qdaemon->fcaller, 3);
-	  absync[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, absync);
-	  absync[CHDRLEN + 0] = (iIrequest_packsize >> 8) & 0xff;
-	  absync[CHDRLEN + 1] = iIrequest_packsize & 0xff;
-	  absync[CHDRLEN + 2] = iIrequest_winsize;
-	  icksum = icrc (absync + CHDRLEN, 3, ICRCINIT);
-	  UCKSUM_SET (absync + CHDRLEN + 3, icksum);
+	  zsync = absync + CHDRLEN;
+	  zsync[0] = (iIrequest_packsize >> 8) & 0xff;
+	  zsync[1] = iIrequest_packsize & 0xff;
+	  if (! fIwide)
+	    zsync[2] = iIrequest_winsize;
+	  else
+	    {
+	      zsync[2] = (iIrequest_winsize >> 8) & 0xff;
+	      zsync[3] = iIrequest_winsize & 0xff;
+	    }
+	  icksum = icrc (zsync, (size_t) csync, ICRCINIT);
+	  UCKSUM_SET (zsync + csync, icksum);
 
 	  cIerrors *= 2;
 
@@ -1044,7 +1360,7 @@ ficheck_errors (struct sdaemon *qdaemon)
 			  iIrequest_packsize, iIrequest_winsize);
 
 	  return (*pfIsend) (qdaemon->qconn, absync,
-			     CHDRLEN + 3 + CCKSUMLEN, TRUE);
+			     CHDRLEN + csync + CCKSUMLEN, TRUE);
 	}
 
       ulog (LOG_ERROR, "Too many '%c' protocol errors",
@@ -1072,7 +1388,7 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 
   while (iPrecstart != iPrecend)
     {
-      char ab[CHDRLEN];
+      char ab[CMAXHDRLEN] = { 0 };
       int cfirst, csecond;
       char *zfirst, *zsecond;
       int i;
@@ -1101,7 +1417,12 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 
 	  cintro = iPrecend - iPrecstart;
 	  if (cintro < 0)
-	    cintro = CRECBUFLEN - iPrecstart;
+	    {
+	      if (fPrecmirror)
+		cintro += CRECBUFLEN;
+	      else
+		cintro = CRECBUFLEN - iPrecstart;
+	    }
 
 	  zintro = memchr (abPrecbuf + iPrecstart, IINTRO, (size_t) cintro);
 
@@ -1111,9 +1432,10 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 	      continue;
 	    }
 
-	  /* We don't need % CRECBUFLEN here because zintro - (abPrecbuf
-	     + iPrecstart) < cintro <= CRECBUFLEN - iPrecstart.  */
-	  iPrecstart += zintro - (abPrecbuf + iPrecstart);
+	  /* If the buffer is mirrored, zintro may be in the second
+	     copy, so we need % CRECBUFLEN here.  */
+	  iPrecstart = ((iPrecstart + (zintro - (abPrecbuf + iPrecstart)))
+			% CRECBUFLEN);
 	}
 
       /* Get the header into ab.  */
@@ -1129,9 +1451,8 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 	  return TRUE;
 	}
 
-      if ((ab[IHDR_CHECK] & 0xff) != IHDRCHECK_VAL (qdaemon, ab)
-	  || (FHDRCON_GETCALLER (ab[IHDR_CONTENTS1], ab[IHDR_CONTENTS2])
-	      ? qdaemon->fcaller : ! qdaemon->fcaller))
+      if (IHDR_GETCHECK (ab) != iiheader_check (qdaemon, ab)
+	  || (FHDR_GETCALLER (ab) ? qdaemon->fcaller : ! qdaemon->fcaller))
 	{
 	  /* We only report a single bad header message per call, to
 	     avoid generating many errors if we get many INTRO bytes
@@ -1155,12 +1476,12 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
       zfirst = zsecond = NULL;
       cfirst = csecond = 0;
 
-      ttype = THDRCON_GETTYPE (ab[IHDR_CONTENTS1], ab[IHDR_CONTENTS2]);
+      ttype = THDR_GETTYPE (ab);
       if (ttype == DATA || ttype == SPOS || ttype == CLOSE)
-	iseq = IHDRWIN_GETSEQ (ab[IHDR_LOCAL]);
+	iseq = IHDR_GETLOCALSEQ (ab);
       else
 	iseq = -1;
-      csize = CHDRCON_GETBYTES (ab[IHDR_CONTENTS1], ab[IHDR_CONTENTS2]);
+      csize = CHDR_GETBYTES (ab);
 
       if (iseq != -1)
 	{
@@ -1199,7 +1520,8 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 	      return TRUE;
 	    }
 
-	  if (iPrecend > iPrecstart)
+	  /* If the buffer is mirrored, the data never wraps.  */
+	  if (iPrecend > iPrecstart || fPrecmirror)
 	    {
 	      cfirst = csize;
 	      zfirst = abPrecbuf + iPrecstart + CHDRLEN;
@@ -1255,7 +1577,7 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 		  && iseq != iIrecseq
 		  && (iIrequest_winsize <= 0
 		      || CSEQDIFF (iseq, iIrecseq) <= iIrequest_winsize)
-		  && azIrecbuffers[iseq] == NULL)
+		  && azIrecbuffers[IRECSLOT (iseq)] == NULL)
 		{
 		  if (! finak (qdaemon, iseq))
 		    return FALSE;
@@ -1281,7 +1603,7 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 	 the next sequence number we are going to send, and
 	 iIremote_ack is the last sequence number acknowledged by the
 	 remote system.  */
-      iack = IHDRWIN_GETSEQ (ab[IHDR_REMOTE]);
+      iack = IHDR_GETREMOTESEQ (ab);
       if (iIremote_winsize > 0
 	  && iack != iIsendseq
 	  && CSEQDIFF (iack, iIremote_ack) <= iIremote_winsize
@@ -1290,6 +1612,15 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 	  /* Call uwindow_acked each time packet 0 is acked.  */
 	  if (iack < iIremote_ack)
 	    uwindow_acked (qdaemon, FALSE);
+
+	  /* If this acknowledges the packet we are timing, update the
+	     round trip time estimate.  */
+	  if (sIrtt.iseq != -1
+	      && sIrtt.iseq != iIremote_ack
+	      && (CSEQDIFF (sIrtt.iseq, iIremote_ack)
+		  <= CSEQDIFF (iack, iIremote_ack)))
+	    urtt_sample (&sIrtt);
+
 	  iIremote_ack = iack;
 	}
 
@@ -1307,20 +1638,20 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 		 packet 1 lost
 		 receive packet 2
 	     At this point we want to send NAK 1.  */
-	  if (afInaked[iseq]
-	      && azIrecbuffers[IPREVSEQ (iseq)] == NULL)
+	  if (afInaked[IRECSLOT (iseq)]
+	      && azIrecbuffers[IRECSLOT (IPREVSEQ (iseq))] == NULL)
 	    {
 	      for (i = INEXTSEQ (iIrecseq);
 		   i != iseq;
 		   i = INEXTSEQ (i))
-		afInaked[i] = FALSE;
+		afInaked[IRECSLOT (i)] = FALSE;
 	    }
 
-	  afInaked[iseq] = FALSE;
-	  if (azIrecbuffers[iseq] != NULL)
+	  afInaked[IRECSLOT (iseq)] = FALSE;
+	  if (azIrecbuffers[IRECSLOT (iseq)] != NULL)
 	    {
-	      ubuffree (azIrecbuffers[iseq]);
-	      azIrecbuffers[iseq] = NULL;
+	      ubuffree (azIrecbuffers[IRECSLOT (iseq)]);
+	      azIrecbuffers[IRECSLOT (iseq)] = NULL;
 	    }
 
 	  /* If we haven't handled all previous packets, we must save
@@ -1338,23 +1669,24 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 		}
 	      else
 		{
+		  char *zsave;
+
 		  DEBUG_MESSAGE2 (DEBUG_PROTO | DEBUG_ABNORMAL,
 				  "fiprocess_data: Saving unexpected packet %d (recseq %d)",
 				  iseq, iIrecseq);
 
-		  if (azIrecbuffers[iseq] != NULL)
-		    ubuffree (azIrecbuffers[iseq]);
+		  if (azIrecbuffers[IRECSLOT (iseq)] != NULL)
+		    ubuffree (azIrecbuffers[IRECSLOT (iseq)]);
 
-		  azIrecbuffers[iseq] = zbufalc ((size_t) (CHDRLEN
-							   + csize));
-		  memcpy (azIrecbuffers[iseq], ab, CHDRLEN);
+		  zsave = zbufalc ((size_t) (CHDRLEN + csize));
+		  azIrecbuffers[IRECSLOT (iseq)] = zsave;
+		  memcpy (zsave, ab, (size_t) CHDRLEN);
 		  if (csize > 0)
 		    {
-		      memcpy (azIrecbuffers[iseq] + CHDRLEN, zfirst,
-			      (size_t) cfirst);
+		      memcpy (zsave + CHDRLEN, zfirst, (size_t) cfirst);
 		      if (csecond > 0)
-			memcpy (azIrecbuffers[iseq] + CHDRLEN + cfirst,
-				zsecond, (size_t) csecond);
+			memcpy (zsave + CHDRLEN + cfirst, zsecond,
+				(size_t) csecond);
 		    }
 		}
 
@@ -1366,8 +1698,8 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 		   i != iseq;
 		   i = INEXTSEQ (i))
 		{
-		  if (! afInaked[i]
-		      && azIrecbuffers[i] == NULL)
+		  if (! afInaked[IRECSLOT (i)]
+		      && azIrecbuffers[IRECSLOT (i)] == NULL)
 		    {
 		      if (! finak (qdaemon, i))
 			return FALSE;
@@ -1394,19 +1726,19 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
 	  /* If we've already received the next packet(s), process
 	     them.  */
 	  inext = INEXTSEQ (iIrecseq);
-	  while (azIrecbuffers[inext] != NULL)
+	  while (azIrecbuffers[IRECSLOT (inext)] != NULL)
 	    {
 	      char *z;
 	      int c;
 
-	      z = azIrecbuffers[inext];
-	      c = CHDRCON_GETBYTES (z[IHDR_CONTENTS1], z[IHDR_CONTENTS2]);
+	      z = azIrecbuffers[IRECSLOT (inext)];
+	      c = CHDR_GETBYTES (z);
 	      iIrecseq = inext;
 	      if (! fiprocess_packet (qdaemon, z, z + CHDRLEN, c,
 				      (char *) NULL, 0, pfexit))
 		return FALSE;
-	      ubuffree (azIrecbuffers[inext]);
-	      azIrecbuffers[inext] = NULL;
+	      ubuffree (azIrecbuffers[IRECSLOT (inext)]);
+	      azIrecbuffers[IRECSLOT (inext)] = NULL;
 	      inext = INEXTSEQ (inext);
 	    }
 	}
@@ -1422,15 +1754,11 @@ fiprocess_data (struct sdaemon *qdaemon, boolean *pfexit, boolean *pffound, size
       if (iIrequest_winsize > 0
 	  && CSEQDIFF (iIrecseq, iIlocal_ack) >= cIack_frequency)
 	{
-	  char aback[CHDRLEN];
+	  char aback[CMAXHDRLEN];
 
-	  aback[IHDR_INTRO] = IINTRO;
-	  aback[IHDR_LOCAL] = IHDRWIN_SET (0, 0);
-	  aback[IHDR_REMOTE] = IHDRWIN_SET (iIrecseq, 0);
+	  uiset_header (qdaemon, aback, ACK, 0, 0, (size_t) 0);
+	  uiset_ack (qdaemon, aback, iIrecseq, 0);
 	  iIlocal_ack = iIrecseq;
-	  aback[IHDR_CONTENTS1] = IHDRCON_SET1 (ACK, qdaemon->fcaller, 0);
-	  aback[IHDR_CONTENTS2] = IHDRCON_SET2 (ACK, qdaemon->fcaller, 0);
-	  aback[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, aback);
 
 	  DEBUG_MESSAGE1 (DEBUG_PROTO, "fiprocess_data: Sending ACK %d",
 			  iIrecseq);
@@ -1453,7 +1781,7 @@ fiprocess_packet (struct sdaemon *qdaemon, const char *zhdr, const char *zfirst,
 {
   int ttype;
 
-  ttype = THDRCON_GETTYPE (zhdr[IHDR_CONTENTS1], zhdr[IHDR_CONTENTS2]);
+  ttype = THDR_GETTYPE (zhdr);
   switch (ttype)
     {
     case DATA:
@@ -1461,16 +1789,16 @@ fiprocess_packet (struct sdaemon *qdaemon, const char *zhdr, const char *zfirst,
 	int iseq;
 	boolean fret;
 
-	iseq = IHDRWIN_GETSEQ (zhdr[IHDR_LOCAL]);
+	iseq = IHDR_GETLOCALSEQ (zhdr);
 	DEBUG_MESSAGE4 (DEBUG_PROTO,
 			"fiprocess_packet: Got DATA packet %d size %d local %d remote %d",
 			iseq, cfirst + csecond,
-			IHDRWIN_GETCHAN (zhdr[IHDR_REMOTE]),
-			IHDRWIN_GETCHAN (zhdr[IHDR_LOCAL]));
+			IHDR_GETREMOTECHAN (zhdr),
+			IHDR_GETLOCALCHAN (zhdr));
 	fret = fgot_data (qdaemon, zfirst, (size_t) cfirst,
 			  zsecond, (size_t) csecond,
-			  IHDRWIN_GETCHAN (zhdr[IHDR_REMOTE]),
-			  IHDRWIN_GETCHAN (zhdr[IHDR_LOCAL]),
+			  IHDR_GETREMOTECHAN (zhdr),
+			  IHDR_GETLOCALCHAN (zhdr),
 			  iIrecpos,
 			  INEXTSEQ (iIremote_ack) == iIsendseq,
 			  pfexit);
@@ -1480,41 +1808,57 @@ fiprocess_packet (struct sdaemon *qdaemon, const char *zhdr, const char *zfirst,
 
     case SYNC:
       {
-	int ipack, iwin, cchans;
+	char absync[5];
+	int csync, cwin, ipack, iwin, cchans;
 
 	/* We accept a SYNC packet to adjust the packet and window
-	   sizes at any time.  */
-	if (cfirst + csecond < 3)
+	   sizes at any time.  The window size is one byte, or two
+	   bytes with wide headers.  */
+	cwin = fIwide ? 2 : 1;
+	csync = cfirst + csecond;
+	if (csync < 2 + cwin)
 	  {
 	    ulog (LOG_ERROR, "Bad SYNC packet");
 	    return FALSE;
 	  }
-	ipack = (zfirst[0] & 0xff) << 8;
-	if (cfirst > 1)
-	  ipack |= zfirst[1] & 0xff;
+	if (csync > (int) sizeof absync)
+	  csync = sizeof absync;
+	if (cfirst >= csync)
+	  memcpy (absync, zfirst, (size_t) csync);
 	else
-	  ipack |= zsecond[0];
-	if (cfirst > 2)
-	  iwin = zfirst[2];
+	  {
+	    memcpy (absync, zfirst, (size_t) cfirst);
+	    memcpy (absync + cfirst, zsecond, (size_t) (csync - cfirst));
+	  }
+
+	ipack = ((absync[0] & 0xff) << 8) | (absync[1] & 0xff);
+	if (! fIwide)
+	  iwin = absync[2] & 0xff;
 	else
-	  iwin = zsecond[2 - cfirst];
+	  iwin = ((absync[2] & 0xff) << 8) | (absync[3] & 0xff);
 
-	/* The fourth byte in a SYNC packet is the number of channels
-	   to use.  This is optional.  Switching the number of
-	   channels in the middle of a conversation may cause
-	   problems.  */
-	if (cfirst + csecond <= 3)
+	/* The byte after the window size in a SYNC packet is the
+	   number of channels to use.  This is optional.  Switching
+	   the number of channels in the middle of a conversation may
+	   cause problems.  */
+	if (csync <= 2 + cwin)
 	  cchans = 0;
 	else
 	  {
-	    if (cfirst > 3)
-	      cchans = zfirst[3];
-	    else
-	      cchans = zsecond[3 - cfirst];
+	    cchans = absync[2 + cwin];
 	    if (cchans > 0 && cchans < 8)
 	      qdaemon->cchans = cchans;
 	  }
 
+	/* A window of more than half the sequence space would confuse
+	   the protocol, as described in fijstart.  Once the send
+	   buffers have been allocated, the window can not be larger
+	   than the ring will hold.  */
+	if (iwin > iImaxseq / 2)
+	  iwin = iImaxseq / 2;
+	if (azIsendbuffers != NULL && iwin > cIsendslots - 2)
+	  iwin = cIsendslots - 2;
+
 	DEBUG_MESSAGE3 (DEBUG_PROTO,
 			"fiprocess_packet: Got SYNC packsize %d winsize %d channels %d",
 			ipack, iwin, cchans);
@@ -1539,7 +1883,7 @@ fiprocess_packet (struct sdaemon *qdaemon, const char *zhdr, const char *zfirst,
 	 handled in fiprocess_data.  */
       DEBUG_MESSAGE1 (DEBUG_PROTO,
 		      "fiprocess_packet: Got ACK %d",
-		      IHDRWIN_GETSEQ (zhdr[IHDR_REMOTE]));
+		      IHDR_GETREMOTESEQ (zhdr));
       return TRUE;
 
     case NAK:
@@ -1553,7 +1897,7 @@ fiprocess_packet (struct sdaemon *qdaemon, const char *zhdr, const char *zfirst,
 	if (! ficheck_errors (qdaemon))
 	  return FALSE;
 
-	iseq = IHDRWIN_GETSEQ (zhdr[IHDR_LOCAL]);
+	iseq = IHDR_GETLOCALSEQ (zhdr);
 
 	/* If the remote side times out while waiting for a packet, it
 	   will send a NAK for the next packet it wants to see.  If we
@@ -1564,15 +1908,11 @@ fiprocess_packet (struct sdaemon *qdaemon, const char *zhdr, const char *zfirst,
 	if (iseq == iIsendseq &&
 	    INEXTSEQ (iIremote_ack) == iIsendseq)
 	  {
-	    char aback[CHDRLEN];
+	    char aback[CMAXHDRLEN];
 
-	    aback[IHDR_INTRO] = IINTRO;
-	    aback[IHDR_LOCAL] = IHDRWIN_SET (0, 0);
-	    aback[IHDR_REMOTE] = IHDRWIN_SET (iIrecseq, 0);
+	    uiset_header (qdaemon, aback, ACK, 0, 0, (size_t) 0);
+	    uiset_ack (qdaemon, aback, iIrecseq, 0);
 	    iIlocal_ack = iIrecseq;
-	    aback[IHDR_CONTENTS1] = IHDRCON_SET1 (ACK, qdaemon->fcaller, 0);
-	    aback[IHDR_CONTENTS2] = IHDRCON_SET2 (ACK, qdaemon->fcaller, 0);
-	    aback[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, aback);
 
 	    DEBUG_MESSAGE1 (DEBUG_PROTO, "fiprocess_packet: Sending ACK %d",
 			    iIrecseq);
@@ -1582,6 +1922,7 @@ fiprocess_packet (struct sdaemon *qdaemon, const char *zhdr, const char *zfirst,
 	else
 	  {
 	    if (iseq == iIsendseq
+		|| azIsendbuffers == NULL
 		|| (iIremote_winsize > 0
 		    && (CSEQDIFF (iseq, iIremote_ack) > iIremote_winsize
 			|| CSEQDIFF (iIsendseq, iseq) > iIremote_winsize)))
@@ -1596,22 +1937,20 @@ fiprocess_packet (struct sdaemon *qdaemon, const char *zhdr, const char *zfirst,
 			    "fiprocess_packet: Got NAK %d; resending packet",
 			    iseq);
 
+	    urtt_cancel (&sIrtt);
+
 	    /* Update the received sequence number.  */
-	    zsend = azIsendbuffers[iseq] + CHDROFFSET;
-	    if (IHDRWIN_GETSEQ (zsend[IHDR_REMOTE]) != iIrecseq)
+	    zsend = azIsendbuffers[ISENDSLOT (iseq)] + CHDROFFSET;
+	    if (IHDR_GETREMOTESEQ (zsend) != iIrecseq)
 	      {
-		int iremote;
-
-		iremote = IHDRWIN_GETCHAN (zsend[IHDR_REMOTE]);
-		zsend[IHDR_REMOTE] = IHDRWIN_SET (iIrecseq, iremote);
-		zsend[IHDR_CHECK] = IHDRCHECK_VAL (qdaemon, zsend);
+		uiset_ack (qdaemon, zsend, iIrecseq,
+			   IHDR_GETREMOTECHAN (zsend));
 		iIlocal_ack = iIrecseq;
 	      }
 	      
 	    ++cIresent_packets;
 
-	    clen = CHDRCON_GETBYTES (zsend[IHDR_CONTENTS1],
-				     zsend[IHDR_CONTENTS2]);
+	    clen = CHDR_GETBYTES (zsend);
 
 	    return (*pfIsend) (qdaemon->qconn, zsend,
 			       CHDRLEN + clen + (clen > 0 ? CCKSUMLEN : 0),
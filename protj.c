@@ -108,16 +108,7 @@ const char protj_rcsid[] = "$Id$";
 
 /* The maximum packet size we support, as determined by the byte
    indices.  */
-#define IMAXPACKSIZE ((125 - 32) * 32 + 31)
-
-/* Amount to offset the bytes in the byte index by.  */
-#define INDEX_OFFSET (32)
-
-/* Maximum value of INDEX-LOW, before offsetting.  */
-#define INDEX_MAX_LOW (32)
-
-/* Maximum value of INDEX-HIGH, before offsetting. */
-#define INDEX_MAX_HIGH (94)
+#define IMAXPACKSIZE (CJMAXPACKSIZE)
 
 /* The set of characters to avoid.  */
 static char *zJavoid;
@@ -125,6 +116,11 @@ static char *zJavoid;
 /* The number of characters to avoid.  */
 static size_t cJavoid;
 
+/* A table indexed by unsigned character, which is non-zero for the
+   characters to avoid.  This lets cjskip and cjencode check each byte
+   with a single lookup, however many characters there are to avoid.  */
+static char abJavoid[256];
+
 /* A buffer used when sending data.  */
 static char *zJbuf;
 
@@ -246,6 +242,10 @@ fjstart (struct sdaemon *qdaemon, char **pzlog)
 	}
     }
 
+  bzero (abJavoid, sizeof abJavoid);
+  for (i = 0; i < cJavoid; i++)
+    abJavoid[(unsigned char) zJavoid[i]] = 1;
+
   /* If we are avoiding XON and XOFF, use XON/XOFF handshaking.  */
   if (memchr (zJavoid, '\021', cJavoid) != NULL
       && memchr (zJavoid, '\023', cJavoid) != NULL)
@@ -273,6 +273,10 @@ fjstart (struct sdaemon *qdaemon, char **pzlog)
   iJrecend = iPrecend;
   iPrecend = iPrecstart;
 
+  /* The undecoded data is beyond iPrecend, so the receive buffer
+     must not be resized while we are running.  */
+  fPrecfixed = TRUE;
+
   /* Now do the 'i' protocol startup.  */
   return fijstart (qdaemon, pzlog, IMAXPACKSIZE, fjsend_data,
 		   fjreceive_data);
@@ -288,122 +292,61 @@ fjshutdown (struct sdaemon *qdaemon)
   fret = fishutdown (qdaemon);
   ubuffree (zJavoid);
   ubuffree (zJbuf);
+  fPrecfixed = FALSE;
   return fret;
 }
 
-/* Encode a packet of data and send it.  This copies the data, which
-   is a waste of time, but calling fsend_data three times (for the
-   header, the body, and the trailer) would waste even more time.  */
+/* Encode a packet of data and send it.  If none of the data needs to
+   be avoided, the packet is just the header, the data itself, and a
+   trailer, and we hand the three pieces to fsend_datav without
+   copying anything.  Otherwise we must change some bytes, and we may
+   not change the caller's buffer, so cjencode copies the data into
+   zJbuf as it changes it.  */
 
 static boolean
 fjsend_data (struct sconnection *qconn, const char *zsend, size_t csend, boolean fdoread)
 {
-  char *zput, *zindex;
-  const char *zfrom, *zend;
-  char bfirst, bsecond;
+  size_t iscan;
+  char *zindex;
   int iprecendhold;
   boolean fret;
 
-  zput = zJbuf + CHDRLEN;
-  zindex = zput + csend;
-  zfrom = zsend;
-  zend = zsend + csend;
-
-  /* Optimize for the common case of avoiding two characters.  */
-  bfirst = zJavoid[0];
-  if (cJavoid <= 1)
-    bsecond = bfirst;
-  else
-    bsecond = zJavoid[1];
-  while (zfrom < zend)
-    {
-      char b;
-      boolean f128, f32;
-      int i, ihigh, ilow;
-
-      b = *zfrom++;
-      if (b != bfirst && b != bsecond)
-	{
-	  int ca;
-	  char *za;
+  iscan = cjskip (abJavoid, zsend, csend);
 
-	  if (cJavoid <= 2)
-	    {
-	      *zput++ = b;
-	      continue;
-	    }
+  if (iscan >= csend)
+    {
+      struct sconn_iov as[3];
+      static char bJtrailer = TRAILER;
 
-	  ca = cJavoid - 2;
-	  za = zJavoid + 2;
-	  while (ca-- != 0)
-	    if (*za++ == b)
-	      break;
+      zJbuf[1] = ISETLENGTH_FIRST (CHDRLEN + csend + 1);
+      zJbuf[2] = ISETLENGTH_SECOND (CHDRLEN + csend + 1);
+      zJbuf[4] = ISETLENGTH_FIRST (csend);
+      zJbuf[5] = ISETLENGTH_SECOND (csend);
 
-	  if (ca < 0)
-	    {
-	      *zput++ = b;
-	      continue;
-	    }
-	}
+      as[0].zbuf = zJbuf;
+      as[0].clen = CHDRLEN;
+      as[1].zbuf = zsend;
+      as[1].clen = csend;
+      as[2].zbuf = &bJtrailer;
+      as[2].clen = 1;
 
-      if ((b & 0x80) == 0)
-	f128 = FALSE;
-      else
-	{
-	  b &=~ 0x80;
-	  f128 = TRUE;
-	}
-      if (b >= 32 && b != 127)
-	f32 = FALSE;
-      else
-	{
-	  b ^= 0x20;
-	  f32 = TRUE;
-	}
+      iprecendhold = iPrecend;
+      iPrecend = iJrecend;
+      fret = fsend_datav (qconn, as, 3, fdoread);
+      iJrecend = iPrecend;
+      iPrecend = iprecendhold;
 
-      /* We must now put the byte index into the buffer.  The byte
-	 index is encoded similarly to the length of the actual data,
-	 but the byte index also encodes the operations that must be
-	 performed on the byte.  The first byte in the index is the
-	 most significant bits.  If we only had to subtract 128 from
-	 the byte, we use the second byte directly.  If we had to xor
-	 the byte with 32, we add 32 to the second byte index.  If we
-	 had to perform both operations, we add 64 to the second byte
-	 index.  However, if we had to perform both operations, and
-	 the second byte index was 31, then after adding 64 and
-	 offsetting by 32 we would come up with 127, which we are not
-	 permitted to use.  Therefore, in this special case we set the
-	 first byte of the index to 126 and put the original first
-	 byte into the second byte position instead.  This is why we
-	 could not permit the high byte of the length of the actual
-	 data to be 126.  We can get away with the switch because both
-	 the value of the second byte index (31) and the operations to
-	 perform (both) are known.  */
-      i = zput - (zJbuf + CHDRLEN);
-      ihigh = i / INDEX_MAX_LOW;
-      ilow = i % INDEX_MAX_LOW;
-
-      if (f128 && ! f32)
-	;
-      else if (f32 && ! f128)
-	ilow += INDEX_MAX_LOW;
-      else
+      if (fret && iPrecend != iJrecend)
 	{
-	  /* Both operations had to be performed.  */
-	  if (ilow != INDEX_MAX_LOW - 1)
-	    ilow += 2 * INDEX_MAX_LOW;
-	  else
-	    {
-	      ilow = ihigh;
-	      ihigh = INDEX_MAX_HIGH;
-	    }
+	  if (! fjprocess_data ((size_t *) NULL))
+	    return FALSE;
 	}
 
-      *zindex++ = ihigh + INDEX_OFFSET;
-      *zindex++ = ilow + INDEX_OFFSET;
-      *zput++ = b;
+      return fret;
     }
 
+  zindex = (zJbuf + CHDRLEN
+	    + cjencode (abJavoid, zsend, csend, iscan, zJbuf + CHDRLEN));
   *zindex++ = TRAILER;
 
   /* Set the lengths into the buffer.  zJbuf[0,3,6] were set when
@@ -516,7 +459,7 @@ fjprocess_data (size_t *pcneed)
       int i, iget;
       char ab[CHDRLEN];
       int cpacket, cdata, chave;
-      int iindex, iendindex;
+      int cindex, iendindex;
 
       /* Find the next occurrence of FIRST.  If we have to skip some
 	 garbage bytes to get to it, zero them out (so they don't
@@ -585,8 +528,9 @@ fjprocess_data (size_t *pcneed)
 	  return TRUE;
 	}
 
-      /* Figure out where the byte indices start and end.  */
-      iindex = (istart + CHDRLEN + cdata) % CRECBUFLEN;
+      /* Figure out how many byte indices there are and where they
+	 end.  */
+      cindex = cpacket - CHDRLEN - 1 - cdata;
       iendindex = (istart + cpacket - 1) % CRECBUFLEN;
 
       /* Make sure the magic trailer character is there.  */
@@ -598,48 +542,16 @@ fjprocess_data (size_t *pcneed)
 
       /* We have a packet to decode.  The decoding process is simpler
 	 than the encoding process, since all we have to do is examine
-	 the byte indices.  We zero out the byte indices as we go, so
-	 that they will not confuse the 'i' protocol.  */
-      while (iindex != iendindex)
-	{
-	  int ihigh, ilow;
-	  boolean f32, f128;
-	  int iset;
-
-	  ihigh = abPrecbuf[iindex] - INDEX_OFFSET;
-	  abPrecbuf[iindex] = 0;
-	  iindex = (iindex + 1) % CRECBUFLEN;
-	  ilow = abPrecbuf[iindex] - INDEX_OFFSET;
-	  abPrecbuf[iindex] = 0;
-	  iindex = (iindex + 1) % CRECBUFLEN;
-
-	  /* Now we must undo the encoding, by adding 128 and xoring
-	     with 32 as appropriate.  Which to do is encoded in the
-	     low byte, except that if the high byte is the special
-	     value 126, then the low byte is actually the high byte
-	     and both operations are performed.  */
-	  f128 = TRUE;
-	  f32 = TRUE;
-	  if (ihigh == INDEX_MAX_HIGH)
-	    iset = ilow * INDEX_MAX_LOW + INDEX_MAX_LOW - 1;
-	  else
-	    {
-	      iset = ihigh * INDEX_MAX_LOW + ilow % INDEX_MAX_LOW;
-	      if (ilow < INDEX_MAX_LOW)
-		f32 = FALSE;
-	      else if (ilow < 2 * INDEX_MAX_LOW)
-		f128 = FALSE;
-	    }
-
-	  /* Now iset is the index from the start of the data to the
-	     byte to modify; adjust it to an index in abPrecbuf.  */
-	  iset = (istart + CHDRLEN + iset) % CRECBUFLEN;
-
-	  if (f128)
-	    abPrecbuf[iset] |= 0x80;
-	  if (f32)
-	    abPrecbuf[iset] ^= 0x20;
-	}
+	 the byte indices.  The byte indices are zeroed out, so that
+	 they will not confuse the 'i' protocol.  If the packet does
+	 not wrap around the end of abPrecbuf, or abPrecbuf is
+	 mirrored so that wrapping does not matter, we can use
+	 pointers into the packet.  */
+      if (fPrecmirror || istart + cpacket <= CRECBUFLEN)
+	ujdecode (abPrecbuf + istart + CHDRLEN, cdata, cindex);
+      else
+	ujdecode_ring (abPrecbuf, CRECBUFLEN, (istart + CHDRLEN) % CRECBUFLEN,
+		       cdata, cindex);
 
       /* Zero out the header and trailer to avoid confusing the 'i'
 	 protocol, and update iPrecend to the end of decoded data.  */
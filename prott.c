@@ -64,6 +64,8 @@ static int cTtimeout = 120;
 struct uuconf_cmdtab asTproto_params[] =
 {
   { "timeout", UUCONF_CMDTABTYPE_INT, (pointer) &cTtimeout, NULL },
+  { "receive-buffer", UUCONF_CMDTABTYPE_INT, (pointer) &cPrecbuf_max,
+      NULL },
   { NULL, 0, NULL, NULL }
 };
 
@@ -128,6 +130,9 @@ ftsendcmd (struct sdaemon *qdaemon, const char *z, int ilocal ATTRIBUTE_UNUSED,
   if (csend > clen)
     bzero (zalc + clen, csend - clen);
 
+  sPstats.csent_packets += csend / CTPACKSIZE;
+  sPstats.cdata_sent += csend;
+
   fret = fsend_data (qdaemon->qconn, zalc, csend, TRUE);
   ubuffree (zalc);
   return fret;
@@ -161,6 +166,9 @@ ftsenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRI
   zdata[-2] = (char) ((cdata >> 8) & 0xff);
   zdata[-1] = (char) (cdata & 0xff);
 
+  ++sPstats.csent_packets;
+  sPstats.cdata_sent += cdata;
+
   /* We pass FALSE to fsend_data since we don't expect the other side
      to be sending us anything just now.  */
   return fsend_data (qdaemon->qconn, zdata - CTFRAMELEN, cdata + CTFRAMELEN,
@@ -194,6 +202,7 @@ ftprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
 			  "ftprocess_data: Got %d command bytes",
 			  cfirst);
 
+	  ++sPstats.crec_packets;
 	  if (! fgot_data (qdaemon, abPrecbuf + iPrecstart,
 			   (size_t) cfirst, abPrecbuf,
 			   (size_t) CTPACKSIZE - cfirst,
@@ -244,6 +253,7 @@ ftprocess_data (struct sdaemon *qdaemon, boolean *pfexit, size_t *pcneed)
 		      "ftprocess_data: Got %d data bytes",
 		      clen);
 
+      ++sPstats.crec_packets;
       if (! fgot_data (qdaemon, abPrecbuf + iPrecstart,
 		       (size_t) cfirst, abPrecbuf, (size_t) (clen - cfirst),
 		       -1, -1, (long) -1, TRUE, pfexit))
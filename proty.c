@@ -123,6 +123,8 @@ struct uuconf_cmdtab asYproto_params[] =
 {
   { "timeout", UUCONF_CMDTABTYPE_INT, (pointer) &cYtimeout, NULL },
   { "packet-size", UUCONF_CMDTABTYPE_INT, (pointer) &iYlocal_packsize, NULL },
+  { "receive-buffer", UUCONF_CMDTABTYPE_INT, (pointer) &cPrecbuf_max,
+      NULL },
   { NULL, 0, NULL, NULL }
 };
 
@@ -278,6 +280,8 @@ fysendcmd (struct sdaemon *qdaemon, const char *z, int ilocal ATTRIBUTE_UNUSED,
       if (csize > iYremote_packsize)
 	csize = iYremote_packsize;
 
+      ++sPstats.csent_packets;
+      sPstats.cdata_sent += csize;
       if (! fysend_pkt (qdaemon, z, csize))
 	return FALSE;
 
@@ -310,6 +314,8 @@ fysenddata (struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRI
 
   TOLITTLE (zYbuf + YFRAME_SEQ_OFF, iYlocal_pktnum);
   ++iYlocal_pktnum;
+  ++sPstats.csent_packets;
+  sPstats.cdata_sent += cdata;
   TOLITTLE (zYbuf + YFRAME_LEN_OFF, cdata);
   TOLITTLE (zYbuf + YFRAME_CHK_OFF, iychecksum (zdata, cdata));
 
@@ -394,21 +400,25 @@ fysend_control (struct sdaemon *qdaemon, int itype)
 
 /* Private function to send a packet.  This one doesn't need the data
    to be in the buffer provided by zygetspace.  I've found it worth
-   for avoiding memory copies.  Somebody may want to do it otherwise */
+   for avoiding memory copies.  Somebody may want to do it otherwise.
+   The header and the data are still written with a single call.  */
 
 static boolean
 fysend_pkt (struct sdaemon *qdaemon, const void *zdata, size_t cdata)
 {
   char header[CYFRAMELEN];
+  struct sconn_iov as[2];
 
   TOLITTLE (header + YFRAME_SEQ_OFF, iYlocal_pktnum);
   iYlocal_pktnum++;
   TOLITTLE (header + YFRAME_LEN_OFF, cdata);
   TOLITTLE (header + YFRAME_CHK_OFF, iychecksum (zdata, cdata));
 
-  if (! fsend_data (qdaemon->qconn, header, CYFRAMELEN, FALSE))
-    return FALSE;
-  return fsend_data (qdaemon->qconn, zdata, cdata, FALSE);
+  as[0].zbuf = header;
+  as[0].clen = CYFRAMELEN;
+  as[1].zbuf = (const char *) zdata;
+  as[1].clen = cdata;
+  return fsend_datav (qdaemon->qconn, as, 2, FALSE);
 }
 
 /* Wait until enough data arrived from the comm line.  This protocol
@@ -558,6 +568,7 @@ fywait_for_packet (struct sdaemon *qdaemon, boolean *pfexit)
     return FALSE;
 
   iPrecstart = (iPrecstart + clen) % CRECBUFLEN;
+  ++sPstats.crec_packets;
 
   return TRUE;
 }
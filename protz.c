@@ -269,6 +269,7 @@ const char protz_rcsid[] = "$Id$";
  */
 
 #define TX_ESCCTL	1	/* Tx will escape control chars */
+#define CANLARGE	2	/* Can send and receive 8k data packets */
 
 /*
  * Possible errors when running ZMODEM ...
@@ -298,6 +299,7 @@ const char protz_rcsid[] = "$Id$";
  */
 
 #define CPACKETSIZE		1024	/* max packet size (data only) */
+#define CLARGEPACKETSIZE	8192	/* max if both sides set CANLARGE */
 #define CFRAMELEN		12	/* header size */
 #define CSUFFIXLEN		10	/* suffix at end of data packets */
 #define CEXCHANGE_INIT_RETRIES	4
@@ -311,7 +313,7 @@ const char protz_rcsid[] = "$Id$";
 #endif
 
 /* packet buffer size */
-#define CPACKBUFSIZE  (CFRAMELEN + 2 * CPACKETSIZE + CSUFFIXLEN + 42 /*slop*/)
+#define CPACKBUFSIZE  (CFRAMELEN + 2 * CLARGEPACKETSIZE + CSUFFIXLEN + 42 /*slop*/)
 
 /*
  * Data types ...
@@ -333,6 +335,7 @@ typedef unsigned long winpos_t;
 #define CGARBAGE		2400
 #define CSEND_WINDOW		16384
 #define FESCAPE_CONTROL		FALSE
+#define FLARGE_PACKETS		TRUE
 
 static int cZtimeout = CTIMEOUT;	/* (seconds) */
 static int cZretries = CRETRIES;
@@ -341,6 +344,7 @@ static int cZmax_garbage = CGARBAGE;		/* max garbage before header */
 static int cZtx_window = CSEND_WINDOW;		/* our transmission window */
 static int cZrx_buf_len = 0;			/* our reception buffer size */
 static boolean fZesc_ctl = FESCAPE_CONTROL;	/* escape control chars */
+static boolean fZlarge_packets = FLARGE_PACKETS; /* offer 8k packets */
 
 struct uuconf_cmdtab asZproto_params[] =
 {
@@ -352,6 +356,10 @@ struct uuconf_cmdtab asZproto_params[] =
 	{"send-window", UUCONF_CMDTABTYPE_INT, (pointer) & cZtx_window, NULL},
 	{"escape-control", UUCONF_CMDTABTYPE_BOOLEAN, (pointer) & fZesc_ctl,
 	   NULL},
+	{"large-packets", UUCONF_CMDTABTYPE_BOOLEAN,
+	   (pointer) & fZlarge_packets, NULL},
+	{"receive-buffer", UUCONF_CMDTABTYPE_INT, (pointer) & cPrecbuf_max,
+	 NULL},
 	{NULL, 0, NULL, NULL}
 };
 
@@ -381,6 +389,7 @@ static char *zZrx_packet_buf;	/* raw incoming packet data */
  * Transmitter state variables ...
  */
 
+static unsigned cZpacketsize;	/* max data length, after negotiation */
 static unsigned cZblklen;	/* data length in sent/received packets */
 static unsigned cZtxwspac;	/* spacing between ZCRCQ requests */
 /*static unsigned cZblklen_override;*//* override value for <cZblklen> */
@@ -411,6 +420,13 @@ static int iZlast_rx_data_packet; /* last successfully received ZCRCx packet */
 
 static char xon = XON;
 
+/*
+ * Characters which must be sent as ZDLE followed by the character xor 0100.
+ * This is set up by uzinit_escapes(), since it depends on <fZesc_ctl>.
+ */
+
+static char abZescape[256];
+
 #ifdef DJE_TESTING
 int uucptest = -1;
 int uucptest2;
@@ -490,6 +506,7 @@ static int zrdat32 P((struct sdaemon *qdaemon, char *buf, int length,
 static int getinsync P((struct sdaemon *qdaemon, boolean flag));
 static char *zputhex P((char *p, int ch));
 static char *zputchar P((char *p, int ch));
+static void uzinit_escapes P((void));
 static int zgethex P((struct sdaemon *qdaemon));
 static int zdlread P((struct sdaemon *qdaemon));
 static int noxrd7 P((struct sdaemon *qdaemon));
@@ -551,7 +568,7 @@ fzstart(struct sdaemon *qdaemon, char **pzlog)
 		return FALSE;
 	}
 
-	zZtx_buf = (char *) xmalloc (CPACKETSIZE);
+	zZtx_buf = (char *) xmalloc (CLARGEPACKETSIZE);
 	zZtx_packet_buf = (char *) xmalloc (CPACKBUFSIZE);
 	zZrx_packet_buf = (char *) xmalloc (CPACKBUFSIZE);
 
@@ -560,6 +577,9 @@ fzstart(struct sdaemon *qdaemon, char **pzlog)
 
 	wpZtxpos = wpZlrxpos = wpZrxpos = wpZrxbytes = 0;
 	cZtxwspac = cZtx_window / 4;
+	cZpacketsize = CPACKETSIZE;
+
+	uzinit_escapes ();
 
 	cZheaders_sent = cZheaders_received = cZbytes_resent = 0;
 	cZtimeouts = cZerrors = 0;
@@ -626,6 +646,9 @@ fzshutdown(struct sdaemon *qdaemon)
 	 * latter is jargonese.
 	 */
 
+	sPstats.csent_packets = (long) cZheaders_sent;
+	sPstats.crec_packets = (long) cZheaders_received;
+
 	ulog (LOG_NORMAL,
 	      "Protocol 'a' messages: sent %lu, received %lu",
 	      cZheaders_sent, cZheaders_received);
@@ -649,6 +672,7 @@ fzshutdown(struct sdaemon *qdaemon)
 	cZmax_garbage = CGARBAGE;
 	cZtx_window = CSEND_WINDOW;
 	fZesc_ctl = FESCAPE_CONTROL;
+	fZlarge_packets = FLARGE_PACKETS;
 
 	cZheaders_sent = cZheaders_received = cZbytes_resent = 0;
 	cZtimeouts = cZerrors = 0;
@@ -688,6 +712,7 @@ fzsendcmd(struct sdaemon *qdaemon, const char *z, int ilocal ATTRIBUTE_UNUSED, i
 #endif
 
 	strcpy (zbuf, z);
+	sPstats.cdata_sent += clen;
 
 	/*
 	 * Send it out ...
@@ -707,7 +732,8 @@ fzsendcmd(struct sdaemon *qdaemon, const char *z, int ilocal ATTRIBUTE_UNUSED, i
  * Allocate a packet to send out ...
  *
  * Note that 'z' has dynamic packet resizing and that <cZblklen> will range
- * from 32 to 1024, in multiples of 2.
+ * from 32 to <cZpacketsize> (1024, or 8192 if both sides can handle it), in
+ * multiples of 2.
  */
 
 /*ARGSUSED*/
@@ -730,6 +756,8 @@ fzsenddata(struct sdaemon *qdaemon, char *zdata, size_t cdata, int ilocal ATTRIB
 {
 	DEBUG_MESSAGE1 (DEBUG_PROTO, "fzsenddata: %d bytes", (int) cdata);
 
+	sPstats.cdata_sent += cdata;
+
 	if (! fzsend_data (qdaemon, zdata, cdata, cdata == 0))
 		return FALSE;
 	return fzprocess (qdaemon);
@@ -775,14 +803,14 @@ fzsend_data(struct sdaemon *qdaemon, char *zdata, size_t cdata, boolean fendofme
 
 	if (++iZtleft > 3) {
 		iZtleft = 0;
-		if (cZblklen < 1024)
+		if (cZblklen < cZpacketsize)
 			cZblklen *= 2;
 #if 0	/* <cZblklen_override> is currently unnecessary */
 		if (cZblklen_override && cZblklen > cZblklen_override)
 			cZblklen = cZblklen_override;
 #endif
-		if (cZblklen > 1024)
-			cZblklen = 1024;
+		if (cZblklen > cZpacketsize)
+			cZblklen = cZpacketsize;
 		if (cZrx_buf_len && cZblklen > (size_t) cZrx_buf_len)
 			cZblklen = cZrx_buf_len;
 	}
@@ -1012,7 +1040,7 @@ nxthdr:
 					return FALSE;
 				}
 				(void) zrdat32 (qdaemon, zZrx_packet_buf,
-						1024, &rxcount);
+						(int) cZpacketsize, &rxcount);
 				/*fport_break ();*/
 				/*
 				 * FIXME: Seems to me we should ignore this one
@@ -1029,8 +1057,8 @@ moredata:
 			 * not ZCRCF. fgot_data() will erroneously think this
 			 * is the end of the message.
 			 */
-			c = zrdat32 (qdaemon, zZrx_packet_buf, 1024,
-				     &rxcount);
+			c = zrdat32 (qdaemon, zZrx_packet_buf,
+				     (int) cZpacketsize, &rxcount);
 #if DEBUG > 1
 			if (FDEBUGGING(DEBUG_PROTO)) {
 				const char *msg;
@@ -1420,6 +1448,8 @@ fzstart_proto(struct sdaemon *qdaemon)
 		tx_hdr[ZF0] = ZPROTOCOL_VERSION;
 		if (fZesc_ctl)
 			tx_hdr[ZF1] |= TX_ESCCTL;
+		if (fZlarge_packets)
+			tx_hdr[ZF1] |= CANLARGE;
 		switch (izexchange_init (qdaemon, ZINIT, tx_hdr, rx_hdr)) {
 		case -1: return FALSE;
 		case 0:  continue;
@@ -1432,6 +1462,16 @@ fzstart_proto(struct sdaemon *qdaemon)
 		}
 #endif
 		fZesc_ctl = fZesc_ctl || (rx_hdr[ZF1] & TX_ESCCTL) != 0;
+		uzinit_escapes ();
+
+		/*
+		 * As with ZMODEM-8K, data packets of up to 8k are only used
+		 * if both sides ask for them.
+		 */
+		if (fZlarge_packets && (rx_hdr[ZF1] & CANLARGE) != 0)
+			cZpacketsize = CLARGEPACKETSIZE;
+		else
+			cZpacketsize = CPACKETSIZE;
 
 		stohdr (0L, tx_hdr);
 		switch (izexchange_init (qdaemon, ZDATA, tx_hdr, rx_hdr)) {
@@ -1454,8 +1494,9 @@ fzstart_proto(struct sdaemon *qdaemon)
 		case 1:  break;
 		}
 
-		DEBUG_MESSAGE0 (DEBUG_PROTO,
-				"fzstart_proto: Protocol started");
+		DEBUG_MESSAGE1 (DEBUG_PROTO,
+				"fzstart_proto: Protocol started, packet size %u",
+				cZpacketsize);
 		return TRUE;
 
 		/* FIXME: see protg.c regarding sequencing here. */
@@ -1510,7 +1551,7 @@ izexchange_init(struct sdaemon *qdaemon, int send_type, unsigned char *send_val,
 		case ZINITEND:
 			break;
 		case ZDATA:
-			if (zrdat32 (qdaemon, zZrx_packet_buf, 1024, &count)
+			if (zrdat32 (qdaemon, zZrx_packet_buf, CPACKETSIZE, &count)
 			    == GOTCRCF)
 				break;
 			continue;
@@ -1572,7 +1613,7 @@ fzstart_tx(void)
 	 * triggered by (wpZlastsync == wpZtxpos).
 	 */
 
-	cZblklen = 1024;
+	cZblklen = cZpacketsize;
 	wpZlastsync = -1L;
 	iZbeenhereb4 = 0;
 	iZtleft = 0;
@@ -1632,6 +1673,7 @@ fzfinish_tx(struct sdaemon *qdaemon, long int *plredo)
 			if (((wpZtxpos + 1024) & ~1023) == wpZrxpos)
 				return TRUE;
 			cZbytes_resent += wpZtxpos - wpZrxpos;
+			++sPstats.cnaks_received;
 			wpZlrxpos = wpZtxpos = wpZrxpos;
 			if (wpZlastsync == wpZrxpos) {
 				if (++iZbeenhereb4 > 4)
@@ -1889,33 +1931,46 @@ czbuild_header(char *zresult, int ipkttype, int ihdrtype, hdrval_t hdrval)
 /*
  * Build Zmodem data packets ...
  *
- * This function is zsdata() and zsda32() from the zm source.
+ * This function is zsdata() and zsda32() from the zm source.  Rather than
+ * going through zputchar() a byte at a time, we copy each run of characters
+ * which need no escaping in one go, and compute the CRC over the whole block
+ * with icrc().
  */
 
 static int
 czbuild_data_packet(char *zresult, const char *zdata, size_t cdata, int frameend)
 {
 	char *p;
+	const char *zend;
 	unsigned long crc;
+	int i;
 
 	p = zresult;
 
-	crc = ICRCINIT;
-	for ( ; cdata-- != 0; zdata++) {
-		char c;
+	crc = icrc (zdata, cdata, ICRCINIT);
 
-		c = *zdata;
-		if (c & 0140)
-			*p++ = c;
-		else
-			p = zputchar (p, c);
-		crc = UPDC32 ((unsigned char) c, crc);
+	zend = zdata + cdata;
+	while (zdata < zend) {
+		const char *zrun;
+
+		zrun = zdata;
+		while (zdata < zend && !abZescape[(unsigned char) *zdata])
+			zdata++;
+		if (zdata > zrun) {
+			memcpy (p, zrun, (size_t) (zdata - zrun));
+			p += zdata - zrun;
+		}
+		if (zdata < zend) {
+			*p++ = ZDLE;
+			*p++ = *zdata++ ^ 0100;
+		}
 	}
+
 	*p++ = ZDLE;
 	*p++ = frameend;
 	crc = UPDC32 (frameend, crc);
 	crc = ~crc;
-	for (cdata = 0; cdata < 4; cdata++) {
+	for (i = 0; i < 4; i++) {
 		p = zputchar (p, (char) crc);
 		crc >>= 8;
 	}
@@ -2100,6 +2155,11 @@ zrhhdr(struct sdaemon *qdaemon, unsigned char *hdr)
 
 /*
  * Receive a data packet ...
+ *
+ * Characters with either of the 0140 bits set are never escaped, so we copy
+ * runs of them straight out of the receive buffer rather than calling
+ * zdlread() for each one. The CRC of the data is computed at the end with
+ * icrc().
  */
 
 static int
@@ -2107,12 +2167,32 @@ zrdat32(struct sdaemon *qdaemon, char *buf, int length, int *iprxcount)
 {
 	int c,d;
 	unsigned long crc;
-	char *end;
+	char *start,*end;
 
-	crc = ICRCINIT;
 	*iprxcount = 0;
+	start = buf;
 	end = buf + length;
 	while (buf <= end) {
+		if (iPrecstart != iPrecend) {
+			const char *zfrom,*zstop,*z;
+
+			zfrom = abPrecbuf + iPrecstart;
+			if (iPrecend > iPrecstart)
+				zstop = abPrecbuf + iPrecend;
+			else
+				zstop = abPrecbuf + CRECBUFLEN;
+			if (zstop - zfrom > end - buf)
+				zstop = zfrom + (end - buf);
+			for (z = zfrom; z < zstop && (*z & 0140) != 0; z++)
+				;
+			if (z > zfrom) {
+				memcpy (buf, zfrom, (size_t) (z - zfrom));
+				buf += z - zfrom;
+				iPrecstart = ((iPrecstart + (z - zfrom))
+					      % CRECBUFLEN);
+				continue;
+			}
+		}
 		if ((c = zdlread (qdaemon)) & ~0377) {
 crcfoo:
 			switch (c) {
@@ -2122,6 +2202,8 @@ crcfoo:
 			case GOTCRCW:
 			case GOTCRCF:
 				d = c;
+				crc = icrc (start, (size_t) (buf - start),
+					    ICRCINIT);
 				c &= 0377;
 				crc = UPDC32 (c, crc);
 				if ((c = zdlread (qdaemon)) & ~0377)
@@ -2148,7 +2230,6 @@ crcfoo:
 			}
 		}
 		*buf++ = (char) c;
-		crc = UPDC32 (c, crc);
 	}
 
 	return ZM_ERROR;	/* bad packet, too long */
@@ -2174,6 +2255,7 @@ getinsync(struct sdaemon *qdaemon, boolean flag)
 			wpZrxpos = lzupdate_rxpos (rx_hdr, wpZrxpos,
 						   wpZlrxpos, wpZtxpos);
 			cZbytes_resent += wpZtxpos - wpZrxpos;
+			++sPstats.cnaks_received;
 			wpZlrxpos = wpZtxpos = wpZrxpos;
 			if (wpZlastsync == wpZrxpos) {
 				if (++iZbeenhereb4 > 4)
@@ -2246,11 +2328,42 @@ zputhex(char *p, int ch)
 }
 
 /*
- * Send character c with ZMODEM escape sequence encoding ...
+ * Set up the table of characters which must be escaped ...
  *
- * Escape XON, XOFF.
+ * Escape ZDLE, XON, XOFF, ^P and CR, and all control characters if
+ * <fZesc_ctl> is set.  Characters with either of the 0140 bits set are
+ * never escaped.
  * FIXME: Escape CR following @ (Telenet net escape) ... disabled for now
- *	Will need to put back references to <lastsent>.
+ *	Would need to put back references to <lastsent>.
+ */
+
+static void
+uzinit_escapes(void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		if (i & 0140)
+			abZescape[i] = FALSE;
+		else {
+			switch (i) {
+			case ZDLE:
+			case CR:
+			case 020:	/* ^P */
+			case XON:
+			case XOFF:
+				abZescape[i] = TRUE;
+				break;
+			default:
+				abZescape[i] = fZesc_ctl;
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Send character c with ZMODEM escape sequence encoding ...
  */
 
 static char *
@@ -2258,39 +2371,11 @@ zputchar(char *p, int ch)
 {
 	char c = ch;
 
-	/* Quick check for non control characters */
-
-	if (c & 0140) {
-		*p++ = c;
-	} else {
-		switch (c & 0377) {
-		case ZDLE:
-			*p++ = ZDLE;
-			*p++ = c ^ 0100;
-			break;
-		case CR:
-#if 0
-			if (!fZesc_ctl && (lastsent & 0177) != '@')
-				goto sendit;
-#endif
-			/* fall through */
-		case 020:	/* ^P */
-		case XON:
-		case XOFF:
-			*p++ = ZDLE;
-			c ^= 0100;
-/*sendit:*/
-			*p++ = c;
-			break;
-		default:
-			if (fZesc_ctl && !(c & 0140)) {
-				*p++ = ZDLE;
-				c ^= 0100;
-			}
-			*p++ = c;
-			break;
-		}
+	if (abZescape[c & 0377]) {
+		*p++ = ZDLE;
+		c ^= 0100;
 	}
+	*p++ = c;
 
 	return p;
 }
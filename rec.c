@@ -61,6 +61,16 @@ struct srecinfo
   boolean freplied;
   /* TRUE if we moved the file to the final destination.  */
   boolean fmoved;
+  /* TRUE if we keep a checkpoint so that the file may be restarted
+     in a later conversation.  */
+  boolean fcheckpoint;
+  /* Number of bytes at the start of the file covered by icrc.  */
+  long cverified;
+  /* CRC of the first cverified bytes of the file.  */
+  unsigned long icrc;
+  /* If not NULL, the signatures of an old copy of the file to send
+     in the reply, so that the file is sent as a delta.  */
+  char *zdelta;
 };
 
 /* This structure is kept in the pinfo field if we are refusing a
@@ -88,6 +98,14 @@ static boolean flocal_rec_await_reply P((struct stransfer *qtrans,
 					 struct sdaemon *qdaemon,
 					 const char *zdata,
 					 size_t cdata));
+static boolean frec_crc_file P((const struct uuconf_system *qsys,
+				 const char *zfile, long istart, long iend,
+				 unsigned long *picrc));
+static long crec_checkpoint_restart P((const struct uuconf_system *qsys,
+				       const struct scmd *qcmd,
+				       const char *ztemp, long crestart,
+				       long *pcverified,
+				       unsigned long *picrc));
 static boolean fremote_send_reply P((struct stransfer *qtrans,
 				     struct sdaemon *qdaemon));
 static boolean fremote_send_fail P((struct sdaemon *qdaemon,
@@ -102,6 +120,12 @@ static boolean fremote_discard P((struct stransfer *qtrans,
 static boolean frec_file_end P((struct stransfer *qtrans,
 				struct sdaemon *qdaemon,
 				const char *zdata, size_t cdata));
+static boolean frec_group_sync P((const struct sdaemon *qdaemon,
+				  const struct stransfer *qtrans));
+static boolean frec_sync P((struct stransfer *qtrans, boolean fgroup));
+static boolean frec_file_finish P((struct stransfer *qtrans,
+				   struct sdaemon *qdaemon,
+				   const char *zerr));
 static boolean frec_file_send_confirm P((struct stransfer *qtrans,
 					 struct sdaemon *qdaemon));
 
@@ -117,6 +141,7 @@ urrec_free (struct stransfer *qtrans)
       ubuffree (qinfo->zmail);
       ubuffree (qinfo->zfile);
       ubuffree (qinfo->ztemp);
+      ubuffree (qinfo->zdelta);
       xfree (qtrans->pinfo);
     }
 
@@ -259,6 +284,10 @@ flocal_rec_file_init (struct sdaemon *qdaemon, struct scmd *qcmd)
   qinfo->flocal = TRUE;
   qinfo->freceived = FALSE;
   qinfo->freplied = TRUE;
+  qinfo->fcheckpoint = FALSE;
+  qinfo->cverified = 0;
+  qinfo->icrc = ICRCINIT;
+  qinfo->zdelta = NULL;
 
   qtrans = qtransalc (qcmd);
   qtrans->psendfn = flocal_rec_send_request;
@@ -462,6 +491,27 @@ flocal_rec_await_reply (struct stransfer *qtrans, struct sdaemon *qdaemon, const
       qdaemon->fhangup_requested = TRUE;
     }
 
+  /* If there is a Z after the mode (and after any M), the file data
+     is compressed.  */
+  if (*zend == 'M')
+    ++zend;
+  if (*zend == 'Z')
+    {
+      if ((qdaemon->ifeatures & FEATURE_COMPRESS) == 0)
+	{
+	  ulog (LOG_ERROR, "%s: Compressed data not agreed on",
+		qtrans->s.zfrom);
+	  urrec_free (qtrans);
+	  return FALSE;
+	}
+      qtrans->qcompress = qcompress_start (qdaemon, FALSE);
+      if (qtrans->qcompress == NULL)
+	{
+	  urrec_free (qtrans);
+	  return FALSE;
+	}
+    }
+
   /* Open the file to receive into.  We just ignore any restart count,
      since we have no way to tell it to the other side.  SVR4 may have
      some way to do this, but I don't know what it is.  */
@@ -559,6 +609,11 @@ fremote_send_file_init (struct sdaemon *qdaemon, struct scmd *qcmd, int iremote)
   char *ztemp;
   long cbytes, cbytes2;
   long crestart;
+  long cverified;
+  unsigned long icrc;
+  struct scompress *qcompress;
+  struct sdelta *qdelta;
+  char *zsigs;
   struct srecinfo *qinfo;
   struct stransfer *qtrans;
   const char *zlog;
@@ -681,23 +736,68 @@ fremote_send_file_init (struct sdaemon *qdaemon, struct scmd *qcmd, int iremote)
 	}
     }
 
+  /* A 'z' option means that the file data is compressed.  The other
+     side should only use it if we both said we could handle it.  */
+  qcompress = NULL;
+  if (strchr (qcmd->zoptions, 'z') != NULL)
+    {
+      if ((qdaemon->ifeatures & FEATURE_COMPRESS) == 0)
+	{
+	  ulog (LOG_ERROR, "%s: Compressed data not agreed on", zfile);
+	  ubuffree (ztemp);
+	  ubuffree (zfile);
+	  return fremote_send_fail (qdaemon, qcmd, FAILURE_OPEN, iremote);
+	}
+      qcompress = qcompress_start (qdaemon, FALSE);
+      if (qcompress == NULL)
+	{
+	  ubuffree (ztemp);
+	  ubuffree (zfile);
+	  return fremote_send_fail (qdaemon, qcmd, FAILURE_OPEN, iremote);
+	}
+    }
+
   /* Open the file to receive into.  This may find an old copy of the
      file, which will be used for file restart if the other side
-     supports it.  */
+     supports it.  We can't restart a compressed file, since the
+     position would have to be in the compressed data.  */
   crestart = -1;
   e = esysdep_open_receive (qsys, zfile, qcmd->ztemp, ztemp,
 			    ((qdaemon->qproto->frestart
 			      && (qdaemon->ifeatures
-				  & FEATURE_RESTART) != 0)
+				  & FEATURE_RESTART) != 0
+			      && qcompress == NULL)
 			     ? &crestart
 			     : (long *) NULL));
   if (! ffileisopen (e))
     {
+      ucompress_free (qcompress);
       ubuffree (ztemp);
       ubuffree (zfile);
       return fremote_send_fail (qdaemon, qcmd, FAILURE_OPEN, iremote);
     }
 
+  /* Only trust as much of an old copy as its checkpoint covers.  */
+  cverified = 0;
+  icrc = ICRCINIT;
+  if (crestart > 0)
+    {
+      crestart = crec_checkpoint_restart (qsys, qcmd, ztemp, crestart,
+					  &cverified, &icrc);
+      if (crestart <= 0)
+	{
+	  e = esysdep_truncate (e, ztemp);
+	  if (! ffileisopen (e))
+	    {
+	      ucompress_free (qcompress);
+	      ubuffree (ztemp);
+	      ubuffree (zfile);
+	      return fremote_send_fail (qdaemon, qcmd, FAILURE_OPEN,
+					iremote);
+	    }
+	}
+    }
+
   if (crestart > 0)
     {
       DEBUG_MESSAGE1 (DEBUG_UUCP_PROTO,
@@ -707,12 +807,49 @@ fremote_send_file_init (struct sdaemon *qdaemon, struct scmd *qcmd, int iremote)
 	{
 	  ulog (LOG_ERROR, "seek: %s", strerror (errno));
 	  (void) ffileclose (e);
+	  ucompress_free (qcompress);
 	  ubuffree (ztemp);
 	  ubuffree (zfile);
 	  return FALSE;
 	}
     }
 
+  /* A 'D' option means that the sender will send the file as a delta
+     if we have an old copy of it.  We look for one at the
+     destination, and then under the same name in the public
+     directory.  If we are restarting the file we don't bother, and
+     we ignore the option unless we agreed to use deltas.  */
+  qdelta = NULL;
+  zsigs = NULL;
+  if (strchr (qcmd->zoptions, 'D') != NULL
+      && (qdaemon->ifeatures & FEATURE_DELTA) != 0
+      && ! fspool
+      && crestart <= 0)
+    {
+      qdelta = qdelta_rec_start (qsys, zfile, &zsigs);
+      if (qdelta == NULL && csysdep_size (zfile) == -1)
+	{
+	  char *zbase, *zpub;
+
+	  zbase = zsysdep_base_name (zfile);
+	  if (zbase != NULL)
+	    {
+	      zpub = zsysdep_in_dir (qsys->uuconf_zpubdir, zbase);
+	      ubuffree (zbase);
+	      if (zpub != NULL && strcmp (zpub, zfile) != 0)
+		qdelta = qdelta_rec_start (qsys, zpub, &zsigs);
+	      ubuffree (zpub);
+	    }
+	}
+
+      /* The delta replaces compression.  */
+      if (qdelta != NULL && qcompress != NULL)
+	{
+	  ucompress_free (qcompress);
+	  qcompress = NULL;
+	}
+    }
+
   qinfo = (struct srecinfo *) xmalloc (sizeof (struct srecinfo));
   if (strchr (qcmd->zoptions, 'n') == NULL)
     qinfo->zmail = NULL;
@@ -724,6 +861,16 @@ fremote_send_file_init (struct sdaemon *qdaemon, struct scmd *qcmd, int iremote)
   qinfo->flocal = FALSE;
   qinfo->freceived = FALSE;
   qinfo->freplied = FALSE;
+  qinfo->fcheckpoint = (qdaemon->qproto->frestart
+			&& (qdaemon->ifeatures & FEATURE_RESTART) != 0
+			&& qcompress == NULL
+			&& qdelta == NULL
+			&& qcmd->ztemp != NULL
+			&& qcmd->ztemp[0] == 'D'
+			&& strcmp (qcmd->ztemp, "D.0") != 0);
+  qinfo->cverified = cverified;
+  qinfo->icrc = icrc;
+  qinfo->zdelta = zsigs;
 
   qtrans = qtransalc (qcmd);
   qtrans->psendfn = fremote_send_reply;
@@ -732,6 +879,8 @@ fremote_send_file_init (struct sdaemon *qdaemon, struct scmd *qcmd, int iremote)
   qtrans->pinfo = (pointer) qinfo;
   qtrans->frecfile = TRUE;
   qtrans->e = e;
+  qtrans->qcompress = qcompress;
+  qtrans->qdelta = qdelta;
   if (crestart > 0)
     qtrans->ipos = crestart;
 
@@ -774,6 +923,7 @@ fremote_send_reply (struct stransfer *qtrans, struct sdaemon *qdaemon)
   struct srecinfo *qinfo = (struct srecinfo *) qtrans->pinfo;
   boolean fret;
   char ab[50];
+  char *zalc;
 
   /* If the file has been completely received, we just want to send
      the final confirmation.  Otherwise, we must wait for the file
@@ -788,15 +938,32 @@ fremote_send_reply (struct stransfer *qtrans, struct sdaemon *qdaemon)
 
   ab[0] = qtrans->s.bcmd;
   ab[1] = 'Y';
-  if (qtrans->ipos <= 0)
+  /* With multiple channels we may already have received some of the
+     file.  Don't report the position of compressed data, since the
+     sender would take it as a restart request.  */
+  if (qtrans->ipos <= 0 || qtrans->qcompress != NULL)
     ab[2] = '\0';
   else
     sprintf (ab + 2, " 0x%lx", (unsigned long) qtrans->ipos);
 
+  /* If we have an old copy of the file, follow that with the
+     signatures for the sender to build the delta from.  */
+  zalc = NULL;
+  if (qinfo->zdelta != NULL)
+    {
+      zalc = zbufalc (strlen (ab) + strlen (qinfo->zdelta) + 1);
+      sprintf (zalc, "%s%s", ab, qinfo->zdelta);
+      ubuffree (qinfo->zdelta);
+      qinfo->zdelta = NULL;
+    }
+
   qinfo->freplied = TRUE;
 
-  if (! (*qdaemon->qproto->pfsendcmd) (qdaemon, ab, qtrans->ilocal,
-				       qtrans->iremote))
+  fret = (*qdaemon->qproto->pfsendcmd) (qdaemon,
+					zalc != NULL ? zalc : ab,
+					qtrans->ilocal, qtrans->iremote);
+  ubuffree (zalc);
+  if (! fret)
     {
       (void) ffileclose (qtrans->e);
       qtrans->e = EFILECLOSED;
@@ -936,6 +1103,45 @@ fremote_discard (struct stransfer *qtrans, struct sdaemon *qdaemon ATTRIBUTE_UNU
   return TRUE;
 }
 
+/* See whether the sync of a received file may be grouped with the
+   syncs of the files which follow it, as described with FSYNC_GROUP
+   in policy.h.  The confirmation, and our reply to the request if we
+   have not sent it yet, are held back until the group is synced, so
+   we only do this when there is more than one channel and the other
+   system can go on sending files over the other channels.  When
+   pipelining over a single channel the replies must be sent in
+   order, so the reply to the next request would be held up too, and
+   the other system would not send the next file.  */
+
+/*ARGSUSED*/
+static boolean
+frec_group_sync (const struct sdaemon *qdaemon ATTRIBUTE_UNUSED, const struct stransfer *qtrans ATTRIBUTE_UNUSED)
+{
+#if FSYNC_ON_CLOSE && FSYNC_GROUP > 1
+  return ! qdaemon->fmaster && qdaemon->cchans > 1;
+#else
+  return FALSE;
+#endif
+}
+
+/* Sync a received file before closing it.  If fgroup is TRUE, a file
+   in the spool directory is left to be synced by fqueue_sync_flush
+   along with the rest of its group.  */
+
+static boolean
+frec_sync (struct stransfer *qtrans, boolean fgroup)
+{
+  boolean fret;
+
+  if (! fgroup)
+    return fsysdep_sync (qtrans->e, qtrans->s.zto);
+
+  usysdep_spool_batch ();
+  fret = fsysdep_sync (qtrans->e, qtrans->s.zto);
+  usysdep_spool_pause ();
+  return fret;
+}
+
 /* This is called when a file has been completely received.  It sends
    a response to the remote system.  */
 
@@ -944,9 +1150,8 @@ static boolean
 frec_file_end (struct stransfer *qtrans, struct sdaemon *qdaemon, const char *zdata ATTRIBUTE_UNUSED, size_t cdata ATTRIBUTE_UNUSED)
 {
   struct srecinfo *qinfo = (struct srecinfo *) qtrans->pinfo;
-  char *zalc;
   const char *zerr;
-  boolean fnever;
+  boolean fgroup;
 
   DEBUG_MESSAGE3 (DEBUG_UUCP_PROTO, "frec_file_end: %s to %s (freplied %s)",
 		  qtrans->s.zfrom, qtrans->s.zto,
@@ -969,11 +1174,36 @@ frec_file_end (struct stransfer *qtrans, struct sdaemon *qdaemon, const char *zd
 
   qinfo->freceived = TRUE;
 
-  fnever = FALSE;
+  /* Whatever happens below, the temporary file will not be
+     restarted.  */
+  if (qinfo->fcheckpoint)
+    (void) fsysdep_forget_checkpoint (qdaemon->qsys, qtrans->s.ztemp);
 
-  zalc = NULL;
+  fgroup = frec_group_sync (qdaemon, qtrans);
 
-  if (! fsysdep_sync (qtrans->e, qtrans->s.zto))
+  if (qtrans->qcompress != NULL)
+    ucompress_log (qtrans->qcompress);
+  if (qtrans->qdelta != NULL)
+    udelta_log (qtrans->qdelta);
+
+  if (qtrans->qcompress != NULL
+      && ! fcompress_complete (qtrans->qcompress))
+    {
+      zerr = "compressed data truncated";
+      ulog (LOG_ERROR, "%s: %s", qtrans->s.zto, zerr);
+      (void) ffileclose (qtrans->e);
+      qtrans->e = EFILECLOSED;
+      (void) remove (qinfo->ztemp);
+    }
+  else if (qtrans->qdelta != NULL
+	   && ! fdelta_complete (qtrans->qdelta, &zerr))
+    {
+      ulog (LOG_ERROR, "%s: %s", qtrans->s.zto, zerr);
+      (void) ffileclose (qtrans->e);
+      qtrans->e = EFILECLOSED;
+      (void) remove (qinfo->ztemp);
+    }
+  else if (! frec_sync (qtrans, fgroup))
     {
       zerr = strerror (errno);
       (void) ffileclose (qtrans->e);
@@ -990,6 +1220,64 @@ frec_file_end (struct stransfer *qtrans, struct sdaemon *qdaemon, const char *zd
   else
     {
       qtrans->e = EFILECLOSED;
+      if (fgroup)
+	return fqueue_sync (qdaemon, qtrans);
+      zerr = NULL;
+    }
+
+  /* The confirmations must be sent in the order in which the files
+     arrived, so finish any files which are waiting to be synced.  */
+  if (! fqueue_sync_flush (qdaemon))
+    return FALSE;
+
+  return frec_file_finish (qtrans, qdaemon, zerr);
+}
+
+/* Finish receiving a file queued by fqueue_sync.  */
+
+boolean
+frec_file_synced (struct sdaemon *qdaemon, struct stransfer *qtrans, boolean fsynced)
+{
+  struct srecinfo *qinfo = (struct srecinfo *) qtrans->pinfo;
+  const char *zerr;
+
+  /* fsysdep_spool_commit has already logged any error.  */
+  if (fsynced)
+    zerr = NULL;
+  else
+    {
+      zerr = "could not sync to disk";
+      (void) remove (qinfo->ztemp);
+    }
+
+  if (! frec_file_finish (qtrans, qdaemon, zerr))
+    return FALSE;
+
+  /* If we had not replied to the request yet, fqueue_sync took the
+     transfer off the send queue; put it back, so that the reply is
+     sent followed by the confirmation.  */
+  if (! qinfo->freplied)
+    return fqueue_send (qdaemon, qtrans);
+
+  return TRUE;
+}
+
+/* Move a received file into place, unless zerr says why it was
+   rejected, and send a response to the remote system.  */
+
+static boolean
+frec_file_finish (struct stransfer *qtrans, struct sdaemon *qdaemon, const char *zerr)
+{
+  struct srecinfo *qinfo = (struct srecinfo *) qtrans->pinfo;
+  char *zalc;
+  boolean fnever;
+
+  fnever = FALSE;
+
+  zalc = NULL;
+
+  if (zerr == NULL)
+    {
       if (! fsysdep_move_file (qinfo->ztemp, qinfo->zfile, qinfo->fspool,
 			       FALSE, ! qinfo->fspool,
 			       (qinfo->flocal
@@ -1057,8 +1345,6 @@ frec_file_end (struct stransfer *qtrans, struct sdaemon *qdaemon, const char *zd
 		imode = 0666;
 	      (void) fsysdep_change_mode (qinfo->zfile, imode);
 	    }
-  
-	  zerr = NULL;
 	}
     }
 
@@ -1320,5 +1606,160 @@ frec_discard_temp (struct sdaemon *qdaemon, struct stransfer *qtrans)
       || qtrans->s.ztemp[0] != 'D'
       || strcmp (qtrans->s.ztemp, "D.0") == 0)
     (void) remove (qinfo->ztemp);
+  else
+    (void) frec_checkpoint (qdaemon, qtrans);
   return TRUE;
 }
+
+/* Record how much of a file we have safely received, so that if the
+   conversation is lost the file can be restarted from there.  This is
+   called every CHECKPOINT_DELTA bytes, and when the connection is
+   lost.  The CRC lets the next conversation check that the data is
+   still what we wrote.  */
+
+boolean
+frec_checkpoint (struct sdaemon *qdaemon, struct stransfer *qtrans)
+{
+  struct srecinfo *qinfo = (struct srecinfo *) qtrans->pinfo;
+  struct scheckpoint sck;
+
+  if (! qinfo->fcheckpoint || ! ffileisopen (qtrans->e))
+    return TRUE;
+
+  /* With multiple channels, the other side may start sending the
+     file from the beginning before it sees where we want to restart;
+     in that case we must start the CRC again.  */
+  if (qtrans->ipos < qinfo->cverified)
+    {
+      qinfo->cverified = 0;
+      qinfo->icrc = ICRCINIT;
+    }
+
+  if (! fsysdep_sync (qtrans->e, qtrans->s.zto))
+    return FALSE;
+  if (! frec_crc_file (qdaemon->qsys, qinfo->ztemp, qinfo->cverified,
+		       qtrans->ipos, &qinfo->icrc))
+    return FALSE;
+  qinfo->cverified = qtrans->ipos;
+
+  DEBUG_MESSAGE2 (DEBUG_UUCP_PROTO,
+		  "frec_checkpoint: %s verified to %ld",
+		  qtrans->s.zto, qinfo->cverified);
+
+  sck.zfrom = (char *) qtrans->s.zfrom;
+  sck.zto = (char *) qtrans->s.zto;
+  sck.cbytes = qtrans->s.cbytes;
+  sck.cverified = qinfo->cverified;
+  sck.icrc = qinfo->icrc;
+  return fsysdep_write_checkpoint (qdaemon->qsys, qtrans->s.ztemp, &sck);
+}
+
+/* Extend a CRC over the bytes from istart to iend of a file.  */
+
+static boolean
+frec_crc_file (const struct uuconf_system *qsys, const char *zfile, long istart, long iend, unsigned long *picrc)
+{
+  openfile_t e;
+  char ab[8192];
+  boolean fret;
+
+  if (istart >= iend)
+    return TRUE;
+
+  e = esysdep_open_send (qsys, zfile, FALSE, (const char *) NULL);
+  if (! ffileisopen (e))
+    return FALSE;
+
+  fret = TRUE;
+  if (istart > 0 && ! ffileseek (e, istart))
+    {
+      ulog (LOG_ERROR, "seek: %s", strerror (errno));
+      fret = FALSE;
+    }
+
+  while (fret && istart < iend)
+    {
+      size_t c;
+      int cread;
+
+      c = sizeof ab;
+      if ((long) c > iend - istart)
+	c = (size_t) (iend - istart);
+      cread = cfileread (e, ab, c);
+      if (ffileioerror (e, cread))
+	{
+	  ulog (LOG_ERROR, "read: %s", strerror (errno));
+	  fret = FALSE;
+	}
+      else if (cread == 0)
+	{
+	  ulog (LOG_ERROR, "%s: file shorter than expected", zfile);
+	  fret = FALSE;
+	}
+      else
+	{
+	  *picrc = icrc (ab, (size_t) cread, *picrc);
+	  istart += cread;
+	}
+    }
+
+  (void) ffileclose (e);
+  return fret;
+}
+
+/* Decide where to restart a file which was partially received in an
+   earlier conversation; crestart is the size of the temporary file.
+   If there is a checkpoint, we only trust the part of the file it
+   covers, and only if it is for the same file and the data still
+   matches its CRC.  Otherwise this returns 0, and the file is
+   received again from the start.  A temporary file without a
+   checkpoint was left by an older version, so we trust all of it, as
+   that version did.  This sets *pcverified and *picrc to the CRC
+   state for the returned position.  */
+
+static long
+crec_checkpoint_restart (const struct uuconf_system *qsys, const struct scmd *qcmd, const char *ztemp, long crestart, long *pcverified, unsigned long *picrc)
+{
+  struct scheckpoint sck;
+  boolean fbad;
+  const char *zwhy;
+  unsigned long ick;
+
+  ick = ICRCINIT;
+  if (! fsysdep_read_checkpoint (qsys, qcmd->ztemp, &sck, &fbad))
+    return fbad ? 0 : crestart;
+
+  if (strcmp (sck.zfrom, qcmd->zfrom) != 0
+      || strcmp (sck.zto, qcmd->zto) != 0
+      || sck.cbytes != qcmd->cbytes)
+    zwhy = "it is a different file";
+  else if (sck.cverified > crestart
+	   || (sck.cbytes == -1 && sck.cverified != crestart)
+	   || (sck.cbytes != -1 && crestart > sck.cbytes))
+    zwhy = "the temporary file has changed size";
+  else
+    {
+      if (! frec_crc_file (qsys, ztemp, (long) 0, sck.cverified, &ick))
+	zwhy = "the temporary file can not be read";
+      else if (ick != sck.icrc)
+	zwhy = "the temporary file is corrupt";
+      else
+	zwhy = NULL;
+    }
+
+  ubuffree (sck.zfrom);
+  ubuffree (sck.zto);
+
+  if (zwhy != NULL)
+    {
+      ulog (LOG_NORMAL, "%s: Not restarting from checkpoint: %s",
+	    qcmd->zto, zwhy);
+      *pcverified = 0;
+      *picrc = ICRCINIT;
+      return 0;
+    }
+
+  *pcverified = sck.cverified;
+  *picrc = ick;
+  return sck.cverified;
+}
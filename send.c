@@ -55,6 +55,12 @@ struct ssendinfo
   /* TRUE if the file send will never succeed; used by
      flocal_send_cancelled.  */
   boolean fnever;
+  /* TRUE if the file was cancelled before it was opened, so
+     flocal_send_cancelled must send the end of file itself.  */
+  boolean fsendeof;
+  /* TRUE if we offered to send the file as a delta, so we must wait
+     for the reply before sending any data.  */
+  boolean fdelta;
   /* Execution file for sending an unsupported E request.  */
   char *zexec;
   /* Confirmation command received in fsend_await_confirm.  */
@@ -281,12 +287,15 @@ flocal_send_file_init (struct sdaemon *qdaemon, struct scmd *qcmd)
   qinfo->flocal = strchr (qcmd->zuser, '!') == NULL;
   qinfo->fspool = fspool;
   qinfo->fsent = FALSE;
+  qinfo->fsendeof = FALSE;
+  qinfo->fdelta = FALSE;
   qinfo->zexec = NULL;
   qinfo->zconfirm = NULL;
 
   qtrans = qtransalc (qcmd);
   qtrans->psendfn = flocal_send_request;
   qtrans->pinfo = (pointer) qinfo;
+  qtrans->csize = cbytes;
 
   return fqueue_local (qdaemon, qtrans);
 }
@@ -356,6 +365,8 @@ flocal_send_request (struct stransfer *qtrans, struct sdaemon *qdaemon)
   struct scmd squoted;
   const char *znotify;
   char absize[20];
+  const char *zcompress;
+  const char *zdelta;
   char *zsend;
   boolean fret;
 
@@ -389,7 +400,13 @@ flocal_send_request (struct stransfer *qtrans, struct sdaemon *qdaemon)
   qtrans->psendfn = flocal_send_open_file;
   qtrans->precfn = flocal_send_await_reply;
 
-  if (qdaemon->cchans > 1)
+  /* If we offer to send the file as a delta, we can't send anything
+     until the reply tells us whether the remote system took us up on
+     it.  */
+  qinfo->fdelta = (qinfo->zexec == NULL
+		   && fdelta_file (qdaemon, qtrans->s.zto, qinfo->cbytes));
+
+  if (qdaemon->cchans > 1 && ! qinfo->fdelta)
     fret = fqueue_send (qdaemon, qtrans);
   else
     fret = fqueue_receive (qdaemon, qtrans);
@@ -442,6 +459,25 @@ flocal_send_request (struct stransfer *qtrans, struct sdaemon *qdaemon)
   else
     sprintf (absize, "%ld", qinfo->cbytes);
 
+  /* If we are going to compress the file data, tell the other side
+     with a 'z' option.  The other side will not ask us to restart the
+     file part way through, since the position would be in the
+     compressed data.  */
+  if (qinfo->zexec == NULL
+      && qtrans->qcompress == NULL
+      && fcompress_file (qdaemon, qinfo->cbytes))
+    qtrans->qcompress = qcompress_start (qdaemon, TRUE);
+  if (qtrans->qcompress != NULL)
+    zcompress = "z";
+  else
+    zcompress = "";
+
+  /* A 'D' option offers to send the file as a delta.  */
+  if (qinfo->fdelta)
+    zdelta = "D";
+  else
+    zdelta = "";
+
   zsend = zbufalc (strlen (qcmd->zfrom) + strlen (qcmd->zto)
 		   + strlen (qcmd->zuser) + strlen (qcmd->zoptions)
 		   + strlen (qcmd->ztemp) + strlen (znotify)
@@ -461,8 +497,8 @@ flocal_send_request (struct stransfer *qtrans, struct sdaemon *qdaemon)
 	 E zfrom zto zuser zoptions ztemp imode znotify size zcmd
 	 to the remote system.  We put a '-' in front of the (possibly
 	 empty) options and a '0' in front of the mode.  */
-      sprintf (zsend, "E %s %s %s -%s %s 0%o %s %s %s", qcmd->zfrom,
-	       qcmd->zto, qcmd->zuser, qcmd->zoptions,
+      sprintf (zsend, "E %s %s %s -%s%s %s 0%o %s %s %s", qcmd->zfrom,
+	       qcmd->zto, qcmd->zuser, qcmd->zoptions, zcompress,
 	       qcmd->ztemp, qcmd->imode, znotify, absize,
 	       qcmd->zcmd);
     }
@@ -499,8 +535,8 @@ flocal_send_request (struct stransfer *qtrans, struct sdaemon *qdaemon)
       else
 	zdummy = " ";
 
-      sprintf (zsend, "S %s %s %s -%s %s 0%o %s%s%s", qcmd->zfrom,
-	       qcmd->zto, qcmd->zuser, zoptions,
+      sprintf (zsend, "S %s %s %s -%s%s%s %s 0%o %s%s%s", qcmd->zfrom,
+	       qcmd->zto, qcmd->zuser, zoptions, zcompress, zdelta,
 	       qcmd->ztemp, qcmd->imode, znotify, zdummy,
 	       absize);
     }
@@ -639,10 +675,16 @@ flocal_send_await_reply (struct stransfer *qtrans, struct sdaemon *qdaemon, cons
 	      usfree_send (qtrans);
 	      return FALSE;
 	    }
+	  if (qtrans->qcompress != NULL)
+	    {
+	      ucompress_free (qtrans->qcompress);
+	      qtrans->qcompress = NULL;
+	    }
 	  qtrans->psendfn = flocal_send_cancelled;
 	  qtrans->precfn = NULL;
 
 	  qinfo->fnever = fnever;
+	  qinfo->fsendeof = ! qtrans->fsendfile;
 
 	  return fqueue_send (qdaemon, qtrans);
 	}
@@ -650,12 +692,47 @@ flocal_send_await_reply (struct stransfer *qtrans, struct sdaemon *qdaemon, cons
 
   /* A number following the SY or EY is the file position to start
      sending from.  If we are already sending the file, we must set
-     the position accordingly.  */
+     the position accordingly.  If we offered to send a delta, the
+     reply may instead hold a D followed by the signatures of the
+     remote system's old copy of the file.  */
   if (zdata[2] != '\0')
     {
       long cskip;
+      const char *zsigs;
+
+      zsigs = NULL;
+      if (qinfo->fdelta)
+	zsigs = strstr (zdata + 2, " D ");
+      if (zsigs != NULL)
+	{
+	  qtrans->qdelta = qdelta_send_start (zsigs + sizeof " D " - 1);
+	  if (qtrans->qdelta == NULL)
+	    {
+	      ulog (LOG_ERROR, "%s: Bad delta signatures in reply",
+		    qtrans->s.zfrom);
+	      usfree_send (qtrans);
+	      return FALSE;
+	    }
+	  DEBUG_MESSAGE1 (DEBUG_UUCP_PROTO,
+			  "flocal_send_await_reply: Sending %s as a delta",
+			  qtrans->s.zfrom);
+
+	  /* The delta replaces compression.  */
+	  if (qtrans->qcompress != NULL)
+	    {
+	      ucompress_free (qtrans->qcompress);
+	      qtrans->qcompress = NULL;
+	    }
+	}
 
       cskip = strtol ((char *) (zdata + 2), (char **) NULL, 0);
+      if (cskip > 0 && qtrans->qcompress != NULL)
+	{
+	  ulog (LOG_ERROR, "%s: Can't restart compressed file",
+		qtrans->s.zfrom);
+	  usfree_send (qtrans);
+	  return FALSE;
+	}
       if (cskip > 0 && qtrans->ipos < cskip)
 	{
 	  if (qtrans->fsendfile && ! qinfo->fsent)
@@ -680,7 +757,7 @@ flocal_send_await_reply (struct stransfer *qtrans, struct sdaemon *qdaemon, cons
   qtrans->precfn = fsend_await_confirm;
   if (qinfo->fsent)
     return fqueue_receive (qdaemon, qtrans);
-  else if (qdaemon->cchans <= 1)
+  else if (qdaemon->cchans <= 1 || qinfo->fdelta)
     return fqueue_send (qdaemon, qtrans);
   else
     return TRUE;
@@ -813,6 +890,26 @@ flocal_send_cancelled (struct stransfer *qtrans, struct sdaemon *qdaemon)
 {
   struct ssendinfo *qinfo = (struct ssendinfo *) qtrans->pinfo;
 
+  /* If the file was never opened, floop has not sent an end of file
+     marker, but the remote system is waiting for one.  */
+  if (qinfo->fsendeof)
+    {
+      char *zdata;
+      size_t cdata;
+
+      qinfo->fsendeof = FALSE;
+      zdata = (*qdaemon->qproto->pzgetspace) (qdaemon, &cdata);
+      if (zdata == NULL
+	  || ! (*qdaemon->qproto->pfsenddata) (qdaemon, zdata, (size_t) 0,
+					       qtrans->ilocal,
+					       qtrans->iremote,
+					       qtrans->ipos))
+	{
+	  usfree_send (qtrans);
+	  return FALSE;
+	}
+    }
+
   /* If we are breaking a 'E' command into two 'S' commands, and that
      was for the first 'S' command, and the first 'S' command will
      never be sent, we still have to send the second one.  */
@@ -933,6 +1030,8 @@ fremote_rec_file_init (struct sdaemon *qdaemon, struct scmd *qcmd, int iremote)
   qinfo->flocal = FALSE;
   qinfo->fspool = FALSE;
   qinfo->fsent = FALSE;
+  qinfo->fsendeof = FALSE;
+  qinfo->fdelta = FALSE;
   qinfo->zexec = NULL;
   qinfo->zconfirm = NULL;
 
@@ -942,6 +1041,7 @@ fremote_rec_file_init (struct sdaemon *qdaemon, struct scmd *qcmd, int iremote)
   qtrans->pinfo = (pointer) qinfo;
   qtrans->e = e;
   qtrans->ipos = qcmd->ipos;
+  qtrans->csize = cbytes;
   qtrans->s.imode = imode;
 
   return fqueue_remote (qdaemon, qtrans);
@@ -964,6 +1064,11 @@ fremote_rec_reply (struct stransfer *qtrans, struct sdaemon *qdaemon)
   if (! fqueue_send (qdaemon, qtrans))
     return FALSE;
 
+  /* If we are starting at the beginning of the file, we may compress
+     it; if so, we tell the other side with a Z after the mode.  */
+  if (qtrans->ipos == 0 && fcompress_file (qdaemon, qinfo->cbytes))
+    qtrans->qcompress = qcompress_start (qdaemon, TRUE);
+
   qtrans->zlog = zbufalc (sizeof "Sending ( bytes) "
 			  + strlen (qtrans->s.zfrom) + 25);
   sprintf (qtrans->zlog, "Sending %s (%ld bytes)", qtrans->s.zfrom,
@@ -976,8 +1081,9 @@ fremote_rec_reply (struct stransfer *qtrans, struct sdaemon *qdaemon)
   if (qdaemon->frequest_hangup)
     DEBUG_MESSAGE0 (DEBUG_UUCP_PROTO,
 		    "fremote_rec_reply: Requesting remote to transfer control");
-  sprintf (absend, "RY 0%o%s 0x%lx%s", qtrans->s.imode,
+  sprintf (absend, "RY 0%o%s%s 0x%lx%s", qtrans->s.imode,
 	   qdaemon->frequest_hangup ? "M" : "",
+	   qtrans->qcompress != NULL ? "Z" : "",
 	   (unsigned long) qinfo->cbytes,
 	   qdaemon->frequest_hangup ? "M" : "");
   if (! (*qdaemon->qproto->pfsendcmd) (qdaemon, absend, qtrans->ilocal,
@@ -1084,7 +1190,13 @@ fsend_file_end (struct stransfer *qtrans, struct sdaemon *qdaemon)
 	return TRUE;
     }
 
+  if (qtrans->qcompress != NULL)
+    ucompress_log (qtrans->qcompress);
+  if (qtrans->qdelta != NULL)
+    udelta_log (qtrans->qdelta);
+
   qinfo->fsent = TRUE;
+  qtrans->fconfirm = TRUE;
 
   /* If zconfirm is set, then we have already received the
      confirmation, and should call fsend_await_confirm directly.  */
@@ -1290,6 +1402,8 @@ fsend_exec_file_init (struct stransfer *qtrans, struct sdaemon *qdaemon)
   qtrans->isecs = 0;
   qtrans->imicros = 0;
   qinfo->fsent = FALSE;
+  qinfo->fsendeof = FALSE;
+  qinfo->fdelta = FALSE;
   ubuffree (qinfo->zconfirm);
   qinfo->zconfirm = NULL;
 
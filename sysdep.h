@@ -31,6 +31,7 @@
    header file.  */
 struct uuconf_system;
 struct sconnection;
+struct sconn_iov;
 #endif
 
 /* SCO, SVR4 and Sequent lockfiles are basically just like HDB
@@ -44,10 +45,18 @@ struct sconnection;
  #error Terminal driver define not set or duplicated
 #endif
 
-#if SPOOLDIR_V2 + SPOOLDIR_BSD42 + SPOOLDIR_BSD43 + SPOOLDIR_HDB + SPOOLDIR_ULTRIX + SPOOLDIR_SVR4 + SPOOLDIR_TAYLOR != 1
+#if SPOOLDIR_V2 + SPOOLDIR_BSD42 + SPOOLDIR_BSD43 + SPOOLDIR_HDB + SPOOLDIR_ULTRIX + SPOOLDIR_SVR4 + SPOOLDIR_TAYLOR + SPOOLDIR_HASHED != 1
  #error Spool directory define not set or duplicated
 #endif
 
+/* SPOOLDIR_HASHED is SPOOLDIR_TAYLOR with the command and data files
+   moved down one directory level, so everything else about
+   SPOOLDIR_TAYLOR applies to it.  */
+#if SPOOLDIR_HASHED
+#undef SPOOLDIR_TAYLOR
+#define SPOOLDIR_TAYLOR 1
+#endif
+
 /* If setreuid is broken, don't use it.  */
 #if HAVE_BROKEN_SETREUID
 #undef HAVE_SETREUID
@@ -398,8 +407,22 @@ extern boolean fsysdep_conn_write P((struct sconnection *qconn,
 extern boolean fsysdep_conn_io P((struct sconnection *qconn,
 				  const char *zwrite, size_t *pcwrite,
 				  char *zread, size_t *pcread));
+extern boolean fsysdep_conn_writev P((struct sconnection *qconn,
+				      const struct sconn_iov *qiov,
+				      int ciov));
+extern boolean fsysdep_conn_iov P((struct sconnection *qconn,
+				   const struct sconn_iov *qiov, int ciov,
+				   size_t *pcwrite, char *zread,
+				   size_t *pcread));
 extern boolean fsysdep_conn_chat P((struct sconnection *qconn,
 				    char **pzprog));
+extern boolean fsysdep_conn_sendfile P((struct sconnection *qconn,
+					openfile_t e, size_t *pclen));
+extern boolean fsysdep_conn_recvfile P((struct sconnection *qconn,
+					openfile_t e, size_t *pclen));
+extern boolean fsysdep_conn_trywrite P((struct sconnection *qconn,
+					const struct sconn_iov *qiov,
+					int ciov, size_t *pcwrite));
 
 /* Set a signal handler.  */
 extern void usset_signal P((int isig, RETSIGTYPE (*pfn) P((int)),
@@ -448,6 +471,18 @@ extern boolean fsdouble_read P((struct sconnection *qconn, char *zbuf,
 extern boolean fsdouble_write P((struct sconnection *qconn,
 				 const char *zbuf, size_t clen));
 
+/* Write several pieces to a connection using two file descriptors.  */
+extern boolean fsdouble_writev P((struct sconnection *qconn,
+				  const struct sconn_iov *qiov, int ciov));
+
+/* Write from a file to a connection using two file descriptors.  */
+extern boolean fsdouble_sendfile P((struct sconnection *qconn,
+				    openfile_t e, size_t *pclen));
+
+/* Read from a connection into a file using two file descriptors.  */
+extern boolean fsdouble_recvfile P((struct sconnection *qconn,
+				    openfile_t e, size_t *pclen));
+
 /* Run a chat program on a connection using two file descriptors.  */
 extern boolean fsdouble_chat P((struct sconnection *qconn,
 				char **pzprog));
@@ -461,6 +496,18 @@ extern char *zsfind_file P((const char *zsimple, const char *zsystem,
 /* Return the grade given a sequence number.  */
 extern int bsgrade P((pointer pseq));
 
+/* Get the modification time of the directory holding a command file,
+   before adding or removing it.  */
+extern long iswork_index_stamp P((const char *zfile));
+
+/* Record in the work index that a command file was added or
+   removed.  */
+extern void uswork_index_note P((const char *zfile, long istamp,
+				 boolean fadd));
+
+/* Throw away the work index for a system.  */
+extern void uswork_index_discard P((const char *zsystem));
+
 /* Lock a string.  */
 extern boolean fsdo_lock P((const char *, boolean fspooldir,
 			    boolean *pferr));
@@ -556,6 +603,11 @@ extern const char *zSspooldir;
 /* The lock directory name.  */
 extern const char *zSlockdir;
 
+/* TRUE while syncs of spool files are being put off, between a call
+   to usysdep_spool_batch and the next call to usysdep_spool_pause or
+   fsysdep_spool_commit.  */
+extern boolean fSspool_batch;
+
 /* The local UUCP name (needed for some spool directory stuff).  */
 extern const char *zSlocalname;
 
@@ -35,6 +35,7 @@ struct uuconf_system;
 struct uuconf_port;
 struct sconnection;
 struct sstatus;
+struct scheckpoint;
 struct scmd;
 #endif
 
@@ -355,6 +356,21 @@ extern char *zsysdep_save_failed_file P((const char *zfile));
    fsysdep_get_work.  This may be called even though
    fsysdep_get_work_init has not been.  */
 extern void usysdep_get_work_free P((const struct uuconf_system *qsys));
+
+/* Start watching for new work queued for a system during a
+   conversation.  This returns FALSE if the system can not watch for
+   new work, in which case the work queue must be checked
+   periodically.  */
+extern boolean fsysdep_watch_work P((const struct uuconf_system *qsys));
+
+/* Report whether any new work may have been queued since the last
+   call.  This must not block.  It may return TRUE when there is no
+   new work.  */
+extern boolean fsysdep_new_work P((void));
+
+/* Stop watching for new work.  This may be called even though
+   fsysdep_watch_work has not been.  */
+extern void usysdep_watch_work_free P((void));
 
 /* Add a base name to a file if it is a directory.  If zfile names a
    directory, then return a string naming a file within the directory
@@ -474,6 +490,24 @@ extern openfile_t esysdep_truncate P((openfile_t e, const char *zname));
    the zmsg parameter, and return FALSE.  This is controlled by the
    FSYNC_ON_CLOSE macro in policy.h.  */
 extern boolean fsysdep_sync P((openfile_t e, const char *zmsg));
+
+/* Start a batch of spool files.  Until fsysdep_spool_commit is
+   called, fsysdep_sync may skip forcing files in the spool directory
+   out to disk.  A program which queues many jobs at once may use
+   this to pay for a single sync rather than one for each file.  */
+extern void usysdep_spool_batch P((void));
+
+/* Stop putting off syncs for the current batch.  Files written after
+   this are synced as usual by fsysdep_sync.  The files whose syncs
+   were already put off are still forced out by the next call to
+   fsysdep_spool_commit.  Calling usysdep_spool_batch again resumes
+   the batch.  */
+extern void usysdep_spool_pause P((void));
+
+/* Finish a batch started by usysdep_spool_batch, forcing every file
+   written during the batch out to disk.  This should return FALSE
+   on error.  It does nothing if no batch was started.  */
+extern boolean fsysdep_spool_commit P((void));
 
 /* It is possible for the acknowledgement of a received file to be
    lost.  The sending system will then now know that the file was
@@ -510,6 +544,31 @@ extern boolean fsysdep_already_received P((const struct uuconf_system *qsys,
 extern boolean fsysdep_forget_reception P((const struct uuconf_system *qsys,
 					   const char *zto,
 					   const char *ztemp));
+
+/* Write a checkpoint for a file which is being received, and which
+   may be restarted in a later conversation.  The ztemp argument is
+   the temporary file name from the sending system, as for
+   fsysdep_remember_reception.  The caller must already have flushed
+   the received data to disk.  This should return FALSE on error.  */
+extern boolean fsysdep_write_checkpoint P((const struct uuconf_system *qsys,
+					   const char *ztemp,
+					   const struct scheckpoint *qck));
+
+/* Read the checkpoint written by fsysdep_write_checkpoint.  This
+   should return FALSE, without reporting an error, if there is no
+   checkpoint.  If the checkpoint can not be read, it should report
+   an error and return FALSE with *pfbad set to TRUE.  The zfrom and
+   zto fields of qck must be freed using ubuffree.  */
+extern boolean fsysdep_read_checkpoint P((const struct uuconf_system *qsys,
+					  const char *ztemp,
+					  struct scheckpoint *qck,
+					  boolean *pfbad));
+
+/* Remove the checkpoint for a file, if there is one.  This is called
+   when the file has been received or thrown away.  It should return
+   FALSE on error.  */
+extern boolean fsysdep_forget_checkpoint P((const struct uuconf_system *qsys,
+					    const char *ztemp));
 
 /* Start expanding a wildcarded file name.  This should return FALSE
    on error; otherwise subsequent calls to zsysdep_wildcard should
@@ -566,6 +625,28 @@ extern char *zsysdep_data_file_name P((const struct uuconf_system *qsys,
 				       char *ztname, char *zdname,
 				       char *zxname));
 
+/* Copy an open file to a data file in the spool directory.  If an
+   identical file has already been spooled, this may make the data
+   file share its contents rather than copying it.  Returns FALSE on
+   error.  */
+extern boolean fsysdep_spool_copy P((openfile_t efrom, const char *zto));
+
+/* Let a data file which has already been written to the spool
+   directory share its contents with any identical file.  Returns
+   FALSE on error; the data file is still usable.  */
+extern boolean fsysdep_spool_share P((const char *zfile));
+
+/* Remove a data file from the spool directory, releasing any
+   contents it shared with other files.  Returns 0 on success, -1 on
+   error with errno set, like remove.  */
+extern int isysdep_spool_remove P((const char *zfile));
+
+/* Move every command and data file in the spool directory to where
+   the spool directory layout this program was compiled for expects
+   it.  This is used by uuspool when changing layouts.  Sets *pcmoved
+   to the number of files moved.  Returns FALSE on error.  */
+extern boolean fsysdep_respool P((long *pcmoved));
+
 /* Get a name for a local execute file.  This is used by uux for a
    local command with remote files.  Returns NULL on error.  */
 extern char *zsysdep_xqt_file_name P((void));
@@ -859,6 +940,21 @@ extern char *zsysdep_all_status P((pointer phold, boolean *pferr,
    fsysdep_all_status_init.  */
 extern void usysdep_all_status_free P((pointer phold));
 
+/* Start getting the checkpoints of all partially received files, for
+   uustat -P.  This works like fsysdep_all_status_init.  */
+extern boolean fsysdep_all_checkpoints_init P((pointer *phold));
+
+/* Get the next checkpoint.  This should return the name of the
+   system the file is coming from and fill in qck, whose zfrom and zto
+   fields must be freed using ubuffree.  At the end, or on error, this
+   should return NULL, setting *pferr as zsysdep_all_status does.  */
+extern char *zsysdep_all_checkpoints P((pointer phold, boolean *pferr,
+					struct scheckpoint *qck));
+
+/* Free up anything allocated by fsysdep_all_checkpoints_init and
+   zsysdep_all_checkpoints.  */
+extern void usysdep_all_checkpoints_free P((pointer phold));
+
 /* Display the process status of all processes holding lock files.
    This is uustat -p.  The return value is passed to usysdep_exit.  */
 extern boolean fsysdep_lock_status P((void));
@@ -999,4 +1095,16 @@ extern char *zsysdep_uupick_local_file P((const char *zfile,
 /* Remove a directory and all the files in it.  */
 extern boolean fsysdep_rmdir P((const char *zdir));
 
+/* Allocate a buffer of c bytes which is mapped twice in a row, so
+   that the c bytes following the buffer are the buffer itself.  This
+   lets a ring buffer be read or written across its end in one piece.
+   The memory is shared with any child process.  This returns NULL,
+   without reporting an error, if it is not supported or c is not a
+   multiple of the page size.  */
+extern char *zsysdep_mirror_alloc P((size_t c));
+
+/* Free a buffer returned by zsysdep_mirror_alloc; c is the size that
+   was passed to it.  */
+extern void usysdep_mirror_free P((char *z, size_t c));
+
 #endif /* ! defined (SYSTEM_H) */
@@ -28,10 +28,12 @@
 const char trans_rcsid[] = "$Id$";
 #endif
 
+#include <ctype.h>
 #include <errno.h>
 
 #include "uudefs.h"
 #include "uuconf.h"
+#include "conn.h"
 #include "prot.h"
 #include "system.h"
 #include "trans.h"
@@ -57,6 +59,7 @@ struct sreceive_ack
 static void utqueue P((struct stransfer **, struct stransfer *,
 		       boolean fhead));
 static void utdequeue P((struct stransfer *));
+static boolean ftchan_avail P((const struct sdaemon *qdaemon));
 static void utchanalc P((struct sdaemon *qdaemon, struct stransfer *qtrans));
 __inline__ static struct stransfer *qtchan P((int ichan));
 __inline__ static void utchanfree P((struct stransfer *qtrans));
@@ -64,6 +67,7 @@ static void utfree_queue P((struct stransfer **pq));
 static boolean fttime P((struct sdaemon *qdaemon, long *pisecs,
 			 long *pimicros));
 static boolean fcheck_queue P((struct sdaemon *qdaemon));
+static boolean ftnew_work P((void));
 static boolean ftadd_cmd P((struct sdaemon *qdaemon, const char *z,
 			    size_t cdata, int iremote, boolean flast));
 static boolean fremote_hangup_reply P((struct stransfer *qtrans,
@@ -72,6 +76,15 @@ static void utfree_receive_ack P((struct sreceive_ack *q));
 static void utfree_acked P((void));
 static boolean flocal_poll_file P((struct stransfer *qtrans,
 				   struct sdaemon *qdaemon));
+static boolean ftsched P((const struct sdaemon *qdaemon));
+static boolean ftsync_wait P((void));
+static void utfailed_queue P((struct sdaemon *qdaemon,
+			      struct stransfer *qqueue));
+static long ctsched_left P((const struct stransfer *qtrans));
+static long itsched_stride P((int bgrade));
+static int itsched_cmp P((const struct stransfer *q1,
+			  const struct stransfer *q2));
+static struct stransfer *qtsched_local P((void));
 
 /* Queue of transfer structures that are ready to start which have
    been requested by the local system.  These are only permitted to
@@ -93,6 +106,14 @@ struct stransfer *qTsend;
    to receive information.  */
 static struct stransfer *qTreceive;
 
+/* Queue of received files whose sync has been put off so that they
+   can be synced together, in the order in which they were received.
+   They are not confirmed until they have been synced.  */
+static struct stransfer *qTsync;
+
+/* Number of transfer structures on qTsync.  */
+static int cTsync;
+
 /* Queue of free transfer structures.  */
 static struct stransfer *qTavail;
 
@@ -132,6 +153,35 @@ static long iTrecmicros;
    for convenience in the routines which use it.  */
 static long iTchecktime;
 
+/* The minimum amount of time, in milliseconds, between calls to
+   fsysdep_new_work.  The transfer loops would otherwise ask after
+   every packet, which costs a system call each time; this still
+   notices a new job quickly.  */
+#define CNEWWORKWAIT (20)
+
+/* The time we last called fsysdep_new_work, from
+   ixsysdep_process_time.  */
+static long iTnewworksecs;
+static long iTnewworkmicros;
+
+/* When several files are being sent at once over a protocol with
+   more than one channel, we share the line between them rather than
+   sending each file in its entirety.  A file sends at most
+   CSCHED_QUANTUM bytes before we choose again.  Files with fewer than
+   CSCHED_SMALL bytes left go first, shortest first, so that short
+   jobs such as mail are not held up behind a large file.  The larger
+   files take turns by stride scheduling: each turn adds the stride
+   for the grade of the file to its pass, and the file with the lowest
+   pass goes next.  The stride doubles every ten grades, so a file of
+   grade 0 gets 64 times the share of a file of grade z.  */
+#define CSCHED_QUANTUM (16384)
+#define CSCHED_SMALL (65536)
+
+/* The pass of the file which most recently took a turn.  A file
+   which starts sending starts from here, so that it gets no more
+   than its share.  */
+static long iTpass;
+
 /* The size of the command we have read so far in ftadd_cmd.  */
 static size_t cTcmdlen;
 
@@ -217,16 +267,23 @@ fqueue_remote (struct sdaemon *qdaemon ATTRIBUTE_UNUSED, struct stransfer *qtran
 /* Queue up a transfer with something to send.  */
 
 boolean
-fqueue_send (struct sdaemon *qdaemon ATTRIBUTE_UNUSED, struct stransfer *qtrans)
+fqueue_send (struct sdaemon *qdaemon, struct stransfer *qtrans)
 {
+  boolean fsched;
+
 #if DEBUG > 0
   if (qtrans->psendfn == NULL)
     ulog (LOG_FATAL, "fqueue_send: Bad call");
 #endif
   utdequeue (qtrans);
 
+  fsched = ftsched (qdaemon) && qtrans->fsendfile;
+  if (fsched && qtrans->ipass < 0)
+    qtrans->ipass = iTpass;
+
   /* Sort the send queue to always send commands before files, and to
-     sort jobs by grade.  */
+     sort jobs by grade.  When sharing the line between several files,
+     sort the files as described above CSCHED_QUANTUM.  */
   if (qTsend == NULL)
     utqueue (&qTsend, qtrans, FALSE);
   else
@@ -241,7 +298,9 @@ fqueue_send (struct sdaemon *qdaemon ATTRIBUTE_UNUSED, struct stransfer *qtrans)
 	  if (! qtrans->fsendfile && q->fsendfile)
 	    break;
 	  if ((! qtrans->fsendfile || q->fsendfile)
-	      && UUCONF_GRADE_CMP (qtrans->s.bgrade, q->s.bgrade) < 0)
+	      && (fsched && q->fsendfile
+		  ? itsched_cmp (qtrans, q) < 0
+		  : UUCONF_GRADE_CMP (qtrans->s.bgrade, q->s.bgrade) < 0))
 	    break;
 
 	  ffirst = FALSE;
@@ -283,15 +342,228 @@ fqueue_receive (struct sdaemon *qdaemon ATTRIBUTE_UNUSED, struct stransfer *qtra
   return TRUE;
 }
 
+/* Queue up a received file whose sync has been put off.  Once
+   FSYNC_GROUP files are waiting, sync them all.  Taking the transfer
+   off qTreceive means that no more data will be routed to it.  */
+
+boolean
+fqueue_sync (struct sdaemon *qdaemon, struct stransfer *qtrans)
+{
+  utdequeue (qtrans);
+  utqueue (&qTsync, qtrans, FALSE);
+  ++cTsync;
+  if (cTsync < FSYNC_GROUP)
+    return TRUE;
+  return fqueue_sync_flush (qdaemon);
+}
+
+/* Sync the received files waiting on qTsync, and let each of them go
+   on to be moved into place and confirmed.  */
+
+boolean
+fqueue_sync_flush (struct sdaemon *qdaemon)
+{
+  boolean fsynced, fret;
+
+  if (qTsync == NULL)
+    return TRUE;
+
+  DEBUG_MESSAGE1 (DEBUG_UUCP_PROTO, "fqueue_sync_flush: Syncing %d files",
+		  cTsync);
+
+  fsynced = fsysdep_spool_commit ();
+
+  fret = TRUE;
+  while (qTsync != NULL)
+    {
+      struct stransfer *q;
+
+      q = qTsync;
+      utdequeue (q);
+      if (! frec_file_synced (qdaemon, q, fsynced))
+	fret = FALSE;
+    }
+  cTsync = 0;
+
+  return fret;
+}
+
+/* See whether we may keep waiting before syncing the files on
+   qTsync.  The other system may be waiting for their confirmations,
+   so we only wait if we know that it is still sending, because we
+   have accepted a file which has not all arrived yet.  */
+
+static boolean
+ftsync_wait (void)
+{
+  struct stransfer *q;
+
+  q = qTsend;
+  if (q != NULL)
+    {
+      do
+	{
+	  if (q->frecfile)
+	    return TRUE;
+	  q = q->qnext;
+	}
+      while (q != qTsend);
+    }
+
+  q = qTreceive;
+  if (q != NULL)
+    {
+      do
+	{
+	  if (q->frecfile)
+	    return TRUE;
+	  q = q->qnext;
+	}
+      while (q != qTreceive);
+    }
+
+  return FALSE;
+}
+
+/* See whether we can start another local request.  Normally this
+   requires a free channel.  When pipelining, we may also start one
+   if every active transfer has sent its file and is only waiting for
+   the confirmation; the replies arrive in the order the requests
+   were sent, so they are matched up through qTreceive.  We stop
+   doing this once the remote has asked for a hangup, so that it gets
+   a chance to become master.
+
+   This only ever puts one file in flight.  A file's data can not be
+   sent until its SY arrives, because the remote may refuse it, and
+   the next command can not be sent in the middle of that data, since
+   on a single channel protocol the remote would read it as file data.
+   So each file still costs the S/SY round trip; only the wait for
+   the CY overlaps with the next file.  */
+
+static boolean
+ftchan_avail (const struct sdaemon *qdaemon)
+{
+  int i;
+
+  if (cTchans < qdaemon->cchans)
+    return TRUE;
+  if (! qdaemon->fpipeline
+      || qdaemon->fhangup_requested
+      || cTchans >= IMAX_CHAN)
+    return FALSE;
+  for (i = 1; i <= IMAX_CHAN; i++)
+    if (aqTchan[i] != NULL && ! aqTchan[i]->fconfirm)
+      return FALSE;
+  DEBUG_MESSAGE1 (DEBUG_UUCP_PROTO,
+		  "ftchan_avail: Pipelining with %d awaiting confirmation",
+		  cTchans);
+  return TRUE;
+}
+
+/* See whether to share the line between the files being sent.  When
+   file data is striped across several connections, floop already
+   sends a block of each file in turn.  */
+
+static boolean
+ftsched (const struct sdaemon *qdaemon)
+{
+  return qdaemon->cchans > 1 && qdaemon->cstreams <= 1;
+}
+
+/* Return the number of bytes left to send for a transfer, or -1 if
+   that is not known.  */
+
+static long
+ctsched_left (const struct stransfer *qtrans)
+{
+  if (qtrans->csize < 0)
+    return -1;
+  if (qtrans->ipos >= qtrans->csize)
+    return 0;
+  return qtrans->csize - qtrans->ipos;
+}
+
+/* Return the stride for a grade.  Requests from the remote system
+   have no grade, and are treated as the default uucp grade.  */
+
+static long
+itsched_stride (int bgrade)
+{
+  int b;
+  int irank;
+
+  b = BUCHAR (bgrade);
+  if (! isalnum (b))
+    b = BDEFAULT_UUCP_GRADE;
+  if (isdigit (b))
+    irank = b - '0';
+  else if (isupper (b))
+    irank = 10 + b - 'A';
+  else
+    irank = 36 + b - 'a';
+  return 1L << (irank / 10);
+}
+
+/* Compare two files being sent, returning < 0 if q1 should send
+   before q2.  */
+
+static int
+itsched_cmp (const struct stransfer *q1, const struct stransfer *q2)
+{
+  long c1, c2;
+  boolean fsmall1, fsmall2;
+
+  c1 = ctsched_left (q1);
+  c2 = ctsched_left (q2);
+  fsmall1 = c1 >= 0 && c1 < CSCHED_SMALL;
+  fsmall2 = c2 >= 0 && c2 < CSCHED_SMALL;
+  if (fsmall1 && fsmall2)
+    return c1 < c2 ? -1 : c1 > c2 ? 1 : 0;
+  if (fsmall1)
+    return -1;
+  if (fsmall2)
+    return 1;
+  if (q1->ipass != q2->ipass)
+    return q1->ipass < q2->ipass ? -1 : 1;
+  return UUCONF_GRADE_CMP (q1->s.bgrade, q2->s.bgrade);
+}
+
+/* Choose the local request to start when a channel is free: the one
+   with the highest grade, and then the smallest file.  A receive
+   request has no size, but sending it only takes a command.  */
+
+static struct stransfer *
+qtsched_local (void)
+{
+  struct stransfer *q, *qbest;
+
+  qbest = qTlocal;
+  for (q = qTlocal->qnext; q != qTlocal; q = q->qnext)
+    {
+      int icmp;
+
+      icmp = UUCONF_GRADE_CMP (q->s.bgrade, qbest->s.bgrade);
+      if (icmp < 0
+	  || (icmp == 0
+	      && (q->csize < 0 ? 0 : q->csize) < (qbest->csize < 0
+						  ? 0 : qbest->csize)))
+	qbest = q;
+    }
+  return qbest;
+}
+
 /* Get a new local channel number.  */
 
 static void
 utchanalc (struct sdaemon *qdaemon, struct stransfer *qtrans)
 {
+  int cmax;
+
+  cmax = qdaemon->fpipeline ? IMAX_CHAN : qdaemon->cchans;
   do
     {
       ++iTchan;
-      if (iTchan > qdaemon->cchans)
+      if (iTchan > cmax)
 	iTchan = 1;
     }
   while (aqTchan[iTchan] != NULL);
@@ -376,6 +648,12 @@ qtransalc (struct scmd *qcmd)
   q->isecs = 0;
   q->imicros = 0;
   q->cbytes = 0;
+  q->fconfirm = FALSE;
+  q->qcompress = NULL;
+  q->qdelta = NULL;
+  q->csize = -1;
+  q->ipass = -1;
+  q->iqueuedsecs = ixsysdep_process_time (&q->iqueuedmicros);
 
   return q;
 }
@@ -408,6 +686,18 @@ utransfree (struct stransfer *q)
       q->e = EFILECLOSED;
     }
 
+  if (q->qcompress != NULL)
+    {
+      ucompress_free (q->qcompress);
+      q->qcompress = NULL;
+    }
+
+  if (q->qdelta != NULL)
+    {
+      udelta_free (q->qdelta);
+      q->qdelta = NULL;
+    }
+
 #if DEBUG > 0
   q->zcmd = NULL;
   q->s.zfrom = NULL;
@@ -446,7 +736,8 @@ static boolean
 fttime (struct sdaemon *qdaemon, long int *pisecs, long int *pimicros)
 {
   *pisecs = ixsysdep_process_time (pimicros);
-  if (*pisecs - iTchecktime >= CCHECKWAIT)
+  if (*pisecs - iTchecktime >= CCHECKWAIT
+      || ftnew_work ())
     {
       if (! fcheck_queue (qdaemon))
 	return FALSE;
@@ -454,6 +745,25 @@ fttime (struct sdaemon *qdaemon, long int *pisecs, long int *pimicros)
   return TRUE;
 }
 
+/* Ask whether a new command file has appeared, but not more often
+   than every CNEWWORKWAIT milliseconds.  Getting the time is much
+   cheaper than reading the inotify descriptor.  */
+
+static boolean
+ftnew_work (void)
+{
+  long isecs, imicros, imillis;
+
+  isecs = ixsysdep_process_time (&imicros);
+  imillis = ((isecs - iTnewworksecs) * 1000
+	     + (imicros - iTnewworkmicros) / 1000);
+  if (imillis >= 0 && imillis < CNEWWORKWAIT)
+    return FALSE;
+  iTnewworksecs = isecs;
+  iTnewworkmicros = imicros;
+  return fsysdep_new_work ();
+}
+
 /* Gather local commands and queue them up for later processing.  Also
    recompute time based control values.  */
 
@@ -586,6 +896,8 @@ uclear_queue (struct sdaemon *qdaemon)
   utfree_queue (&qTremote);
   utfree_queue (&qTsend);
   utfree_queue (&qTreceive);
+  utfree_queue (&qTsync);
+  cTsync = 0;
   cTchans = 0;
   iTchan = 0;
   qTtiming_rec = NULL;
@@ -601,7 +913,8 @@ uclear_queue (struct sdaemon *qdaemon)
 
 /* Recheck the work queue during a conversation.  This is only called
    if it's been more than CCHECKWAIT seconds since the last time the
-   queue was checked.  */
+   queue was checked, or if fsysdep_new_work reports that a new
+   command file has appeared.  */
 
 static boolean
 fcheck_queue (struct sdaemon *qdaemon)
@@ -641,6 +954,11 @@ floop (struct sdaemon *qdaemon)
 
   fret = TRUE;
 
+  /* If we can, find out about new jobs as soon as they are queued,
+     rather than waiting CCHECKWAIT seconds.  */
+  if (fsysdep_watch_work (qdaemon->qsys))
+    DEBUG_MESSAGE0 (DEBUG_UUCP_PROTO, "floop: Watching for new work");
+
   while (! qdaemon->fhangup)
     {
       register struct stransfer *q;
@@ -698,12 +1016,14 @@ floop (struct sdaemon *qdaemon)
 
 	  if (fhangup)
 	    {
+	      /* Give up being master first, since the protocol may
+		 see the reply while it is still sending the H.  */
+	      qdaemon->fmaster = FALSE;
 	      if (! (*qdaemon->qproto->pfsendcmd) (qdaemon, "H", 0, 0))
 		{
 		  fret = FALSE;
 		  break;
 		}
-	      qdaemon->fmaster = FALSE;
 	    }
 	}
 
@@ -727,10 +1047,13 @@ floop (struct sdaemon *qdaemon)
 	 queue up additional local jobs.  */
       if (qdaemon->fmaster || qdaemon->cchans > 1)
 	{
-	  while (qTlocal != NULL && cTchans < qdaemon->cchans)
+	  while (qTlocal != NULL && ftchan_avail (qdaemon))
 	    {
 	      /* We have room for an additional channel.  */
-	      q = qTlocal;
+	      if (ftsched (qdaemon))
+		q = qtsched_local ();
+	      else
+		q = qTlocal;
 	      if (! fqueue_send (qdaemon, q))
 		{
 		  fret = FALSE;
@@ -742,6 +1065,18 @@ floop (struct sdaemon *qdaemon)
 	    break;
 	}
 
+      /* Sync any received files which are waiting, unless we know
+	 that more are on the way, so that the other system gets their
+	 confirmations.  */
+      if (qTsync != NULL && ! ftsync_wait ())
+	{
+	  if (! fqueue_sync_flush (qdaemon))
+	    {
+	      fret = FALSE;
+	      break;
+	    }
+	}
+
       q = qTsend;
 
       if (q == NULL)
@@ -777,6 +1112,8 @@ floop (struct sdaemon *qdaemon)
 	      long cmax_time;
 	      long istart = 0;
 	      long inextsecs = 0, inextmicros;
+	      boolean fsched;
+	      long cturn;
 
 	      if (! fttime (qdaemon, &isecs, &imicros))
 		{
@@ -785,6 +1122,24 @@ floop (struct sdaemon *qdaemon)
 		}
 	      fcharged = FALSE;
 
+	      if (q->iqueuedsecs != -1)
+		{
+		  long cwait;
+
+		  cwait = ((isecs - q->iqueuedsecs) * 1000
+			   + (imicros - q->iqueuedmicros) / 1000);
+		  if (cwait < 0)
+		    cwait = 0;
+		  DEBUG_MESSAGE3 (DEBUG_UUCP_PROTO,
+				  "floop: %s %s waited %ld milliseconds",
+				  q->s.zfrom, q->s.zto, cwait);
+		  ++qdaemon->cwaits;
+		  qdaemon->cwait_total += cwait;
+		  if (cwait > qdaemon->cwait_max)
+		    qdaemon->cwait_max = cwait;
+		  q->iqueuedsecs = -1;
+		}
+
 	      if (q->zlog != NULL)
 		{
 		  ulog (LOG_NORMAL, "%s", q->zlog);
@@ -792,8 +1147,12 @@ floop (struct sdaemon *qdaemon)
 		  q->zlog = NULL;
 		}
 
+	      /* When sharing the line between files, the turns are
+		 shorter than the maximum file send time.  */
+	      fsched = ftsched (qdaemon);
+	      cturn = 0;
 	      cmax_time = qdaemon->qsys->uuconf_cmax_file_time;
-	      if (qdaemon->cchans <= 1)
+	      if (qdaemon->cchans <= 1 || fsched)
 		cmax_time = 0;
 	      if (cmax_time > 0)
 		istart = ixsysdep_time (NULL);
@@ -812,35 +1171,81 @@ floop (struct sdaemon *qdaemon)
 		  size_t cdata;
 		  long ipos;
 
-		  zdata = (*qdaemon->qproto->pzgetspace) (qdaemon, &cdata);
-		  if (zdata == NULL)
+		  /* If the protocol can send straight from the file, let
+		     it.  It will send nothing at the end of the file,
+		     in which case we go through the usual code.  */
+		  cdata = 0;
+		  if (q->qcompress == NULL
+		      && q->qdelta == NULL
+		      && qdaemon->qproto->pfsendfile != NULL)
 		    {
-		      fret = FALSE;
-		      break;
+		      if (! (*qdaemon->qproto->pfsendfile) (qdaemon, q->e,
+							    &cdata,
+							    q->ilocal,
+							    q->iremote,
+							    q->ipos))
+			{
+			  fret = FALSE;
+			  break;
+			}
 		    }
 
-		  if (ffileeof (q->e))
-		    cdata = 0;
+		  if (cdata > 0)
+		    zdata = NULL;
 		  else
 		    {
-		      cdata = cfileread (q->e, zdata, cdata);
-		      if (ffileioerror (q->e, cdata))
+		      zdata = (*qdaemon->qproto->pzgetspace) (qdaemon,
+							      &cdata);
+		      if (zdata == NULL)
 			{
-			  /* There is no way to report a file reading
-			     error, so we just drop the connection.  */
-			  ulog (LOG_ERROR, "read: %s", strerror (errno));
 			  fret = FALSE;
 			  break;
 			}
+
+		      if (q->qcompress != NULL)
+			{
+			  if (! fcompress_read (q->qcompress, q->e, zdata,
+						&cdata))
+			    {
+			      /* As with a read error, below, all we can
+				 do is drop the connection.  */
+			      fret = FALSE;
+			      break;
+			    }
+			}
+		      else if (q->qdelta != NULL)
+			{
+			  if (! fdelta_read (q->qdelta, q->e, zdata, &cdata))
+			    {
+			      fret = FALSE;
+			      break;
+			    }
+			}
+		      else if (ffileeof (q->e))
+			cdata = 0;
+		      else
+			{
+			  cdata = cfileread (q->e, zdata, cdata);
+			  if (ffileioerror (q->e, cdata))
+			    {
+			      /* There is no way to report a file reading
+				 error, so we just drop the connection.  */
+			      ulog (LOG_ERROR, "read: %s", strerror (errno));
+			      fret = FALSE;
+			      break;
+			    }
+			}
 		    }
 
 		  ipos = q->ipos;
 		  q->ipos += cdata;
 		  q->cbytes += cdata;
+		  cturn += cdata;
 
-		  if (! (*qdaemon->qproto->pfsenddata) (qdaemon, zdata,
-							cdata, q->ilocal,
-							q->iremote, ipos))
+		  if (zdata != NULL
+		      && ! (*qdaemon->qproto->pfsenddata) (qdaemon, zdata,
+							   cdata, q->ilocal,
+							   q->iremote, ipos))
 		    {
 		      fret = FALSE;
 		      break;
@@ -877,6 +1282,34 @@ floop (struct sdaemon *qdaemon)
 		      utdequeue (q);
 		      utqueue (&qTsend, q, FALSE);
 		    }
+		  else if (qdaemon->cstreams > 1 && q->qnext != q)
+		    {
+		      /* Each file goes over its own stream, so keep them
+			 all moving by sending a block of each in turn.  */
+		      utdequeue (q);
+		      utqueue (&qTsend, q, FALSE);
+		    }
+		  else if (qdaemon->cchans > 1 && ftnew_work ())
+		    {
+		      /* A new job has been queued, and there is a
+			 channel it could use.  Go back to the main loop
+			 to start it; this file will carry on after.  */
+		      if (! fcheck_queue (qdaemon))
+			fret = FALSE;
+		      break;
+		    }
+		  else if (fsched && cturn >= CSCHED_QUANTUM)
+		    {
+		      /* This file has had its turn.  Requeue it, and go
+			 back to the main loop so that any new local
+			 requests can start before we choose the next
+			 file to send.  */
+		      iTpass = q->ipass;
+		      q->ipass += itsched_stride (q->s.bgrade);
+		      if (! fqueue_send (qdaemon, q))
+			fret = FALSE;
+		      break;
+		    }
 		}
 
 	      if (! fret)
@@ -894,7 +1327,8 @@ floop (struct sdaemon *qdaemon)
 		  q->imicros += inextmicros - imicros;
 		}
 
-	      if (inextsecs - iTchecktime >= CCHECKWAIT)
+	      if (inextsecs - iTchecktime >= CCHECKWAIT
+		  || ftnew_work ())
 		{
 		  if (! fcheck_queue (qdaemon))
 		    {
@@ -908,7 +1342,15 @@ floop (struct sdaemon *qdaemon)
 
   ulog_user ((const char *) NULL);
 
+  /* The other system never saw a confirmation for any files still
+     waiting to be synced, so it will send them again.  */
+  if (fret && qTsync != NULL)
+    utfailed_queue (qdaemon, qTsync);
+
   (void) (*qdaemon->qproto->pfshutdown) (qdaemon);
+  uprecbuf_shutdown ();
+  upstats_write (qdaemon, fret);
+  usysdep_watch_work_free ();
 
   if (fret)
     uwindow_acked (qdaemon, TRUE);
@@ -918,6 +1360,26 @@ floop (struct sdaemon *qdaemon)
   return fret;
 }
 
+/* Report whether a command or file data for the given channels can
+   be passed to fgot_data.  This uses the same routing as fgot_data,
+   below.  */
+
+boolean
+fgot_data_ready (int ilocal, int iremote, boolean fcmd)
+{
+  struct stransfer *q;
+
+  if (ilocal > 0)
+    q = qtchan (ilocal);
+  else if (iremote > 0)
+    q = aqTremote[iremote];
+  else
+    q = NULL;
+  if (fcmd)
+    return q == NULL || q->fcmd;
+  return q != NULL && q->precfn != NULL && ! q->fcmd;
+}
+
 /* This is called by the protocol routines when they have received
    some data.  If pfexit is not NULL, *pfexit should be set to TRUE if
    the protocol receive loop should exit back to the main floop
@@ -945,6 +1407,8 @@ fgot_data (qdaemon, zfirst, cfirst, zsecond, csecond, ilocal, iremote, ipos,
   boolean fret;
   long isecs, imicros;
 
+  sPstats.cdata_received += cfirst + csecond;
+
   if (fallacked && qTreceive_ack != NULL)
     uwindow_acked (qdaemon, TRUE);
 
@@ -1128,14 +1592,19 @@ fgot_data (qdaemon, zfirst, cfirst, zsecond, csecond, ilocal, iremote, ipos,
       if (! (*q->precfn) (q, qdaemon, zfirst, cfirst))
 	fret = FALSE;
       if (fret && csecond > 0)
-	return fgot_data (qdaemon, zsecond, csecond,
+	{
+	  /* The recursive call will count these bytes again.  */
+	  sPstats.cdata_received -= csecond;
+	  return fgot_data (qdaemon, zsecond, csecond,
 			  (const char *) NULL, (size_t) 0,
 			  ilocal, iremote, ipos + (long) cfirst,
 			  FALSE, pfexit);
+	}
       if (pfexit != NULL
 	  && (qdaemon->fhangup
 	      || qdaemon->fmaster
-	      || qTsend != NULL))
+	      || qTsend != NULL
+	      || qTsync != NULL))
 	*pfexit = TRUE;
     }
   else
@@ -1144,7 +1613,15 @@ fgot_data (qdaemon, zfirst, cfirst, zsecond, csecond, ilocal, iremote, ipos,
 	{
 	  DEBUG_MESSAGE1 (DEBUG_UUCP_PROTO,
 			  "fgot_data: Seeking to %ld", ipos);
-	  if (! ffileseek (q->e, ipos))
+	  /* The position is in the compressed or delta data, so we
+	     can't seek to it.  */
+	  if (q->qcompress != NULL || q->qdelta != NULL)
+	    {
+	      ulog (LOG_ERROR, "Can't seek in %s data",
+		    q->qcompress != NULL ? "compressed" : "delta");
+	      fret = FALSE;
+	    }
+	  else if (! ffileseek (q->e, ipos))
 	    {
 	      ulog (LOG_ERROR, "seek: %s", strerror (errno));
 	      fret = FALSE;
@@ -1156,7 +1633,28 @@ fgot_data (qdaemon, zfirst, cfirst, zsecond, csecond, ilocal, iremote, ipos,
 	{
 	  while (cfirst > 0)
 	    {
-	      cwrote = cfilewrite (q->e, (char *) zfirst, cfirst);
+	      if (q->qcompress != NULL)
+		{
+		  /* fcompress_write reports any errors itself.  */
+		  if (! fcompress_write (q->qcompress, q->e, zfirst, cfirst))
+		    {
+		      fret = FALSE;
+		      break;
+		    }
+		  cwrote = (int) cfirst;
+		}
+	      else if (q->qdelta != NULL)
+		{
+		  /* fdelta_write reports any errors itself.  */
+		  if (! fdelta_write (q->qdelta, q->e, zfirst, cfirst))
+		    {
+		      fret = FALSE;
+		      break;
+		    }
+		  cwrote = (int) cfirst;
+		}
+	      else
+		cwrote = cfilewrite (q->e, (char *) zfirst, cfirst);
 	      if (cwrote >= 0 && (size_t) cwrote == cfirst)
 		{
 #if FREE_SPACE_DELTA > 0
@@ -1178,6 +1676,15 @@ fgot_data (qdaemon, zfirst, cfirst, zsecond, csecond, ilocal, iremote, ipos,
 #endif
 		  q->cbytes += cfirst;
 		  q->ipos += cfirst;
+#if CHECKPOINT_DELTA > 0
+		  if ((q->ipos - (long) cfirst) / CHECKPOINT_DELTA
+		      != q->ipos / CHECKPOINT_DELTA
+		      && ! frec_checkpoint (qdaemon, q))
+		    {
+		      fret = FALSE;
+		      break;
+		    }
+#endif
 		}
 	      else
 		{
@@ -1213,6 +1720,65 @@ fgot_data (qdaemon, zfirst, cfirst, zsecond, csecond, ilocal, iremote, ipos,
   return fret;
 }
 
+/* Move file data directly from the connection into the file being
+   received.  We only do this once fgot_data has seen some data for
+   the file, so that the time is charged correctly, and never for
+   compressed or delta data.  */
+
+boolean
+fgot_file_data (struct sdaemon *qdaemon, size_t cmax, size_t *pcgot)
+{
+  struct stransfer *q;
+  size_t cgot;
+
+  *pcgot = 0;
+
+  q = qTreceive;
+  if (q == NULL
+      || q != qTtiming_rec
+      || q->fcmd
+      || ! q->frecfile
+      || q->qcompress != NULL
+      || q->qdelta != NULL)
+    return TRUE;
+
+  cgot = cmax;
+  if (! fconn_recvfile (qdaemon->qconn, q->e, &cgot))
+    return FALSE;
+  if (cgot == 0)
+    return TRUE;
+
+  sPstats.cdata_received += cgot;
+
+#if FREE_SPACE_DELTA > 0
+  {
+    long cfree_space;
+
+    /* As in fgot_data, check that there is still enough space on the
+       disk.  */
+    cfree_space = qdaemon->qsys->uuconf_cfree_space;
+    if (cfree_space > 0
+	&& ((size_t) (q->cbytes / FREE_SPACE_DELTA)
+	    != (q->cbytes + cgot) / FREE_SPACE_DELTA)
+	&& ! frec_check_free (q, cfree_space))
+      return FALSE;
+  }
+#endif
+
+  q->cbytes += cgot;
+  q->ipos += cgot;
+  *pcgot = cgot;
+
+#if CHECKPOINT_DELTA > 0
+  if ((q->ipos - (long) cgot) / CHECKPOINT_DELTA
+      != q->ipos / CHECKPOINT_DELTA
+      && ! frec_checkpoint (qdaemon, q))
+    return FALSE;
+#endif
+
+  return TRUE;
+}
+
 /* Accumulate a string into a command.  If the command is complete,
    start up a new transfer.  */
 
@@ -1449,54 +2015,46 @@ utfree_acked (void)
 
 void
 ufailed (struct sdaemon *qdaemon)
+{
+  if (qTsend != NULL)
+    utfailed_queue (qdaemon, qTsend);
+  if (qTreceive != NULL)
+    utfailed_queue (qdaemon, qTreceive);
+  if (qTsync != NULL)
+    utfailed_queue (qdaemon, qTsync);
+}
+
+/* Report the failed transfers on one queue for ufailed.  A file
+   waiting on qTsync has been received completely, but it was never
+   confirmed, so it is discarded like any other.  */
+
+static void
+utfailed_queue (struct sdaemon *qdaemon, struct stransfer *qqueue)
 {
   register struct stransfer *q;
 
-  if (qTsend != NULL)
+  q = qqueue;
+  do
     {
-      q = qTsend;
-      do
-	{
-	  if ((q->fsendfile || q->frecfile)
-	      && q->cbytes > 0)
-	    {
-	      ustats (FALSE, q->s.zuser, qdaemon->qsys->uuconf_zname,
-		      q->fsendfile, q->cbytes, q->isecs, q->imicros,
-		      qdaemon->fcaller);
-	      if (q->fsendfile)
-		qdaemon->csent += q->cbytes;
-	      else
-		qdaemon->creceived += q->cbytes;
-	    }
-	  if (q->frecfile)
-	    (void) frec_discard_temp (qdaemon, q);
-	  q = q->qnext;
-	}
-      while (q != qTsend);
-    }
+      boolean frec;
 
-  if (qTreceive != NULL)
-    {
-      q = qTreceive;
-      do
+      frec = q->frecfile || q->pqqueue == &qTsync;
+      if ((q->fsendfile || frec)
+	  && q->cbytes > 0)
 	{
-	  if ((q->fsendfile || q->frecfile)
-	      && q->cbytes > 0)
-	    {
-	      ustats (FALSE, q->s.zuser, qdaemon->qsys->uuconf_zname,
-		      q->fsendfile, q->cbytes, q->isecs, q->imicros,
-		      qdaemon->fcaller);
-	      if (q->fsendfile)
-		qdaemon->csent += q->cbytes;
-	      else
-		qdaemon->creceived += q->cbytes;
-	    }
-	  if (q->frecfile)
-	    (void) frec_discard_temp (qdaemon, q);
-	  q = q->qnext;
+	  ustats (FALSE, q->s.zuser, qdaemon->qsys->uuconf_zname,
+		  q->fsendfile, q->cbytes, q->isecs, q->imicros,
+		  qdaemon->fcaller);
+	  if (q->fsendfile)
+	    qdaemon->csent += q->cbytes;
+	  else
+	    qdaemon->creceived += q->cbytes;
 	}
-      while (q != qTreceive);
+      if (frec)
+	(void) frec_discard_temp (qdaemon, q);
+      q = q->qnext;
     }
+  while (q != qqueue);
 }
 
 /* When a local poll file is found, it is entered on the queue like
@@ -58,6 +58,52 @@
    confused if the modem spits out a series of identical bytes.  */
 #define FEATURE_ICOMPL (0100)
 
+/* Supports wide headers for the 'i' protocol, with 16 bit sequence
+   numbers and packet sizes.  */
+#define FEATURE_IWIDE (0200)
+
+/* Supports selective retransmission for the 'g' protocol: the
+   receiver keeps packets which arrive after a missing one, and sends
+   an SRJ for each missing packet.  */
+#define FEATURE_GSRJ (0400)
+
+/* Supports compressed file data.  A 'z' option in an S or E command,
+   or a Z following the mode in an RY reply, means that the file data
+   is sent as a zlib stream.  */
+#define FEATURE_COMPRESS (01000)
+
+/* Accepts a new command while an earlier file is still waiting for
+   its CY confirmation.  This is only used with a single
+   channel end to end protocol.  */
+#define FEATURE_PIPELINE (02000)
+
+/* Can carry file data over extra TCP connections made after the
+   protocol starts, as the 'e' protocol does when the streams
+   protocol parameter is set.  */
+#define FEATURE_STREAMS (04000)
+
+/* Can send a file as the differences from an old copy held by the
+   receiving system.  A 'D' option in an S command offers to do this;
+   if the receiving system has an old copy, it puts the block
+   signatures of the old copy after a D in the SY reply, and the file
+   data is then sent as a delta (see delta.c).  */
+#define FEATURE_DELTA (010000)
+
+/* The FEATURE_COMPRESS bit if we can compress file data, for or'ing
+   into the features we send to the remote system.  */
+#if HAVE_LIBZ && HAVE_ZLIB_H
+#define FEATURE_LOCAL_COMPRESS FEATURE_COMPRESS
+#else
+#define FEATURE_LOCAL_COMPRESS (0)
+#endif
+
+/* The FEATURE_STREAMS bit if we can make extra TCP connections.  */
+#if HAVE_TCP && HAVE_SELECT
+#define FEATURE_LOCAL_STREAMS FEATURE_STREAMS
+#else
+#define FEATURE_LOCAL_STREAMS (0)
+#endif
+
 /* This structure is used to hold information concerning the
    communication link established with the remote system.  */
 
@@ -91,6 +137,11 @@ struct sdaemon
   long csent;
   /* Number of bytes received.  */
   long creceived;
+  /* Number of files sent, and the total and longest time in
+     milliseconds that they waited in the queue before starting.  */
+  long cwaits;
+  long cwait_total;
+  long cwait_max;
   /* Number of execution files received since the last time we spawned
      uuxqt.  */
   long cxfiles_received;
@@ -108,11 +159,24 @@ struct sdaemon
   boolean fcaller;
   /* UUCONF_RELIABLE_* flags for the connection.  */
   int ireliable;
+  /* TRUE if we may start a new local request while earlier files are
+     waiting for confirmation (FEATURE_PIPELINE).  */
+  boolean fpipeline;
+  /* Number of separate connections file data is striped across, or
+     0 if there is only the one (FEATURE_STREAMS).  */
+  int cstreams;
   /* If fcaller is FALSE, the lowest grade which may be transferred
      during this call.  */
   char bgrade;
 };
 
+#if ANSI_C
+/* This structure is defined in compress.c.  */
+struct scompress;
+/* This structure is defined in delta.c.  */
+struct sdelta;
+#endif
+
 /* This structure is used to hold a file or command transfer which is
    in progress.  */
 
@@ -160,6 +224,27 @@ struct stransfer
   long imicros;
   /* Number of bytes sent or received.  */
   long cbytes;
+  /* TRUE if the file has been sent, and we are only waiting for the
+     confirmation.  */
+  boolean fconfirm;
+  /* If not NULL, the file data is compressed, and this holds the
+     state of the compressor or decompressor.  */
+  struct scompress *qcompress;
+  /* If not NULL, the file data is sent as a delta from an old copy
+     of the file, and this holds the state of the encoder or
+     decoder.  */
+  struct sdelta *qdelta;
+  /* Size of the file being sent, or -1 if not known.  */
+  long csize;
+  /* Scheduling pass when several files are being sent at once; the
+     file with the lowest pass sends next.  -1 until the file has
+     started.  */
+  long ipass;
+  /* When the transfer was queued, used to record how long it waited
+     before its file started to go out.  iqueuedsecs is -1 once that
+     has happened.  */
+  long iqueuedsecs;
+  long iqueuedmicros;
 };
 
 /* Reasons that a file transfer might fail.  */
@@ -213,6 +298,16 @@ extern boolean fqueue_send P((struct sdaemon *qdaemon,
 extern boolean fqueue_receive P((struct sdaemon *qdaemon,
 				 struct stransfer *qtrans));
 
+/* Queue a received file whose sync has been put off, so that it can
+   be synced along with other files (see FSYNC_GROUP in policy.h).
+   It is not confirmed until then.  */
+extern boolean fqueue_sync P((struct sdaemon *qdaemon,
+			      struct stransfer *qtrans));
+
+/* Sync every received file queued by fqueue_sync, and finish
+   receiving each of them.  */
+extern boolean fqueue_sync_flush P((struct sdaemon *qdaemon));
+
 /* Prepare to send a file by local or remote request.  */
 extern boolean flocal_send_file_init P((struct sdaemon *qdaemon,
 					struct scmd *qcmd));
@@ -243,11 +338,23 @@ extern void ufailed P((struct sdaemon *qdaemon));
 extern boolean frec_check_free P((struct stransfer *qtrans,
 				  long cfree_space));
 
+/* Finish receiving a file queued by fqueue_sync, once the files
+   have been synced.  If fsynced is FALSE the sync failed, and the
+   file is rejected.  */
+extern boolean frec_file_synced P((struct sdaemon *qdaemon,
+				   struct stransfer *qtrans,
+				   boolean fsynced));
+
 /* Discard the temporary file being used to receive a file, if
    appropriate.  */
 extern boolean frec_discard_temp P((struct sdaemon *qdaemon,
 				    struct stransfer *qtrans));
 
+/* Write a checkpoint for a file being received, if it may be
+   restarted.  */
+extern boolean frec_checkpoint P((struct sdaemon *qdaemon,
+				  struct stransfer *qtrans));
+
 /* Handle data received by a protocol.  This is called by the protocol
    specific routines as data comes in.  The data is passed as two
    buffers because that is convenient for packet based protocols, but
@@ -272,6 +379,29 @@ extern boolean fgot_data P((struct sdaemon *qdaemon,
 			    long ipos, boolean fallacked,
 			    boolean *pfexit));
 
+/* A protocol which may receive the data for a file over a different
+   connection from the commands for the file may call this routine to
+   find out whether fgot_data is ready for data (if fcmd is FALSE) or
+   a command (if fcmd is TRUE) for the given channels.  File data is
+   not wanted before the command which starts the transfer, and a
+   command is not wanted while a transfer on the same channel is still
+   waiting for file data.  If this returns FALSE, the protocol should
+   hold on to the data until something else has been processed.  */
+extern boolean fgot_data_ready P((int ilocal, int iremote,
+				  boolean fcmd));
+
+/* Protocols which do no framing or checking of file data, such as
+   'e', may call this routine to move file data directly from the
+   connection into the file being received, rather than reading it
+   into abPrecbuf and passing it to fgot_data.  At most cmax bytes are
+   moved, and only data which has already arrived.  This sets *pcgot
+   to the number of bytes stored, which is zero if nothing could be
+   done this way; the protocol must then fall back on freceive_data
+   and fgot_data.  The end of the file must still be reported to
+   fgot_data.  This returns FALSE on error.  */
+extern boolean fgot_file_data P((struct sdaemon *qdaemon, size_t cmax,
+				 size_t *pcgot));
+
 /* This routine is called when an ack is sent for a file receive.  */
 extern void usent_receive_ack P((struct sdaemon *qdaemon,
 				 struct stransfer *qtrans));
@@ -289,6 +419,76 @@ extern void usent_receive_ack P((struct sdaemon *qdaemon,
 extern void uwindow_acked P((struct sdaemon *qdaemon,
 			     boolean fallacked));
 
+/* Decide whether a file of cbytes bytes should be sent compressed.
+   This is TRUE if both systems can compress file data, the protocol
+   permits it, and the file is not too small to bother.  */
+extern boolean fcompress_file P((struct sdaemon *qdaemon, long cbytes));
+
+/* Start compressing file data (if fsend is TRUE) or decompressing it.
+   This returns NULL on error.  */
+extern struct scompress *qcompress_start P((struct sdaemon *qdaemon,
+					    boolean fsend));
+
+/* Read data from the file e and compress it into zbuf, which holds
+   *pcbuf bytes.  This sets *pcbuf to the number of bytes produced,
+   which is zero only when all the compressed data has been
+   returned.  This returns FALSE on error.  */
+extern boolean fcompress_read P((struct scompress *q, openfile_t e,
+				 char *zbuf, size_t *pcbuf));
+
+/* Decompress cdata bytes of data received from the remote system and
+   write the result to the file e.  This returns FALSE on error.  */
+extern boolean fcompress_write P((struct scompress *q, openfile_t e,
+				  const char *zdata, size_t cdata));
+
+/* Return TRUE if all the compressed data was received.  */
+extern boolean fcompress_complete P((struct scompress *q));
+
+/* Log how much the file data was compressed, and how long it took.  */
+extern void ucompress_log P((struct scompress *q));
+
+/* Free up the compression state.  */
+extern void ucompress_free P((struct scompress *q));
+
+/* Decide whether to offer to send a file of cbytes bytes to zto as a
+   delta.  This is TRUE if the other system supports deltas, the
+   protocol does not need to know the number of bytes it will send,
+   and the file is large enough to be worth it.  */
+extern boolean fdelta_file P((struct sdaemon *qdaemon, const char *zto,
+			      long cbytes));
+
+/* Open zbasis, an old copy of a file we are about to receive, and
+   set *pzsigs to the block signatures to put in the SY reply.  This
+   returns NULL if there is no usable old copy.  */
+extern struct sdelta *qdelta_rec_start P((const struct uuconf_system *qsys,
+					  const char *zbasis,
+					  char **pzsigs));
+
+/* Start sending a file as a delta, given the signatures following
+   the D in the SY reply.  This returns NULL if they are garbled.  */
+extern struct sdelta *qdelta_send_start P((const char *zsigs));
+
+/* Read data from the file e and encode it into zbuf, which holds
+   *pcbuf bytes.  This sets *pcbuf to the number of bytes stored,
+   which is zero only when all the delta data has been produced.  */
+extern boolean fdelta_read P((struct sdelta *q, openfile_t e,
+			      char *zbuf, size_t *pcbuf));
+
+/* Decode cdata bytes of delta data received from the remote system
+   and write the file they describe to e.  */
+extern boolean fdelta_write P((struct sdelta *q, openfile_t e,
+			       const char *zdata, size_t cdata));
+
+/* Return TRUE if all the delta data was received and the rebuilt
+   file matches; otherwise set *pzerr to the reason.  */
+extern boolean fdelta_complete P((struct sdelta *q, const char **pzerr));
+
+/* Log how many bytes sending the file as a delta saved.  */
+extern void udelta_log P((struct sdelta *q));
+
+/* Free up the delta state.  */
+extern void udelta_free P((struct sdelta *q));
+
 /* Spawn a uuxqt process.  The ffork argument is passed to
    fsysdep_run.  If the zsys argument is not NULL, then -s zsys is
    passed to uuxqt.  The zconfig argument is the name of the
@@ -0,0 +1,841 @@
+/* tstsum.c
+   Check and time the checksum routines.
+
+   Copyright (C) 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#if USE_RCS_ID
+const char tstsum_rcsid[] = "$Id$";
+#endif
+
+#include "uudefs.h"
+#include "sysdep.h"
+#include "system.h"
+#include "prot.h"
+#include "getopt.h"
+
+/* This program makes sure that every CRC routine icrc may use gives
+   the same result as the original byte at a time loop, for every
+   length and alignment up to a few hundred bytes, and then reports
+   how many megabytes a second each of them handles.  Routines the
+   processor does not support are skipped.  It does the same for the
+   'g' protocol checksum, comparing igchecksum and igchecksum2, split
+   at every point, against the original code.  Finally it checks that
+   the 'j' protocol escaping gives the same bytes as the original byte
+   at a time loop, for two, eight and sixty four characters to avoid,
+   and that decoding a packet gives back the data, whether or not the
+   packet wraps around the end of the receive buffer.  It exits with a
+   non-zero status if any result differs.
+
+   Usage: tstsum [-b block-size] [-m megabytes]
+
+   The block size defaults to 4096, which is a typical packet size;
+   each routine is timed over 256 megabytes by default.  The 'j'
+   protocol routines are timed on packets no larger than the protocol
+   permits.  */
+
+/* The routines to compare, by the names zcrc_name uses.  The first
+   one is the reference.  */
+static const char * const azSroutines[] =
+{
+  "table",
+  "slice-by-8",
+  "pclmulqdq",
+  "armv8-crc32"
+};
+
+#define CROUTINES (sizeof azSroutines / sizeof azSroutines[0])
+
+/* The largest length and misalignment we check.  */
+#define CCHECK_LEN (300)
+#define CCHECK_ALIGN (16)
+
+/* The values used in the 'j' protocol byte indices, as in jesc.c;
+   the original code below needs them.  */
+#define INDEX_OFFSET (32)
+#define INDEX_MAX_LOW (32)
+#define INDEX_MAX_HIGH (94)
+
+/* A set of characters for the 'j' protocol to avoid, as a list for
+   the original code and as a table for cjskip and cjencode.  */
+struct sjavoid
+{
+  size_t cavoid;
+  char azavoid[256];
+  char abavoid[256];
+};
+
+/* The number of characters in each set we try: XON and XOFF; XON and
+   XOFF with and without the high bit, null, carriage return, and DLE
+   with and without the high bit; and every control character, with
+   and without the high bit.  */
+static const size_t acSjavoid[] = { 2, 8, 64 };
+
+#define CJAVOID (sizeof acSjavoid / sizeof acSjavoid[0])
+
+/* The program name.  */
+const char *zProgram;
+
+static void usfill P((char *z, size_t c));
+static boolean fscheck_crc P((const char *zbuf));
+static void ustime_crc P((const char *zbuf, size_t cblock,
+			  long cmegabytes));
+static int igold_checksum P((const char *z, size_t c));
+static boolean fscheck_g P((const char *zbuf));
+static void ustime_g P((const char *zname, int itype, const char *zbuf,
+			size_t cblock, long cmegabytes));
+static void usjavoid P((struct sjavoid *q, size_t cavoid));
+static size_t csold_jencode P((const struct sjavoid *q, const char *zsend,
+			       size_t csend, char *zbuf));
+static void usold_jdecode P((char *zbuf, int cbuf, int idata, int cdata,
+			     int cindex));
+static void usjring P((char *zring, int cring, int idata, const char *z,
+		       size_t c));
+static boolean fscheck_j P((const char *zbuf));
+static void ustime_j P((const char *zname, int itype,
+			const struct sjavoid *q, const char *zbuf,
+			size_t cpacket, long cmegabytes));
+static long isclock_millis P((void));
+
+int
+main (int argc, char **argv)
+{
+  int iopt;
+  size_t cblock, cpacket;
+  long cmegabytes;
+  char *zbuf;
+  boolean fok;
+  size_t i;
+
+  zProgram = argv[0];
+
+  cblock = 4096;
+  cmegabytes = 256;
+
+  while ((iopt = getopt (argc, argv, "b:m:")) != EOF)
+    {
+      switch (iopt)
+	{
+	case 'b':
+	  cblock = (size_t) strtol (optarg, (char **) NULL, 10);
+	  break;
+	case 'm':
+	  cmegabytes = strtol (optarg, (char **) NULL, 10);
+	  break;
+	default:
+	  fprintf (stderr, "Usage: %s [-b block-size] [-m megabytes]\n",
+		   zProgram);
+	  exit (EXIT_FAILURE);
+	}
+    }
+
+  if (cblock == 0 || cmegabytes <= 0)
+    {
+      fprintf (stderr, "%s: Block size and megabytes must be positive\n",
+	       zProgram);
+      exit (EXIT_FAILURE);
+    }
+
+  i = cblock + CCHECK_ALIGN;
+  if (i < CJMAXPACKSIZE + CCHECK_ALIGN)
+    i = CJMAXPACKSIZE + CCHECK_ALIGN;
+  zbuf = (char *) malloc (i);
+  if (zbuf == NULL)
+    {
+      fprintf (stderr, "%s: Out of memory\n", zProgram);
+      exit (EXIT_FAILURE);
+    }
+  usfill (zbuf, i);
+
+  fok = fscheck_crc (zbuf);
+  if (! fscheck_g (zbuf))
+    fok = FALSE;
+  if (! fscheck_j (zbuf))
+    fok = FALSE;
+
+  printf ("icrc, %lu byte blocks:\n", (unsigned long) cblock);
+  for (i = 0; i < CROUTINES; i++)
+    {
+      if (! fcrc_select (azSroutines[i]))
+	{
+	  printf ("  %-12s not available\n", azSroutines[i]);
+	  continue;
+	}
+      ustime_crc (zbuf, cblock, cmegabytes);
+    }
+
+  printf ("'g' checksum, %lu byte blocks:\n", (unsigned long) cblock);
+  ustime_g ("original", 0, zbuf, cblock, cmegabytes);
+  ustime_g ("igchecksum", 1, zbuf, cblock, cmegabytes);
+  ustime_g ("igchecksum2", 2, zbuf, cblock, cmegabytes);
+
+  cpacket = cblock;
+  if (cpacket > CJMAXPACKSIZE)
+    cpacket = CJMAXPACKSIZE;
+  for (i = 0; i < CJAVOID; i++)
+    {
+      struct sjavoid s;
+
+      usjavoid (&s, acSjavoid[i]);
+      printf ("'j' protocol avoiding %lu characters, %lu byte packets:\n",
+	      (unsigned long) s.cavoid, (unsigned long) cpacket);
+      ustime_j ("original", 0, &s, zbuf, cpacket, cmegabytes);
+      ustime_j ("cjencode", 1, &s, zbuf, cpacket, cmegabytes);
+      ustime_j ("old decode", 2, &s, zbuf, cpacket, cmegabytes);
+      ustime_j ("ujdecode", 3, &s, zbuf, cpacket, cmegabytes);
+      ustime_j ("ujdecode_ring", 4, &s, zbuf, cpacket, cmegabytes);
+    }
+
+  free ((pointer) zbuf);
+
+  exit (fok ? EXIT_SUCCESS : EXIT_FAILURE);
+
+  /* Avoid complaints about not returning.  */
+  return 0;
+}
+
+/* Fill a buffer with pseudo-random bytes, with some runs of zeroes
+   mixed in.  */
+
+static void
+usfill (char *z, size_t c)
+{
+  unsigned long iseed;
+  size_t i;
+
+  iseed = 1;
+  for (i = 0; i < c; i++)
+    {
+      iseed = (iseed * 1103515245 + 12345) & 0x7fffffff;
+      if ((iseed & 0x700000) == 0)
+	z[i] = '\0';
+      else
+	z[i] = (char) (iseed >> 16);
+    }
+}
+
+/* Check each available CRC routine against the first one.  */
+
+static boolean
+fscheck_crc (const char *zbuf)
+{
+  unsigned long airef[CCHECK_ALIGN][CCHECK_LEN + 1];
+  boolean fok;
+  size_t i, ialign, clen;
+
+  if (! fcrc_select (azSroutines[0]))
+    {
+      fprintf (stderr, "%s: No %s CRC routine\n", zProgram,
+	       azSroutines[0]);
+      return FALSE;
+    }
+  for (ialign = 0; ialign < CCHECK_ALIGN; ialign++)
+    for (clen = 0; clen <= CCHECK_LEN; clen++)
+      airef[ialign][clen] = icrc (zbuf + ialign, clen, ICRCINIT);
+
+  fok = TRUE;
+  for (i = 1; i < CROUTINES; i++)
+    {
+      if (! fcrc_select (azSroutines[i]))
+	continue;
+      for (ialign = 0; ialign < CCHECK_ALIGN; ialign++)
+	{
+	  for (clen = 0; clen <= CCHECK_LEN; clen++)
+	    {
+	      unsigned long icheck;
+
+	      icheck = icrc (zbuf + ialign, clen, ICRCINIT);
+	      if (icheck != airef[ialign][clen])
+		{
+		  fprintf (stderr,
+			   "%s: %s gives 0x%lx for %lu bytes at offset %lu, not 0x%lx\n",
+			   zProgram, azSroutines[i], icheck,
+			   (unsigned long) clen, (unsigned long) ialign,
+			   airef[ialign][clen]);
+		  fok = FALSE;
+		  break;
+		}
+	    }
+	  if (clen <= CCHECK_LEN)
+	    break;
+	}
+    }
+
+  return fok;
+}
+
+/* Time the CRC routine currently selected.  */
+
+static void
+ustime_crc (const char *zbuf, size_t cblock, long cmegabytes)
+{
+  long cblocks, i;
+  unsigned long ick;
+  long istart, imillis;
+
+  cblocks = (long) ((cmegabytes * 1024 * 1024) / cblock);
+  if (cblocks == 0)
+    cblocks = 1;
+
+  ick = ICRCINIT;
+  istart = isclock_millis ();
+  for (i = 0; i < cblocks; i++)
+    ick = icrc (zbuf, cblock, ick);
+  imillis = isclock_millis () - istart;
+  if (imillis <= 0)
+    imillis = 1;
+
+  printf ("  %-12s %8.1f MB/s (0x%08lx)\n", zcrc_name (),
+	  ((double) cblocks * cblock / (1024 * 1024)) / (imillis / 1000.0),
+	  ick & (unsigned long) 0xffffffffL);
+}
+
+/* The 'g' protocol checksum as it was originally written, one byte
+   at a time with a branch on zero bytes.  */
+
+static int
+igold_checksum (const char *z, size_t c)
+{
+  unsigned long ichk1, ichk2;
+
+  ichk1 = 0xffff;
+  ichk2 = 0;
+
+  while (c > 0)
+    {
+      unsigned int b;
+
+      ichk1 += ichk1 + ((ichk1 & 0x8000) >> 15);
+      b = BUCHAR (*z++);
+      if (b != 0)
+	{
+	  ichk1 &= 0xffff;
+	  ichk1 += b;
+	  ichk2 += ichk1 ^ c;
+	  if ((ichk1 >> 16) != 0)
+	    ichk1 ^= ichk2;
+	}
+      else
+	{
+	  ichk2 += ichk1 ^ c;
+	  ichk1 ^= ichk2;
+	}
+      --c;
+    }
+
+  return ichk1 & 0xffff;
+}
+
+/* Check igchecksum and igchecksum2 against the original code.  The
+   protocol never computes the checksum of an empty packet, so we
+   start at one byte.  */
+
+static boolean
+fscheck_g (const char *zbuf)
+{
+  size_t ialign, clen, cfirst;
+
+  for (ialign = 0; ialign < CCHECK_ALIGN; ialign++)
+    {
+      for (clen = 1; clen <= CCHECK_LEN; clen++)
+	{
+	  const char *z;
+	  int iref, icheck;
+
+	  z = zbuf + ialign;
+	  iref = igold_checksum (z, clen);
+	  icheck = igchecksum (z, clen);
+	  if (icheck != iref)
+	    {
+	      fprintf (stderr,
+		       "%s: igchecksum gives 0x%x for %lu bytes at offset %lu, not 0x%x\n",
+		       zProgram, icheck, (unsigned long) clen,
+		       (unsigned long) ialign, iref);
+	      return FALSE;
+	    }
+	  for (cfirst = 1; cfirst < clen; cfirst++)
+	    {
+	      icheck = igchecksum2 (z, cfirst, z + cfirst, clen - cfirst);
+	      if (icheck != iref)
+		{
+		  fprintf (stderr,
+			   "%s: igchecksum2 gives 0x%x for %lu bytes at offset %lu split after %lu, not 0x%x\n",
+			   zProgram, icheck, (unsigned long) clen,
+			   (unsigned long) ialign, (unsigned long) cfirst,
+			   iref);
+		  return FALSE;
+		}
+	    }
+	}
+    }
+
+  return TRUE;
+}
+
+/* Time a 'g' checksum routine: the original code if itype is 0,
+   igchecksum if it is 1, and igchecksum2 with the block split in the
+   middle if it is 2.  The start of the block moves around, so that
+   the compiler can not compute the original code once and reuse it.
+   A hash of the checksums is printed; it is the same for each
+   routine.  */
+
+static void
+ustime_g (const char *zname, int itype, const char *zbuf, size_t cblock,
+	  long cmegabytes)
+{
+  long cblocks, i;
+  unsigned long ihash;
+  long istart, imillis;
+  size_t chalf;
+
+  cblocks = (long) ((cmegabytes * 1024 * 1024) / cblock);
+  if (cblocks == 0)
+    cblocks = 1;
+  chalf = cblock / 2;
+
+  ihash = 0;
+  istart = isclock_millis ();
+  for (i = 0; i < cblocks; i++)
+    {
+      const char *z;
+
+      z = zbuf + i % CCHECK_ALIGN;
+      switch (itype)
+	{
+	case 0:
+	  ihash = ihash * 31 + igold_checksum (z, cblock);
+	  break;
+	case 1:
+	  ihash = ihash * 31 + igchecksum (z, cblock);
+	  break;
+	default:
+	  ihash = (ihash * 31
+		   + igchecksum2 (z, chalf, z + chalf, cblock - chalf));
+	  break;
+	}
+    }
+  imillis = isclock_millis () - istart;
+  if (imillis <= 0)
+    imillis = 1;
+
+  printf ("  %-12s %8.1f MB/s (0x%08lx)\n", zname,
+	  ((double) cblocks * cblock / (1024 * 1024)) / (imillis / 1000.0),
+	  ihash & (unsigned long) 0xffffffffL);
+}
+
+/* Set up a set of cavoid characters to avoid, which must be one of
+   the sizes in acSjavoid.  */
+
+static void
+usjavoid (struct sjavoid *q, size_t cavoid)
+{
+  size_t i;
+
+  bzero (q->abavoid, sizeof q->abavoid);
+  if (cavoid == 2)
+    memcpy (q->azavoid, "\021\023", 2);
+  else if (cavoid == 8)
+    memcpy (q->azavoid, "\021\023\221\223\000\015\020\220", 8);
+  else
+    {
+      for (i = 0; i < 32; i++)
+	{
+	  q->azavoid[i] = (char) i;
+	  q->azavoid[i + 32] = (char) (i + 128);
+	}
+    }
+  q->cavoid = cavoid;
+  for (i = 0; i < cavoid; i++)
+    q->abavoid[(unsigned char) q->azavoid[i]] = 1;
+}
+
+/* The 'j' protocol escaping as it was originally written, one byte
+   at a time, comparing each byte against the list of characters to
+   avoid.  This returns the number of bytes of data and byte indices
+   it puts in zbuf.  */
+
+static size_t
+csold_jencode (const struct sjavoid *q, const char *zsend, size_t csend,
+	       char *zbuf)
+{
+  char *zput, *zindex;
+  const char *zfrom, *zend;
+  char bfirst, bsecond;
+
+  zput = zbuf;
+  zindex = zput + csend;
+  zfrom = zsend;
+  zend = zsend + csend;
+
+  /* Optimize for the common case of avoiding two characters.  */
+  bfirst = q->azavoid[0];
+  if (q->cavoid <= 1)
+    bsecond = bfirst;
+  else
+    bsecond = q->azavoid[1];
+  while (zfrom < zend)
+    {
+      char b;
+      boolean f128, f32;
+      int i, ihigh, ilow;
+
+      b = *zfrom++;
+      if (b != bfirst && b != bsecond)
+	{
+	  int ca;
+	  const char *za;
+
+	  if (q->cavoid <= 2)
+	    {
+	      *zput++ = b;
+	      continue;
+	    }
+
+	  ca = q->cavoid - 2;
+	  za = q->azavoid + 2;
+	  while (ca-- != 0)
+	    if (*za++ == b)
+	      break;
+
+	  if (ca < 0)
+	    {
+	      *zput++ = b;
+	      continue;
+	    }
+	}
+
+      if ((b & 0x80) == 0)
+	f128 = FALSE;
+      else
+	{
+	  b &=~ 0x80;
+	  f128 = TRUE;
+	}
+      if (b >= 32 && b != 127)
+	f32 = FALSE;
+      else
+	{
+	  b ^= 0x20;
+	  f32 = TRUE;
+	}
+
+      i = zput - zbuf;
+      ihigh = i / INDEX_MAX_LOW;
+      ilow = i % INDEX_MAX_LOW;
+
+      if (f128 && ! f32)
+	;
+      else if (f32 && ! f128)
+	ilow += INDEX_MAX_LOW;
+      else
+	{
+	  if (ilow != INDEX_MAX_LOW - 1)
+	    ilow += 2 * INDEX_MAX_LOW;
+	  else
+	    {
+	      ilow = ihigh;
+	      ihigh = INDEX_MAX_HIGH;
+	    }
+	}
+
+      *zindex++ = ihigh + INDEX_OFFSET;
+      *zindex++ = ilow + INDEX_OFFSET;
+      *zput++ = b;
+    }
+
+  return zindex - zbuf;
+}
+
+/* The 'j' protocol decoding as it was originally written, which
+   steps through the receive buffer one byte at a time whether or not
+   the packet wraps around the end.  */
+
+static void
+usold_jdecode (char *zbuf, int cbuf, int idata, int cdata, int cindex)
+{
+  int iindex, iendindex;
+
+  iindex = (idata + cdata) % cbuf;
+  iendindex = (idata + cdata + cindex) % cbuf;
+  while (iindex != iendindex)
+    {
+      int ihigh, ilow;
+      boolean f32, f128;
+      int iset;
+
+      ihigh = zbuf[iindex] - INDEX_OFFSET;
+      zbuf[iindex] = 0;
+      iindex = (iindex + 1) % cbuf;
+      ilow = zbuf[iindex] - INDEX_OFFSET;
+      zbuf[iindex] = 0;
+      iindex = (iindex + 1) % cbuf;
+
+      f128 = TRUE;
+      f32 = TRUE;
+      if (ihigh == INDEX_MAX_HIGH)
+	iset = ilow * INDEX_MAX_LOW + INDEX_MAX_LOW - 1;
+      else
+	{
+	  iset = ihigh * INDEX_MAX_LOW + ilow % INDEX_MAX_LOW;
+	  if (ilow < INDEX_MAX_LOW)
+	    f32 = FALSE;
+	  else if (ilow < 2 * INDEX_MAX_LOW)
+	    f128 = FALSE;
+	}
+
+      iset = (idata + iset) % cbuf;
+
+      if (f128)
+	zbuf[iset] |= 0x80;
+      if (f32)
+	zbuf[iset] ^= 0x20;
+    }
+}
+
+/* Copy c bytes into the circular buffer zring of cring bytes,
+   starting at index idata.  */
+
+static void
+usjring (char *zring, int cring, int idata, const char *z, size_t c)
+{
+  size_t cfirst;
+
+  cfirst = cring - idata;
+  if (cfirst > c)
+    cfirst = c;
+  memcpy (zring + idata, z, cfirst);
+  memcpy (zring, z + cfirst, c - cfirst);
+}
+
+/* Check the 'j' protocol escaping against the original code, for
+   each set of characters to avoid, and check that decoding gets back
+   the original data, with the packet wrapping around the end of the
+   receive buffer at every point.  We check every length and
+   alignment up to CCHECK_LEN, and the largest packet, which is the
+   only way to get byte indices which use the special high byte.  */
+
+static boolean
+fscheck_j (const char *zbuf)
+{
+  char *zold, *znew, *zdec;
+  boolean fok;
+  size_t iset, ialign, clen;
+
+  zold = (char *) malloc (CJMAXPACKSIZE * 3);
+  znew = (char *) malloc (CJMAXPACKSIZE * 3);
+  zdec = (char *) malloc (CJMAXPACKSIZE * 3 + 1);
+  if (zold == NULL || znew == NULL || zdec == NULL)
+    {
+      fprintf (stderr, "%s: Out of memory\n", zProgram);
+      exit (EXIT_FAILURE);
+    }
+
+  fok = TRUE;
+  for (iset = 0; iset < CJAVOID && fok; iset++)
+    {
+      struct sjavoid s;
+
+      usjavoid (&s, acSjavoid[iset]);
+      for (ialign = 0; ialign < CCHECK_ALIGN && fok; ialign++)
+	{
+	  for (clen = 0; clen <= CCHECK_LEN + 1 && fok; clen++)
+	    {
+	      const char *z;
+	      size_t cdata, cold, cnew, i;
+	      int cring, isplit;
+
+	      /* After the lengths up to CCHECK_LEN, try the largest
+		 packet.  */
+	      cdata = clen <= CCHECK_LEN ? clen : CJMAXPACKSIZE;
+	      z = zbuf + ialign;
+
+	      cold = csold_jencode (&s, z, cdata, zold);
+	      cnew = cjencode (s.abavoid, z, cdata,
+			       cjskip (s.abavoid, z, cdata), znew);
+	      if (cnew != cold || memcmp (znew, zold, cnew) != 0)
+		{
+		  fprintf (stderr,
+			   "%s: cjencode differs avoiding %lu characters for %lu bytes at offset %lu\n",
+			   zProgram, (unsigned long) s.cavoid,
+			   (unsigned long) cdata, (unsigned long) ialign);
+		  fok = FALSE;
+		  break;
+		}
+
+	      memcpy (zdec, znew, cnew);
+	      ujdecode (zdec, (int) cdata, (int) (cnew - cdata));
+	      for (i = cdata; i < cnew; i++)
+		if (zdec[i] != '\0')
+		  break;
+	      if (memcmp (zdec, z, cdata) != 0 || i < cnew)
+		{
+		  fprintf (stderr,
+			   "%s: ujdecode fails avoiding %lu characters for %lu bytes at offset %lu\n",
+			   zProgram, (unsigned long) s.cavoid,
+			   (unsigned long) cdata, (unsigned long) ialign);
+		  fok = FALSE;
+		  break;
+		}
+
+	      /* Wrapping is independent of alignment, so only try it
+		 once for each length.  The buffer is one byte longer
+		 than the packet, so that the data and byte indices are
+		 all in use without meeting.  */
+	      if (ialign != 0)
+		continue;
+	      cring = (int) cnew + 1;
+	      for (isplit = 1; isplit < (int) cnew; isplit++)
+		{
+		  int idata;
+
+		  idata = cring - isplit;
+		  usjring (zdec, cring, idata, znew, cnew);
+		  ujdecode_ring (zdec, cring, idata, (int) cdata,
+				 (int) (cnew - cdata));
+		  for (i = 0; i < cnew; i++)
+		    {
+		      char b;
+
+		      b = zdec[(idata + i) % cring];
+		      if (i < cdata ? b != z[i] : b != '\0')
+			break;
+		    }
+		  if (i < cnew)
+		    {
+		      fprintf (stderr,
+			       "%s: ujdecode_ring fails avoiding %lu characters for %lu bytes split after %d\n",
+			       zProgram, (unsigned long) s.cavoid,
+			       (unsigned long) cdata, isplit);
+		      fok = FALSE;
+		      break;
+		    }
+		}
+	    }
+	}
+    }
+
+  free ((pointer) zold);
+  free ((pointer) znew);
+  free ((pointer) zdec);
+
+  return fok;
+}
+
+/* Time a 'j' protocol routine.  If itype is 0 or 1, time escaping
+   with the original code or cjencode; the start of the data moves
+   around, and a hash of the encoded lengths is printed.  Otherwise
+   time decoding a packet with the original code, with ujdecode, or
+   with ujdecode_ring; the original code and ujdecode_ring are given
+   a packet which wraps around the end of the receive buffer in the
+   middle.  Decoding changes the packet, so each time around we copy
+   it into place first, and a hash of the decoded bytes is printed.
+   The time includes the copy, which is the same for each routine.  */
+
+static void
+ustime_j (const char *zname, int itype, const struct sjavoid *q,
+	  const char *zbuf, size_t cpacket, long cmegabytes)
+{
+  char *zenc, *zwork;
+  size_t cenc;
+  int cring, idata;
+  long cpackets, i;
+  unsigned long ihash;
+  long istart, imillis;
+
+  zenc = (char *) malloc (cpacket * 3);
+  zwork = (char *) malloc (cpacket * 6);
+  if (zenc == NULL || zwork == NULL)
+    {
+      fprintf (stderr, "%s: Out of memory\n", zProgram);
+      exit (EXIT_FAILURE);
+    }
+
+  cenc = cjencode (q->abavoid, zbuf, cpacket,
+		   cjskip (q->abavoid, zbuf, cpacket), zenc);
+  cring = (int) cenc * 2;
+  idata = cring - (int) cenc / 2;
+
+  cpackets = (long) ((cmegabytes * 1024 * 1024) / cpacket);
+  if (cpackets == 0)
+    cpackets = 1;
+
+  ihash = 0;
+  istart = isclock_millis ();
+  for (i = 0; i < cpackets; i++)
+    {
+      const char *z;
+
+      z = zbuf + i % CCHECK_ALIGN;
+      switch (itype)
+	{
+	case 0:
+	  ihash = ihash * 31 + csold_jencode (q, z, cpacket, zwork);
+	  break;
+	case 1:
+	  ihash = (ihash * 31
+		   + cjencode (q->abavoid, z, cpacket,
+			       cjskip (q->abavoid, z, cpacket), zwork));
+	  break;
+	case 2:
+	  usjring (zwork, cring, idata, zenc, cenc);
+	  usold_jdecode (zwork, cring, idata, (int) cpacket,
+			 (int) (cenc - cpacket));
+	  ihash = (ihash * 31
+		   + BUCHAR (zwork[(idata + i % cpacket) % cring]));
+	  break;
+	case 3:
+	  memcpy (zwork, zenc, cenc);
+	  ujdecode (zwork, (int) cpacket, (int) (cenc - cpacket));
+	  ihash = ihash * 31 + BUCHAR (zwork[i % cpacket]);
+	  break;
+	default:
+	  usjring (zwork, cring, idata, zenc, cenc);
+	  ujdecode_ring (zwork, cring, idata, (int) cpacket,
+			 (int) (cenc - cpacket));
+	  ihash = (ihash * 31
+		   + BUCHAR (zwork[(idata + i % cpacket) % cring]));
+	  break;
+	}
+    }
+  imillis = isclock_millis () - istart;
+  if (imillis <= 0)
+    imillis = 1;
+
+  printf ("  %-13s %8.1f MB/s (0x%08lx)\n", zname,
+	  ((double) cpackets * cpacket / (1024 * 1024)) / (imillis / 1000.0),
+	  ihash & (unsigned long) 0xffffffffL);
+
+  free ((pointer) zenc);
+  free ((pointer) zwork);
+}
+
+/* Return the current time in milliseconds.  */
+
+static long
+isclock_millis (void)
+{
+  long isecs, imicros;
+
+  isecs = ixsysdep_process_time (&imicros);
+  return isecs * 1000 + imicros / 1000;
+}
@@ -0,0 +1,384 @@
+/* blob.c
+   Share identical data files in the spool directory.
+
+   Copyright (C) 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#include "uudefs.h"
+#include "uuconf.h"
+#include "sysdep.h"
+#include "system.h"
+#include "prot.h"
+
+#include <errno.h>
+
+#if HAVE_OPENDIR
+#if HAVE_DIRENT_H
+#include <dirent.h>
+#else /* ! HAVE_DIRENT_H */
+#include <sys/dir.h>
+#define dirent direct
+#endif /* ! HAVE_DIRENT_H */
+#endif /* HAVE_OPENDIR */
+
+/* When the same file is queued for many systems, we keep a single
+   copy of its contents.  Each data file of at least CBLOB_MIN bytes
+   which is copied into the spool directory is also linked into the
+   .Blobs directory under a name made from its size and CRC, with a
+   sequence number in case different files have the same size and
+   CRC.  A later identical file is linked to the blob rather than
+   copied.  The link count of the blob is its reference count: once
+   the last data file using it is removed, the blob has a link count
+   of one and is removed as well.  */
+
+#define ZBLOBDIR ".Blobs"
+
+/* Files smaller than this are always copied.  */
+#define CBLOB_MIN (65536)
+
+/* The size of the buffers used to read files.  */
+#define CBLOB_BUFSIZE (8192)
+
+static char *zsblob_name P((long cbytes, unsigned long icrc, int iseq));
+static boolean fsblob_sum P((openfile_t e, long *pcbytes,
+			     unsigned long *picrc));
+static boolean fsblob_same P((openfile_t e, const char *zblob));
+static char *zsblob_find P((openfile_t e, long cbytes, unsigned long icrc,
+			    char **pzfree));
+static void usblob_publish P((const char *zfile, const char *zblob));
+static void usblob_release P((long cbytes));
+
+/* Get the name of a blob.  */
+
+static char *
+zsblob_name (long int cbytes, unsigned long int icrc, int iseq)
+{
+  char *z;
+
+  z = zbufalc (sizeof ZBLOBDIR + 40);
+  sprintf (z, "%s/%lx-%08lx-%d", ZBLOBDIR, (unsigned long) cbytes,
+	   icrc & 0xffffffffUL, iseq);
+  return z;
+}
+
+/* Get the size and CRC of a file from its current position, and go
+   back to the start.  */
+
+static boolean
+fsblob_sum (openfile_t e, long int *pcbytes, unsigned long int *picrc)
+{
+  char ab[CBLOB_BUFSIZE];
+  int c;
+
+  *pcbytes = 0;
+  *picrc = ICRCINIT;
+  while ((c = cfileread (e, ab, sizeof ab)) > 0)
+    {
+      *pcbytes += c;
+      *picrc = icrc (ab, (size_t) c, *picrc);
+    }
+  if (ffileioerror (e, c))
+    {
+      ulog (LOG_ERROR, "read: %s", strerror (errno));
+      return FALSE;
+    }
+  if (! ffileseek (e, 0))
+    {
+      ulog (LOG_ERROR, "seek: %s", strerror (errno));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* See whether the file e has the same contents as a blob, and go
+   back to the start of e.  */
+
+static boolean
+fsblob_same (openfile_t e, const char *zblob)
+{
+  openfile_t eblob;
+  char ab1[CBLOB_BUFSIZE], ab2[CBLOB_BUFSIZE];
+  boolean fsame;
+
+  eblob = esysdep_open_send ((const struct uuconf_system *) NULL, zblob,
+			     FALSE, (const char *) NULL);
+  if (! ffileisopen (eblob))
+    return FALSE;
+
+  fsame = TRUE;
+  while (fsame)
+    {
+      int c1, c2;
+
+      c1 = cfileread (e, ab1, sizeof ab1);
+      if (ffileioerror (e, c1))
+	c1 = -1;
+      c2 = 0;
+      while (c1 > 0 && c2 < c1)
+	{
+	  int c;
+
+	  c = cfileread (eblob, ab2 + c2, (size_t) (c1 - c2));
+	  if (ffileioerror (eblob, c) || c <= 0)
+	    break;
+	  c2 += c;
+	}
+      if (c1 < 0 || c2 != c1 || memcmp (ab1, ab2, (size_t) c1) != 0)
+	fsame = FALSE;
+      else if (c1 == 0)
+	{
+	  /* Make sure the blob ends here too.  */
+	  if (cfileread (eblob, ab2, 1) != 0)
+	    fsame = FALSE;
+	  break;
+	}
+    }
+
+  (void) ffileclose (eblob);
+
+  if (! ffileseek (e, 0))
+    {
+      ulog (LOG_ERROR, "seek: %s", strerror (errno));
+      return FALSE;
+    }
+
+  return fsame;
+}
+
+/* Look for a blob with the same contents as e.  If there is one,
+   return its name.  Otherwise return NULL, and set *pzfree to the
+   name to use for a new blob.  */
+
+static char *
+zsblob_find (openfile_t e, long int cbytes, unsigned long int icrc,
+	     char **pzfree)
+{
+  int iseq;
+
+  *pzfree = NULL;
+  for (iseq = 0; ; iseq++)
+    {
+      char *zblob;
+
+      zblob = zsblob_name (cbytes, icrc, iseq);
+      if (! fsysdep_file_exists (zblob))
+	{
+	  *pzfree = zblob;
+	  return NULL;
+	}
+      if (fsblob_same (e, zblob))
+	return zblob;
+      ubuffree (zblob);
+    }
+}
+
+/* Publish zfile as a blob.  If this fails, the file just won't be
+   shared.  */
+
+static void
+usblob_publish (const char *zfile, const char *zblob)
+{
+  if (link (zfile, zblob) != 0
+      && errno == ENOENT
+      && fsysdep_make_dirs (zblob, FALSE))
+    (void) link (zfile, zblob);
+}
+
+/* Copy a file into the spool directory, sharing the contents with an
+   identical blob if there is one.  */
+
+boolean
+fsysdep_spool_copy (openfile_t efrom, const char *zto)
+{
+  struct stat s;
+  long cbytes;
+  unsigned long icrc;
+  char *zblob, *zfree;
+
+#if USE_STDIO
+  if (fstat (fileno (efrom), &s) < 0)
+#else
+  if (fstat (efrom, &s) < 0)
+#endif
+    s.st_size = 0;
+
+  if (! S_ISREG (s.st_mode)
+      || s.st_size < CBLOB_MIN
+      || ! fsblob_sum (efrom, &cbytes, &icrc))
+    return fcopy_open_file (efrom, zto, FALSE, TRUE, TRUE);
+
+  zblob = zsblob_find (efrom, cbytes, icrc, &zfree);
+  if (zblob != NULL)
+    {
+      if (link (zblob, zto) == 0)
+	{
+	  DEBUG_MESSAGE2 (DEBUG_SPOOLDIR,
+			  "fsysdep_spool_copy: Linked %s to %s", zto, zblob);
+	  ubuffree (zblob);
+	  return TRUE;
+	}
+
+      /* The blob may have just been released, or be on another
+	 file system; fall back to copying without publishing.  */
+      ubuffree (zblob);
+      return fcopy_open_file (efrom, zto, FALSE, TRUE, TRUE);
+    }
+
+  if (! fcopy_open_file (efrom, zto, FALSE, TRUE, TRUE))
+    {
+      ubuffree (zfree);
+      return FALSE;
+    }
+  usblob_publish (zto, zfree);
+  ubuffree (zfree);
+  return TRUE;
+}
+
+/* Share the contents of a data file which has already been written
+   to the spool directory.  We can't avoid writing data read from a
+   pipe, but we can avoid keeping more than one copy of it.  */
+
+boolean
+fsysdep_spool_share (const char *zfile)
+{
+  openfile_t e;
+  long cbytes;
+  unsigned long icrc;
+  char *zblob, *zfree;
+
+  if (csysdep_size (zfile) < CBLOB_MIN)
+    return TRUE;
+
+  e = esysdep_open_send ((const struct uuconf_system *) NULL, zfile,
+			 FALSE, (const char *) NULL);
+  if (! ffileisopen (e))
+    return FALSE;
+  if (! fsblob_sum (e, &cbytes, &icrc))
+    {
+      (void) ffileclose (e);
+      return FALSE;
+    }
+
+  zblob = zsblob_find (e, cbytes, icrc, &zfree);
+  (void) ffileclose (e);
+
+  if (zblob == NULL)
+    {
+      usblob_publish (zfile, zfree);
+      ubuffree (zfree);
+      return TRUE;
+    }
+
+  /* Replace the file with a link to the blob.  We link to a
+     temporary name and rename it over the file, so that the file
+     always exists.  */
+  {
+    char *ztemp;
+
+    ztemp = zbufalc (strlen (zfile) + sizeof ".blob");
+    sprintf (ztemp, "%s.blob", zfile);
+    if (link (zblob, ztemp) == 0)
+      {
+	if (rename (ztemp, zfile) == 0)
+	  DEBUG_MESSAGE2 (DEBUG_SPOOLDIR,
+			  "fsysdep_spool_share: Linked %s to %s", zfile,
+			  zblob);
+	else
+	  {
+	    ulog (LOG_ERROR, "rename (%s, %s): %s", ztemp, zfile,
+		  strerror (errno));
+	    (void) remove (ztemp);
+	  }
+      }
+    ubuffree (ztemp);
+  }
+
+  ubuffree (zblob);
+  return TRUE;
+}
+
+/* Remove a data file from the spool directory.  If it was the last
+   file sharing a blob, remove the blob too.  */
+
+int
+isysdep_spool_remove (const char *zfile)
+{
+  struct stat s;
+  boolean frelease;
+
+  frelease = (stat ((char *) zfile, &s) == 0
+	      && S_ISREG (s.st_mode)
+	      && s.st_nlink == 2
+	      && s.st_size >= CBLOB_MIN);
+
+  if (remove (zfile) != 0)
+    return -1;
+
+  if (frelease)
+    usblob_release ((long) s.st_size);
+
+  return 0;
+}
+
+/* Remove any blob of the given size which is no longer used by any
+   data file.  Only blobs of the right size can have been released,
+   and their names start with the size, so we don't need to look at
+   any others.  */
+
+static void
+usblob_release (long int cbytes)
+{
+#if HAVE_OPENDIR
+  DIR *qdir;
+  struct dirent *qentry;
+  char abprefix[30];
+  size_t cprefix;
+
+  qdir = opendir ((char *) ZBLOBDIR);
+  if (qdir == NULL)
+    return;
+
+  sprintf (abprefix, "%lx-", (unsigned long) cbytes);
+  cprefix = strlen (abprefix);
+
+  while ((qentry = readdir (qdir)) != NULL)
+    {
+      char *zblob;
+      struct stat s;
+
+      if (strncmp (qentry->d_name, abprefix, cprefix) != 0)
+	continue;
+      zblob = zsysdep_in_dir (ZBLOBDIR, qentry->d_name);
+      if (stat (zblob, &s) == 0 && s.st_nlink == 1)
+	{
+	  DEBUG_MESSAGE1 (DEBUG_SPOOLDIR,
+			  "usblob_release: Removing %s", zblob);
+	  if (remove (zblob) != 0 && errno != ENOENT)
+	    ulog (LOG_ERROR, "remove (%s): %s", zblob, strerror (errno));
+	}
+      ubuffree (zblob);
+    }
+
+  (void) closedir (qdir);
+#endif /* HAVE_OPENDIR */
+}
@@ -76,19 +76,69 @@
 #define ZCHARS \
   "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 
+/* The number of sequence numbers to reserve at once while a batch of
+   spool files is being written (see usysdep_spool_batch).  */
+#define CSEQ_RESERVE (32)
+
+/* The sequence numbers reserved for a batch: the system they belong
+   to, the last one handed out, and how many are left.  */
+static char *zSseq_system;
+static char abSseq_last[CSEQLEN + 1];
+static int cSseq_left;
+
 /* Local functions.  */
 
+static void usseq_incr P((char *zseq));
 static boolean fscmd_seq P((const char *zsystem, char *zseq));
 static char *zsfile_name P((int btype, const char *zsystem,
 			    const char *zlocalname, int bgrade,
 			    boolean fxqt, char *ztname, char *zdname,
 			    char *zxname));
 
+/* Add one to a command sequence number.  On Ultrix, arbitrary
+   characters are allowed in the sequence number.  On other systems,
+   the sequence number apparently must be in hex.  */
+
+static void
+usseq_incr (char *zseq)
+{
+  int i;
+
+#if SPOOLDIR_V2 || SPOOLDIR_BSD42 || SPOOLDIR_BSD43 || SPOOLDIR_HDB || SPOOLDIR_SVR4
+  i = (int) strtol (zseq, (char **) NULL, 16);
+  ++i;
+  if (i > 0xffff)
+    i = 0;
+  /* The sprintf argument has CSEQLEN built into it.  */
+  sprintf (zseq, "%04x", (unsigned int) i);
+#endif
+#if SPOOLDIR_ULTRIX || SPOOLDIR_TAYLOR
+  for (i = CSEQLEN - 1; i >= 0; i--)
+    {
+      const char *zdig;
+
+      zdig = strchr (ZCHARS, zseq[i]);
+      if (zdig == NULL || zdig[0] == '\0' || zdig[1] == '\0')
+	zseq[i] = '0';
+      else
+	{
+	  zseq[i] = zdig[1];
+	  break;
+	}
+    }
+#endif /* SPOOLDIR_ULTRIX || SPOOLDIR_TAYLOR */
+}
+
 /* Get a new command sequence number (this is not a sequence number to
    be used for communicating with another system, but a sequence
    number to be used when generating the name of a command file).
    The sequence number is placed into zseq, which should be five
-   characters long.  */
+   characters long.
+
+   While a batch of spool files is being written we reserve a block
+   of numbers each time we lock the sequence file, and hand them out
+   without locking it again.  Numbers which are reserved but not used
+   are simply skipped.  */
 
 static boolean
 fscmd_seq (const char *zsystem, char *zseq)
@@ -98,9 +148,19 @@ fscmd_seq (const char *zsystem, char *zseq)
   const char *zfile;
   int o;
   boolean flockfile;
-  int i;
+  char abwrite[CSEQLEN + 1];
   boolean fret;
 
+  if (fSspool_batch
+      && cSseq_left > 0
+      && strcmp (zSseq_system, zsystem) == 0)
+    {
+      usseq_incr (abSseq_last);
+      strcpy (zseq, abSseq_last);
+      --cSseq_left;
+      return TRUE;
+    }
+
   cdelay = 5;
 
 #if ! USE_POSIX_LOCKS
@@ -261,43 +321,32 @@ fscmd_seq (const char *zsystem, char *zseq)
     strcpy (zseq, "0000");
   zseq[CSEQLEN] = '\0';
 
-  /* We must add one to the sequence number and return the new value.
-     On Ultrix, arbitrary characters are allowed in the sequence
-     number.  On other systems, the sequence number apparently must be
-     in hex.  */
-#if SPOOLDIR_V2 || SPOOLDIR_BSD42 || SPOOLDIR_BSD43 || SPOOLDIR_HDB || SPOOLDIR_SVR4
-  i = (int) strtol (zseq, (char **) NULL, 16);
-  ++i;
-  if (i > 0xffff)
-    i = 0;
-  /* The sprintf argument has CSEQLEN built into it.  */
-  sprintf (zseq, "%04x", (unsigned int) i);
-#endif
-#if SPOOLDIR_ULTRIX || SPOOLDIR_TAYLOR
-  for (i = CSEQLEN - 1; i >= 0; i--)
+  /* We must add one to the sequence number and return the new
+     value.  In a batch, we write out the last number we reserve.  */
+  usseq_incr (zseq);
+  strcpy (abwrite, zseq);
+  if (fSspool_batch)
     {
-      const char *zdig;
-
-      zdig = strchr (ZCHARS, zseq[i]);
-      if (zdig == NULL || zdig[0] == '\0' || zdig[1] == '\0')
-	zseq[i] = '0';
-      else
-	{
-	  zseq[i] = zdig[1];
-	  break;
-	}
+      int i;
+
+      ubuffree (zSseq_system);
+      zSseq_system = zbufcpy (zsystem);
+      strcpy (abSseq_last, zseq);
+      for (i = 1; i < CSEQ_RESERVE; i++)
+	usseq_incr (abwrite);
+      cSseq_left = CSEQ_RESERVE - 1;
     }
-#endif /* SPOOLDIR_ULTRIX || SPOOLDIR_TAYLOR */
 
   fret = TRUE;
 
   if (lseek (o, (off_t) 0, SEEK_SET) < 0
-      || write (o, zseq, CSEQLEN) != CSEQLEN
+      || write (o, abwrite, CSEQLEN) != CSEQLEN
       || close (o) < 0)
     {
       ulog (LOG_ERROR, "lseek or write or close %s: %s",
 	    zfile, strerror (errno));
       (void) close (o);
+      cSseq_left = 0;
       fret = FALSE;
     }
 
@@ -0,0 +1,125 @@
+/* mirror.c
+   Allocate a buffer which appears twice in a row in memory.
+
+   Copyright (C) 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#include "uudefs.h"
+#include "sysdep.h"
+#include "system.h"
+
+#include <errno.h>
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#ifdef MAP_ANON
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#ifndef MAP_FAILED
+#define MAP_FAILED ((pointer) -1)
+#endif
+
+/* We need memfd_create to get an anonymous file we can map twice.  */
+#if (HAVE_SYS_MMAN_H && HAVE_MMAP && HAVE_MEMFD_CREATE && HAVE_FTRUNCATE \
+     && HAVE_SYSCONF && defined (MAP_ANONYMOUS))
+#define HAVE_MIRROR 1
+#else
+#define HAVE_MIRROR 0
+#endif
+
+char *
+zsysdep_mirror_alloc (size_t c)
+{
+#if ! HAVE_MIRROR
+  return NULL;
+#else
+  long cpage;
+  int o;
+  char *z;
+
+  /* Each copy must start on a page boundary.  */
+  cpage = sysconf (_SC_PAGESIZE);
+  if (cpage <= 0 || c % (size_t) cpage != 0)
+    return NULL;
+
+  o = memfd_create ("uucp", MFD_CLOEXEC);
+  if (o < 0)
+    {
+      DEBUG_MESSAGE1 (DEBUG_PORT, "zsysdep_mirror_alloc: memfd_create: %s",
+		      strerror (errno));
+      return NULL;
+    }
+
+  if (ftruncate (o, (off_t) c) < 0)
+    {
+      DEBUG_MESSAGE1 (DEBUG_PORT, "zsysdep_mirror_alloc: ftruncate: %s",
+		      strerror (errno));
+      (void) close (o);
+      return NULL;
+    }
+
+  /* Reserve enough address space for both copies, and then map the
+     file over each half of it.  */
+  z = (char *) mmap ((pointer) NULL, 2 * c, PROT_NONE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, (off_t) 0);
+  if (z == (char *) MAP_FAILED)
+    {
+      DEBUG_MESSAGE1 (DEBUG_PORT, "zsysdep_mirror_alloc: mmap: %s",
+		      strerror (errno));
+      (void) close (o);
+      return NULL;
+    }
+
+  if (mmap ((pointer) z, c, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+	    o, (off_t) 0) == MAP_FAILED
+      || mmap ((pointer) (z + c), c, PROT_READ | PROT_WRITE,
+	       MAP_SHARED | MAP_FIXED, o, (off_t) 0) == MAP_FAILED)
+    {
+      DEBUG_MESSAGE1 (DEBUG_PORT, "zsysdep_mirror_alloc: mmap: %s",
+		      strerror (errno));
+      (void) munmap ((pointer) z, 2 * c);
+      (void) close (o);
+      return NULL;
+    }
+
+  /* The mappings keep the file alive.  */
+  (void) close (o);
+
+  return z;
+#endif /* HAVE_MIRROR */
+}
+
+/* Free a buffer allocated by zsysdep_mirror_alloc.  */
+
+void
+usysdep_mirror_free (char *z, size_t c)
+{
+#if HAVE_MIRROR
+  (void) munmap ((pointer) z, 2 * c);
+#endif
+}
@@ -73,11 +73,16 @@ static const struct sconncmds spipecmds =
   fsdouble_read,
   fsdouble_write,
   fsysdep_conn_io,
+  fsdouble_writev,
+  fsysdep_conn_iov,
   NULL, /* pfbreak */
   NULL, /* pfset */
   NULL, /* pfcarrier */
   fsdouble_chat,
-  NULL  /* pibaud */
+  NULL, /* pibaud */
+  fsdouble_sendfile,
+  fsdouble_recvfile,
+  fsysdep_conn_trywrite
 };
 
 /* Initialize a pipe connection.  */
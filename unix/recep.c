@@ -1,5 +1,5 @@
 /* recep.c
-   See whether a file has already been received.
+   See whether a file has already been received, or partially received.
 
    Copyright (C) 1992, 1993, 1995, 2002 Ian Lance Taylor
 
@@ -45,6 +45,8 @@
 
 static char *zsreceived_name P((const struct uuconf_system *qsys,
 				const char *ztemp));
+static char *zscheckpoint_name P((const struct uuconf_system *qsys,
+				  const char *ztemp));
 
 /* These routines are used to see whether we have already received a
    file in a previous UUCP connection.  It is possible for the
@@ -187,3 +189,174 @@ fsysdep_forget_reception (const struct uuconf_system *qsys, const char *zto ATTR
     }
   return TRUE;
 }
+
+/* When a file which may be restarted is being received, we keep a
+   checkpoint for it in .Partial/SYS/TEMP, where SYS and TEMP are as
+   for .Received.  The file holds a single line:
+       cbytes cverified icrc zfrom zto
+   where icrc is in hex.  The receiving code uses it to decide how
+   much of the temporary file can be trusted.  */
+
+/* Return the name of the checkpoint file, or NULL if we have no
+   name.  */
+
+static char *
+zscheckpoint_name (const struct uuconf_system *qsys, const char *ztemp)
+{
+  if (ztemp != NULL
+      && *ztemp == 'D'
+      && strcmp (ztemp, "D.0") != 0)
+    return zsappend3 (".Partial", qsys->uuconf_zname, ztemp);
+  else
+    return NULL;
+}
+
+/* Write out a checkpoint.  */
+
+boolean
+fsysdep_write_checkpoint (const struct uuconf_system *qsys, const char *ztemp, const struct scheckpoint *qck)
+{
+  char *zfile;
+  FILE *e;
+
+  zfile = zscheckpoint_name (qsys, ztemp);
+  if (zfile == NULL)
+    return TRUE;
+
+  e = esysdep_fopen (zfile, FALSE, FALSE, TRUE);
+  ubuffree (zfile);
+  if (e == NULL)
+    return FALSE;
+
+  fprintf (e, "%ld %ld %lx %s %s\n", qck->cbytes, qck->cverified,
+	   qck->icrc, qck->zfrom, qck->zto);
+
+  if (fclose (e) != 0)
+    {
+      ulog (LOG_ERROR, "fclose: %s", strerror (errno));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Read a checkpoint.  */
+
+boolean
+fsysdep_read_checkpoint (const struct uuconf_system *qsys, const char *ztemp, struct scheckpoint *qck, boolean *pfbad)
+{
+  char *zfile;
+  FILE *e;
+  char *zline;
+  size_t cline;
+  struct stat s;
+  char *znext, *zend;
+  boolean fbad;
+
+  *pfbad = FALSE;
+
+  zfile = zscheckpoint_name (qsys, ztemp);
+  if (zfile == NULL)
+    return FALSE;
+
+  e = fopen (zfile, "r");
+  if (e == NULL)
+    {
+      if (errno != ENOENT)
+	{
+	  ulog (LOG_ERROR, "fopen (%s): %s", zfile, strerror (errno));
+	  *pfbad = TRUE;
+	}
+      ubuffree (zfile);
+      return FALSE;
+    }
+
+  if (fstat (fileno (e), &s) < 0)
+    s.st_mtime = 0;
+
+  zline = NULL;
+  cline = 0;
+  fbad = getline (&zline, &cline, e) <= 0;
+  (void) fclose (e);
+
+  /* This is basically
+
+     sscanf (zline, "%ld %ld %lx %s %s", ...);
+
+     but, as in fsysdep_get_status, done without scanf.  */
+  qck->zfrom = NULL;
+  qck->zto = NULL;
+  if (! fbad)
+    {
+      znext = zline;
+      qck->cbytes = strtol (znext, &zend, 10);
+      fbad = zend == znext;
+      znext = zend;
+      qck->cverified = strtol (znext, &zend, 10);
+      fbad = fbad || zend == znext || qck->cverified < 0;
+      znext = zend;
+      qck->icrc = strtoul (znext, &zend, 16);
+      fbad = fbad || zend == znext;
+      znext = zend;
+    }
+  if (! fbad)
+    {
+      znext += strspn (znext, " \t");
+      zend = znext + strcspn (znext, " \t\n");
+      if (*zend == '\0' || zend == znext)
+	fbad = TRUE;
+      else
+	{
+	  *zend++ = '\0';
+	  qck->zfrom = zbufcpy (znext);
+	  znext = zend + strspn (zend, " \t");
+	  zend = znext + strcspn (znext, " \t\n");
+	  if (zend == znext)
+	    fbad = TRUE;
+	  else
+	    {
+	      *zend = '\0';
+	      qck->zto = zbufcpy (znext);
+	    }
+	}
+    }
+
+  xfree ((pointer) zline);
+
+  if (fbad)
+    {
+      ulog (LOG_ERROR, "%s: Bad checkpoint file format", zfile);
+      ubuffree (zfile);
+      ubuffree (qck->zfrom);
+      qck->zfrom = NULL;
+      *pfbad = TRUE;
+      return FALSE;
+    }
+
+  qck->itime = (long) s.st_mtime;
+
+  ubuffree (zfile);
+
+  return TRUE;
+}
+
+/* Forget a checkpoint.  */
+
+boolean
+fsysdep_forget_checkpoint (const struct uuconf_system *qsys, const char *ztemp)
+{
+  char *zfile;
+
+  zfile = zscheckpoint_name (qsys, ztemp);
+  if (zfile == NULL)
+    return TRUE;
+  if (remove (zfile) < 0
+      && errno != ENOENT)
+    {
+      ulog (LOG_ERROR, "remove (%s): %s", zfile, strerror (errno));
+      ubuffree (zfile);
+      return FALSE;
+    }
+  ubuffree (zfile);
+  return TRUE;
+}
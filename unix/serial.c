@@ -126,6 +126,40 @@ const char serial_rcsid[] = "$Id$";
 #include <sys/termiox.h>
 #endif
 
+/* We use sendfile to write file data straight from the page cache,
+   and splice (which <fcntl.h> declares) to read it straight into the
+   page cache.  Only the Linux (and Solaris) form of sendfile is
+   supported.  */
+#if HAVE_SENDFILE && HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#define USE_SENDFILE 1
+#else
+#define USE_SENDFILE 0
+#endif
+
+#if HAVE_WRITEV && HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#define USE_WRITEV 1
+#else
+#define USE_WRITEV 0
+#endif
+
+/* When we are run from inetd, standard input is a TCP socket.  */
+#if HAVE_TCP && HAVE_NETINET_TCP_H
+#if HAVE_SYS_TYPES_TCP_H
+#include <sys/types.tcp.h>
+#endif
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#if HAVE_SPLICE && defined (SPLICE_F_MOVE) && defined (SPLICE_F_NONBLOCK)
+#define USE_SPLICE 1
+#else
+#define USE_SPLICE 0
+#endif
+
 /* Get definitions for both O_NONBLOCK and O_NDELAY.  */
 #ifndef O_NDELAY
 #ifdef FNDELAY
@@ -281,6 +315,14 @@ static boolean fsserial_hardflow P((struct sconnection *qconn,
 				    boolean fhardflow));
 static boolean fsrun_chat P((int oread, int owrite, char **pzprog));
 static long isserial_baud P((struct sconnection *qconn));
+static int csiov_write P((int o, const struct sconn_iov *qiov, int ciov));
+static void usiov_advance P((struct sconn_iov *qiov, int *piiov, int ciov,
+			     size_t c));
+#if USE_SENDFILE || USE_SPLICE
+static boolean fsfile_getpos P((openfile_t e, boolean fwrite, int *po,
+				off_t *pipos));
+static boolean fsfile_setpos P((openfile_t e, off_t ipos));
+#endif
 
 /* The command table for standard input ports.  */
 
@@ -295,11 +337,16 @@ static const struct sconncmds sstdincmds =
   fsdouble_read,
   fsdouble_write,
   fsysdep_conn_io,
+  fsdouble_writev,
+  fsysdep_conn_iov,
   fsstdin_break,
   fsstdin_set,
   NULL, /* pfcarrier */
   fsdouble_chat,
-  isserial_baud
+  isserial_baud,
+  fsdouble_sendfile,
+  fsdouble_recvfile,
+  fsysdep_conn_trywrite
 };
 
 /* The command table for modem ports.  */
@@ -315,11 +362,16 @@ static const struct sconncmds smodemcmds =
   fsysdep_conn_read,
   fsysdep_conn_write,
   fsysdep_conn_io,
+  fsysdep_conn_writev,
+  fsysdep_conn_iov,
   fsserial_break,
   fsserial_set,
   fsmodem_carrier,
   fsysdep_conn_chat,
-  isserial_baud
+  isserial_baud,
+  NULL, /* pfsendfile */
+  NULL, /* pfrecvfile */
+  NULL  /* pftrywrite */
 };
 
 /* The command table for direct ports.  */
@@ -335,11 +387,16 @@ static const struct sconncmds sdirectcmds =
   fsysdep_conn_read,
   fsysdep_conn_write,
   fsysdep_conn_io,
+  fsysdep_conn_writev,
+  fsysdep_conn_iov,
   fsserial_break,
   fsserial_set,
   NULL, /* pfcarrier */
   fsysdep_conn_chat,
-  isserial_baud
+  isserial_baud,
+  NULL, /* pfsendfile */
+  NULL, /* pfrecvfile */
+  NULL  /* pftrywrite */
 };
 
 /* If the system will let us set both O_NDELAY and O_NONBLOCK, we do
@@ -1306,6 +1363,21 @@ fsstdin_open (struct sconnection *qconn, long int ibaud, boolean fwait, boolean
       ulog (LOG_ERROR, "fcntl: %s", strerror (errno));
       return FALSE;
     }
+
+#if HAVE_TCP && HAVE_NETINET_TCP_H && defined (TCP_NODELAY)
+  /* If standard output is a TCP socket, turn off the Nagle algorithm
+     as ftcp_set_flags does; otherwise a reply to a pipelined command
+     can wait for the acknowledgement of the previous one.  This just
+     fails if standard output is not a socket.  */
+  {
+    int iyes;
+
+    iyes = 1;
+    (void) setsockopt (q->owr, IPPROTO_TCP, TCP_NODELAY, (char *) &iyes,
+		       sizeof iyes);
+  }
+#endif
+
   return TRUE;
 }
 
@@ -2528,24 +2600,96 @@ fsdouble_read (struct sconnection *qconn, char *zbuf, size_t *pclen, size_t cmin
   return fsysdep_conn_read (qconn, zbuf, pclen, cmin, ctimeout, freport);
 }
 
+/* Write out as much of a list of pieces of data as a single system
+   call will take, using writev if there is more than one piece.  This
+   returns what write returns.  */
+
+static int
+csiov_write (int o, const struct sconn_iov *qiov, int ciov)
+{
+#if USE_WRITEV
+  if (ciov > 1)
+    {
+      struct iovec as[CCONN_IOV_MAX];
+      int i;
+
+      for (i = 0; i < ciov; i++)
+	{
+	  as[i].iov_base = (pointer) qiov[i].zbuf;
+	  as[i].iov_len = qiov[i].clen;
+	}
+      return writev (o, as, ciov);
+    }
+#endif /* USE_WRITEV */
+
+  return write (o, qiov->zbuf, qiov->clen);
+}
+
+/* Step over c bytes of a list of pieces of data, starting at piece
+   *piiov, and then past any empty pieces.  */
+
+static void
+usiov_advance (struct sconn_iov *qiov, int *piiov, int ciov, size_t c)
+{
+  int i;
+
+  i = *piiov;
+  while (i < ciov && c >= qiov[i].clen)
+    {
+      c -= qiov[i].clen;
+      ++i;
+    }
+  if (i < ciov)
+    {
+      qiov[i].zbuf += c;
+      qiov[i].clen -= c;
+    }
+  *piiov = i;
+}
+
 /* Write data to a connection.  This routine handles all types of
    connections, including TLI.  */
 
 boolean
 fsysdep_conn_write (struct sconnection *qconn, const char *zwrite, size_t cwrite)
+{
+  struct sconn_iov s;
+
+  s.zbuf = zwrite;
+  s.clen = cwrite;
+  return fsysdep_conn_writev (qconn, &s, 1);
+}
+
+/* Write several pieces of data to a connection, with a single call to
+   writev if the system has it.  This routine handles all types of
+   connections; TLI connections get one t_snd per piece.  */
+
+boolean
+fsysdep_conn_writev (struct sconnection *qconn, const struct sconn_iov *qiov, int ciov)
 {
   struct ssysdep_conn *q;
+  struct sconn_iov as[CCONN_IOV_MAX];
+  int iiov;
   int czero;
 
   q = (struct ssysdep_conn *) qconn->psysdep;
 
+  if (ciov > CCONN_IOV_MAX)
+    {
+      ulog (LOG_FATAL, "fsysdep_conn_writev: Too many pieces");
+      return FALSE;
+    }
+  memcpy (as, qiov, ciov * sizeof (struct sconn_iov));
+  iiov = 0;
+  usiov_advance (as, &iiov, ciov, (size_t) 0);
+
   /* We want blocking writes here.  */
   if (! fsblock (q, TRUE))
     return FALSE;
 
   czero = 0;
 
-  while (cwrite > 0)
+  while (iiov < ciov)
     {
       int cdid;
 
@@ -2559,7 +2703,7 @@ fsysdep_conn_write (struct sconnection *qconn, const char *zwrite, size_t cwrite
 #if HAVE_TLI
 	  if (q->ftli)
 	    {
-	      cdid = t_snd (q->o, (char *) zwrite, cwrite, 0);
+	      cdid = t_snd (q->o, (char *) as[iiov].zbuf, as[iiov].clen, 0);
 	      if (cdid < 0 && t_errno != TSYSERR)
 		{
 		  ulog (LOG_ERROR, "t_snd: %s",
@@ -2571,7 +2715,7 @@ fsysdep_conn_write (struct sconnection *qconn, const char *zwrite, size_t cwrite
 	    }
 	  else
 #endif
-	    cdid = write (q->o, zwrite, cwrite);
+	    cdid = csiov_write (q->o, as + iiov, ciov - iiov);
 
 	  if (cdid >= 0)
 	    break;
@@ -2610,8 +2754,7 @@ fsysdep_conn_write (struct sconnection *qconn, const char *zwrite, size_t cwrite
 	{
 	  czero = 0;
 
-	  cwrite -= cdid;
-	  zwrite += cdid;
+	  usiov_advance (as, &iiov, ciov, (size_t) cdid);
 	}
     }
 
@@ -2632,6 +2775,469 @@ fsdouble_write (struct sconnection *qconn, const char *zwrite, size_t cwrite)
   qsysdep->o = qsysdep->owr;
   return fsysdep_conn_write (qconn, zwrite, cwrite);
 }
+
+/* Write several pieces of data to a port with separate read/write
+   file descriptors.  */
+
+boolean
+fsdouble_writev (struct sconnection *qconn, const struct sconn_iov *qiov, int ciov)
+{
+  struct ssysdep_conn *qsysdep;
+
+  qsysdep = (struct ssysdep_conn *) qconn->psysdep;
+  qsysdep->o = qsysdep->ord;
+  if (! fsblock (qsysdep, TRUE))
+    return FALSE;
+  qsysdep->o = qsysdep->owr;
+  return fsysdep_conn_writev (qconn, qiov, ciov);
+}
+
+/* Write as much of several pieces of data as the connection will take
+   without blocking.  This is used for the pftrywrite entry of the
+   network and pipe port types; the read and write descriptors of a
+   standard input or pipe port are switched together, as in
+   fsdouble_writev.  Terminals and TLI descriptors just get a blocking
+   write.  */
+
+boolean
+fsysdep_conn_trywrite (struct sconnection *qconn, const struct sconn_iov *qiov, int ciov, size_t *pcwrite)
+{
+  struct ssysdep_conn *q;
+  int iiov;
+  int cdid;
+
+  q = (struct ssysdep_conn *) qconn->psysdep;
+
+  if (q->fterminal || q->ftli)
+    {
+      *pcwrite = 0;
+      for (iiov = 0; iiov < ciov; iiov++)
+	*pcwrite += qiov[iiov].clen;
+      if (q->ord >= 0)
+	return fsdouble_writev (qconn, qiov, ciov);
+      return fsysdep_conn_writev (qconn, qiov, ciov);
+    }
+
+  if (ciov > CCONN_IOV_MAX)
+    {
+      ulog (LOG_FATAL, "fsysdep_conn_trywrite: Too many pieces");
+      return FALSE;
+    }
+
+  if (q->ord >= 0)
+    q->o = q->ord;
+  if (! fsblock (q, FALSE))
+    return FALSE;
+  if (q->owr >= 0)
+    q->o = q->owr;
+
+  while (TRUE)
+    {
+      if (FGOT_QUIT_SIGNAL ())
+	return FALSE;
+
+      cdid = csiov_write (q->o, qiov, ciov);
+      if (cdid >= 0 || errno != EINTR)
+	break;
+
+      /* We were interrupted by a signal.  Log it.  */
+      ulog (LOG_ERROR, (const char *) NULL);
+    }
+
+  if (cdid < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENODATA)
+	{
+	  ulog (LOG_ERROR, "write: %s", strerror (errno));
+	  return FALSE;
+	}
+      cdid = 0;
+    }
+
+  *pcwrite = (size_t) cdid;
+  return TRUE;
+}
+
+/* Wait until one of several connections has something to read, or
+   one of them can be written to, or the timeout expires.  */
+
+boolean
+fsysdep_conn_poll (struct sconnection **pqconns, int cconns, boolean *pafread, int iwrite, boolean *pfwrite, int ctimeout)
+{
+#if HAVE_SELECT && defined (FD_ZERO)
+  fd_set sread, swrite;
+  struct timeval stime;
+  int omax;
+  int i;
+  int c;
+
+  while (TRUE)
+    {
+      FD_ZERO (&sread);
+      FD_ZERO (&swrite);
+      omax = -1;
+      for (i = 0; i < cconns; i++)
+	{
+	  struct ssysdep_conn *q;
+	  int o;
+
+	  q = (struct ssysdep_conn *) pqconns[i]->psysdep;
+	  if (pafread[i])
+	    {
+	      o = q->ord >= 0 ? q->ord : q->o;
+	      FD_SET (o, &sread);
+	      if (o > omax)
+		omax = o;
+	    }
+	  if (i == iwrite)
+	    {
+	      o = q->owr >= 0 ? q->owr : q->o;
+	      FD_SET (o, &swrite);
+	      if (o > omax)
+		omax = o;
+	    }
+	}
+
+      if (FGOT_QUIT_SIGNAL ())
+	return FALSE;
+
+      stime.tv_sec = ctimeout;
+      stime.tv_usec = 0;
+      c = select (omax + 1, (pointer) &sread, (pointer) &swrite,
+		  (pointer) NULL, &stime);
+      if (c >= 0)
+	break;
+      if (errno != EINTR)
+	{
+	  ulog (LOG_ERROR, "select: %s", strerror (errno));
+	  return FALSE;
+	}
+
+      /* We were interrupted by a signal.  Log it.  */
+      ulog (LOG_ERROR, (const char *) NULL);
+    }
+
+  for (i = 0; i < cconns; i++)
+    {
+      struct ssysdep_conn *q;
+
+      q = (struct ssysdep_conn *) pqconns[i]->psysdep;
+      if (pafread[i])
+	pafread[i] = FD_ISSET (q->ord >= 0 ? q->ord : q->o, &sread) != 0;
+      if (i == iwrite)
+	*pfwrite = FD_ISSET (q->owr >= 0 ? q->owr : q->o, &swrite) != 0;
+    }
+
+  return TRUE;
+#else /* ! HAVE_SELECT || ! defined (FD_ZERO) */
+  ulog (LOG_ERROR, "fsysdep_conn_poll: Not supported");
+  return FALSE;
+#endif /* ! HAVE_SELECT || ! defined (FD_ZERO) */
+}
+
+#if USE_SENDFILE || USE_SPLICE
+
+/* Get the descriptor and the current position of an open file, so
+   that data can be moved to or from it behind the back of stdio.  If
+   fwrite is TRUE, any buffered output is written out first.  */
+
+static boolean
+fsfile_getpos (openfile_t e, boolean fwrite, int *po, off_t *pipos)
+{
+#if USE_STDIO
+  long ipos;
+
+  if (fwrite && fflush (e) != 0)
+    return FALSE;
+  ipos = ftell (e);
+  if (ipos < 0)
+    return FALSE;
+  *po = fileno (e);
+  *pipos = (off_t) ipos;
+#else
+  *po = e;
+  *pipos = lseek (e, (off_t) 0, SEEK_CUR);
+  if (*pipos < 0)
+    return FALSE;
+#endif
+  return TRUE;
+}
+
+/* Move an open file to a new position after data has been moved to
+   or from it directly.  */
+
+static boolean
+fsfile_setpos (openfile_t e, off_t ipos)
+{
+  if (! ffileseek (e, ipos))
+    {
+      ulog (LOG_ERROR, "seek: %s", strerror (errno));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+#endif /* USE_SENDFILE || USE_SPLICE */
+
+#if USE_SENDFILE
+/* Set if sendfile does not work for this connection or these files,
+   so that we don't keep trying it.  */
+static boolean fSno_sendfile;
+#endif
+
+/* Write data directly from a file to a connection using sendfile.
+   This handles all types of connections except TLI.  If sendfile is
+   not available or does not work with this descriptor, we report that
+   nothing was written, and the caller falls back on reading the file
+   itself.  */
+
+boolean
+fsysdep_conn_sendfile (struct sconnection *qconn, openfile_t e, size_t *pclen)
+{
+#if USE_SENDFILE
+  struct ssysdep_conn *q;
+  size_t clen;
+  int ofile;
+  off_t ipos;
+  long cdid;
+
+  clen = *pclen;
+  *pclen = 0;
+
+  q = (struct ssysdep_conn *) qconn->psysdep;
+
+  if (fSno_sendfile || q->ftli || clen == 0)
+    return TRUE;
+
+  /* We want blocking writes here, as in fsysdep_conn_write.  */
+  if (! fsblock (q, TRUE))
+    return FALSE;
+
+  if (! fsfile_getpos (e, FALSE, &ofile, &ipos))
+    return TRUE;
+
+  while (TRUE)
+    {
+      /* If we've received a signal, don't continue.  */
+      if (FGOT_QUIT_SIGNAL ())
+	return FALSE;
+
+      cdid = (long) sendfile (q->o, ofile, &ipos, clen);
+      if (cdid >= 0)
+	break;
+      if (errno != EINTR)
+	break;
+
+      /* We were interrupted by a signal.  Log it.  */
+      ulog (LOG_ERROR, (const char *) NULL);
+    }
+
+  if (cdid < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+	return TRUE;
+      if (errno == EINVAL || errno == ENOSYS
+#ifdef EOPNOTSUPP
+	  || errno == EOPNOTSUPP
+#endif
+	  )
+	{
+	  DEBUG_MESSAGE1 (DEBUG_PORT,
+			  "fsysdep_conn_sendfile: Not using sendfile: %s",
+			  strerror (errno));
+	  fSno_sendfile = TRUE;
+	  return TRUE;
+	}
+      ulog (LOG_ERROR, "sendfile: %s", strerror (errno));
+      return FALSE;
+    }
+
+  if (! fsfile_setpos (e, ipos))
+    return FALSE;
+
+  *pclen = (size_t) cdid;
+  return TRUE;
+#else /* ! USE_SENDFILE */
+  *pclen = 0;
+  return TRUE;
+#endif /* ! USE_SENDFILE */
+}
+
+/* Write from a file to a port with separate read/write file
+   descriptors.  */
+
+boolean
+fsdouble_sendfile (struct sconnection *qconn, openfile_t e, size_t *pclen)
+{
+  struct ssysdep_conn *qsysdep;
+
+  qsysdep = (struct ssysdep_conn *) qconn->psysdep;
+  qsysdep->o = qsysdep->ord;
+  if (! fsblock (qsysdep, TRUE))
+    return FALSE;
+  qsysdep->o = qsysdep->owr;
+  return fsysdep_conn_sendfile (qconn, e, pclen);
+}
+
+#if USE_SPLICE
+/* Set if splice does not work for this connection or these files.  */
+static boolean fSno_splice;
+
+/* splice can only move data to or from a pipe, so we move data from
+   the connection to the file through this one.  */
+static int aoSsplice[2] = { -1, -1 };
+#endif
+
+/* Read data which has already arrived on a connection directly into a
+   file using splice.  This handles all types of connections except
+   TLI.  We never wait for data here; the caller will do that with
+   fconn_read, which knows how to handle timeouts.  */
+
+boolean
+fsysdep_conn_recvfile (struct sconnection *qconn, openfile_t e, size_t *pclen)
+{
+#if USE_SPLICE
+  struct ssysdep_conn *q;
+  size_t clen;
+  int ofile;
+  off_t ipos;
+  long cin, cout;
+
+  clen = *pclen;
+  *pclen = 0;
+
+  q = (struct ssysdep_conn *) qconn->psysdep;
+
+  if (fSno_splice || q->ftli || clen == 0)
+    return TRUE;
+
+  if (aoSsplice[0] < 0)
+    {
+      if (pipe (aoSsplice) < 0)
+	{
+	  DEBUG_MESSAGE1 (DEBUG_PORT,
+			  "fsysdep_conn_recvfile: pipe: %s",
+			  strerror (errno));
+	  fSno_splice = TRUE;
+	  return TRUE;
+	}
+      (void) fcntl (aoSsplice[0], F_SETFD,
+		    fcntl (aoSsplice[0], F_GETFD, 0) | FD_CLOEXEC);
+      (void) fcntl (aoSsplice[1], F_SETFD,
+		    fcntl (aoSsplice[1], F_GETFD, 0) | FD_CLOEXEC);
+    }
+
+  /* Only take what is already there.  */
+  if (! fsblock (q, FALSE))
+    return FALSE;
+
+  if (! fsfile_getpos (e, TRUE, &ofile, &ipos))
+    return TRUE;
+
+  cin = (long) splice (q->o, (loff_t *) NULL, aoSsplice[1], (loff_t *) NULL,
+		       clen, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (cin < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	return TRUE;
+      if (errno == EINVAL || errno == ENOSYS)
+	{
+	  DEBUG_MESSAGE1 (DEBUG_PORT,
+			  "fsysdep_conn_recvfile: Not using splice: %s",
+			  strerror (errno));
+	  fSno_splice = TRUE;
+	  return TRUE;
+	}
+      ulog (LOG_ERROR, "splice: %s", strerror (errno));
+      return FALSE;
+    }
+
+  /* If cin is zero the other side has hung up; fconn_read will
+     notice that.  Otherwise, the data is now in the pipe, and we must
+     get all of it into the file.  */
+  cout = 0;
+  while (cout < cin)
+    {
+      long c;
+      loff_t ioff;
+
+      ioff = (loff_t) ipos;
+      c = (long) splice (aoSsplice[0], (loff_t *) NULL, ofile, &ioff,
+			 (size_t) (cin - cout), SPLICE_F_MOVE);
+      if (c > 0)
+	{
+	  ipos = (off_t) ioff;
+	  cout += c;
+	  continue;
+	}
+      if (c < 0 && errno == EINTR)
+	continue;
+
+      if (c < 0 && errno == EINVAL && ! fSno_splice)
+	{
+	  /* This file system can't be spliced into.  Copy what is
+	     left in the pipe by hand, and don't try again.  */
+	  DEBUG_MESSAGE0 (DEBUG_PORT,
+			  "fsysdep_conn_recvfile: Can't splice to file");
+	  fSno_splice = TRUE;
+	  if (lseek (ofile, ipos, SEEK_SET) < 0)
+	    {
+	      ulog (LOG_ERROR, "lseek: %s", strerror (errno));
+	      return FALSE;
+	    }
+	  while (cout < cin)
+	    {
+	      char ab[1024];
+	      int cread, cwrote;
+
+	      cread = read (aoSsplice[0], ab, sizeof ab);
+	      if (cread <= 0)
+		{
+		  ulog (LOG_ERROR, "read: %s", strerror (errno));
+		  return FALSE;
+		}
+	      cwrote = write (ofile, ab, (size_t) cread);
+	      if (cwrote != cread)
+		{
+		  ulog (LOG_ERROR, "write: %s", strerror (errno));
+		  return FALSE;
+		}
+	      ipos += cread;
+	      cout += cread;
+	    }
+	  break;
+	}
+
+      if (c == 0)
+	ulog (LOG_ERROR, "splice: Short write to file");
+      else
+	ulog (LOG_ERROR, "splice: %s", strerror (errno));
+      return FALSE;
+    }
+
+  if (! fsfile_setpos (e, ipos))
+    return FALSE;
+
+  *pclen = (size_t) cin;
+  return TRUE;
+#else /* ! USE_SPLICE */
+  *pclen = 0;
+  return TRUE;
+#endif /* ! USE_SPLICE */
+}
+
+/* Read from a port with separate read/write file descriptors into a
+   file.  */
+
+boolean
+fsdouble_recvfile (struct sconnection *qconn, openfile_t e, size_t *pclen)
+{
+  struct ssysdep_conn *qsysdep;
+
+  qsysdep = (struct ssysdep_conn *) qconn->psysdep;
+  qsysdep->o = qsysdep->ord;
+  return fsysdep_conn_recvfile (qconn, e, pclen);
+}
 
 /* The fsysdep_conn_io routine is supposed to both read and write data
    until it has either filled its read buffer or written out all the
@@ -2641,14 +3247,40 @@ fsdouble_write (struct sconnection *qconn, const char *zwrite, size_t cwrite)
 
 boolean
 fsysdep_conn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite, char *zread, size_t *pcread)
+{
+  struct sconn_iov s;
+
+  s.zbuf = zwrite;
+  s.clen = *pcwrite;
+  return fsysdep_conn_iov (qconn, &s, 1, pcwrite, zread, pcread);
+}
+
+/* This is fsysdep_conn_io with the data to write in several pieces,
+   which are written with writev when the system has it.  */
+
+boolean
+fsysdep_conn_iov (struct sconnection *qconn, const struct sconn_iov *qiov, int ciov, size_t *pcwrite, char *zread, size_t *pcread)
 {
   struct ssysdep_conn *q;
+  struct sconn_iov as[CCONN_IOV_MAX];
+  int iiov, i;
   size_t cwrite, cread;
   int czero;
 
   q = (struct ssysdep_conn *) qconn->psysdep;
 
-  cwrite = *pcwrite;
+  if (ciov > CCONN_IOV_MAX)
+    {
+      ulog (LOG_FATAL, "fsysdep_conn_iov: Too many pieces");
+      return FALSE;
+    }
+  memcpy (as, qiov, ciov * sizeof (struct sconn_iov));
+  iiov = 0;
+  usiov_advance (as, &iiov, ciov, (size_t) 0);
+
+  cwrite = 0;
+  for (i = 0; i < ciov; i++)
+    cwrite += qiov[i].clen;
   *pcwrite = 0;
   cread = *pcread;
   *pcread = 0;
@@ -2658,7 +3290,8 @@ fsysdep_conn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite,
   while (TRUE)
     {
       int cgot, cdid;
-      size_t cdo;
+      struct sconn_iov sdo;
+      int cdo;
 
       /* This used to always use nonblocking writes, but it turns out
 	 that some systems don't support them on terminals.
@@ -2779,12 +3412,20 @@ fsysdep_conn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite,
       if (cread == 0 || cwrite == 0)
 	return TRUE;
 
-      /* The port is currently unblocked.  Do a write.  */
-      cdo = cwrite;
+      /* The port is currently unblocked.  Do a write.  Normally we
+	 write all the remaining pieces, but if we are limited to
+	 SINGLE_WRITE bytes we only write from the first one.  */
+      cdo = ciov - iiov;
 
 #if ! HAVE_UNBLOCKED_WRITES
-      if (q->fterminal && cdo > SINGLE_WRITE)
-	cdo = SINGLE_WRITE;
+      if (q->fterminal && cwrite > SINGLE_WRITE)
+	cdo = 1;
+#endif
+
+      sdo = as[iiov];
+#if ! HAVE_UNBLOCKED_WRITES
+      if (q->fterminal && sdo.clen > SINGLE_WRITE)
+	sdo.clen = SINGLE_WRITE;
 #endif
 
       if (q->owr >= 0)
@@ -2800,7 +3441,7 @@ fsysdep_conn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite,
 #if HAVE_TLI
 	  if (q->ftli)
 	    {
-	      cdid = t_snd (q->o, (char *) zwrite, cdo, 0);
+	      cdid = t_snd (q->o, (char *) sdo.zbuf, sdo.clen, 0);
 	      if (cdid < 0)
 		{
 		  if (t_errno == TFLOW)
@@ -2817,7 +3458,12 @@ fsysdep_conn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite,
 	    }
 	  else
 #endif
-	    cdid = write (q->o, zwrite, cdo);
+	    {
+	      if (cdo > 1)
+		cdid = csiov_write (q->o, as + iiov, cdo);
+	      else
+		cdid = write (q->o, sdo.zbuf, sdo.clen);
+	    }
 
 	  if (cdid >= 0)
 	    break;
@@ -2843,7 +3489,7 @@ fsysdep_conn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite,
 	  /* We wrote some data.  If we wrote everything, return out.
 	     Otherwise loop around and do another read.  */
 	  cwrite -= cdid;
-	  zwrite += cdid;
+	  usiov_advance (as, &iiov, ciov, (size_t) cdid);
 	  *pcwrite += cdid;
 
 	  if (cwrite == 0)
@@ -2982,7 +3628,7 @@ fsysdep_conn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite,
 #if HAVE_TLI
 	      if (q->ftli)
 		{
-		  cdid = t_snd (q->o, (char *) zwrite, 1, 0);
+		  cdid = t_snd (q->o, (char *) as[iiov].zbuf, 1, 0);
 		  if (cdid < 0 && t_errno != TSYSERR)
 		    {
 		      usset_signal (SIGALRM, SIG_IGN, TRUE, (boolean *) NULL);
@@ -2996,7 +3642,7 @@ fsysdep_conn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite,
 		}
 	      else
 #endif
-		cdid = write (q->o, zwrite, 1);
+		cdid = write (q->o, as[iiov].zbuf, 1);
 
 	      ierr = errno;
 
@@ -3040,7 +3686,7 @@ fsysdep_conn_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite,
 	      else
 		{
 		  cwrite -= cdid;
-		  zwrite += cdid;
+		  usiov_advance (as, &iiov, ciov, (size_t) cdid);
 		  *pcwrite += cdid;
 		  czero = 0;
 		}
@@ -46,6 +46,7 @@ zsysdep_spool_commands (const struct uuconf_system *qsys, int bgrade, int ccmds,
   const struct scmd *qcmd;
   char *z;
   char *zjobid;
+  long istamp;
 
   if (pftemp != NULL)
     *pftemp = TRUE;
@@ -62,6 +63,10 @@ zsysdep_spool_commands (const struct uuconf_system *qsys, int bgrade, int ccmds,
   if (ztemp == NULL)
     return NULL;
 
+  /* Creating the temporary file changes the directory, so get the
+     stamp for the work index now.  */
+  istamp = iswork_index_stamp (ztemp);
+
   e = esysdep_fopen (ztemp, FALSE, FALSE, TRUE);
   if (e == NULL)
     {
@@ -154,6 +159,13 @@ zsysdep_spool_commands (const struct uuconf_system *qsys, int bgrade, int ccmds,
       if (link (ztemp, z) >= 0)
 	break;
 
+      /* Under SPOOLDIR_HASHED the command file may go in a
+	 subdirectory which does not exist yet.  */
+      if (errno == ENOENT
+	  && fsysdep_make_dirs (z, FALSE)
+	  && link (ztemp, z) >= 0)
+	break;
+
       if (errno != EEXIST)
 	{
 	  ulog (LOG_ERROR, "link (%s, %s): %s", ztemp, z, strerror (errno));
@@ -172,6 +184,8 @@ zsysdep_spool_commands (const struct uuconf_system *qsys, int bgrade, int ccmds,
   zjobid = zsfile_to_jobid (qsys, z, bgrade);
   if (zjobid == NULL)
     (void) remove (z);
+  else
+    uswork_index_note (z, istamp, TRUE);
   ubuffree (z);
   return zjobid;
 }
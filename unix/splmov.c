@@ -0,0 +1,201 @@
+/* splmov.c
+   Move spooled files into the current spool directory layout.
+
+   Copyright (C) 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#include "uudefs.h"
+#include "sysdep.h"
+#include "system.h"
+
+#include <ctype.h>
+#include <errno.h>
+
+#if HAVE_OPENDIR
+#if HAVE_DIRENT_H
+#include <dirent.h>
+#else /* ! HAVE_DIRENT_H */
+#include <sys/dir.h>
+#define dirent direct
+#endif /* ! HAVE_DIRENT_H */
+#endif /* HAVE_OPENDIR */
+
+/* SPOOLDIR_TAYLOR and SPOOLDIR_HASHED differ only in whether command
+   and data files are in the C., D. and D.X directories of a system or
+   in two digit subdirectories of them.  To change from one to the
+   other, we look in both places and move each file to wherever
+   zsfind_file says it belongs.  Files which are already in the right
+   place are left alone, so it does no harm to run this more than
+   once.  */
+
+#if SPOOLDIR_TAYLOR
+
+static boolean fsspool_move_dir P((const char *zsystem, const char *zdir,
+				   boolean fsub, long *pcmoved));
+
+/* The directories of each system which hold command and data
+   files.  */
+static const char * const azSspool_dirs[] = { "C.", "D.", "D.X" };
+
+#define CSPOOL_DIRS (sizeof azSspool_dirs / sizeof azSspool_dirs[0])
+
+/* Move the files in one directory.  If fsub is TRUE, also move the
+   files in any two digit subdirectories.  */
+
+static boolean
+fsspool_move_dir (const char *zsystem, const char *zdir, boolean fsub, long int *pcmoved)
+{
+  DIR *qdir;
+  struct dirent *qentry;
+  boolean fret;
+
+  qdir = opendir ((char *) zdir);
+  if (qdir == NULL)
+    {
+      if (errno == ENOENT || errno == ENOTDIR)
+	return TRUE;
+      ulog (LOG_ERROR, "opendir (%s): %s", zdir, strerror (errno));
+      return FALSE;
+    }
+
+  fret = TRUE;
+  while ((qentry = readdir (qdir)) != NULL)
+    {
+      char *zfrom, *zto;
+
+      if (fsub
+	  && isxdigit (BUCHAR (qentry->d_name[0]))
+	  && isxdigit (BUCHAR (qentry->d_name[1]))
+	  && qentry->d_name[2] == '\0')
+	{
+	  char *zsub;
+
+	  zsub = zsysdep_in_dir (zdir, qentry->d_name);
+	  if (! fsspool_move_dir (zsystem, zsub, FALSE, pcmoved))
+	    fret = FALSE;
+#if ! SPOOLDIR_HASHED
+	  /* The subdirectory should be empty now.  */
+	  (void) rmdir (zsub);
+#endif
+	  ubuffree (zsub);
+	  continue;
+	}
+
+      /* Leave the TMP files of zsysdep_spool_commands and anything
+	 else we don't recognize where they are.  */
+      if ((qentry->d_name[0] != 'C' && qentry->d_name[0] != 'D')
+	  || ! fspool_file (qentry->d_name))
+	continue;
+
+      zto = zsfind_file (qentry->d_name, zsystem, -1);
+      if (zto == NULL)
+	continue;
+      zfrom = zsysdep_in_dir (zdir, qentry->d_name);
+
+      if (strcmp (zfrom, zto) != 0)
+	{
+	  if (fsysdep_file_exists (zto))
+	    {
+	      ulog (LOG_ERROR, "%s: Not moved, since %s already exists",
+		    zfrom, zto);
+	      fret = FALSE;
+	    }
+	  else if (fsysdep_move_file (zfrom, zto, TRUE, FALSE, FALSE,
+				      (const char *) NULL))
+	    ++*pcmoved;
+	  else
+	    fret = FALSE;
+	}
+
+      ubuffree (zfrom);
+      ubuffree (zto);
+    }
+
+  closedir (qdir);
+
+  return fret;
+}
+
+#endif /* SPOOLDIR_TAYLOR */
+
+/* Move every command and data file in the spool directory to where
+   this version of the code expects to find it.  */
+
+boolean
+fsysdep_respool (long int *pcmoved)
+{
+#if ! SPOOLDIR_TAYLOR
+  *pcmoved = 0;
+  ulog (LOG_ERROR,
+	"Only the taylor and hashed spool directory layouts may be changed");
+  return FALSE;
+#else /* SPOOLDIR_TAYLOR */
+  DIR *qtop;
+  struct dirent *qsys;
+  boolean fret;
+
+  *pcmoved = 0;
+
+  /* Every directory in the spool directory not starting with a dot
+     is named for a system.  */
+  qtop = opendir ((char *) ".");
+  if (qtop == NULL)
+    {
+      ulog (LOG_ERROR, "opendir (%s): %s", zSspooldir, strerror (errno));
+      return FALSE;
+    }
+
+  fret = TRUE;
+  while ((qsys = readdir (qtop)) != NULL)
+    {
+      long cbefore;
+      size_t i;
+
+      if (qsys->d_name[0] == '.')
+	continue;
+
+      DEBUG_MESSAGE1 (DEBUG_SPOOLDIR, "fsysdep_respool: Checking %s",
+		      qsys->d_name);
+
+      cbefore = *pcmoved;
+      for (i = 0; i < CSPOOL_DIRS; i++)
+	{
+	  char *zdir;
+
+	  zdir = zsysdep_in_dir (qsys->d_name, azSspool_dirs[i]);
+	  if (! fsspool_move_dir (qsys->d_name, zdir, TRUE, pcmoved))
+	    fret = FALSE;
+	  ubuffree (zdir);
+	}
+
+      /* The work index may not notice that the command files moved,
+	 if it happens in the same second as the index was built.  */
+      if (*pcmoved != cbefore)
+	uswork_index_discard (qsys->d_name);
+    }
+
+  closedir (qtop);
+
+  return fret;
+#endif /* SPOOLDIR_TAYLOR */
+}
@@ -65,6 +65,12 @@ const char spool_rcsid[] = "$Id$";
    number for a C. file is actually a long string; it is not based on
    the sequence number file, but is generated via a process which
    attempts to produce a unique string each time it is run.
+   #if SPOOLDIR_HASHED
+   The files are placed one level further down, in ssssss/C./hh,
+   where hh is two hexadecimal digits taken from a hash of the
+   sequence number.  A large queue is thus spread over 256
+   directories, none of which becomes slow to search.
+   #endif
    #endif
 
    Data files
@@ -116,6 +122,10 @@ const char spool_rcsid[] = "$Id$";
    qqqq is a sequence number.  If the corresponding C. file is in
    directory ssssss/C., a D.X file is placed in ssssss/D.X and a D.
    file is placed in "ssssss/D.".
+   #if SPOOLDIR_HASHED
+   As with command files, they are placed in a subdirectory hh of
+   that directory named for a hash of the sequence number.
+   #endif
    #endif
 
    Execute files
@@ -180,6 +190,30 @@ const char spool_rcsid[] = "$Id$";
    #endif
    */
 
+#if SPOOLDIR_HASHED
+
+/* Get the name of the subdirectory for a command or data file, which
+   is two hexadecimal digits from a hash of the sequence number.  The
+   zsimple argument is the file name starting with the sequence
+   number.  */
+
+static void usspool_hash_dir P((const char *zsimple, char *zdir));
+
+static void
+usspool_hash_dir (const char *zsimple, char *zdir)
+{
+  unsigned long ihash;
+
+  ihash = 0;
+  for (; *zsimple != '\0'; zsimple++)
+    ihash = ihash * 31 + (unsigned char) *zsimple;
+  ihash ^= ihash >> 8;
+  ihash ^= ihash >> 16;
+  sprintf (zdir, "%02x", (unsigned int) (ihash & 0xff));
+}
+
+#endif /* SPOOLDIR_HASHED */
+
 /* Given the name of a file as specified in a UUCP command, and the
    system for which this file has been created, return where to find
    it in the spool directory.  The file will begin with C. (a command
@@ -277,6 +311,17 @@ zsfind_file (const char *zsimple, const char *zsystem, int bgrade ATTRIBUTE_UNUS
 	return zsappend4 ("sys", "DEFAULT", "C.", zsimple);
 #endif /* SPOOLDIR_ULTRIX */
 #if SPOOLDIR_TAYLOR
+#if SPOOLDIR_HASHED
+      /* The TMP file created by zsysdep_spool_commands stays in C.
+	 itself.  */
+      if (*zsimple == 'C' && zsimple[2] != '\0')
+	{
+	  char abdir[3];
+
+	  usspool_hash_dir (zsimple + 3, abdir);
+	  return zsappend4 (zsystem, "C.", abdir, zsimple);
+	}
+#endif /* SPOOLDIR_HASHED */
       return zsappend3 (zsystem, "C.", zsimple);
 #endif /* SPOOLDIR_TAYLOR */
 
@@ -390,10 +435,27 @@ zsfind_file (const char *zsimple, const char *zsystem, int bgrade ATTRIBUTE_UNUS
       }
 #endif /* SPOOLDIR_ULTRIX */
 #if SPOOLDIR_TAYLOR
+#if ! SPOOLDIR_HASHED
       if (zsimple[2] == 'X')
 	return zsappend3 (zsystem, "D.X", zsimple);
       else
 	return zsappend3 (zsystem, "D.", zsimple);
+#else /* SPOOLDIR_HASHED */
+      {
+	char abdir[3];
+
+	if (zsimple[2] == 'X')
+	  {
+	    usspool_hash_dir (zsimple + 3, abdir);
+	    return zsappend4 (zsystem, "D.X", abdir, zsimple);
+	  }
+	else
+	  {
+	    usspool_hash_dir (zsimple + 2, abdir);
+	    return zsappend4 (zsystem, "D.", abdir, zsimple);
+	  }
+      }
+#endif /* SPOOLDIR_HASHED */
 #endif /* SPOOLDIR_TAYLOR */
 
 
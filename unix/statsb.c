@@ -210,7 +210,7 @@ fskill_or_rejuv (pointer puuconf, const char *zid, boolean fkill)
 	  else
 	    {
 	      if (fkill)
-		isys = remove (ztemp);
+		isys = isysdep_spool_remove (ztemp);
 	      else
 		isys = issettime (ztemp, inow);
 
@@ -233,7 +233,14 @@ fskill_or_rejuv (pointer puuconf, const char *zid, boolean fkill)
   ubuffree (zsys);
 
   if (fkill)
-    isys = remove (zfile);
+    {
+      long istamp;
+
+      istamp = iswork_index_stamp (zfile);
+      isys = remove (zfile);
+      if (isys == 0)
+	uswork_index_note (zfile, istamp, FALSE);
+    }
   else
     isys = issettime (zfile, inow);
 
@@ -370,6 +377,134 @@ usysdep_all_status_free (pointer phold)
   (void) closedir (qdir);
 }
 
+/* We need to hold on to two directories while getting the
+   checkpoints, since they are in a directory for each system.  */
+
+struct sscheckpoints
+{
+  /* The .Partial directory.  */
+  DIR *qtop;
+  /* The directory for the current system, or NULL.  */
+  DIR *qsys;
+  /* The name of the current system.  */
+  char *zsystem;
+};
+
+/* Start getting the checkpoints.  */
+
+boolean
+fsysdep_all_checkpoints_init (pointer *phold)
+{
+  struct sscheckpoints *q;
+
+  q = (struct sscheckpoints *) xmalloc (sizeof (struct sscheckpoints));
+  q->qtop = opendir ((char *) ".Partial");
+  if (q->qtop == NULL && errno != ENOENT)
+    {
+      ulog (LOG_ERROR, "opendir (.Partial): %s", strerror (errno));
+      xfree ((pointer) q);
+      return FALSE;
+    }
+  q->qsys = NULL;
+  q->zsystem = NULL;
+
+  *phold = (pointer) q;
+  return TRUE;
+}
+
+/* Get the next checkpoint.  A checkpoint whose temporary file has
+   gone away is left over from a file which was thrown away, so we
+   skip it.  */
+
+char *
+zsysdep_all_checkpoints (pointer phold, boolean *pferr, struct scheckpoint *qck)
+{
+  struct sscheckpoints *q = (struct sscheckpoints *) phold;
+  struct dirent *qentry;
+
+  *pferr = FALSE;
+  if (q->qtop == NULL)
+    return NULL;
+
+  while (TRUE)
+    {
+      struct uuconf_system ssys;
+      char *ztemp;
+      boolean fbad;
+
+      if (q->qsys == NULL)
+	{
+	  char *zdir;
+
+	  errno = 0;
+	  qentry = readdir (q->qtop);
+	  if (qentry == NULL)
+	    {
+	      if (errno != 0)
+		{
+		  ulog (LOG_ERROR, "readdir: %s", strerror (errno));
+		  *pferr = TRUE;
+		}
+	      return NULL;
+	    }
+	  if (qentry->d_name[0] == '.')
+	    continue;
+
+	  ubuffree (q->zsystem);
+	  q->zsystem = zbufcpy (qentry->d_name);
+	  zdir = zsysdep_in_dir (".Partial", q->zsystem);
+	  q->qsys = opendir (zdir);
+	  ubuffree (zdir);
+	  continue;
+	}
+
+      errno = 0;
+      qentry = readdir (q->qsys);
+      if (qentry == NULL)
+	{
+	  if (errno != 0)
+	    {
+	      ulog (LOG_ERROR, "readdir: %s", strerror (errno));
+	      *pferr = TRUE;
+	      return NULL;
+	    }
+	  (void) closedir (q->qsys);
+	  q->qsys = NULL;
+	  continue;
+	}
+      if (qentry->d_name[0] == '.')
+	continue;
+
+      ztemp = zsappend3 (".Temp", q->zsystem, qentry->d_name);
+      if (! fsysdep_file_exists (ztemp))
+	{
+	  ubuffree (ztemp);
+	  continue;
+	}
+      ubuffree (ztemp);
+
+      /* As in zsysdep_all_status, we only need to fake the name.  */
+      ssys.uuconf_zname = q->zsystem;
+      if (fsysdep_read_checkpoint (&ssys, qentry->d_name, qck, &fbad))
+	return zbufcpy (q->zsystem);
+    }
+}
+
+/* Finish getting the checkpoints.  */
+
+void
+usysdep_all_checkpoints_free (pointer phold)
+{
+  struct sscheckpoints *q = (struct sscheckpoints *) phold;
+
+  if (q->qsys != NULL)
+    (void) closedir (q->qsys);
+  if (q->qtop != NULL)
+    (void) closedir (q->qtop);
+  ubuffree (q->zsystem);
+  xfree ((pointer) q);
+}
+
 /* Get the status of all processes holding lock files.  We do this by
    invoking ps after we've figured out the process entries to use.  */
 
@@ -9,6 +9,36 @@
 
 #include <errno.h>
 
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#if HAVE_SYS_FILE_H
+#include <sys/file.h>
+#endif
+#endif
+
+#ifndef O_RDONLY
+#define O_RDONLY 0
+#endif
+
+#ifndef O_NOCTTY
+#define O_NOCTTY 0
+#endif
+
+/* TRUE while a batch of spool files is being written.  */
+boolean fSspool_batch;
+
+/* TRUE if a batch has been started and not yet committed; it may
+   have been paused.  */
+static boolean fSspool_pending;
+
+#if FSYNC_ON_CLOSE
+/* The device holding the spool directory.  Only files on this device
+   have their fsync deferred to the end of the batch, since that is
+   the only file system we sync then.  */
+static dev_t iSspool_dev;
+#endif
+
 boolean
 fsysdep_sync (openfile_t e, const char *zmsg)
 {
@@ -31,6 +61,14 @@ fsysdep_sync (openfile_t e, const char *zmsg)
   o = e;
 #endif
 
+  if (fSspool_batch)
+    {
+      struct stat s;
+
+      if (fstat (o, &s) == 0 && s.st_dev == iSspool_dev)
+	return TRUE;
+    }
+
   if (fsync (o) < 0)
     {
       ulog (LOG_ERROR, "%s: fsync: %s", zmsg, strerror (errno));
@@ -40,3 +78,74 @@ fsysdep_sync (openfile_t e, const char *zmsg)
 
   return TRUE;
 }
+
+/* Start a batch of spool files.  */
+
+void
+usysdep_spool_batch (void)
+{
+#if FSYNC_ON_CLOSE
+  struct stat s;
+
+  /* If we can't find the spool directory, we just don't defer
+     anything.  */
+  if (stat ((char *) zSspooldir, &s) < 0)
+    {
+      ulog (LOG_ERROR, "stat (%s): %s", zSspooldir, strerror (errno));
+      return;
+    }
+  iSspool_dev = s.st_dev;
+#endif
+
+  fSspool_batch = TRUE;
+  fSspool_pending = TRUE;
+}
+
+/* Stop putting off syncs for the current batch, without committing
+   it.  */
+
+void
+usysdep_spool_pause (void)
+{
+  fSspool_batch = FALSE;
+}
+
+/* Finish a batch of spool files, forcing everything written since
+   usysdep_spool_batch out to disk.  */
+
+boolean
+fsysdep_spool_commit (void)
+{
+#if FSYNC_ON_CLOSE && HAVE_SYNCFS
+  int o;
+#endif
+
+  if (! fSspool_pending)
+    return TRUE;
+  fSspool_batch = FALSE;
+  fSspool_pending = FALSE;
+
+#if FSYNC_ON_CLOSE
+#if HAVE_SYNCFS
+  /* One syncfs takes care of the files and of the directory entries
+     which name them.  */
+  o = open ((char *) zSspooldir, O_RDONLY | O_NOCTTY);
+  if (o < 0)
+    {
+      ulog (LOG_ERROR, "open (%s): %s", zSspooldir, strerror (errno));
+      return FALSE;
+    }
+  if (syncfs (o) < 0)
+    {
+      ulog (LOG_ERROR, "syncfs (%s): %s", zSspooldir, strerror (errno));
+      (void) close (o);
+      return FALSE;
+    }
+  (void) close (o);
+#else /* ! HAVE_SYNCFS */
+  sync ();
+#endif /* ! HAVE_SYNCFS */
+#endif /* FSYNC_ON_CLOSE */
+
+  return TRUE;
+}
@@ -46,6 +46,10 @@ const char tcp_rcsid[] = "$Id$";
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#if HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
+
 #if HAVE_FCNTL_H
 #include <fcntl.h>
 #else
@@ -58,6 +62,14 @@ const char tcp_rcsid[] = "$Id$";
 #define FD_CLOEXEC 1
 #endif
 
+#ifndef O_NOCTTY
+#define O_NOCTTY 0
+#endif
+
+#ifndef SOMAXCONN
+#define SOMAXCONN 5
+#endif
+
 #if HAVE_STRUCT_SOCKADDR_STORAGE
 typedef struct sockaddr_storage sockaddr_storage;
 #else
@@ -89,6 +101,9 @@ static boolean ftcp_dial P((struct sconnection *qconn, pointer puuconf,
 			    struct uuconf_dialer *qdialer,
 			    enum tdialerfound *ptdialer));
 static int itcp_port_number P((const char *zport));
+static int otcp_stream_master P((struct sconnection *qconn));
+static boolean ftcp_stream_port P((sockaddr_storage *qaddr, int *piport));
+static boolean ftcp_stream_init P((struct sconnection *qnew, int o));
 
 /* The command table for a TCP connection.  */
 static const struct sconncmds stcpcmds =
@@ -102,11 +117,16 @@ static const struct sconncmds stcpcmds =
   fsysdep_conn_read,
   fsysdep_conn_write,
   fsysdep_conn_io,
+  fsysdep_conn_writev,
+  fsysdep_conn_iov,
   NULL, /* pfbreak */
   NULL, /* pfset */
   NULL, /* pfcarrier */
   fsysdep_conn_chat,
-  NULL /* pibaud */
+  NULL, /* pibaud */
+  fsysdep_conn_sendfile,
+  fsysdep_conn_recvfile,
+  fsysdep_conn_trywrite
 };
 
 /* Initialize a TCP connection.  */
@@ -172,11 +192,18 @@ ftcp_set_hints (int iversion, struct addrinfo *qhints)
 
 #endif /* HAVE_GETADDRINFO */
 
-/* Set the close on exec flag for a socket.  */
+/* Set the close on exec flag for a socket.  Also turn off the Nagle
+   algorithm.  When file transfers are pipelined, the next command
+   follows the end of a file at once, and it must not wait for the
+   remote system to acknowledge the last piece of the file.  */
 
 static boolean
 ftcp_set_flags (struct ssysdep_conn *qsysdep)
 {
+#ifdef TCP_NODELAY
+  int iyes;
+#endif
+
   if (fcntl (qsysdep->o, F_SETFD,
 	     fcntl (qsysdep->o, F_GETFD, 0) | FD_CLOEXEC) < 0)
     {
@@ -195,6 +222,15 @@ ftcp_set_flags (struct ssysdep_conn *qsysdep)
       return FALSE;
     }
 
+#ifdef TCP_NODELAY
+  iyes = 1;
+  if (setsockopt (qsysdep->o, IPPROTO_TCP, TCP_NODELAY, (char *) &iyes,
+		  sizeof iyes) < 0)
+    DEBUG_MESSAGE1 (DEBUG_PORT,
+		    "ftcp_set_flags: setsockopt (TCP_NODELAY): %s",
+		    strerror (errno));
+#endif
+
   return TRUE;
 }
 
@@ -627,6 +663,268 @@ ftcp_dial (struct sconnection *qconn, pointer puuconf, const struct uuconf_syste
   return TRUE;
 }
 
+/* Get the socket of the connection which carries a conversation.
+   This is a TCP port, or a standard input port when uucico was
+   started by inetd.  */
+
+static int
+otcp_stream_master (struct sconnection *qconn)
+{
+  struct ssysdep_conn *qsysdep;
+
+  qsysdep = (struct ssysdep_conn *) qconn->psysdep;
+  if (qsysdep->ord >= 0)
+    return qsysdep->ord;
+  return qsysdep->o;
+}
+
+/* Get or set the port number of a socket address.  If *piport is -1
+   it is set from the address, otherwise the address is changed.  */
+
+static boolean
+ftcp_stream_port (sockaddr_storage *qaddr, int *piport)
+{
+  struct sockaddr *qsa;
+
+  qsa = (struct sockaddr *) qaddr;
+  if (qsa->sa_family == AF_INET)
+    {
+      struct sockaddr_in *qsin;
+
+      qsin = (struct sockaddr_in *) qaddr;
+      if (*piport == -1)
+	*piport = ntohs (qsin->sin_port);
+      else
+	qsin->sin_port = htons (*piport);
+      return TRUE;
+    }
+#if HAVE_STRUCT_SOCKADDR_STORAGE && defined (AF_INET6)
+  if (qsa->sa_family == AF_INET6)
+    {
+      struct sockaddr_in6 *qsin6;
+
+      qsin6 = (struct sockaddr_in6 *) qaddr;
+      if (*piport == -1)
+	*piport = ntohs (qsin6->sin6_port);
+      else
+	qsin6->sin6_port = htons (*piport);
+      return TRUE;
+    }
+#endif
+
+  ulog (LOG_ERROR, "Unsupported socket address family %d",
+	(int) qsa->sa_family);
+  return FALSE;
+}
+
+/* Set up a connection structure for an extra stream socket.  */
+
+static boolean
+ftcp_stream_init (struct sconnection *qnew, int o)
+{
+  struct ssysdep_conn *qsysdep;
+
+  qnew->qport = NULL;
+  if (! fsysdep_tcp_init (qnew))
+    {
+      (void) close (o);
+      return FALSE;
+    }
+  qsysdep = (struct ssysdep_conn *) qnew->psysdep;
+  qsysdep->o = o;
+  qsysdep->ipid = getpid ();
+  if (! ftcp_set_flags (qsysdep))
+    {
+      utcp_free (qnew);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Listen for extra stream connections on a new port at the address
+   the remote system reached us on.  */
+
+boolean
+fsysdep_tcp_stream_listen (struct sconnection *qconn, struct sconnection *qlisten, int *piport, char *ztoken)
+{
+  sockaddr_storage saddr;
+  socklen_t clen;
+  int o;
+  unsigned char ab[CTCP_STREAM_TOKEN / 2];
+  int oran;
+  size_t i;
+
+  clen = sizeof saddr;
+  if (getsockname (otcp_stream_master (qconn), (struct sockaddr *) &saddr,
+		   &clen) < 0)
+    {
+      ulog (LOG_ERROR, "getsockname: %s", strerror (errno));
+      return FALSE;
+    }
+  *piport = 0;
+  if (! ftcp_stream_port (&saddr, piport))
+    return FALSE;
+
+  o = socket (((struct sockaddr *) &saddr)->sa_family, SOCK_STREAM, 0);
+  if (o < 0)
+    {
+      ulog (LOG_ERROR, "socket: %s", strerror (errno));
+      return FALSE;
+    }
+  /* The other side makes all its connections before it tells us it
+     is ready, and we may have to skip some bad ones as well, so let
+     the kernel queue as many as it will.  */
+  if (bind (o, (struct sockaddr *) &saddr, clen) < 0
+      || listen (o, SOMAXCONN) < 0)
+    {
+      ulog (LOG_ERROR, "bind: %s", strerror (errno));
+      (void) close (o);
+      return FALSE;
+    }
+  clen = sizeof saddr;
+  if (getsockname (o, (struct sockaddr *) &saddr, &clen) < 0)
+    {
+      ulog (LOG_ERROR, "getsockname: %s", strerror (errno));
+      (void) close (o);
+      return FALSE;
+    }
+  *piport = -1;
+  if (! ftcp_stream_port (&saddr, piport))
+    {
+      (void) close (o);
+      return FALSE;
+    }
+  if (! ftcp_stream_init (qlisten, o))
+    return FALSE;
+
+  /* The token keeps anybody else from taking over one of the
+     streams, so it must not be guessable.  Without a random device
+     we don't use streams at all.  */
+  oran = open ((char *) "/dev/urandom", O_RDONLY | O_NOCTTY, 0);
+  if (oran < 0)
+    {
+      ulog (LOG_ERROR, "open (/dev/urandom): %s", strerror (errno));
+      usysdep_tcp_stream_close (qlisten);
+      return FALSE;
+    }
+  if (read (oran, ab, sizeof ab) != (int) sizeof ab)
+    {
+      ulog (LOG_ERROR, "read (/dev/urandom) failed");
+      (void) close (oran);
+      usysdep_tcp_stream_close (qlisten);
+      return FALSE;
+    }
+  (void) close (oran);
+  for (i = 0; i < sizeof ab; i++)
+    sprintf (ztoken + i * 2, "%02x", (unsigned int) ab[i]);
+
+  return TRUE;
+}
+
+/* Accept an extra stream connection.  */
+
+boolean
+fsysdep_tcp_stream_accept (struct sconnection *qlisten, struct sconnection *qconn, struct sconnection *qnew)
+{
+  sockaddr_storage sfrom, speer;
+  socklen_t cfrom, cpeer;
+  int o;
+  boolean fsame;
+
+  cfrom = sizeof sfrom;
+  o = accept (((struct ssysdep_conn *) qlisten->psysdep)->o,
+	      (struct sockaddr *) &sfrom, &cfrom);
+  if (o < 0)
+    {
+      ulog (LOG_ERROR, "accept: %s", strerror (errno));
+      return FALSE;
+    }
+
+  cpeer = sizeof speer;
+  if (getpeername (otcp_stream_master (qconn), (struct sockaddr *) &speer,
+		   &cpeer) < 0)
+    {
+      ulog (LOG_ERROR, "getpeername: %s", strerror (errno));
+      (void) close (o);
+      return FALSE;
+    }
+
+  fsame = FALSE;
+  if (((struct sockaddr *) &sfrom)->sa_family
+      == ((struct sockaddr *) &speer)->sa_family)
+    {
+      if (((struct sockaddr *) &sfrom)->sa_family == AF_INET)
+	fsame = memcmp (&((struct sockaddr_in *) &sfrom)->sin_addr,
+			&((struct sockaddr_in *) &speer)->sin_addr,
+			sizeof (struct in_addr)) == 0;
+#if HAVE_STRUCT_SOCKADDR_STORAGE && defined (AF_INET6)
+      else if (((struct sockaddr *) &sfrom)->sa_family == AF_INET6)
+	fsame = memcmp (&((struct sockaddr_in6 *) &sfrom)->sin6_addr,
+			&((struct sockaddr_in6 *) &speer)->sin6_addr,
+			sizeof (struct in6_addr)) == 0;
+#endif
+    }
+  if (! fsame)
+    {
+      ulog (LOG_ERROR, "Stream connection from wrong host");
+      (void) close (o);
+      return FALSE;
+    }
+
+  return ftcp_stream_init (qnew, o);
+}
+
+/* Make an extra stream connection to the remote system.  */
+
+boolean
+fsysdep_tcp_stream_connect (struct sconnection *qconn, int iport, struct sconnection *qnew)
+{
+  sockaddr_storage saddr;
+  socklen_t clen;
+  int o;
+
+  clen = sizeof saddr;
+  if (getpeername (otcp_stream_master (qconn), (struct sockaddr *) &saddr,
+		   &clen) < 0)
+    {
+      ulog (LOG_ERROR, "getpeername: %s", strerror (errno));
+      return FALSE;
+    }
+  if (! ftcp_stream_port (&saddr, &iport))
+    return FALSE;
+
+  o = socket (((struct sockaddr *) &saddr)->sa_family, SOCK_STREAM, 0);
+  if (o < 0)
+    {
+      ulog (LOG_ERROR, "socket: %s", strerror (errno));
+      return FALSE;
+    }
+  if (connect (o, (struct sockaddr *) &saddr, clen) < 0)
+    {
+      ulog (LOG_ERROR, "connect: %s", strerror (errno));
+      (void) close (o);
+      return FALSE;
+    }
+
+  return ftcp_stream_init (qnew, o);
+}
+
+/* Close an extra stream connection.  */
+
+void
+usysdep_tcp_stream_close (struct sconnection *qconn)
+{
+  struct ssysdep_conn *qsysdep;
+
+  qsysdep = (struct ssysdep_conn *) qconn->psysdep;
+  if (qsysdep == NULL)
+    return;
+  if (qsysdep->o >= 0)
+    (void) close (qsysdep->o);
+  utcp_free (qconn);
+  qconn->psysdep = NULL;
+}
+
 /* Get the port number given a name.  The argument will almost always
    be "uucp" so we cache that value.  The return value is always in
    network byte order.  This returns -1 on error.  */
@@ -129,11 +129,16 @@ static const struct sconncmds stlicmds =
   fsysdep_conn_read,
   fsysdep_conn_write,
   fsysdep_conn_io,
+  fsysdep_conn_writev,
+  fsysdep_conn_iov,
   NULL, /* pfbreak */
   NULL, /* pfset */
   NULL, /* pfcarrier */
   fsysdep_conn_chat,
-  NULL /* pibaud */
+  NULL, /* pibaud */
+  NULL, /* pfsendfile */
+  NULL, /* pfrecvfile */
+  NULL  /* pftrywrite */
 };
 
 /* Get a TLI error string.  */
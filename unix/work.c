@@ -36,6 +36,63 @@ const char work_rcsid[] = "$Id$";
 #include <ctype.h>
 #include <errno.h>
 
+#if HAVE_TIME_H
+#include <time.h>
+#endif
+
+/* Under SPOOLDIR_SVR4 and SPOOLDIR_HASHED the command files are in
+   subdirectories of the work directory.  FWORK_SUBDIR is true for the
+   name of one of those subdirectories.  */
+#if SPOOLDIR_SVR4
+#define WORK_SUBDIRS 1
+#define FWORK_SUBDIR(z) ((z)[0] != '.' && (z)[1] == '\0')
+#elif SPOOLDIR_HASHED
+#define WORK_SUBDIRS 1
+#define FWORK_SUBDIR(z) \
+  (isxdigit (BUCHAR ((z)[0])) && isxdigit (BUCHAR ((z)[1])) \
+   && (z)[2] == '\0')
+#else
+#define WORK_SUBDIRS 0
+#endif
+
+/* We can watch the work directory for new command files using
+   inotify.  When command files are in subdirectories of the work
+   directory, inotify would not report them.  */
+#if HAVE_INOTIFY_INIT && HAVE_SYS_INOTIFY_H && ! WORK_SUBDIRS
+#define USE_INOTIFY 1
+#include <sys/inotify.h>
+#else
+#define USE_INOTIFY 0
+#endif
+
+#ifndef FD_CLOEXEC
+#define FD_CLOEXEC 1
+#endif
+
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#if HAVE_SYS_FILE_H
+#include <sys/file.h>
+#endif
+#endif
+
+#ifndef O_RDWR
+#define O_RDWR 2
+#endif
+
+#ifndef O_NOCTTY
+#define O_NOCTTY 0
+#endif
+
+#ifndef SEEK_SET
+#define SEEK_SET 0
+#endif
+
+#ifndef SEEK_END
+#define SEEK_END 2
+#endif
+
 #if HAVE_OPENDIR
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -51,6 +108,10 @@ static char *zswork_directory P((const char *zsystem));
 static boolean fswork_file P((const char *zsystem, const char *zfile,
 			      char *pbgrade));
 static int iswork_cmp P((constpointer pkey, constpointer pdatum));
+static struct ssfilename *qswork_lookup P((const char *zfile));
+static void uswork_add P((char *zfile, int bgrade));
+static void uswork_rehash P((void));
+static void uswork_sort_new P((void));
 
 /* These functions can support multiple actions going on at once.
    This allows the UUCP package to send and receive multiple files at
@@ -65,6 +126,10 @@ struct ssfilename
   char bgrade;
   /* Some compiler may need this, and it won't normally hurt.  */
   char bdummy;
+  /* Whether the work index says the file has been removed.  */
+  boolean fdead;
+  /* The next file in the same hash bucket, plus one.  */
+  size_t inext;
 };
 
 /* The ssfile structure holds a command file name and all the lines
@@ -101,6 +166,136 @@ static size_t cSwork_files;
 static size_t iSwork_file;
 static struct ssfile *qSwork_file;
 
+/* A hash table of the names in asSwork_files, so that we can tell
+   which files we already know about.  Each bucket holds the index of
+   the first file in the bucket plus one, or zero if it is empty.  */
+
+static size_t *aiSwork_hash;
+static size_t cSwork_hash;
+
+/* The number of entries by which to grow asSwork_files.  */
+#define CWORKFILES (10)
+
+/* The work index.  Scanning the work directory each time uucico
+   looks for more work is slow when there are many thousands of
+   command files queued for a system, so we also keep a log of the
+   command files which have been added and removed in the file
+   .Workindex/SSSSSS, where SSSSSS is the system name.
+   zsysdep_spool_commands adds a record when it creates a command
+   file, and fsysdep_did_work adds one when it removes one, so
+   fsysdep_get_work_init only has to read the records added since the
+   last time it looked.
+
+   The index is only a cache of the work directory.  It is only
+   trusted if it records the modification time the work directory
+   had after the last change made to it by a program which updated
+   the index; anything else which adds or removes a command file will
+   change the time, and the index will be rebuilt from the directory.
+   A program which changes the directory records the time the
+   directory had before it made its change, and only updates the time
+   in the index if that was the time the index recorded.  Where the
+   system records modification times to the nanosecond we use the
+   time to the microsecond.  Otherwise the time is only in seconds,
+   and a change made by some other program later in the same second
+   would not change it, so a time in the current second is never
+   trusted (see iswork_dir_stamp).  The clock used for modification
+   times can still be coarser than that, so to limit the damage of a
+   missed change the index is also rebuilt once it is
+   CWORK_INDEX_AGE seconds old.
+
+   The index is a sequence of CWORK_INDEX_REC byte records.  The first
+   is a header: the magic string "UUWIDX1\n", followed by the
+   modification time of the work directory, the time the index was
+   rebuilt, a generation number which changes each time it is
+   rebuilt, and the number of records for removed files, each as an
+   eight byte big endian number.  Every other record is either a '+'
+   (a command file was added) or a '-' (it was removed), followed by
+   the grade and by the name of the file, padded with null bytes.
+   Records are only added to the end of the index, so a program which
+   is interrupted while writing one leaves at most a partial record,
+   which is ignored.  A header which is not valid means that the index
+   must be rebuilt.  Access to the index is controlled by an fcntl
+   lock on the index itself, so the index is only used when those
+   work.  Only the SPOOLDIR_TAYLOR layout keeps command files for a
+   single system in a directory of their own, so only that layout
+   uses an index.  SPOOLDIR_HASHED spreads them over many directories,
+   so a single modification time no longer tells us whether the index
+   is current; it doesn't need an index anyhow, since no directory
+   gets large.  */
+
+#if (SPOOLDIR_TAYLOR && ! SPOOLDIR_HASHED && HAVE_FTRUNCATE \
+     && ! HAVE_BROKEN_SETLKW && defined (F_SETLKW))
+#define USE_WORK_INDEX 1
+#else
+#define USE_WORK_INDEX 0
+#endif
+
+#if USE_WORK_INDEX
+
+#define ZWORK_INDEX_DIR ".Workindex"
+#define ZWORK_INDEX_MAGIC "UUWIDX1\n"
+
+/* The size of each record.  */
+#define CWORK_INDEX_REC (64)
+
+/* The offsets of the fields in the header.  */
+#define IWORK_INDEX_MTIME (8)
+#define IWORK_INDEX_BUILT (16)
+#define IWORK_INDEX_GEN (24)
+#define IWORK_INDEX_DEAD (32)
+
+/* Rebuild the index when it is this many seconds old.  */
+#define CWORK_INDEX_AGE (60 * 60)
+
+/* Rebuild the index when it holds this many records for removed
+   files.  */
+#define CWORK_INDEX_DEAD (1024)
+
+/* The number of records to read or write at once.  */
+#define CWORK_INDEX_BUFRECS (128)
+
+static void uswork_put P((char *z, long i));
+static long iswork_get P((const char *z));
+static long iswork_dir_stamp P((const struct stat *q));
+static char *zswork_system P((const char *zfile));
+static int oswork_index_open P((const char *zsystem, boolean fcreate));
+static boolean fswork_index_header P((int o, char *abhdr));
+static boolean fswork_index_write P((int o, long ipos, const char *z,
+				     size_t c));
+static boolean fswork_index_rebuild P((int o, const char *zsystem,
+				       const char *zdir, long imtime,
+				       long igen));
+static boolean fswork_index_load P((const struct uuconf_system *qsys,
+				    const char *zdir, int bgrade,
+				    unsigned int cmax));
+
+/* The generation of the index from which we have read records, or -1
+   if we have not read any.  */
+static long iSwork_index_gen = -1;
+
+/* The offset of the next record to read from the index.  */
+static long iSwork_index_off;
+
+/* The grade argument passed to fsysdep_get_work_init when we last
+   read the index; records for files of a lower grade were skipped.  */
+static int bSwork_index_grade;
+
+#endif /* USE_WORK_INDEX */
+
+/* Whether the files in asSwork_files came from the work index, in
+   which case we don't complain if one of them has disappeared.  */
+static boolean fSwork_index;
+
+#if USE_INOTIFY
+
+/* The inotify descriptor watching the work directory, or -1.  */
+static int oSwork_watch = -1;
+
+/* The name of the system whose work directory is being watched.  */
+static char *zSwork_watch_system;
+
+#endif /* USE_INOTIFY */
+
 /* Given a system name, return a directory to search for work.  */
 
 static char *
@@ -191,7 +386,635 @@ iswork_cmp (constpointer pkey, constpointer pdatum)
   const struct ssfilename *qkey = (const struct ssfilename *) pkey;
   const struct ssfilename *qdatum = (const struct ssfilename *) pdatum;
 
+#if SPOOLDIR_HASHED
+  /* The names are hh/C.gqqqq; compare the part after the
+     subdirectory, so that the files still come out in grade
+     order.  */
+  return strcmp (qkey->zfile + 3, qdatum->zfile + 3);
+#else
   return strcmp (qkey->zfile, qdatum->zfile);
+#endif
+}
+
+/* Hash a file name.  */
+
+#define ISWORK_HASH(z, i) \
+  do \
+    { \
+      const char *zhash; \
+      (i) = 0; \
+      for (zhash = (z); *zhash != '\0'; zhash++) \
+	(i) = (i) * 31 + (unsigned char) *zhash; \
+    } \
+  while (0)
+
+/* Look up a file name in asSwork_files.  */
+
+static struct ssfilename *
+qswork_lookup (const char *zfile)
+{
+  size_t ihash, i;
+
+  if (cSwork_hash == 0)
+    return NULL;
+  ISWORK_HASH (zfile, ihash);
+  for (i = aiSwork_hash[ihash & (cSwork_hash - 1)];
+       i != 0;
+       i = asSwork_files[i - 1].inext)
+    if (strcmp (asSwork_files[i - 1].zfile, zfile) == 0)
+      return &asSwork_files[i - 1];
+  return NULL;
+}
+
+/* Add a file name, which must have been allocated using zbufalc, to
+   asSwork_files.  */
+
+static void
+uswork_add (char *zfile, int bgrade)
+{
+  static size_t callocated;
+  struct ssfilename *q;
+  size_t ihash, ibucket;
+
+  if (asSwork_files == NULL)
+    callocated = 0;
+  if (cSwork_files >= callocated)
+    {
+      callocated += CWORKFILES + callocated / 2;
+      asSwork_files =
+	((struct ssfilename *)
+	 xrealloc ((pointer) asSwork_files,
+		   callocated * sizeof (struct ssfilename)));
+    }
+
+  q = &asSwork_files[cSwork_files];
+  q->zfile = zfile;
+  q->bgrade = (char) bgrade;
+  q->fdead = FALSE;
+  ++cSwork_files;
+
+  if (cSwork_files * 2 > cSwork_hash)
+    uswork_rehash ();
+  else
+    {
+      ISWORK_HASH (zfile, ihash);
+      ibucket = ihash & (cSwork_hash - 1);
+      q->inext = aiSwork_hash[ibucket];
+      aiSwork_hash[ibucket] = cSwork_files;
+    }
+}
+
+/* Rebuild the hash table, after asSwork_files has grown or been
+   sorted.  */
+
+static void
+uswork_rehash (void)
+{
+  size_t i;
+
+  if (cSwork_files * 2 > cSwork_hash)
+    {
+      if (cSwork_hash == 0)
+	cSwork_hash = 64;
+      while (cSwork_files * 2 > cSwork_hash)
+	cSwork_hash *= 2;
+      xfree ((pointer) aiSwork_hash);
+      aiSwork_hash = (size_t *) xmalloc (cSwork_hash * sizeof (size_t));
+    }
+
+  for (i = 0; i < cSwork_hash; i++)
+    aiSwork_hash[i] = 0;
+
+  for (i = 0; i < cSwork_files; i++)
+    {
+      size_t ihash, ibucket;
+
+      ISWORK_HASH (asSwork_files[i].zfile, ihash);
+      ibucket = ihash & (cSwork_hash - 1);
+      asSwork_files[i].inext = aiSwork_hash[ibucket];
+      aiSwork_hash[ibucket] = i + 1;
+    }
+}
+
+#if USE_WORK_INDEX
+
+/* Store a number in an index record.  */
+
+static void
+uswork_put (char *z, long int i)
+{
+  unsigned long u;
+  int j;
+
+  u = (unsigned long) i;
+  for (j = 7; j >= 0; j--)
+    {
+      z[j] = (char) (u & 0xff);
+      u >>= 8;
+    }
+}
+
+/* Get a number from an index record.  */
+
+static long
+iswork_get (const char *z)
+{
+  unsigned long u;
+  int j;
+
+  u = 0;
+  for (j = 0; j < 8; j++)
+    u = (u << 8) | (unsigned long) (z[j] & 0xff);
+  return (long) u;
+}
+
+/* Turn the status of a work directory into the time we record in
+   the index.  We only ever compare these for equality, so where we
+   have nanoseconds we fold the microseconds into the value.
+   Otherwise, if the directory was changed in the current second it
+   may yet change again without the time changing, so we return -1,
+   which means that the time can't be trusted.  */
+
+static long
+iswork_dir_stamp (const struct stat *q)
+{
+#if HAVE_STRUCT_STAT_ST_MTIM
+  return (long) ((unsigned long) q->st_mtime * 1000000UL
+		 + (unsigned long) q->st_mtim.tv_nsec / 1000UL);
+#else
+  if ((long) q->st_mtime >= (long) time ((time_t *) NULL))
+    return -1;
+  return (long) q->st_mtime;
+#endif
+}
+
+/* Get the system name from the name of a command file, which is
+   always SSSSSS/C./C.gqqqq.  This returns NULL for any other name.  */
+
+static char *
+zswork_system (const char *zfile)
+{
+  const char *zslash;
+  char *zret;
+
+  zslash = strchr (zfile, '/');
+  if (zslash == NULL
+      || zslash == zfile
+      || strncmp (zslash, "/C./C.", sizeof "/C./C." - 1) != 0
+      || strchr (zslash + sizeof "/C./" - 1, '/') != NULL)
+    return NULL;
+  zret = zbufalc ((size_t) (zslash - zfile) + 1);
+  memcpy (zret, zfile, (size_t) (zslash - zfile));
+  zret[zslash - zfile] = '\0';
+  return zret;
+}
+
+/* Open and lock the work index for a system.  If fcreate is FALSE,
+   and the index does not exist, quietly return -1.  */
+
+static int
+oswork_index_open (const char *zsystem, boolean fcreate)
+{
+  char *zindex;
+  int o;
+  struct flock slock;
+
+  zindex = zsysdep_in_dir (ZWORK_INDEX_DIR, zsystem);
+  o = open (zindex, O_RDWR | O_NOCTTY | (fcreate ? O_CREAT : 0),
+	    IPRIVATE_FILE_MODE);
+  if (o < 0 && fcreate && errno == ENOENT)
+    {
+      if (fsysdep_make_dirs (zindex, FALSE))
+	o = open (zindex, O_RDWR | O_NOCTTY | O_CREAT, IPRIVATE_FILE_MODE);
+    }
+  if (o < 0)
+    {
+      if (errno != ENOENT)
+	ulog (LOG_ERROR, "open (%s): %s", zindex, strerror (errno));
+      ubuffree (zindex);
+      return -1;
+    }
+
+  slock.l_type = F_WRLCK;
+  slock.l_whence = SEEK_SET;
+  slock.l_start = 0;
+  slock.l_len = 0;
+  while (fcntl (o, F_SETLKW, &slock) == -1)
+    {
+      /* If locking doesn't work, just do without the index.  */
+      if (errno != EINTR || FGOT_SIGNAL ())
+	{
+	  DEBUG_MESSAGE2 (DEBUG_SPOOLDIR,
+			  "oswork_index_open: Locking %s: %s",
+			  zindex, strerror (errno));
+	  (void) close (o);
+	  ubuffree (zindex);
+	  return -1;
+	}
+    }
+
+  ubuffree (zindex);
+  return o;
+}
+
+/* Read the header of the work index, and check that it is valid.  */
+
+static boolean
+fswork_index_header (int o, char *abhdr)
+{
+  return (lseek (o, (off_t) 0, SEEK_SET) == 0
+	  && read (o, abhdr, CWORK_INDEX_REC) == CWORK_INDEX_REC
+	  && memcmp (abhdr, ZWORK_INDEX_MAGIC,
+		     sizeof ZWORK_INDEX_MAGIC - 1) == 0);
+}
+
+/* Write to the work index at a given position.  */
+
+static boolean
+fswork_index_write (int o, long int ipos, const char *z, size_t c)
+{
+  if (lseek (o, (off_t) ipos, SEEK_SET) != (off_t) ipos
+      || write (o, z, c) != (int) c)
+    {
+      ulog (LOG_ERROR, "Writing work index: %s", strerror (errno));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Rebuild the work index from the work directory.  The caller has
+   stated the directory and passes in the modification time, and a new
+   generation number.  If this fails the header is left invalid.  */
+
+static boolean
+fswork_index_rebuild (int o, const char *zsystem, const char *zdir, long int imtime, long int igen)
+{
+  char abhdr[CWORK_INDEX_REC];
+  char *zbuf;
+  size_t cbuf;
+  long ipos, cfiles;
+  DIR *qdir;
+  struct dirent *qentry;
+
+  memset (abhdr, 0, sizeof abhdr);
+  if (! fswork_index_write (o, (long) 0, abhdr, sizeof abhdr))
+    return FALSE;
+  if (ftruncate (o, (off_t) CWORK_INDEX_REC) < 0)
+    {
+      ulog (LOG_ERROR, "ftruncate: %s", strerror (errno));
+      return FALSE;
+    }
+
+  ipos = CWORK_INDEX_REC;
+  cfiles = 0;
+
+  qdir = opendir ((char *) zdir);
+  if (qdir == NULL && errno != ENOENT)
+    {
+      ulog (LOG_ERROR, "opendir (%s): %s", zdir, strerror (errno));
+      return FALSE;
+    }
+
+  zbuf = zbufalc (CWORK_INDEX_BUFRECS * CWORK_INDEX_REC);
+  cbuf = 0;
+  while (qdir != NULL && (qentry = readdir (qdir)) != NULL)
+    {
+      char bfilegrade;
+      char *zrec;
+
+      if (! fswork_file (zsystem, qentry->d_name, &bfilegrade))
+	continue;
+      if (strlen (qentry->d_name) >= CWORK_INDEX_REC - 2)
+	{
+	  (void) closedir (qdir);
+	  ubuffree (zbuf);
+	  return FALSE;
+	}
+
+      zrec = zbuf + cbuf;
+      memset (zrec, 0, CWORK_INDEX_REC);
+      zrec[0] = '+';
+      zrec[1] = bfilegrade;
+      strcpy (zrec + 2, qentry->d_name);
+      cbuf += CWORK_INDEX_REC;
+      ++cfiles;
+
+      if (cbuf >= CWORK_INDEX_BUFRECS * CWORK_INDEX_REC)
+	{
+	  if (! fswork_index_write (o, ipos, zbuf, cbuf))
+	    {
+	      (void) closedir (qdir);
+	      ubuffree (zbuf);
+	      return FALSE;
+	    }
+	  ipos += cbuf;
+	  cbuf = 0;
+	}
+    }
+  if (qdir != NULL)
+    (void) closedir (qdir);
+
+  if (cbuf > 0 && ! fswork_index_write (o, ipos, zbuf, cbuf))
+    {
+      ubuffree (zbuf);
+      return FALSE;
+    }
+  ubuffree (zbuf);
+
+  memcpy (abhdr, ZWORK_INDEX_MAGIC, sizeof ZWORK_INDEX_MAGIC - 1);
+  uswork_put (abhdr + IWORK_INDEX_MTIME, imtime);
+  uswork_put (abhdr + IWORK_INDEX_BUILT, (long) time ((time_t *) NULL));
+  uswork_put (abhdr + IWORK_INDEX_GEN, igen);
+  uswork_put (abhdr + IWORK_INDEX_DEAD, (long) 0);
+  if (! fswork_index_write (o, (long) 0, abhdr, sizeof abhdr))
+    return FALSE;
+
+  DEBUG_MESSAGE2 (DEBUG_SPOOLDIR,
+		  "fswork_index_rebuild: Rebuilt index for %s with %ld files",
+		  zsystem, cfiles);
+
+  return TRUE;
+}
+
+/* Read new records from the work index, rebuilding it first if
+   necessary.  This returns FALSE if the index can not be used, in
+   which case the caller should scan the work directory.  */
+
+static boolean
+fswork_index_load (const struct uuconf_system *qsys, const char *zdir, int bgrade, unsigned int cmax)
+{
+  int o;
+  struct stat s;
+  long imtime, inow, igen, ioff;
+  char abhdr[CWORK_INDEX_REC];
+  size_t chad;
+  char *zbuf;
+  boolean fret;
+
+  o = oswork_index_open (qsys->uuconf_zname, TRUE);
+  if (o < 0)
+    return FALSE;
+
+  if (stat ((char *) zdir, &s) == 0)
+    imtime = iswork_dir_stamp (&s);
+  else if (errno == ENOENT)
+    imtime = 0;
+  else
+    {
+      ulog (LOG_ERROR, "stat (%s): %s", zdir, strerror (errno));
+      (void) close (o);
+      return FALSE;
+    }
+
+  inow = (long) time ((time_t *) NULL);
+  if (! fswork_index_header (o, abhdr)
+      || imtime == -1
+      || iswork_get (abhdr + IWORK_INDEX_MTIME) != imtime
+      || inow - iswork_get (abhdr + IWORK_INDEX_BUILT) > CWORK_INDEX_AGE
+      || inow < iswork_get (abhdr + IWORK_INDEX_BUILT)
+      || iswork_get (abhdr + IWORK_INDEX_DEAD) > CWORK_INDEX_DEAD)
+    {
+      igen = iswork_get (abhdr + IWORK_INDEX_GEN);
+      if (igen < iSwork_index_gen)
+	igen = iSwork_index_gen;
+      ++igen;
+      if (! fswork_index_rebuild (o, qsys->uuconf_zname, zdir, imtime,
+				  igen))
+	{
+	  (void) close (o);
+	  return FALSE;
+	}
+    }
+  else
+    igen = iswork_get (abhdr + IWORK_INDEX_GEN);
+
+  /* If the index was rebuilt, or we skipped files of a grade we now
+     want, start again from the beginning; the hash table will weed
+     out the files we already know about.  */
+  if (igen != iSwork_index_gen || bgrade != bSwork_index_grade)
+    ioff = CWORK_INDEX_REC;
+  else
+    ioff = iSwork_index_off;
+
+  chad = cSwork_files;
+  fret = TRUE;
+  zbuf = zbufalc (CWORK_INDEX_BUFRECS * CWORK_INDEX_REC);
+  while (TRUE)
+    {
+      int cread;
+      const char *zrec;
+
+      if (cmax != 0 && cSwork_files - chad > cmax)
+	break;
+
+      if (lseek (o, (off_t) ioff, SEEK_SET) != (off_t) ioff)
+	{
+	  fret = FALSE;
+	  break;
+	}
+      cread = read (o, zbuf, CWORK_INDEX_BUFRECS * CWORK_INDEX_REC);
+      if (cread < 0)
+	{
+	  ulog (LOG_ERROR, "Reading work index: %s", strerror (errno));
+	  fret = FALSE;
+	  break;
+	}
+      /* Stop at the end, or at a partial record.  */
+      if (cread < CWORK_INDEX_REC)
+	break;
+
+      for (zrec = zbuf;
+	   zrec + CWORK_INDEX_REC <= zbuf + cread;
+	   zrec += CWORK_INDEX_REC)
+	{
+	  const char *zname;
+
+	  if (cmax != 0 && cSwork_files - chad > cmax)
+	    break;
+
+	  zname = zrec + 2;
+	  if ((zrec[0] != '+' && zrec[0] != '-')
+	      || zrec[CWORK_INDEX_REC - 1] != '\0'
+	      || *zname == '\0')
+	    {
+	      ulog (LOG_ERROR, "Bad record in work index for %s",
+		    qsys->uuconf_zname);
+	      fret = FALSE;
+	      break;
+	    }
+
+	  if (zrec[0] == '+')
+	    {
+	      if (UUCONF_GRADE_CMP (bgrade, zrec[1]) >= 0
+		  && qswork_lookup (zname) == NULL)
+		{
+		  DEBUG_MESSAGE1 (DEBUG_SPOOLDIR,
+				  "fsysdep_get_work_init: Found %s", zname);
+		  uswork_add (zbufcpy (zname), zrec[1]);
+		}
+	    }
+	  else
+	    {
+	      struct ssfilename *q;
+
+	      /* A file we have not yet returned may have been
+		 removed since it was added.  */
+	      q = qswork_lookup (zname);
+	      if (q != NULL && (size_t) (q - asSwork_files) >= iSwork_file)
+		q->fdead = TRUE;
+	    }
+
+	  ioff += CWORK_INDEX_REC;
+	}
+
+      if (! fret)
+	break;
+    }
+  ubuffree (zbuf);
+
+  if (! fret)
+    {
+      /* Make sure the index is rebuilt next time.  */
+      memset (abhdr, 0, sizeof abhdr);
+      (void) fswork_index_write (o, (long) 0, abhdr, sizeof abhdr);
+      iSwork_index_gen = -1;
+    }
+  else
+    {
+      iSwork_index_gen = igen;
+      iSwork_index_off = ioff;
+      bSwork_index_grade = bgrade;
+      fSwork_index = TRUE;
+    }
+
+  (void) close (o);
+  return fret;
+}
+
+#endif /* USE_WORK_INDEX */
+
+/* Get the modification time of the directory holding a command file,
+   to pass to uswork_index_note after adding or removing the file.
+   This returns -1 if it is not known, or can not be trusted.  */
+
+/*ARGSUSED*/
+long
+iswork_index_stamp (const char *zfile ATTRIBUTE_UNUSED)
+{
+#if USE_WORK_INDEX
+  const char *zslash;
+  char *zdir;
+  struct stat s;
+  long iret;
+
+  zslash = strrchr (zfile, '/');
+  if (zslash == NULL)
+    return -1;
+  zdir = zbufalc ((size_t) (zslash - zfile) + 1);
+  memcpy (zdir, zfile, (size_t) (zslash - zfile));
+  zdir[zslash - zfile] = '\0';
+  if (stat (zdir, &s) == 0)
+    iret = iswork_dir_stamp (&s);
+  else
+    iret = -1;
+  ubuffree (zdir);
+  return iret;
+#else
+  return -1;
+#endif
+}
+
+/* Record in the work index that a command file has been added or
+   removed.  The istamp argument is the value iswork_index_stamp
+   returned before the file was added or removed.  If anything goes
+   wrong, the index will simply be rebuilt the next time it is
+   read.  */
+
+/*ARGSUSED*/
+void
+uswork_index_note (const char *zfile ATTRIBUTE_UNUSED, long int istamp ATTRIBUTE_UNUSED, boolean fadd ATTRIBUTE_UNUSED)
+{
+#if USE_WORK_INDEX
+  char *zsystem;
+  const char *zbase;
+  int o;
+  char abhdr[CWORK_INDEX_REC];
+  char abrec[CWORK_INDEX_REC];
+  off_t iend;
+
+  zsystem = zswork_system (zfile);
+  if (zsystem == NULL)
+    return;
+
+  o = oswork_index_open (zsystem, FALSE);
+  if (o < 0)
+    {
+      ubuffree (zsystem);
+      return;
+    }
+
+  if (! fswork_index_header (o, abhdr))
+    {
+      (void) close (o);
+      ubuffree (zsystem);
+      return;
+    }
+
+  zbase = strrchr (zfile, '/') + 1;
+  iend = lseek (o, (off_t) 0, SEEK_END);
+  if (strlen (zbase) >= CWORK_INDEX_REC - 2
+      || iend < CWORK_INDEX_REC
+      || iend % CWORK_INDEX_REC != 0)
+    {
+      /* We can't record this, so make sure the index is rebuilt.  */
+      memset (abhdr, 0, sizeof abhdr);
+      (void) fswork_index_write (o, (long) 0, abhdr, sizeof abhdr);
+      (void) close (o);
+      ubuffree (zsystem);
+      return;
+    }
+
+  memset (abrec, 0, sizeof abrec);
+  abrec[0] = fadd ? '+' : '-';
+  abrec[1] = zbase[2];
+  strcpy (abrec + 2, zbase);
+  if (! fswork_index_write (o, (long) iend, abrec, sizeof abrec))
+    memset (abhdr, 0, sizeof abhdr);
+  else
+    {
+      if (! fadd)
+	uswork_put (abhdr + IWORK_INDEX_DEAD,
+		    iswork_get (abhdr + IWORK_INDEX_DEAD) + 1);
+
+      /* If the index was up to date before this change, it is up to
+	 date after it.  */
+      if (istamp != -1 && istamp == iswork_get (abhdr + IWORK_INDEX_MTIME))
+	uswork_put (abhdr + IWORK_INDEX_MTIME,
+		    iswork_index_stamp (zfile));
+    }
+  (void) fswork_index_write (o, (long) 0, abhdr, sizeof abhdr);
+
+  (void) close (o);
+  ubuffree (zsystem);
+#endif /* USE_WORK_INDEX */
+}
+
+/* Throw away the work index for a system, so that it is rebuilt from
+   the work directory the next time it is read.  This is for a
+   program which rearranges the work directory wholesale.  */
+
+/*ARGSUSED*/
+void
+uswork_index_discard (const char *zsystem ATTRIBUTE_UNUSED)
+{
+#if USE_WORK_INDEX
+  char *zindex;
+
+  zindex = zsysdep_in_dir (ZWORK_INDEX_DIR, zsystem);
+  if (remove (zindex) != 0 && errno != ENOENT)
+    ulog (LOG_ERROR, "remove (%s): %s", zindex, strerror (errno));
+  ubuffree (zindex);
+#endif /* USE_WORK_INDEX */
 }
 
 /* See whether there is any work to do for a particular system.  */
@@ -202,7 +1025,7 @@ fsysdep_has_work (const struct uuconf_system *qsys)
   char *zdir;
   DIR *qdir;
   struct dirent *qentry;
-#if SPOOLDIR_SVR4
+#if WORK_SUBDIRS
   DIR *qgdir;
   struct dirent *qgentry;
 #endif
@@ -217,14 +1040,13 @@ fsysdep_has_work (const struct uuconf_system *qsys)
       return FALSE;
     }
 
-#if SPOOLDIR_SVR4
+#if WORK_SUBDIRS
   qgdir = qdir;
   while ((qgentry = readdir (qgdir)) != NULL)
     {
       char *zsub;
 
-      if (qgentry->d_name[0] == '.'
-	  || qgentry->d_name[1] != '\0')
+      if (! FWORK_SUBDIR (qgentry->d_name))
 	continue;
       zsub = zsysdep_in_dir (zdir, qgentry->d_name);
       qdir = opendir (zsub);
@@ -240,7 +1062,7 @@ fsysdep_has_work (const struct uuconf_system *qsys)
 	  if (fswork_file (qsys->uuconf_zname, qentry->d_name, &bgrade))
 	    {
 	      closedir (qdir);
-#if SPOOLDIR_SVR4
+#if WORK_SUBDIRS
 	      closedir (qgdir);
 #endif
 	      ubuffree (zdir);
@@ -248,7 +1070,7 @@ fsysdep_has_work (const struct uuconf_system *qsys)
 	    }
 	}
 
-#if SPOOLDIR_SVR4
+#if WORK_SUBDIRS
       closedir (qdir);
     }
   qdir = qgdir;
@@ -266,8 +1088,6 @@ fsysdep_has_work (const struct uuconf_system *qsys)
    clear the data out when we are done with the system.  This returns
    FALSE on error.  */
 
-#define CWORKFILES (10)
-
 boolean
 fsysdep_get_work_init (const struct uuconf_system *qsys, int bgrade, unsigned int cmax)
 {
@@ -275,8 +1095,7 @@ fsysdep_get_work_init (const struct uuconf_system *qsys, int bgrade, unsigned in
   DIR *qdir;
   struct dirent *qentry;
   size_t chad;
-  size_t callocated;
-#if SPOOLDIR_SVR4
+#if WORK_SUBDIRS
   DIR *qgdir;
   struct dirent *qgentry;
 #endif
@@ -285,6 +1104,17 @@ fsysdep_get_work_init (const struct uuconf_system *qsys, int bgrade, unsigned in
   if (zdir == NULL)
     return FALSE;
 
+#if USE_WORK_INDEX
+  if (fswork_index_load (qsys, zdir, bgrade, cmax))
+    {
+      ubuffree (zdir);
+      uswork_sort_new ();
+      return TRUE;
+    }
+#endif
+
+  fSwork_index = FALSE;
+
   qdir = opendir (zdir);
   if (qdir == NULL)
     {
@@ -302,29 +1132,19 @@ fsysdep_get_work_init (const struct uuconf_system *qsys, int bgrade, unsigned in
     }
 
   chad = cSwork_files;
-  callocated = cSwork_files;
-
-  /* Sort the files we already know about so that we can check the new
-     ones with bsearch.  It would be faster to use a hash table, and
-     the code should be probably be changed.  The sort done at the end
-     of this function does not suffice because it only includes the
-     files added last time, and does not sort the entire array.  Some
-     (bad) qsort implementations are very slow when given a sorted
-     array, which causes particularly bad effects here.  */
-  if (chad > 0)
-    qsort ((pointer) asSwork_files, chad, sizeof (struct ssfilename),
-	   iswork_cmp);
 
-#if SPOOLDIR_SVR4
+#if WORK_SUBDIRS
   qgdir = qdir;
   while ((qgentry = readdir (qgdir)) != NULL)
     {
       char *zsub;
 
-      if (qgentry->d_name[0] == '.'
-	  || qgentry->d_name[1] != '\0'
-	  || UUCONF_GRADE_CMP (bgrade, qgentry->d_name[0]) < 0)
+      if (! FWORK_SUBDIR (qgentry->d_name))
+	continue;
+#if SPOOLDIR_SVR4
+      if (UUCONF_GRADE_CMP (bgrade, qgentry->d_name[0]) < 0)
 	continue;
+#endif
       zsub = zsysdep_in_dir (zdir, qgentry->d_name);
       qdir = opendir (zsub);
       if (qdir == NULL)
@@ -334,6 +1154,8 @@ fsysdep_get_work_init (const struct uuconf_system *qsys, int bgrade, unsigned in
 	      ulog (LOG_ERROR, "opendir (%s): %s", zsub,
 		    strerror (errno));
 	      ubuffree (zsub);
+	      closedir (qgdir);
+	      ubuffree (zdir);
 	      return FALSE;
 	    }
 	  ubuffree (zsub);
@@ -346,24 +1168,20 @@ fsysdep_get_work_init (const struct uuconf_system *qsys, int bgrade, unsigned in
 	{
 	  char bfilegrade;
 	  char *zname;
-	  struct ssfilename slook;
 
-#if ! SPOOLDIR_SVR4
+#if ! WORK_SUBDIRS
 	  zname = zbufcpy (qentry->d_name);
 #else
 	  zname = zsysdep_in_dir (qgentry->d_name, qentry->d_name);
+#if SPOOLDIR_SVR4
 	  bfilegrade = qgentry->d_name[0];
+#endif
 #endif
 
-	  slook.zfile = zname;
 	  if (! fswork_file (qsys->uuconf_zname, qentry->d_name,
 			     &bfilegrade)
 	      || UUCONF_GRADE_CMP (bgrade, bfilegrade) < 0
-	      || (asSwork_files != NULL
-		  && bsearch ((pointer) &slook,
-			      (pointer) asSwork_files,
-			      chad, sizeof (struct ssfilename),
-			      iswork_cmp) != NULL))
+	      || qswork_lookup (zname) != NULL)
 	    ubuffree (zname);
 	  else
 	    {
@@ -371,24 +1189,13 @@ fsysdep_get_work_init (const struct uuconf_system *qsys, int bgrade, unsigned in
 			      "fsysdep_get_work_init: Found %s",
 			      zname);
 
-	      if (cSwork_files >= callocated)
-		{
-		  callocated += CWORKFILES;
-		  asSwork_files =
-		    ((struct ssfilename *)
-		     xrealloc ((pointer) asSwork_files,
-			       (callocated * sizeof (struct ssfilename))));
-		}
-
-	      asSwork_files[cSwork_files].zfile = zname;
-	      asSwork_files[cSwork_files].bgrade = bfilegrade;
-	      ++cSwork_files;
+	      uswork_add (zname, bfilegrade);
 	      if (cmax != 0 && cSwork_files - chad > cmax)
 		break;
 	    }
 	}
 
-#if SPOOLDIR_SVR4
+#if WORK_SUBDIRS
       closedir (qdir);
       if (cmax != 0 && cSwork_files - chad > cmax)
 	break;
@@ -399,16 +1206,27 @@ fsysdep_get_work_init (const struct uuconf_system *qsys, int bgrade, unsigned in
   closedir (qdir);
   ubuffree (zdir);
 
-  /* Sorting the files alphabetically will get the grades in the
-     right order, since all the file prefixes are the same.  */
-  if (cSwork_files > iSwork_file)
-    qsort ((pointer) (asSwork_files + iSwork_file),
-	   cSwork_files - iSwork_file,
-	   sizeof (struct ssfilename), iswork_cmp);
+  uswork_sort_new ();
 
   return TRUE;
 }
 
+/* Sort the files we have not yet looked at.  Sorting the files
+   alphabetically will get the grades in the right order, since all
+   the file prefixes are the same.  */
+
+static void
+uswork_sort_new (void)
+{
+  if (cSwork_files > iSwork_file)
+    {
+      qsort ((pointer) (asSwork_files + iSwork_file),
+	     cSwork_files - iSwork_file,
+	     sizeof (struct ssfilename), iswork_cmp);
+      uswork_rehash ();
+    }
+}
+
 /* Get the next work entry for a system.  This must parse the next
    line in the next work file.  The type of command is set into
    qcmd->bcmd If there are no more commands, qcmd->bcmd is set to 'H'.
@@ -457,6 +1275,13 @@ fsysdep_get_work (const struct uuconf_system *qsys, int bgrade ATTRIBUTE_UNUSED,
 		  return TRUE;
 		}
 
+	      if (asSwork_files[iSwork_file].fdead)
+		{
+		  ++iSwork_file;
+		  e = NULL;
+		  continue;
+		}
+
 	      if (zdir == NULL)
 		{
 		  zdir = zswork_directory (qsys->uuconf_zname);
@@ -472,8 +1297,13 @@ fsysdep_get_work (const struct uuconf_system *qsys, int bgrade ATTRIBUTE_UNUSED,
 	      e = fopen (zname, "r");
 	      if (e == NULL)
 		{
-		  ulog (LOG_ERROR, "fopen (%s): %s", zname,
-			strerror (errno));
+		  if (errno == ENOENT && fSwork_index)
+		    DEBUG_MESSAGE1 (DEBUG_SPOOLDIR,
+				    "fsysdep_get_work: %s has gone away",
+				    zname);
+		  else
+		    ulog (LOG_ERROR, "fopen (%s): %s", zname,
+			  strerror (errno));
 		  ubuffree (zname);
 		}
 	    }
@@ -599,6 +1429,7 @@ fsysdep_did_work (pointer pseq)
   struct ssfile *qfile;
   struct ssline *qline;
   int i;
+  long istamp;
   
   qline = (struct ssline *) pseq;
 
@@ -614,7 +1445,7 @@ fsysdep_did_work (pointer pseq)
      called without complaining.  */
   if (qline->ztemp != NULL)
     {
-      (void) remove (qline->ztemp);
+      (void) isysdep_spool_remove (qline->ztemp);
       ubuffree (qline->ztemp);
       qline->ztemp = NULL;
     }
@@ -630,12 +1461,14 @@ fsysdep_did_work (pointer pseq)
       return TRUE;
 
   /* All commands have finished.  */
+  istamp = iswork_index_stamp (qfile->zfile);
   if (remove (qfile->zfile) != 0)
     {
       ulog (LOG_ERROR, "remove (%s): %s", qfile->zfile,
 	    strerror (errno));
       return FALSE;
     }
+  uswork_index_note (qfile->zfile, istamp, FALSE);
 
   ubuffree (qfile->zfile);
   xfree ((pointer) qfile);
@@ -664,6 +1497,13 @@ usysdep_get_work_free (const struct uuconf_system *qsys ATTRIBUTE_UNUSED)
       cSwork_files = 0;
       iSwork_file = 0;
     }
+  xfree ((pointer) aiSwork_hash);
+  aiSwork_hash = NULL;
+  cSwork_hash = 0;
+  fSwork_index = FALSE;
+#if USE_WORK_INDEX
+  iSwork_index_gen = -1;
+#endif
   if (qSwork_file != NULL)
     {
       int i;
@@ -681,6 +1521,141 @@ usysdep_get_work_free (const struct uuconf_system *qsys ATTRIBUTE_UNUSED)
     }
 }
 
+/* Start watching the work directory of a system for new command
+   files.  If the directory does not exist yet, we just don't watch
+   it; the caller will check the queue periodically anyhow.  */
+
+/*ARGSUSED*/
+boolean
+fsysdep_watch_work (const struct uuconf_system *qsys ATTRIBUTE_UNUSED)
+{
+#if USE_INOTIFY
+  char *zdir;
+  int iflags;
+
+  usysdep_watch_work_free ();
+
+  zdir = zswork_directory (qsys->uuconf_zname);
+  if (zdir == NULL)
+    return FALSE;
+
+  oSwork_watch = inotify_init ();
+  if (oSwork_watch < 0)
+    {
+      DEBUG_MESSAGE1 (DEBUG_SPOOLDIR, "fsysdep_watch_work: inotify_init: %s",
+		      strerror (errno));
+      ubuffree (zdir);
+      return FALSE;
+    }
+
+  /* Don't pass the descriptor to uuxqt or any other child.  */
+  iflags = fcntl (oSwork_watch, F_GETFL, 0);
+  if (iflags < 0
+      || fcntl (oSwork_watch, F_SETFL, iflags | O_NONBLOCK) < 0
+      || fcntl (oSwork_watch, F_SETFD,
+		fcntl (oSwork_watch, F_GETFD, 0) | FD_CLOEXEC) < 0
+      || inotify_add_watch (oSwork_watch, zdir,
+			    IN_CREATE | IN_MOVED_TO | IN_ONLYDIR) < 0)
+    {
+      DEBUG_MESSAGE2 (DEBUG_SPOOLDIR, "fsysdep_watch_work: %s: %s",
+		      zdir, strerror (errno));
+      (void) close (oSwork_watch);
+      oSwork_watch = -1;
+      ubuffree (zdir);
+      return FALSE;
+    }
+
+  DEBUG_MESSAGE1 (DEBUG_SPOOLDIR, "fsysdep_watch_work: Watching %s", zdir);
+
+  ubuffree (zdir);
+  zSwork_watch_system = zbufcpy (qsys->uuconf_zname);
+  return TRUE;
+#else /* ! USE_INOTIFY */
+  return FALSE;
+#endif /* ! USE_INOTIFY */
+}
+
+/* Report whether a command file has appeared in the work directory
+   since the last call.  We read all the pending events, so that each
+   new file is only reported once.  */
+
+boolean
+fsysdep_new_work (void)
+{
+#if USE_INOTIFY
+  union
+    {
+      struct inotify_event s;
+      char ab[4096];
+    } u;
+  boolean fnew;
+
+  if (oSwork_watch < 0)
+    return FALSE;
+
+  fnew = FALSE;
+  while (TRUE)
+    {
+      int cread;
+      const char *z;
+
+      cread = read (oSwork_watch, u.ab, sizeof u.ab);
+      if (cread <= 0)
+	{
+	  if (cread < 0 && errno == EINTR)
+	    continue;
+	  break;
+	}
+
+      for (z = u.ab; z < u.ab + cread; )
+	{
+	  const struct inotify_event *qevent;
+	  char bgrade;
+
+	  qevent = (const struct inotify_event *) z;
+	  if ((qevent->mask & IN_Q_OVERFLOW) != 0)
+	    fnew = TRUE;
+	  else if ((qevent->mask & IN_IGNORED) != 0)
+	    {
+	      /* The directory is gone; go back to checking
+		 periodically.  */
+	      usysdep_watch_work_free ();
+	      return TRUE;
+	    }
+	  else if (qevent->len > 0
+		   && fswork_file (zSwork_watch_system, qevent->name,
+				   &bgrade))
+	    {
+	      DEBUG_MESSAGE1 (DEBUG_SPOOLDIR,
+			      "fsysdep_new_work: %s created", qevent->name);
+	      fnew = TRUE;
+	    }
+	  z += sizeof (struct inotify_event) + qevent->len;
+	}
+    }
+
+  return fnew;
+#else /* ! USE_INOTIFY */
+  return FALSE;
+#endif /* ! USE_INOTIFY */
+}
+
+/* Stop watching the work directory.  */
+
+void
+usysdep_watch_work_free (void)
+{
+#if USE_INOTIFY
+  if (oSwork_watch >= 0)
+    {
+      (void) close (oSwork_watch);
+      oSwork_watch = -1;
+    }
+  ubuffree (zSwork_watch_system);
+  zSwork_watch_system = NULL;
+#endif
+}
+
 /* Save the temporary file used by a send command, and return an
    informative message to mail to the requestor.  This is called when
    a file transfer failed, to make sure that the potentially valuable
@@ -227,6 +227,11 @@ main (int argc, char **argv)
 	ukuuconf_error (puuconf, iret);
       printf ("Statistics file %s\n", zstr);
 
+      iret = uuconf_protstatsfile (puuconf, &zstr);
+      if (iret != UUCONF_SUCCESS)
+	ukuuconf_error (puuconf, iret);
+      printf ("Protocol statistics file %s\n", zstr);
+
       iret = uuconf_debugfile (puuconf, &zstr);
       if (iret != UUCONF_SUCCESS)
 	ukuuconf_error (puuconf, iret);
@@ -68,36 +68,36 @@ extern char *crypt ();
 
 static const struct sprotocol asProtocols[] =
 {
-  { 't', TCP_PROTO, 1, TRUE,
+  { 't', TCP_PROTO, 1, TRUE, TRUE,
       asTproto_params, ftstart, ftshutdown, ftsendcmd, ztgetspace,
-      ftsenddata, ftwait, ftfile },
-  { 'e', TCP_PROTO, 1, TRUE,
+      ftsenddata, ftwait, ftfile, NULL },
+  { 'e', TCP_PROTO, 1, TRUE, FALSE,
       asEproto_params, festart, feshutdown, fesendcmd, zegetspace,
-      fesenddata, fewait, fefile },
-  { 'i', UUCONF_RELIABLE_EIGHT, 7, TRUE,
+      fesenddata, fewait, fefile, fesendfile },
+  { 'i', UUCONF_RELIABLE_EIGHT, 7, TRUE, TRUE,
       asIproto_params, fistart, fishutdown, fisendcmd, zigetspace,
-      fisenddata, fiwait, NULL },
-  { 'a', UUCONF_RELIABLE_EIGHT, 1, TRUE,
+      fisenddata, fiwait, NULL, NULL },
+  { 'a', UUCONF_RELIABLE_EIGHT, 1, TRUE, FALSE,
       asZproto_params, fzstart, fzshutdown, fzsendcmd, zzgetspace,
-      fzsenddata, fzwait, fzfile },
-  { 'g', UUCONF_RELIABLE_EIGHT, 1, TRUE,
+      fzsenddata, fzwait, fzfile, NULL },
+  { 'g', UUCONF_RELIABLE_EIGHT, 1, TRUE, TRUE,
       asGproto_params, fgstart, fgshutdown, fgsendcmd, zggetspace,
-      fgsenddata, fgwait, NULL },
-  { 'G', UUCONF_RELIABLE_EIGHT, 1, TRUE,
+      fgsenddata, fgwait, NULL, NULL },
+  { 'G', UUCONF_RELIABLE_EIGHT, 1, TRUE, TRUE,
       asGproto_params, fbiggstart, fgshutdown, fgsendcmd, zggetspace,
-      fgsenddata, fgwait, NULL },
-  { 'j', UUCONF_RELIABLE_EIGHT, 7, TRUE,
+      fgsenddata, fgwait, NULL, NULL },
+  { 'j', UUCONF_RELIABLE_EIGHT, 7, TRUE, TRUE,
       asIproto_params, fjstart, fjshutdown, fisendcmd, zigetspace,
-      fisenddata, fiwait, NULL },
-  { 'f', UUCONF_RELIABLE_RELIABLE, 1, FALSE,
+      fisenddata, fiwait, NULL, NULL },
+  { 'f', UUCONF_RELIABLE_RELIABLE, 1, FALSE, FALSE,
       asFproto_params, ffstart, ffshutdown, ffsendcmd, zfgetspace,
-      ffsenddata, ffwait, fffile },
-  { 'v', UUCONF_RELIABLE_EIGHT, 1, TRUE,
+      ffsenddata, ffwait, fffile, NULL },
+  { 'v', UUCONF_RELIABLE_EIGHT, 1, TRUE, TRUE,
       asGproto_params, fvstart, fgshutdown, fgsendcmd, zggetspace,
-      fgsenddata, fgwait, NULL },
-  { 'y', UUCONF_RELIABLE_RELIABLE | UUCONF_RELIABLE_EIGHT, 1, TRUE,
+      fgsenddata, fgwait, NULL, NULL },
+  { 'y', UUCONF_RELIABLE_RELIABLE | UUCONF_RELIABLE_EIGHT, 1, TRUE, TRUE,
       asYproto_params, fystart, fyshutdown, fysendcmd, zygetspace,
-      fysenddata, fywait, fyfile }
+      fysenddata, fywait, fyfile, NULL }
 };
 
 #define CPROTOCOLS (sizeof asProtocols / sizeof asProtocols[0])
@@ -117,6 +117,13 @@ static struct sconnection *qConn;
    error.  */
 static pointer pUuconf;
 
+/* --trace file: record the data passed over the connection.  */
+static const char *zTrace_file;
+
+/* --replay file: replay a recorded conversation instead of using a
+   port.  */
+static const char *zReplay_file;
+
 /* This structure is passed to iuport_lock via uuconf_find_port.  */
 struct spass
 {
@@ -160,6 +167,8 @@ static void uaccept_call_cleanup P((pointer puuconf,
 static void uapply_proto_params P((pointer puuconf, int bproto,
 				   struct uuconf_cmdtab *qcmds,
 				   struct uuconf_proto_param *pas));
+static boolean fspipeline P((const struct sdaemon *qdaemon));
+static void ulog_queue_wait P((const struct sdaemon *qdaemon));
 static boolean fsend_uucp_cmd P((struct sconnection *qconn,
 				 const char *z));
 static char *zget_uucp_cmd P((struct sconnection *qconn,
@@ -185,6 +194,8 @@ static const struct option asLongopts[] =
   { "login", required_argument, NULL, 'u' },
   { "wait", no_argument, NULL, 'w' },
   { "try-next", no_argument, NULL, 'z' },
+  { "trace", required_argument, NULL, 5 },
+  { "replay", required_argument, NULL, 6 },
   { "config", required_argument, NULL, 'I' },
   { "debug", required_argument, NULL, 'x' },
   { "version", no_argument, NULL, 'v' },
@@ -404,6 +415,32 @@ main (int argc, char **argv)
 	  fmaster = TRUE;
 	  break;
 
+	case 5:
+	  /* --trace.  A trace holds everything sent over the
+	     connection, and the file belongs to the invoking user, so
+	     only a privileged user may make one.  */
+	  if (fsysdep_privileged ())
+	    zTrace_file = optarg;
+	  else
+	    fprintf (stderr,
+		     "%s: ignoring --trace: not a privileged user\n",
+		     zProgram);
+	  break;
+
+	case 6:
+	  /* --replay.  Replaying lets the caller act as any remote
+	     system, so only a privileged user may do it.  */
+	  if (fsysdep_privileged ())
+	    zReplay_file = optarg;
+	  else
+	    {
+	      fprintf (stderr,
+		       "%s: --replay may only be used by a privileged user\n",
+		       zProgram);
+	      exit (EXIT_FAILURE);
+	    }
+	  break;
+
 	case 1:
 	  /* --help.  */
 	  uhelp ();
@@ -429,6 +466,16 @@ main (int argc, char **argv)
       uusage ();
     }
 
+  if (zReplay_file != NULL
+      && (zport != NULL || fendless || flogin || fwait
+	  || (fmaster && zsystem == NULL)))
+    {
+      fprintf (stderr,
+	       "%s: --replay requires -s or a single incoming call\n",
+	       zProgram);
+      uusage ();
+    }
+
   iuuconf = uuconf_init (&puuconf, (const char *) NULL, zconfig);
   if (iuuconf != UUCONF_SUCCESS)
     ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
@@ -483,6 +530,10 @@ main (int argc, char **argv)
   ulog_to_file (puuconf, TRUE);
   ulog_fatal_fn (uabort);
 
+  /* Use a mirrored receive buffer, if possible, so that the protocols
+     never see a packet split around the end of it.  */
+  uprecbuf_mirror ();
+
   if (fmaster)
     {
       if (zsystem != NULL)
@@ -656,7 +707,15 @@ main (int argc, char **argv)
       fret = TRUE;
       zsystem = NULL;
 
-      if (! fconn_init (qport, &sconn, tstdintype))
+      if (zReplay_file != NULL)
+	{
+	  if (! fconn_replay_init (&sconn, zReplay_file, FALSE))
+	    {
+	      ulog_close ();
+	      usysdep_exit (FALSE);
+	    }
+	}
+      else if (! fconn_init (qport, &sconn, tstdintype))
 	fret = FALSE;
 
       if (qport != NULL)
@@ -808,6 +867,8 @@ uhelp (void)
   printf (" -u,--login: Set login name (privileged users only)\n");
   printf (" -i,--stdin type: Type of standard input (only TLI supported)\n");
   printf (" -z,--try-next: If a call fails, try the next alternate\n");
+  printf (" --trace file: Record the data sent and received in file\n");
+  printf (" --replay file: Replay a conversation recorded by --trace\n");
   printf (" -x,-X,--debug debug: Set debugging level\n");
 #if HAVE_TAYLOR_CONFIG
   printf (" -I,--config file: Set configuration file to use\n");
@@ -986,6 +1047,9 @@ fcall (puuconf, zconfig, fuuxqt, qorigsys, qport, fifwork, fforce, fdetach,
       sDaemon.cmax_receive = -1;
       sDaemon.csent = 0;
       sDaemon.creceived = 0;
+      sDaemon.cwaits = 0;
+      sDaemon.cwait_total = 0;
+      sDaemon.cwait_max = 0;
       sDaemon.cxfiles_received = 0;
       sDaemon.ifeatures = 0;
       sDaemon.frequest_hangup = FALSE;
@@ -994,6 +1058,8 @@ fcall (puuconf, zconfig, fuuxqt, qorigsys, qport, fifwork, fforce, fdetach,
       sDaemon.fmaster = TRUE;
       sDaemon.fcaller = TRUE;
       sDaemon.ireliable = 0;
+      sDaemon.fpipeline = FALSE;
+      sDaemon.cstreams = 0;
       sDaemon.bgrade = '\0';
 
       /* Queue up any work there is to do.  */
@@ -1088,6 +1154,21 @@ fconn_call (struct sdaemon *qdaemon, struct uuconf_port *qport, struct sstatus *
 
   *pfcalled = FALSE;
 
+  /* When replaying a trace there is no port to find or dial.  */
+  if (zReplay_file != NULL)
+    {
+      if (! fconn_replay_init (&sconn, zReplay_file, TRUE))
+	return FALSE;
+      qdaemon->qconn = &sconn;
+      fret = (fconn_open (&sconn, (long) 0, (long) 0, FALSE, FALSE)
+	      && fdo_call (qdaemon, qstat, (const struct uuconf_dialer *) NULL,
+			   pfcalled, &terr));
+      (void) fconn_close (&sconn, puuconf, (struct uuconf_dialer *) NULL,
+			  fret);
+      uconn_free (&sconn);
+      return fret;
+    }
+
   /* Ignore any SIGHUP signal we may have received up to this point.
      This is needed on Unix because we may have gotten one from the
      shell before we detached from the controlling terminal.  */
@@ -1263,12 +1344,19 @@ fdo_call (struct sdaemon *qdaemon, struct sstatus *qstat, const struct uuconf_di
     zport = "unknown";
   else
     zport = qconn->qport->uuconf_zname;
-  if (! fchat (qconn, puuconf, &qsys->uuconf_schat, qsys,
-	       (const struct uuconf_dialer *) NULL,
-	       (const char *) NULL, FALSE, zport,
-	       iconn_baud (qconn)))
+
+  /* A trace does not include the chat script, since the chat script
+     may send a password, so a replay starts after it.  */
+  if (zReplay_file == NULL
+      && ! fchat (qconn, puuconf, &qsys->uuconf_schat, qsys,
+		  (const struct uuconf_dialer *) NULL,
+		  (const char *) NULL, FALSE, zport,
+		  iconn_baud (qconn)))
     return FALSE;
 
+  if (zTrace_file != NULL && zReplay_file == NULL)
+    (void) fconn_trace_start (qconn, zTrace_file, TRUE);
+
   *pfcalled = TRUE;
   istart_time = ixsysdep_time ((long *) NULL);
 
@@ -1392,7 +1480,13 @@ fdo_call (struct sdaemon *qdaemon, struct sstatus *qstat, const struct uuconf_di
 				   | FEATURE_EXEC
 				   | FEATURE_RESTART
 				   | FEATURE_QUOTES
-				   | FEATURE_ICOMPL));
+				   | FEATURE_ICOMPL
+				   | FEATURE_IWIDE
+				   | FEATURE_GSRJ
+				   | FEATURE_PIPELINE
+				   | FEATURE_LOCAL_COMPRESS
+				   | FEATURE_LOCAL_STREAMS
+				   | FEATURE_DELTA));
 	else
 	  sprintf (zsend, "S%s -p%c -vgrade=%c -R -N0%o",
 		   qdaemon->zlocalname, bgrade, bgrade,
@@ -1400,7 +1494,13 @@ fdo_call (struct sdaemon *qdaemon, struct sstatus *qstat, const struct uuconf_di
 				   | FEATURE_EXEC
 				   | FEATURE_RESTART
 				   | FEATURE_QUOTES
-				   | FEATURE_ICOMPL));
+				   | FEATURE_ICOMPL
+				   | FEATURE_IWIDE
+				   | FEATURE_GSRJ
+				   | FEATURE_PIPELINE
+				   | FEATURE_LOCAL_COMPRESS
+				   | FEATURE_LOCAL_STREAMS
+				   | FEATURE_DELTA));
       }
     else
       {
@@ -1415,7 +1515,13 @@ fdo_call (struct sdaemon *qdaemon, struct sstatus *qstat, const struct uuconf_di
 				   | FEATURE_EXEC
 				   | FEATURE_RESTART
 				   | FEATURE_QUOTES
-				   | FEATURE_ICOMPL));
+				   | FEATURE_ICOMPL
+				   | FEATURE_IWIDE
+				   | FEATURE_GSRJ
+				   | FEATURE_PIPELINE
+				   | FEATURE_LOCAL_COMPRESS
+				   | FEATURE_LOCAL_STREAMS
+				   | FEATURE_DELTA));
 	else
 	  sprintf (zsend, "S%s -Q%ld -p%c -vgrade=%c -R -N0%o",
 		   qdaemon->zlocalname, iseq, bgrade, bgrade,
@@ -1423,7 +1529,13 @@ fdo_call (struct sdaemon *qdaemon, struct sstatus *qstat, const struct uuconf_di
 				   | FEATURE_EXEC
 				   | FEATURE_RESTART
 				   | FEATURE_QUOTES
-				   | FEATURE_ICOMPL));
+				   | FEATURE_ICOMPL
+				   | FEATURE_IWIDE
+				   | FEATURE_GSRJ
+				   | FEATURE_PIPELINE
+				   | FEATURE_LOCAL_COMPRESS
+				   | FEATURE_LOCAL_STREAMS
+				   | FEATURE_DELTA));
       }
 
     fret = fsend_uucp_cmd (qconn, zsend);
@@ -1606,6 +1718,7 @@ fdo_call (struct sdaemon *qdaemon, struct sstatus *qstat, const struct uuconf_di
       qdaemon->cchans = 1;
     else
       qdaemon->cchans = asProtocols[i].cchans;
+    qdaemon->fpipeline = fspipeline (qdaemon);
 
     sprintf (ab, "U%c", qdaemon->qproto->bname);
     if (! fsend_uucp_cmd (qconn, ab))
@@ -1632,6 +1745,7 @@ fdo_call (struct sdaemon *qdaemon, struct sstatus *qstat, const struct uuconf_di
     }
 
   /* Turn on the selected protocol.  */
+  upstats_clear ();
   if (! (*qdaemon->qproto->pfstart) (qdaemon, &zlog))
     return FALSE;
   if (zlog == NULL)
@@ -1686,6 +1800,7 @@ fdo_call (struct sdaemon *qdaemon, struct sstatus *qstat, const struct uuconf_di
 	  (iend_time != istart_time
 	   ? (qdaemon->csent + qdaemon->creceived) / (iend_time - istart_time)
 	   : 0));
+    ulog_queue_wait (qdaemon);
 
     if (fret)
       {
@@ -1893,6 +2008,9 @@ faccept_call (pointer puuconf, const char *zconfig, boolean fuuxqt, const char *
   ulog (LOG_NORMAL, "Incoming call (login %s port %s)", zlogin,
 	zLdevice == NULL ? (char *) "unknown" : zLdevice);
 
+  if (zTrace_file != NULL)
+    (void) fconn_trace_start (qconn, zTrace_file, FALSE);
+
   istart_time = ixsysdep_time ((long *) NULL);
 
   iuuconf = uuconf_strip (puuconf, &istrip);
@@ -1995,6 +2113,9 @@ faccept_call (pointer puuconf, const char *zconfig, boolean fuuxqt, const char *
   sDaemon.cmax_receive = -1;
   sDaemon.csent = 0;
   sDaemon.creceived = 0;
+  sDaemon.cwaits = 0;
+  sDaemon.cwait_total = 0;
+  sDaemon.cwait_max = 0;
   sDaemon.cxfiles_received = 0;
   sDaemon.ifeatures = 0;
   sDaemon.frequest_hangup = FALSE;
@@ -2003,6 +2124,8 @@ faccept_call (pointer puuconf, const char *zconfig, boolean fuuxqt, const char *
   sDaemon.fmaster = FALSE;
   sDaemon.fcaller = FALSE;
   sDaemon.ireliable = 0;
+  sDaemon.fpipeline = FALSE;
+  sDaemon.cstreams = 0;
   sDaemon.bgrade = UUCONF_GRADE_LOW;
 
   /* Get the local name to use.  If uuconf_login_localname returns a
@@ -2403,7 +2526,13 @@ faccept_call (pointer puuconf, const char *zconfig, boolean fuuxqt, const char *
 				 | FEATURE_EXEC
 				 | FEATURE_RESTART
 				 | FEATURE_QUOTES
-				 | FEATURE_ICOMPL));
+				 | FEATURE_ICOMPL
+				 | FEATURE_IWIDE
+				 | FEATURE_GSRJ
+				 | FEATURE_PIPELINE
+				 | FEATURE_LOCAL_COMPRESS
+				 | FEATURE_LOCAL_STREAMS
+				 | FEATURE_DELTA));
 	zreply = ab;
       }
     if (! fsend_uucp_cmd (qconn, zreply))
@@ -2544,6 +2673,7 @@ faccept_call (pointer puuconf, const char *zconfig, boolean fuuxqt, const char *
     sDaemon.cchans = 1;
   else
     sDaemon.cchans = asProtocols[i].cchans;
+  sDaemon.fpipeline = fspipeline (&sDaemon);
 
   /* Run the chat script for when a call is received.  */
   if (! fchat (qconn, puuconf, &qsys->uuconf_scalled_chat, qsys,
@@ -2582,6 +2712,7 @@ faccept_call (pointer puuconf, const char *zconfig, boolean fuuxqt, const char *
 
   /* Turn on the selected protocol and get any jobs queued for the
      system.  */
+  upstats_clear ();
   if (! (*sDaemon.qproto->pfstart) (&sDaemon, &zlog)
       || ! fqueue (&sDaemon, (boolean *) NULL))
     {
@@ -2661,6 +2792,7 @@ faccept_call (pointer puuconf, const char *zconfig, boolean fuuxqt, const char *
 	  (iend_time != istart_time
 	   ? (sDaemon.csent + sDaemon.creceived) / (iend_time - istart_time)
 	   : 0));
+    ulog_queue_wait (&sDaemon);
 
     uclear_queue (&sDaemon);
 
@@ -2734,6 +2866,42 @@ uapply_proto_params (pointer puuconf, int bproto, struct uuconf_cmdtab *qcmds, s
     }
 }
 
+/* See whether we may pipeline file transfers, once we know the
+   protocol and the remote features.  The next file is only started
+   while earlier ones wait for their confirmation, so the protocol
+   must have a single channel and must not need acknowledgements of
+   its own, and the line must be full duplex.  A send of an execution
+   file may be retried after the confirmation if the remote does not
+   support E, so require that too.  */
+
+static boolean
+fspipeline (const struct sdaemon *qdaemon)
+{
+  return (qdaemon->cchans == 1
+	  && (qdaemon->ireliable & UUCONF_RELIABLE_FULLDUPLEX) != 0
+	  && (qdaemon->qproto->ireliable & UUCONF_RELIABLE_ENDTOEND) != 0
+	  && (qdaemon->ifeatures & FEATURE_PIPELINE) != 0
+	  && (qdaemon->ifeatures & FEATURE_EXEC) != 0);
+}
+
+/* Log how long the files we sent during a call waited in the queue
+   before they started, so that the effect of the order in which
+   files are sent can be measured.  */
+
+static void
+ulog_queue_wait (const struct sdaemon *qdaemon)
+{
+  long cavg;
+
+  if (qdaemon->cwaits == 0)
+    return;
+  cavg = qdaemon->cwait_total / qdaemon->cwaits;
+  ulog (LOG_NORMAL,
+	"Queue wait (%ld files average %ld.%03ld seconds maximum %ld.%03ld seconds)",
+	qdaemon->cwaits, cavg / 1000, cavg % 1000,
+	qdaemon->cwait_max / 1000, qdaemon->cwait_max % 1000);
+}
+
 /* Send a string to the other system beginning with a DLE
    character and terminated with a null byte.  This is only
    used when no protocol is in force.  */
@@ -918,6 +918,11 @@ extern int uuconf_logfile (void *uuconf_pglobal,
 extern int uuconf_statsfile (void *uuconf_pglobal,
 			     const char **uuconf_pzstats);
 
+/* Get the name of the UUCP protocol statistics file.  This will set
+   *pzprotstats to a constant string, which should not be freed.  */
+extern int uuconf_protstatsfile (void *uuconf_pglobal,
+				 const char **uuconf_pzprotstats);
+
 /* Get the name of the UUCP debugging file.  This will set *pzdebug to
    a constant string, which should not be freed.  */
 extern int uuconf_debugfile (void *uuconf_pglobal,
@@ -1025,6 +1030,7 @@ extern int uuconf_lockdir ();
 extern int uuconf_pubdir ();
 extern int uuconf_logfile ();
 extern int uuconf_statsfile ();
+extern int uuconf_protstatsfile ();
 extern int uuconf_debugfile ();
 extern int uuconf_debuglevel ();
 extern int uuconf_maxuuxqts ();
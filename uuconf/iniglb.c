@@ -79,6 +79,7 @@ _uuconf_iinit_global (struct sglobal **pqglobal)
 #endif
   qprocess->zlogfile = LOGFILE;
   qprocess->zstatsfile = STATFILE;
+  qprocess->zprotstatsfile = PROTSTATFILE;
   qprocess->zdebugfile = DEBUGFILE;
   qprocess->zdebug = "";
   qprocess->fstrip_login = TRUE;
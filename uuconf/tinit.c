@@ -61,6 +61,8 @@ static const struct cmdtab_offset asCmds[] =
       offsetof (struct sprocess, zlogfile), NULL },
   { "statfile", UUCONF_CMDTABTYPE_STRING,
       offsetof (struct sprocess, zstatsfile), NULL },
+  { "protstatfile", UUCONF_CMDTABTYPE_STRING,
+      offsetof (struct sprocess, zprotstatsfile), NULL },
   { "debugfile", UUCONF_CMDTABTYPE_STRING,
       offsetof (struct sprocess, zdebugfile), NULL },
   { "debug", UUCONF_CMDTABTYPE_FN | 0,
@@ -73,6 +73,8 @@ struct sprocess
   const char *zlogfile;
   /* The statistics file.  */
   const char *zstatsfile;
+  /* The protocol statistics file.  */
+  const char *zprotstatsfile;
   /* The debugging file.  */
   const char *zdebugfile;
   /* The default debugging level.  */
@@ -43,11 +43,18 @@ static void ucusage P((void));
 static void uchelp P((void));
 static void ucdirfile P((const char *zdir, const char *zfile,
 			 pointer pinfo));
+static void ucjob P((struct uuconf_system *qlocalsys, int cargs,
+		     char **pzargs, boolean frecursive));
+static boolean fcbatch P((struct uuconf_system *qlocalsys,
+			  boolean frecursive, boolean fjobid,
+			  boolean fuucico, const char *zconfig));
+static boolean fcbatch_commit P((void));
 static void uccopy P((const char *zfile, const char *zdest,
 		      boolean fforcelocal));
 static void ucadd_cmd P((const struct uuconf_system *qsys,
 			 const struct scmd *qcmd, const char *zlog));
 static void ucspool_cmds P((boolean fjobid));
+static boolean fcstart_uucico P((const char *zconfig));
 static const char *zcone_system P((boolean *pfany));
 static void ucrecord_file P((const char *zfile));
 static void ucabort P((void));
@@ -57,6 +64,7 @@ static void ucabort P((void));
    command.  */
 static const struct option asClongopts[] =
 {
+  { "batch", no_argument, NULL, 'B' },
   { "copy", no_argument, NULL, 'C' },
   { "nocopy", no_argument, NULL, 'c' },
   { "directories", no_argument, NULL, 'd' },
@@ -133,6 +141,20 @@ static char abCrec_options[20];
 
 /* TRUE if the current file being copied from is in the cwd.  */
 static boolean fCneeds_cwd;
+
+/* TRUE if jobs are read from standard input (--batch).  */
+static boolean fCbatch;
+
+/* The number of jobs queued in the current batch, and the time at
+   which the batch was started.  */
+static int cCbatch_jobs;
+static long iCbatch_secs;
+static long iCbatch_micros;
+
+/* The job ids of the current batch, which are not printed until the
+   batch has been committed.  */
+static char **pCzjobids;
+static int cCjobids;
 
 /* The main program.  */
 
@@ -156,18 +178,21 @@ main (int argc, char **argv)
   boolean fgetcwd;
   struct uuconf_system slocalsys;
   char *zexclam;
-  char *zdestfile;
-  const char *zdestsys;
   char *zoptions;
   boolean fexit;
 
   zProgram = argv[0];
 
-  while ((iopt = getopt_long (argc, argv, "cCdfg:I:jmn:prRs:tu:Wvx:",
+  while ((iopt = getopt_long (argc, argv, "BcCdfg:I:jmn:prRs:tu:Wvx:",
 			      asClongopts, (int *) NULL)) != EOF)
     {
       switch (iopt)
 	{
+	case 'B':
+	  /* Read jobs from standard input.  */
+	  fCbatch = TRUE;
+	  break;
+
 	case 'c':
 	  /* Do not copy local files to spool directory.  */
 	  fCcopy = FALSE;
@@ -296,7 +321,14 @@ main (int argc, char **argv)
 	}
     }
 
-  if (argc - optind < 2)
+  /* In batch mode the files are named on standard input, and the
+     uuto emulation needs a destination to work with.  */
+  if (fCbatch)
+    {
+      if (optind != argc || fuuto)
+	ucusage ();
+    }
+  else if (argc - optind < 2)
     ucusage ();
 
   iuuconf = uuconf_init (&puuconf, (const char *) NULL, zconfig);
@@ -319,8 +351,9 @@ main (int argc, char **argv)
   /* See if we are going to need to know the current directory.  We
      just check each argument to see whether it's an absolute
      pathname.  We actually aren't going to need the cwd if fCexpand
-     is FALSE and the file is remote, but so what.  */
-  fgetcwd = FALSE;
+     is FALSE and the file is remote, but so what.  In batch mode we
+     don't know the file names yet, so we always get it.  */
+  fgetcwd = fCbatch;
   for (i = optind; i < argc; i++)
     {
       zexclam = strrchr (argv[i], '!');
@@ -423,13 +456,100 @@ main (int argc, char **argv)
     *zoptions++ = 'm';
   *zoptions = '\0';
 
-  argv[argc - 1] = zremove_local_sys (&slocalsys, argv[argc - 1]);
+  if (! fCbatch)
+    {
+      ucjob (&slocalsys, argc - optind, argv + optind, frecursive);
+
+      /* Now push out the actual commands, making log entries for
+	 them.  */
+      ulog_to_file (puuconf, TRUE);
+      ulog_user (zCuser);
+
+      ucspool_cmds (fjobid);
+
+      ulog_close ();
+
+      if (! fuucico)
+	fexit = TRUE;
+      else
+	fexit = fcstart_uucico (zconfig);
+    }
+  else
+    {
+      fexit = fcbatch (&slocalsys, frecursive, fjobid, fuucico, zconfig);
+      ulog_close ();
+    }
+
+  usysdep_exit (fexit);
+
+  /* Avoid error about not returning.  */
+  return 0;
+}
+
+/* Print usage message and die.  */
 
-  zexclam = strchr (argv[argc - 1], '!');
+static void
+ucusage (void)
+{
+  fprintf (stderr,
+	   "Usage: %s [options] file1 [file2 ...] dest\n", zProgram);
+  fprintf (stderr, "       %s --batch [options] < jobs\n", zProgram);
+  fprintf (stderr, "Use %s --help for help\n", zProgram);
+  exit (EXIT_FAILURE);
+}
+
+/* Print help message.  */
+
+static void
+uchelp (void)
+{
+  printf ("Taylor UUCP %s, copyright (C) 1991, 92, 93, 94, 1995, 2002 Ian Lance Taylor\n",
+	   VERSION);
+  printf ("Usage: %s [options] file1 [file2 ...] dest\n", zProgram);
+  printf (" -c,--nocopy: Do not copy local files to spool directory\n");
+  printf (" -C,-p,--copy: Copy local files to spool directory (default)\n");
+  printf (" -d,--directories: Create necessary directories (default)\n");
+  printf (" -f,--nodirectories: Do not create directories (fail if they do not exist)\n");
+  printf (" -g,--grade grade: Set job grade (must be alphabetic)\n");
+  printf (" -m,--mail: Report status of copy by mail\n");
+  printf (" -n,--notify user: Report status of copy by mail to remote user\n");
+  printf (" -R,--recursive: Copy directories recursively\n");
+  printf (" -r,--nouucico: Do not start uucico daemon\n");
+  printf (" -s,--status file: Report completion status to file\n");
+  printf (" -j,--jobid: Report job id\n");
+  printf (" -W,--noexpand: Do not add current directory to remote filenames\n");
+  printf (" -t,--uuto: Emulate uuto\n");
+  printf (" -u,--user name: Set user name\n");
+  printf (" -B,--batch: Read jobs from standard input, one per line\n");
+  printf (" -x,--debug debug: Set debugging level\n");
+#if HAVE_TAYLOR_CONFIG
+  printf (" -I,--config file: Set configuration file to use\n");
+#endif /* HAVE_TAYLOR_CONFIG */
+  printf (" -v,--version: Print version and exit\n");
+  printf (" --help: Print help and exit\n");
+  printf ("Report bugs to taylor-uucp@gnu.org\n");
+}
+
+/* Queue up the copies requested by one set of arguments: some source
+   files followed by a destination.  This is the whole job when uucp
+   is run normally, and one line of input in batch mode.  */
+
+static void
+ucjob (struct uuconf_system *qlocalsys, int cargs, char **pzargs, boolean frecursive)
+{
+  int iuuconf;
+  int i;
+  char *zexclam;
+  char *zdestfile;
+  const char *zdestsys;
+
+  pzargs[cargs - 1] = zremove_local_sys (qlocalsys, pzargs[cargs - 1]);
+
+  zexclam = strchr (pzargs[cargs - 1], '!');
   if (zexclam == NULL)
     {
       zdestsys = zClocalname;
-      zdestfile = argv[argc - 1];
+      zdestfile = pzargs[cargs - 1];
       fClocaldest = TRUE;
     }
   else
@@ -437,9 +557,9 @@ main (int argc, char **argv)
       size_t clen;
       char *zcopy;
 
-      clen = zexclam - argv[argc - 1];
+      clen = zexclam - pzargs[cargs - 1];
       zcopy = zbufalc (clen + 1);
-      memcpy (zcopy, argv[argc - 1], clen);
+      memcpy (zcopy, pzargs[cargs - 1], clen);
       zcopy[clen] = '\0';
       zdestsys = zcopy;
 
@@ -448,21 +568,21 @@ main (int argc, char **argv)
       fClocaldest = FALSE;
     }
 
-  iuuconf = uuconf_system_info (puuconf, zdestsys, &sCdestsys);
+  iuuconf = uuconf_system_info (pCuuconf, zdestsys, &sCdestsys);
   if (iuuconf != UUCONF_SUCCESS)
     {
       if (iuuconf != UUCONF_NOT_FOUND)
-	ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
+	ulog_uuconf (LOG_FATAL, pCuuconf, iuuconf);
       if (fClocaldest)
 	{
-	  iuuconf = uuconf_system_local (puuconf, &sCdestsys);
+	  iuuconf = uuconf_system_local (pCuuconf, &sCdestsys);
 	  if (iuuconf != UUCONF_SUCCESS)
-	    ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
+	    ulog_uuconf (LOG_FATAL, pCuuconf, iuuconf);
 	  sCdestsys.uuconf_zname = (char *) zClocalname;
 	}
       else
 	{
-	  if (! funknown_system (puuconf, zdestsys, &sCdestsys))
+	  if (! funknown_system (pCuuconf, zdestsys, &sCdestsys))
 	    ulog (LOG_FATAL, "%s: System not found", zdestsys);
 	}
     }
@@ -497,25 +617,22 @@ main (int argc, char **argv)
   else if (fCexpand)
     zdestfile = zsysdep_add_cwd (zdestfile);
   if (zdestfile == NULL)
-    {
-      ulog_close ();
-      usysdep_exit (FALSE);
-    }
+    ucabort ();
 
   /* Process each source argument.  */
-  for (i = optind; i < argc - 1 && ! FGOT_SIGNAL (); i++)
+  for (i = 0; i < cargs - 1 && ! FGOT_SIGNAL (); i++)
     {
       boolean flocal;
       char *zfrom;
 
       fCneeds_cwd = FALSE;
 
-      argv[i] = zremove_local_sys (&slocalsys, argv[i]);
+      pzargs[i] = zremove_local_sys (qlocalsys, pzargs[i]);
 
-      if (strchr (argv[i], '!') != NULL)
+      if (strchr (pzargs[i], '!') != NULL)
 	{
 	  flocal = FALSE;
-	  zfrom = zbufcpy (argv[i]);
+	  zfrom = zbufcpy (pzargs[i]);
 	}
       else
 	{
@@ -523,9 +640,9 @@ main (int argc, char **argv)
 	     original directory.  We don't support local wildcards,
 	     leaving that to the shell.  */
 	  flocal = TRUE;
-	  if (fsysdep_needs_cwd (argv[i]))
+	  if (fsysdep_needs_cwd (pzargs[i]))
 	    fCneeds_cwd = TRUE;
-	  zfrom = zsysdep_local_file_cwd (argv[i],
+	  zfrom = zsysdep_local_file_cwd (pzargs[i],
 					  sCdestsys.uuconf_zpubdir,
 					  (boolean *) NULL);
 	  if (zfrom == NULL)
@@ -558,102 +675,8 @@ main (int argc, char **argv)
   /* See if we got an interrupt, presumably from the user.  */
   if (FGOT_SIGNAL ())
     ucabort ();
-
-  /* Now push out the actual commands, making log entries for them.  */
-  ulog_to_file (puuconf, TRUE);
-  ulog_user (zCuser);
-
-  ucspool_cmds (fjobid);
-
-  ulog_close ();
-
-  if (! fuucico)
-    fexit = TRUE;
-  else
-    {
-      const char *zsys;
-      boolean fany;
-
-      zsys = zcone_system (&fany);
-
-      if (zsys == NULL && ! fany)
-	fexit = TRUE;
-      else
-	{
-	  const char *zarg;
-	  char *zconfigarg;
-
-	  if (zsys == NULL)
-	    zarg = "-r1";
-	  else
-	    {
-	      char *z;
-
-	      z = zbufalc (sizeof "-Cs" + strlen (zsys));
-	      sprintf (z, "-Cs%s", zsys);
-	      zarg = z;
-	    }
-
-	  if (zconfig == NULL)
-	    zconfigarg = NULL;
-	  else
-	    {
-	      zconfigarg = zbufalc (sizeof "-I" + strlen (zconfig));
-	      sprintf (zconfigarg, "-I%s", zconfig);
-	    }
-
-	  fexit = fsysdep_run (FALSE, "uucico", zarg, zconfigarg);
-	}
-    }
-
-  usysdep_exit (fexit);
-
-  /* Avoid error about not returning.  */
-  return 0;
 }
 
-/* Print usage message and die.  */
-
-static void
-ucusage (void)
-{
-  fprintf (stderr,
-	   "Usage: %s [options] file1 [file2 ...] dest\n", zProgram);
-  fprintf (stderr, "Use %s --help for help\n", zProgram);
-  exit (EXIT_FAILURE);
-}
-
-/* Print help message.  */
-
-static void
-uchelp (void)
-{
-  printf ("Taylor UUCP %s, copyright (C) 1991, 92, 93, 94, 1995, 2002 Ian Lance Taylor\n",
-	   VERSION);
-  printf ("Usage: %s [options] file1 [file2 ...] dest\n", zProgram);
-  printf (" -c,--nocopy: Do not copy local files to spool directory\n");
-  printf (" -C,-p,--copy: Copy local files to spool directory (default)\n");
-  printf (" -d,--directories: Create necessary directories (default)\n");
-  printf (" -f,--nodirectories: Do not create directories (fail if they do not exist)\n");
-  printf (" -g,--grade grade: Set job grade (must be alphabetic)\n");
-  printf (" -m,--mail: Report status of copy by mail\n");
-  printf (" -n,--notify user: Report status of copy by mail to remote user\n");
-  printf (" -R,--recursive: Copy directories recursively\n");
-  printf (" -r,--nouucico: Do not start uucico daemon\n");
-  printf (" -s,--status file: Report completion status to file\n");
-  printf (" -j,--jobid: Report job id\n");
-  printf (" -W,--noexpand: Do not add current directory to remote filenames\n");
-  printf (" -t,--uuto: Emulate uuto\n");
-  printf (" -u,--user name: Set user name\n");
-  printf (" -x,--debug debug: Set debugging level\n");
-#if HAVE_TAYLOR_CONFIG
-  printf (" -I,--config file: Set configuration file to use\n");
-#endif /* HAVE_TAYLOR_CONFIG */
-  printf (" -v,--version: Print version and exit\n");
-  printf (" --help: Print help and exit\n");
-  printf ("Report bugs to taylor-uucp@gnu.org\n");
-}
-
 /* This is called for each file in a directory heirarchy.  */
 
 static void
@@ -794,7 +817,7 @@ uccopy (const char *zfile, const char *zdest, boolean fforcelocal)
 	      if (! ffileisopen (efrom))
 		ucabort ();
 	      ucrecord_file (ztemp);
-	      if (! fcopy_open_file (efrom, ztemp, FALSE, TRUE, TRUE))
+	      if (! fsysdep_spool_copy (efrom, ztemp))
 		ucabort ();
 	      (void) ffileclose (efrom);
 	    }
@@ -1118,6 +1141,13 @@ struct sjob
 
 static struct sjob *qCjobs;
 
+/* The system for which we have spooled commands, and whether we have
+   spooled commands for more than one system.  These are kept apart
+   from qCjobs, since in batch mode that list is cleared after each
+   job.  */
+static char *zCone_system;
+static boolean fCmany_systems;
+
 static void
 ucadd_cmd (const struct uuconf_system *qsys, const struct scmd *qcmd, const char *zlog)
 {
@@ -1162,6 +1192,11 @@ ucspool_cmds (boolean fjobid)
 
   for (qjob = qCjobs; qjob != NULL; qjob = qjob->qnext)
     {
+      if (zCone_system == NULL)
+	zCone_system = zbufcpy (qjob->qsys->uuconf_zname);
+      else if (strcmp (zCone_system, qjob->qsys->uuconf_zname) != 0)
+	fCmany_systems = TRUE;
+
       ulog_system (qjob->qsys->uuconf_zname);
       zjobid = zsysdep_spool_commands (qjob->qsys, bCgrade, qjob->ccmds,
 				       qjob->pascmds, (boolean *) NULL);
@@ -1200,6 +1235,17 @@ ucspool_cmds (boolean fjobid)
 		}
 	    }
 
+	  if (fjobid && fCbatch)
+	    {
+	      /* This is printed by fcbatch_commit.  */
+	      pCzjobids = (char **) xrealloc ((pointer) pCzjobids,
+					      ((cCjobids + 1)
+					       * sizeof (char *)));
+	      pCzjobids[cCjobids] = zjobid;
+	      ++cCjobids;
+	      continue;
+	    }
+
 	  if (fjobid)
 	    printf ("%s\n", zjobid);
 
@@ -1208,6 +1254,52 @@ ucspool_cmds (boolean fjobid)
     }
 }
 
+/* Start up uucico for the systems we have created commands for, if
+   any.  This returns FALSE if uucico could not be started.  */
+
+static boolean
+fcstart_uucico (const char *zconfig)
+{
+  const char *zsys;
+  boolean fany;
+  const char *zarg;
+  char *zconfigarg;
+  boolean fret;
+
+  zsys = zcone_system (&fany);
+
+  if (zsys == NULL && ! fany)
+    return TRUE;
+
+  if (zsys == NULL)
+    zarg = "-r1";
+  else
+    {
+      char *z;
+
+      z = zbufalc (sizeof "-Cs" + strlen (zsys));
+      sprintf (z, "-Cs%s", zsys);
+      zarg = z;
+    }
+
+  if (zconfig == NULL)
+    zconfigarg = NULL;
+  else
+    {
+      zconfigarg = zbufalc (sizeof "-I" + strlen (zconfig));
+      sprintf (zconfigarg, "-I%s", zconfig);
+    }
+
+  fret = fsysdep_run (FALSE, "uucico", zarg, zconfigarg);
+
+  /* In batch mode we may be called again for the next batch.  */
+  ubuffree (zCone_system);
+  zCone_system = NULL;
+  fCmany_systems = FALSE;
+
+  return fret;
+}
+
 /* Return the system name for which we have created commands, or NULL
    if we've created commands for more than one system.  Set *pfany to
    FALSE if we didn't create work for any system.  */
@@ -1215,7 +1307,7 @@ ucspool_cmds (boolean fjobid)
 static const char *
 zcone_system (boolean *pfany)
 {
-  if (qCjobs == NULL)
+  if (zCone_system == NULL)
     {
       *pfany = FALSE;
       return NULL;
@@ -1223,8 +1315,8 @@ zcone_system (boolean *pfany)
 
   *pfany = TRUE;
 
-  if (qCjobs->qnext == NULL)
-    return qCjobs->qsys->uuconf_zname;
+  if (! fCmany_systems)
+    return zCone_system;
   else
     return NULL;
 }
@@ -1252,7 +1344,192 @@ ucabort (void)
   int i;
 
   for (i = 0; i < cCfiles; i++)
-    (void) remove (pCaz[i]);
+    (void) isysdep_spool_remove (pCaz[i]);
+
+  /* Jobs already queued in this batch stay queued, so make sure they
+     get to the disk.  */
+  if (cCbatch_jobs > 0)
+    (void) fcbatch_commit ();
+
   ulog_close ();
   usysdep_exit (FALSE);
 }
+
+/* The largest number of jobs we put in a single batch.  */
+#define CBATCH_MAX (1000)
+
+/* Read jobs from standard input, one per line.  Each line holds the
+   arguments uucp would normally be run with: one or more source files
+   followed by a destination, separated by white space.  Backslash
+   escapes are recognized within an argument, so a file name with a
+   space in it may be written using \s.  Lines starting with # are
+   ignored.  The jobs are committed to disk in batches: a blank line,
+   the end of the input, or CBATCH_MAX jobs ends a batch.  This
+   returns FALSE if a line could not be used, uucico could not be
+   started, or a batch could not be committed.  */
+
+static boolean
+fcbatch (struct uuconf_system *qlocalsys, boolean frecursive, boolean fjobid, boolean fuucico, const char *zconfig)
+{
+  char *zline;
+  size_t cline;
+  char **pzargs;
+  int cargsalc;
+  boolean feof;
+  boolean fret;
+
+  zline = NULL;
+  cline = 0;
+  pzargs = NULL;
+  cargsalc = 0;
+  feof = FALSE;
+  fret = TRUE;
+
+  while (! feof && ! FGOT_SIGNAL ())
+    {
+      int cargs;
+      char *z;
+
+      if (getline (&zline, &cline, stdin) <= 0)
+	feof = TRUE;
+      else
+	{
+	  /* Split the line into arguments.  */
+	  cargs = 0;
+	  for (z = strtok (zline, " \t\n"); z != NULL;
+	       z = strtok ((char *) NULL, " \t\n"))
+	    {
+	      if (cargs == 0 && *z == '#')
+		break;
+	      if (cargs >= cargsalc)
+		{
+		  cargsalc += 8;
+		  pzargs = (char **) xrealloc ((pointer) pzargs,
+					       cargsalc * sizeof (char *));
+		}
+	      (void) cescape (z);
+	      pzargs[cargs] = z;
+	      ++cargs;
+	    }
+
+	  if (cargs == 0)
+	    {
+	      /* A blank line ends the batch; a comment does not.  */
+	      if (z != NULL)
+		continue;
+	    }
+	  else if (cargs == 1)
+	    {
+	      ulog (LOG_ERROR, "%s: No destination", pzargs[0]);
+	      fret = FALSE;
+	      continue;
+	    }
+	  else
+	    {
+	      struct sjob *qjob;
+
+	      if (cCbatch_jobs == 0)
+		{
+		  iCbatch_secs = ixsysdep_time (&iCbatch_micros);
+		  usysdep_spool_batch ();
+		}
+
+	      ucjob (qlocalsys, cargs, pzargs, frecursive);
+
+	      ulog_to_file (pCuuconf, TRUE);
+	      ulog_user (zCuser);
+	      ucspool_cmds (fjobid);
+	      ulog_to_file (pCuuconf, FALSE);
+
+	      /* The files of this job are now queued, and must not be
+		 removed if a later job fails.  */
+	      cCfiles = 0;
+	      while (qCjobs != NULL)
+		{
+		  qjob = qCjobs->qnext;
+		  xfree ((pointer) qCjobs->pascmds);
+		  xfree ((pointer) qCjobs->pazlogs);
+		  xfree ((pointer) qCjobs);
+		  qCjobs = qjob;
+		}
+	      (void) uuconf_system_free (pCuuconf, &sCdestsys);
+
+	      ++cCbatch_jobs;
+	      if (cCbatch_jobs < CBATCH_MAX)
+		continue;
+	    }
+	}
+
+      if (cCbatch_jobs > 0)
+	{
+	  if (! fcbatch_commit ())
+	    {
+	      fret = FALSE;
+	      break;
+	    }
+	  if (fuucico && ! fcstart_uucico (zconfig))
+	    fret = FALSE;
+	}
+    }
+
+  xfree ((pointer) zline);
+  xfree ((pointer) pzargs);
+
+  if (FGOT_SIGNAL ())
+    ucabort ();
+
+  return fret;
+}
+
+/* Commit the current batch to disk, print the job ids, and log the
+   rate at which jobs were queued.  */
+
+static boolean
+fcbatch_commit (void)
+{
+  boolean fret;
+  long isecs, imicros;
+  long imillis;
+  int i;
+
+  fret = fsysdep_spool_commit ();
+
+  isecs = ixsysdep_time (&imicros) - iCbatch_secs;
+  imicros -= iCbatch_micros;
+  if (imicros < 0)
+    {
+      imicros += 1000000;
+      --isecs;
+    }
+  imillis = isecs * 1000 + imicros / 1000;
+
+  ulog_to_file (pCuuconf, TRUE);
+  ulog_system ((const char *) NULL);
+  if (! fret)
+    ulog (LOG_ERROR, "Batch of %d jobs may not have reached the disk",
+	  cCbatch_jobs);
+  else if (imillis <= 0)
+    ulog (LOG_NORMAL, "Queued batch of %d job%s", cCbatch_jobs,
+	  cCbatch_jobs == 1 ? "" : "s");
+  else
+    ulog (LOG_NORMAL,
+	  "Queued batch of %d job%s in %ld.%03ld seconds (%ld jobs per second)",
+	  cCbatch_jobs, cCbatch_jobs == 1 ? "" : "s",
+	  imillis / 1000, imillis % 1000,
+	  (long) ((cCbatch_jobs * 1000L) / imillis));
+  ulog_to_file (pCuuconf, FALSE);
+
+  /* Only report the job ids once they are safely on disk.  */
+  for (i = 0; i < cCjobids; i++)
+    {
+      if (fret)
+	printf ("%s\n", pCzjobids[i]);
+      ubuffree (pCzjobids[i]);
+    }
+  cCjobids = 0;
+  (void) fflush (stdout);
+
+  cCbatch_jobs = 0;
+
+  return fret;
+}
@@ -97,6 +97,29 @@ struct sstatus
   char *zstring;
 };
 
+/* The scheckpoint structure holds the contents of a checkpoint file,
+   which records how much of a partially received file can be trusted
+   if the file is restarted in a later conversation.  */
+struct scheckpoint
+{
+  /* Name of the file on the sending system.  Should be freed with
+     ubuffree when read from a checkpoint file.  */
+  char *zfrom;
+  /* Name the file will have when it has been received.  Should be
+     freed with ubuffree when read from a checkpoint file.  */
+  char *zto;
+  /* Size of the file, or -1 if the sending system did not say.  */
+  long cbytes;
+  /* Number of bytes at the start of the file which are known to be
+     on disk.  */
+  long cverified;
+  /* CRC (as computed by icrc) of those bytes.  */
+  unsigned long icrc;
+  /* Time the checkpoint was written, in seconds since the epoch.
+     Only set when reading a checkpoint file.  */
+  long itime;
+};
+
 /* How long we have to wait for the next call, given the number of retries
    we have already made.  This should probably be configurable.  */
 #define CRETRY_WAIT(c) ((c) * 10 * 60)
@@ -338,7 +361,10 @@ extern void ustats P((boolean fsucceeded, const char *zuser,
 		      long cbytes, long csecs, long cmicros,
 		      boolean fcaller));
 
-/* Close the statistics file.  */
+/* Write a line to the protocol statistics file.  */
+extern void ustats_protocol P((const char *zrecord));
+
+/* Close the statistics file and the protocol statistics file.  */
 extern void ustats_close P((void));
 
 #if DEBUG > 1
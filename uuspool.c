@@ -0,0 +1,165 @@
+/* uuspool.c
+   Change the layout of the spool directory.
+
+   Copyright (C) 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#if USE_RCS_ID
+const char uuspool_rcsid[] = "$Id$";
+#endif
+
+#include "getopt.h"
+
+#include "uudefs.h"
+#include "uuconf.h"
+#include "system.h"
+
+/* Local functions.  */
+
+static void uspusage P((void));
+static void usphelp P((void));
+
+/* Long getopt options.  */
+static const struct option asSPlongopts[] =
+{
+  { "config", required_argument, NULL, 'I' },
+  { "debug", required_argument, NULL, 'x' },
+  { "version", no_argument, NULL, 'v' },
+  { "help", no_argument, NULL, 1 },
+  { NULL, 0, NULL, 0 }
+};
+
+int
+main (int argc, char **argv)
+{
+  /* -I: configuration file name.  */
+  const char *zconfig = NULL;
+  int iopt;
+  pointer puuconf;
+  int iuuconf;
+  long cmoved;
+  boolean fret;
+
+  zProgram = argv[0];
+
+  while ((iopt = getopt_long (argc, argv, "I:vx:", asSPlongopts,
+			      (int *) NULL)) != EOF)
+    {
+      switch (iopt)
+	{
+	case 'I':
+	  /* Configuration file name.  */
+	  if (fsysdep_other_config (optarg))
+	    zconfig = optarg;
+	  break;
+
+	case 'x':
+#if DEBUG > 1
+	  /* Set debugging level.  */
+	  iDebug |= idebug_parse (optarg);
+#endif
+	  break;
+
+	case 'v':
+	  /* Print version and exit.  */
+	  printf ("uuspool (Taylor UUCP) %s\n", VERSION);
+	  printf ("Copyright (C) 2002 Ian Lance Taylor\n");
+	  printf ("This program is free software; you may redistribute it under the terms of\n");
+	  printf ("the GNU General Public LIcense.  This program has ABSOLUTELY NO WARRANTY.\n");
+	  exit (EXIT_SUCCESS);
+	  /*NOTREACHED*/
+
+	case 1:
+	  /* --help.  */
+	  usphelp ();
+	  exit (EXIT_SUCCESS);
+	  /*NOTREACHED*/
+
+	case 0:
+	  /* Long option found and flag set.  */
+	  break;
+
+	default:
+	  uspusage ();
+	  /*NOTREACHED*/
+	}
+    }
+
+  if (optind != argc)
+    uspusage ();
+
+  iuuconf = uuconf_init (&puuconf, (const char *) NULL, zconfig);
+  if (iuuconf != UUCONF_SUCCESS)
+    ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
+
+#if DEBUG > 1
+  {
+    const char *zdebug;
+
+    iuuconf = uuconf_debuglevel (puuconf, &zdebug);
+    if (iuuconf != UUCONF_SUCCESS)
+      ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
+    if (zdebug != NULL)
+      iDebug |= idebug_parse (zdebug);
+  }
+#endif
+
+  usysdep_initialize (puuconf, INIT_SUID);
+
+  fret = fsysdep_respool (&cmoved);
+
+  printf ("%ld file%s moved\n", cmoved, cmoved == 1 ? "" : "s");
+
+  usysdep_exit (fret);
+
+  /* Avoid warnings about not returning a value.  */
+  return 0;
+}
+
+/* Print a usage message and die.  */
+
+static void
+uspusage (void)
+{
+  fprintf (stderr, "Usage: %s [-I file]\n", zProgram);
+  fprintf (stderr, "Use %s --help for help\n", zProgram);
+  exit (EXIT_FAILURE);
+}
+
+/* Print a help message.  */
+
+static void
+usphelp (void)
+{
+  printf ("Taylor UUCP %s, copyright (C) 2002 Ian Lance Taylor\n",
+	  VERSION);
+  printf ("Usage: %s [-I file]\n", zProgram);
+  printf ("Move spooled files into the layout this program was built for\n");
+#if HAVE_TAYLOR_CONFIG
+  printf (" -I,--config file: Set configuration file to use\n");
+#endif /* HAVE_TAYLOR_CONFIG */
+  printf (" -x,--debug debug: Set debugging level\n");
+  printf (" -v,--version: Print version and exit\n");
+  printf (" --help: Print help and exit\n");
+  printf ("Report bugs to taylor-uucp@gnu.org\n");
+}
@@ -148,6 +148,7 @@ static boolean fsquery P((pointer puuconf, int csystems,
 			  long iold, long iyoung));
 static int csunits_show P((long idiff));
 static boolean fsmachines P((void));
+static boolean fspartial P((void));
 
 /* Long getopt options.  */
 static const struct option asSlongopts[] =
@@ -165,6 +166,7 @@ static const struct option asSlongopts[] =
   { "notify", no_argument, NULL, 'N' },
   { "older-than", required_argument, NULL, 'o' },
   { "ps", no_argument, NULL, 'p' },
+  { "partial", no_argument, NULL, 'P' },
   { "list", no_argument, NULL, 'q' },
   { "no-list", no_argument, NULL, 'Q' },
   { "rejuvenate", required_argument, NULL, 'r' },
@@ -204,6 +206,8 @@ main (int argc, char **argv)
   int ioldhours = -1;
   /* -p: report status of jobs holding lock files.  */
   boolean fps = FALSE;
+  /* -P: report partially received files.  */
+  boolean fpartial = FALSE;
   /* -q: list number of jobs for each system.  */
   boolean fquery = FALSE;
   /* -r jobid: rejuvenate specified job.  */
@@ -237,7 +241,7 @@ main (int argc, char **argv)
   zProgram = argv[0];
 
   while ((iopt = getopt_long (argc, argv,
-			      "aB:c:C:eiI:k:KmMNo:pqQr:Rs:S:u:U:vW:x:y:",
+			      "aB:c:C:eiI:k:KmMNo:pPqQr:Rs:S:u:U:vW:x:y:",
 			      asSlongopts, (int *) NULL)) != EOF)
     {
       switch (iopt)
@@ -318,6 +322,11 @@ main (int argc, char **argv)
 	  fps = TRUE;
 	  break;
 
+	case 'P':
+	  /* Report partially received files.  */
+	  fpartial = TRUE;
+	  break;
+
 	case 'q':
 	  /* List number of jobs for each system.  */
 	  fquery = TRUE;
@@ -423,6 +432,8 @@ main (int argc, char **argv)
     ++ccmds;
   if (fps)
     ++ccmds;
+  if (fpartial)
+    ++ccmds;
   if (fexecute || fquery || csystems > 0 || cusers > 0 || ioldhours != -1
       || iyounghours != -1 || ccommands > 0)
     ++ccmds;
@@ -565,6 +576,8 @@ main (int argc, char **argv)
     }
   else if (fps)
     fret = fsysdep_lock_status ();
+  else if (fpartial)
+    fret = fspartial ();
   else
     {
 #if DEBUG > 0
@@ -612,6 +625,7 @@ ushelp (void)
   printf (" -N,--notify: mail report on each listed job to requestor\n");
   printf (" -o,--older-than hours: list all jobs older than given number of hours\n");
   printf (" -p,--ps: show status of all processes holding UUCP locks\n");
+  printf (" -P,--partial: show progress of partially received files\n");
   printf (" -q,--list: list number of jobs for each system\n");
   printf (" -Q,--no-list: don't list jobs, just take actions (-i, -K, -M, -N)\n");
   printf (" -r,--rejuvenate job: rejuvenate specified UUCP job\n");
@@ -2410,3 +2424,41 @@ fsmachines (void)
 
   return ! ferr;
 }
+
+/* Show the progress of all partially received files which will be
+   restarted in the next conversation.  */
+
+static boolean
+fspartial (void)
+{
+  pointer phold;
+  char *zsystem;
+  boolean ferr;
+  struct scheckpoint sck;
+
+  if (! fsysdep_all_checkpoints_init (&phold))
+    return FALSE;
+
+  while ((zsystem = zsysdep_all_checkpoints (phold, &ferr, &sck)) != NULL)
+    {
+      struct tm stime;
+
+      usysdep_localtime (sck.itime, &stime);
+      printf ("%-14s %02d-%02d %02d:%02d %s %ld", zsystem,
+	      stime.tm_mon + 1, stime.tm_mday, stime.tm_hour,
+	      stime.tm_min, sck.zto, sck.cverified);
+      if (sck.cbytes > 0)
+	printf (" of %ld bytes (%d%%)", sck.cbytes,
+		(int) ((double) sck.cverified * 100 / (double) sck.cbytes));
+      else
+	printf (" bytes");
+      printf (" from %s\n", sck.zfrom);
+      ubuffree (sck.zfrom);
+      ubuffree (sck.zto);
+      ubuffree (zsystem);
+    }
+
+  usysdep_all_checkpoints_free (phold);
+
+  return ! ferr;
+}
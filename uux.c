@@ -132,10 +132,64 @@ static FILE *eXclose;
 /* A list of file names which will match the file names which appear
    in the uucico logs.  */
 static char *zXnames;
+
+/* The files we have created for the current command, which are
+   removed if we get a signal.  */
+static int cXfiles;
+static const char **pXaz;
+
+/* The options which apply to every command we queue.  */
+static const char *zXrequestor;		/* -a: address for status */
+static boolean fXretstdin;		/* -b: return stdin on error */
+static boolean fXcopy;			/* -C: copy to spool directory */
+static boolean fXdontcopy;		/* -c given explicitly */
+static boolean fXjobid;			/* -j: output job id */
+static boolean fXlink;			/* -l: link to spool directory */
+static boolean fXno_ack;		/* -n: no notification */
+static boolean fXread_stdin;		/* -p: read stdin for command */
+static const char *zXstatus_file;	/* -s: report status to file */
+static boolean fXexpand = TRUE;		/* -W: only expand local names */
+static boolean fXerror_ack;		/* -z: notify only on error */
+
+/* TRUE if commands are read from standard input (--batch).  */
+static boolean fXbatch;
+
+/* The configuration, the local system and the user.  */
+static pointer pXuuconf;
+static const char *zXlocalname;
+static struct uuconf_system sXlocalsys;
+static const char *zXuser;
+
+/* The system to call when we are done, or NULL.  If fXcall_any is
+   TRUE and zXcall_system is NULL, commands were queued for more than
+   one system.  fXany_local is TRUE if a command is to be executed on
+   the local system.  */
+static char *zXcall_system;
+static boolean fXcall_any;
+static boolean fXany_local;
+
+/* The number of commands queued in the current batch, and the time at
+   which the batch was started.  */
+static int cXbatch_jobs;
+static long iXbatch_secs;
+static long iXbatch_micros;
+
+/* The job ids of the current batch, which are not printed until the
+   batch has been committed.  */
+static char **pXzjobids;
+static int cXjobids;
 
 /* Local functions.  */
 static void uxusage P((void));
 static void uxhelp P((void));
+static void uxsplit P((char *zargs, char **pzcmd, char ***ppzargs,
+		       int *pcargs));
+static void uxjob P((char *zcmd, char **pzargs, int cargs));
+static void uxcall_system P((const char *zsystem));
+static void uxstart_uucico P((boolean fuucico, const char *zconfig));
+static void uxjobid P((const char *zjobid));
+static boolean fxbatch P((boolean fuucico, const char *zconfig));
+static boolean fxbatch_commit P((void));
 static void uxadd_xqt_line P((int bchar, const char *z1, const char *z2));
 static void uxadd_send_file P((const char *zfrom, const char *zto,
 			       const char *zoptions, const char *ztemp,
@@ -151,6 +205,7 @@ static const struct option asXlongopts[] =
 {
   { "requestor", required_argument, NULL, 'a' },
   { "return-stdin", no_argument, NULL, 'b' },
+  { "batch", no_argument, NULL, 'B' },
   { "nocopy", no_argument, NULL, 'c' },
   { "copy", no_argument, NULL, 'C' },
   { "grade", required_argument, NULL, 'g' },
@@ -173,61 +228,21 @@ static const struct option asXlongopts[] =
 int
 main (int argc, char **argv)
 {
-  /* -a: requestor address for status reports.  */
-  const char *zrequestor = NULL;
-  /* -b: if true, return standard input on error.  */
-  boolean fretstdin = FALSE;
-  /* -c,-C: if true, copy to spool directory.  */
-  boolean fcopy = FALSE;
-  /* -c: set if -c appears explicitly; if it and -l appear, then if the
-     link fails we don't copy the file.  */
-  boolean fdontcopy = FALSE;
   /* -I: configuration file name.  */
   const char *zconfig = NULL;
-  /* -j: output job id.  */
-  boolean fjobid = FALSE;
-  /* -l: link file to spool directory.  */
-  boolean flink = FALSE;
-  /* -n: do not notify upon command completion.  */
-  boolean fno_ack = FALSE;
-  /* -p: read standard input for command standard input.  */
-  boolean fread_stdin = FALSE;
   /* -r: do not start uucico when finished.  */
   boolean fuucico = TRUE;
-  /* -s: report status to named file.  */
-  const char *zstatus_file = NULL;
-  /* -W: only expand local file names.  */
-  boolean fexpand = TRUE;
-  /* -z: report status only on error.  */
-  boolean ferror_ack = FALSE;
   int iopt;
-  pointer puuconf;
   int iuuconf;
-  const char *zlocalname;
   int i;
   size_t clen;
   char *zargs;
-  char *zarg;
   char *zcmd;
-  const char *zsys;
   char *zexclam;
   boolean fgetcwd;
-  const char *zuser;
-  char *zforward;
   char **pzargs;
-  int calloc_args;
   int cargs;
-  const char *zinput_from;
-  const char *zinput_to;
-  const char *zinput_temp;
-  boolean finputcopied;
-  char *zcall_system;
-  boolean fcall_any;
-  struct uuconf_system slocalsys;
-  boolean fneedshell;
-  char *zfullcmd;
-  boolean fpoll;
-  char aboptions[10];
+  boolean fexit;
 
   zProgram = argv[0];
 
@@ -239,7 +254,7 @@ main (int argc, char **argv)
   opterr = 0;
   while (1)
     {
-      while (getopt_long (argc, argv, "+a:bcCg:I:jlnprs:Wvx:z",
+      while (getopt_long (argc, argv, "+a:bBcCg:I:jlnprs:Wvx:z",
 			  asXlongopts, (int *) NULL) != EOF)
 	;
       if (optind >= argc || strcmp (argv[optind], "-") != 0)
@@ -252,7 +267,7 @@ main (int argc, char **argv)
 
   /* The leading + in the getopt string means to stop processing
      options as soon as a non-option argument is seen.  */
-  while ((iopt = getopt_long (argc, argv, "+a:bcCg:I:jlnprs:Wvx:z",
+  while ((iopt = getopt_long (argc, argv, "+a:bBcCg:I:jlnprs:Wvx:z",
 			      asXlongopts, (int *) NULL)) != EOF)
     {
       switch (iopt)
@@ -260,23 +275,28 @@ main (int argc, char **argv)
 	case 'a':
 	  /* Set requestor name: mail address to which status reports
 	     should be sent.  */
-	  zrequestor = optarg;
+	  zXrequestor = optarg;
 	  break;
 
 	case 'b':
 	  /* Return standard input on error.  */
-	  fretstdin = TRUE;
+	  fXretstdin = TRUE;
+	  break;
+
+	case 'B':
+	  /* Read commands from standard input.  */
+	  fXbatch = TRUE;
 	  break;
 
 	case 'c':
 	  /* Do not copy local files to spool directory.  */
-	  fcopy = FALSE;
-	  fdontcopy = TRUE;
+	  fXcopy = FALSE;
+	  fXdontcopy = TRUE;
 	  break;
 
 	case 'C':
 	  /* Copy local files to spool directory.  */
-	  fcopy = TRUE;
+	  fXcopy = TRUE;
 	  break;
 
 	case 'I':
@@ -287,7 +307,7 @@ main (int argc, char **argv)
 
 	case 'j':
 	  /* Output jobid.  */
-	  fjobid = TRUE;
+	  fXjobid = TRUE;
 	  break;
 
 	case 'g':
@@ -297,17 +317,17 @@ main (int argc, char **argv)
 
 	case 'l':
 	  /* Link file to spool directory.  */
-	  flink = TRUE;
+	  fXlink = TRUE;
 	  break;
 
 	case 'n':
 	  /* Do not notify upon command completion.  */
-	  fno_ack = TRUE;
+	  fXno_ack = TRUE;
 	  break;
 
 	case 'p':
 	  /* Read standard input for command standard input.  */
-	  fread_stdin = TRUE;
+	  fXread_stdin = TRUE;
 	  break;
 
 	case 'r':
@@ -317,12 +337,12 @@ main (int argc, char **argv)
 
 	case 's':
 	  /* Report status to named file.  */
-	  zstatus_file = optarg;
+	  zXstatus_file = optarg;
 	  break;
 
 	case 'W':
 	  /* Only expand local file names.  */
-	  fexpand = FALSE;
+	  fXexpand = FALSE;
 	  break;
 
 	case 'x':
@@ -334,7 +354,7 @@ main (int argc, char **argv)
 
 	case 'z':
 	  /* Report status only on error.  */
-	  ferror_ack = TRUE;
+	  fXerror_ack = TRUE;
 	  break;
 
 	case 2:
@@ -346,16 +366,16 @@ main (int argc, char **argv)
 	      || *optarg == 'e'
 	      || *optarg == 'E')
 	    {
-	      ferror_ack = TRUE;
-	      fno_ack = FALSE;
+	      fXerror_ack = TRUE;
+	      fXno_ack = FALSE;
 	    }
 	  else if (*optarg == 'f'
 		   || *optarg == 'F'
 		   || *optarg == 'n'
 		   || *optarg == 'N')
 	    {
-	      ferror_ack = FALSE;
-	      fno_ack = TRUE;
+	      fXerror_ack = FALSE;
+	      fXno_ack = TRUE;
 	    }
 	  break;
 
@@ -397,46 +417,172 @@ main (int argc, char **argv)
      We always break up the command arguments at spaces anyhow, so we
      don't have to worry about them.  Note that this means that
      certain commands aren't supported.  */
-  if ((zrequestor != NULL
-       && zrequestor[strcspn (zrequestor, " \t\n")] != '\0')
-      || (zstatus_file != NULL
-	  && zstatus_file[strcspn (zstatus_file, " \t\n")] != '\0'))
+  if ((zXrequestor != NULL
+       && zXrequestor[strcspn (zXrequestor, " \t\n")] != '\0')
+      || (zXstatus_file != NULL
+	  && zXstatus_file[strcspn (zXstatus_file, " \t\n")] != '\0'))
     fXquote = TRUE;
 
-  if (optind == argc)
+  /* In batch mode the commands are read from standard input, so it
+     can't also be the standard input of a command.  */
+  if (fXbatch)
+    {
+      if (optind != argc || fXread_stdin)
+	uxusage ();
+    }
+  else if (optind == argc)
     uxusage ();
 
-  iuuconf = uuconf_init (&puuconf, (const char *) NULL, zconfig);
+  iuuconf = uuconf_init (&pXuuconf, (const char *) NULL, zconfig);
   if (iuuconf != UUCONF_SUCCESS)
-    ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
+    ulog_uuconf (LOG_FATAL, pXuuconf, iuuconf);
 
 #if DEBUG > 1
   {
     const char *zdebug;
 
-    iuuconf = uuconf_debuglevel (puuconf, &zdebug);
+    iuuconf = uuconf_debuglevel (pXuuconf, &zdebug);
     if (iuuconf != UUCONF_SUCCESS)
-      ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
+      ulog_uuconf (LOG_FATAL, pXuuconf, iuuconf);
     if (zdebug != NULL)
       iDebug |= idebug_parse (zdebug);
   }
 #endif
 
-  /* The command and files arguments could be quoted in any number of
-     ways, so we split them apart ourselves.  We do this before
-     calling usysdep_initialize because we want to set fgetcwd
-     correctly.  */
-  clen = 1;
-  for (i = optind; i < argc; i++)
-    clen += strlen (argv[i]) + 1;
-
-  zargs = zbufalc (clen);
-  *zargs = '\0';
-  for (i = optind; i < argc; i++)
+  /* We split the command apart before calling usysdep_initialize
+     because we want to set fgetcwd correctly.  In batch mode we don't
+     know the file names yet, so we always get the current
+     directory.  */
+  if (fXbatch)
+    {
+      zcmd = NULL;
+      pzargs = NULL;
+      cargs = 0;
+      fgetcwd = TRUE;
+    }
+  else
+    {
+      clen = 1;
+      for (i = optind; i < argc; i++)
+	clen += strlen (argv[i]) + 1;
+
+      zargs = zbufalc (clen);
+      *zargs = '\0';
+      for (i = optind; i < argc; i++)
+	{
+	  strcat (zargs, argv[i]);
+	  strcat (zargs, " ");
+	}
+
+      uxsplit (zargs, &zcmd, &pzargs, &cargs);
+
+      /* Now look through the arguments to see if we are going to need the
+	 current working directory.  We don't try to make a precise
+	 determination, just a conservative one.  The basic idea is that
+	 we don't want to get the cwd for 'foo!rmail - user' (note that we
+	 don't examine the command itself).  */
+      fgetcwd = FALSE;
+      for (i = 0; i < cargs; i++)
+	{
+	  if (pzargs[i][0] == '(')
+	    continue;
+	  zexclam = strrchr (pzargs[i], '!');
+	  if (zexclam != NULL && fsysdep_needs_cwd (zexclam + 1))
+	    {
+	      fgetcwd = TRUE;
+	      break;
+	    }
+	  if ((pzargs[i][0] == '<' || pzargs[i][0] == '>')
+	      && i + 1 < cargs
+	      && strchr (pzargs[i + 1], '!') == NULL
+	      && fsysdep_needs_cwd (pzargs[i + 1]))
+	    {
+	      fgetcwd = TRUE;
+	      break;
+	    }
+	}
+    }
+
+#ifdef SIGINT
+  usysdep_signal (SIGINT);
+#endif
+#ifdef SIGHUP
+  usysdep_signal (SIGHUP);
+#endif
+#ifdef SIGQUIT
+  usysdep_signal (SIGQUIT);
+#endif
+#ifdef SIGTERM
+  usysdep_signal (SIGTERM);
+#endif
+#ifdef SIGPIPE
+  usysdep_signal (SIGPIPE);
+#endif
+
+  usysdep_initialize (pXuuconf, INIT_SUID | (fgetcwd ? INIT_GETCWD : 0));
+
+  zXuser = zsysdep_login_name ();
+
+  /* Get the local system name.  */
+  iuuconf = uuconf_localname (pXuuconf, &zXlocalname);
+  if (iuuconf == UUCONF_NOT_FOUND)
     {
-      strcat (zargs, argv[i]);
-      strcat (zargs, " ");
+      zXlocalname = zsysdep_localname ();
+      if (zXlocalname == NULL)
+	exit (EX_CONFIG);
     }
+  else if (iuuconf != UUCONF_SUCCESS)
+    ulog_uuconf (LOG_FATAL, pXuuconf, iuuconf);
+
+  /* Get the local system information.  */
+  iuuconf = uuconf_system_info (pXuuconf, zXlocalname, &sXlocalsys);
+  if (iuuconf != UUCONF_SUCCESS)
+    {
+      if (iuuconf != UUCONF_NOT_FOUND)
+	ulog_uuconf (LOG_FATAL, pXuuconf, iuuconf);
+      iuuconf = uuconf_system_local (pXuuconf, &sXlocalsys);
+      if (iuuconf != UUCONF_SUCCESS)
+	ulog_uuconf (LOG_FATAL, pXuuconf, iuuconf);
+      sXlocalsys.uuconf_zname = (char *) zXlocalname;
+    }
+
+  /* Nothing has been queued yet.  uxjob records each system it
+     queues work for, and uxstart_uucico clears the record when it
+     starts uucico, so in batch mode it covers a whole batch.  */
+  zXcall_system = NULL;
+  fXcall_any = FALSE;
+  fXany_local = FALSE;
+
+  if (! fXbatch)
+    {
+      uxjob (zcmd, pzargs, cargs);
+      uxstart_uucico (fuucico, zconfig);
+      fexit = TRUE;
+    }
+  else
+    fexit = fxbatch (fuucico, zconfig);
+
+  ulog_close ();
+
+  exit (fexit ? EX_OK : EX_TEMPFAIL);
+
+  /* Avoid error about not returning a value.  */
+  return 0;
+}
+
+/* Split a command line into the command to execute and its arguments.
+   The command and files arguments could be quoted in any number of
+   ways, so we split them apart ourselves.  */
+
+static void
+uxsplit (char *zargs, char **pzcmd, char ***ppzargs, int *pcargs)
+{
+  size_t clen;
+  char *zcmd;
+  char *zarg;
+  char **pzargs;
+  int calloc_args;
+  int cargs;
 
   /* The first argument is the command to execute.  */
   clen = strcspn (zargs, ZSHELLSEPS);
@@ -495,81 +641,39 @@ main (int argc, char **argv)
 	}
     }
 
-  /* Now look through the arguments to see if we are going to need the
-     current working directory.  We don't try to make a precise
-     determination, just a conservative one.  The basic idea is that
-     we don't want to get the cwd for 'foo!rmail - user' (note that we
-     don't examine the command itself).  */
-  fgetcwd = FALSE;
-  for (i = 0; i < cargs; i++)
-    {
-      if (pzargs[i][0] == '(')
-	continue;
-      zexclam = strrchr (pzargs[i], '!');
-      if (zexclam != NULL && fsysdep_needs_cwd (zexclam + 1))
-	{
-	  fgetcwd = TRUE;
-	  break;
-	}
-      if ((pzargs[i][0] == '<' || pzargs[i][0] == '>')
-	  && i + 1 < cargs
-	  && strchr (pzargs[i + 1], '!') == NULL
-	  && fsysdep_needs_cwd (pzargs[i + 1]))
-	{
-	  fgetcwd = TRUE;
-	  break;
-	}
-    }
-
-#ifdef SIGINT
-  usysdep_signal (SIGINT);
-#endif
-#ifdef SIGHUP
-  usysdep_signal (SIGHUP);
-#endif
-#ifdef SIGQUIT
-  usysdep_signal (SIGQUIT);
-#endif
-#ifdef SIGTERM
-  usysdep_signal (SIGTERM);
-#endif
-#ifdef SIGPIPE
-  usysdep_signal (SIGPIPE);
-#endif
-
-  usysdep_initialize (puuconf, INIT_SUID | (fgetcwd ? INIT_GETCWD : 0));
+  *pzcmd = zcmd;
+  *ppzargs = pzargs;
+  *pcargs = cargs;
+}
 
-  zuser = zsysdep_login_name ();
+/* Queue up one command: zcmd is the command to execute, and pzargs
+   holds its arguments as split by uxsplit.  This is the whole run when
+   uux is run normally, and one line of input in batch mode.  */
 
-  /* Get the local system name.  */
-  iuuconf = uuconf_localname (puuconf, &zlocalname);
-  if (iuuconf == UUCONF_NOT_FOUND)
-    {
-      zlocalname = zsysdep_localname ();
-      if (zlocalname == NULL)
-	exit (EX_CONFIG);
-    }
-  else if (iuuconf != UUCONF_SUCCESS)
-    ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
-
-  /* Get the local system information.  */
-  iuuconf = uuconf_system_info (puuconf, zlocalname, &slocalsys);
-  if (iuuconf != UUCONF_SUCCESS)
-    {
-      if (iuuconf != UUCONF_NOT_FOUND)
-	ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
-      iuuconf = uuconf_system_local (puuconf, &slocalsys);
-      if (iuuconf != UUCONF_SUCCESS)
-	ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
-      slocalsys.uuconf_zname = (char *) zlocalname;
-    }
+static void
+uxjob (char *zcmd, char **pzargs, int cargs)
+{
+  int iuuconf;
+  int i;
+  size_t clen;
+  const char *zsys;
+  char *zexclam;
+  char *zforward;
+  const char *zinput_from;
+  const char *zinput_to;
+  const char *zinput_temp;
+  boolean finputcopied;
+  boolean fneedshell;
+  char *zfullcmd;
+  boolean fpoll;
+  char aboptions[10];
 
   /* Figure out which system the command is to be executed on.  */
-  zcmd = zremove_local_sys (&slocalsys, zcmd);
+  zcmd = zremove_local_sys (&sXlocalsys, zcmd);
   zexclam = strchr (zcmd, '!');
   if (zexclam == NULL)
     {
-      zsys = zlocalname;
+      zsys = zXlocalname;
       fXxqtlocal = TRUE;
       zforward = NULL;
     }
@@ -596,15 +700,15 @@ main (int argc, char **argv)
     }
 
   if (fXxqtlocal)
-    sXxqtsys = slocalsys;
+    sXxqtsys = sXlocalsys;
   else
     {
-      iuuconf = uuconf_system_info (puuconf, zsys, &sXxqtsys);
+      iuuconf = uuconf_system_info (pXuuconf, zsys, &sXxqtsys);
       if (iuuconf != UUCONF_SUCCESS)
 	{
 	  if (iuuconf != UUCONF_NOT_FOUND)
-	    ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
-	  if (! funknown_system (puuconf, zsys, &sXxqtsys))
+	    ulog_uuconf (LOG_FATAL, pXuuconf, iuuconf);
+	  if (! funknown_system (pXuuconf, zsys, &sXxqtsys))
 	    ulog (LOG_FATAL, "%s: System not found", zsys);
 	}
     }
@@ -612,7 +716,7 @@ main (int argc, char **argv)
   /* Get the local name the remote system know us as.  */
   zXxqtloc = sXxqtsys.uuconf_zlocalname;
   if (zXxqtloc == NULL)
-    zXxqtloc = zlocalname;
+    zXxqtloc = zXlocalname;
 
   /* Look through the arguments.  Any argument containing an
      exclamation point character is interpreted as a file name, and is
@@ -621,8 +725,6 @@ main (int argc, char **argv)
   zinput_to = NULL;
   zinput_temp = NULL;
   finputcopied = FALSE;
-  zcall_system = NULL;
-  fcall_any = FALSE;
 
   for (i = 0; i < cargs; i++)
     {
@@ -671,14 +773,14 @@ main (int argc, char **argv)
 
       if (zexclam != NULL)
 	{
-	  pzargs[i] = zremove_local_sys (&slocalsys, pzargs[i]);
+	  pzargs[i] = zremove_local_sys (&sXlocalsys, pzargs[i]);
 	  zexclam = strchr (pzargs[i], '!');
 	}
 
       /* Get the system name and file name for this file.  */
       if (zexclam == NULL)
 	{
-	  zsystem = zlocalname;
+	  zsystem = zXlocalname;
 	  zfile = pzargs[i];
 	  flocal = TRUE;
 	  zforw = NULL;
@@ -734,7 +836,7 @@ main (int argc, char **argv)
       if (flocal)
 	zfile = zsysdep_local_file_cwd (zfile, sXxqtsys.uuconf_zpubdir,
 					(boolean *) NULL);
-      else if (fexpand)
+      else if (fXexpand)
 	zfile = zsysdep_add_cwd (zfile);
       if (zfile == NULL)
 	uxabort (EX_OSERR);
@@ -809,7 +911,7 @@ main (int argc, char **argv)
 
       if (finput)
 	{
-	  if (fread_stdin)
+	  if (fXread_stdin)
 	    ulog (LOG_FATAL, "Standard input specified twice");
 	  pzargs[i] = NULL;
 	}
@@ -839,14 +941,14 @@ main (int argc, char **argv)
 	  if (zdata == NULL)
 	    uxabort (EX_OSERR);
 
-	  if (fcopy || flink || fXxqtlocal)
+	  if (fXcopy || fXlink || fXxqtlocal)
 	    {
 	      boolean fdid;
 
 	      uxrecord_file (zdata);
 
 	      fdid = FALSE;
-	      if (flink)
+	      if (fXlink)
 		{
 		  boolean fworked;
 
@@ -855,7 +957,7 @@ main (int argc, char **argv)
 
 		  if (fworked)
 		    fdid = TRUE;
-		  else if (fdontcopy)
+		  else if (fXdontcopy)
 		    ulog (LOG_FATAL, "%s: Can't link to spool directory",
 			  zfile);
 		}
@@ -867,7 +969,7 @@ main (int argc, char **argv)
 		  efile = esysdep_user_fopen (zfile, TRUE, TRUE);
 		  if (! ffileisopen (efile))
 		    uxabort (EX_NOINPUT);
-		  if (! fcopy_open_file (efile, zdata, FALSE, TRUE, TRUE))
+		  if (! fsysdep_spool_copy (efile, zdata))
 		    uxabort (EX_CANTCREAT);
 		  (void) ffileclose (efile);
 		}
@@ -884,7 +986,7 @@ main (int argc, char **argv)
 		uxabort (EX_NOINPUT);
 	      if (! fin_directory_list (zfile, sXxqtsys.uuconf_pzlocal_send,
 					sXxqtsys.uuconf_zpubdir, TRUE,
-					TRUE, zuser))
+					TRUE, zXuser))
 		ulog (LOG_FATAL, "Not permitted to send from %s",
 		      zfile);
 
@@ -900,7 +1002,7 @@ main (int argc, char **argv)
 	    }
 	  else
 	    {
-	      finputcopied = fcopy || flink;
+	      finputcopied = fXcopy || fXlink;
 
 	      if (finput)
 		{
@@ -940,12 +1042,12 @@ main (int argc, char **argv)
 	  char *zjobid;
 
 	  /* We need to request a remote file.  */
-	  iuuconf = uuconf_system_info (puuconf, zsystem, &sfromsys);
+	  iuuconf = uuconf_system_info (pXuuconf, zsystem, &sfromsys);
 	  if (iuuconf != UUCONF_SUCCESS)
 	    {
 	      if (iuuconf != UUCONF_NOT_FOUND)
-		ulog_uuconf (LOG_FATAL, puuconf, iuuconf);
-	      if (! funknown_system (puuconf, zsystem, &sfromsys))
+		ulog_uuconf (LOG_FATAL, pXuuconf, iuuconf);
+	      if (! funknown_system (pXuuconf, zsystem, &sfromsys))
 		ulog (LOG_FATAL, "%s: System not found", zsystem);
 	    }
 
@@ -986,7 +1088,7 @@ main (int argc, char **argv)
 
 	      /* We must request the file from the remote system to
 		 this one.  */
-	      zdata = zsysdep_data_file_name (&slocalsys, zXxqtloc, bXgrade,
+	      zdata = zsysdep_data_file_name (&sXlocalsys, zXxqtloc, bXgrade,
 					      FALSE, abtname, (char *) NULL,
 					      (char *) NULL);
 	      if (zdata == NULL)
@@ -1002,7 +1104,7 @@ main (int argc, char **argv)
 	      s.pseq = NULL;
 	      s.zfrom = zfile;
 	      s.zto = zbufcpy (abtname);
-	      s.zuser = zuser;
+	      s.zuser = zXuser;
 	      s.zoptions = "9";
 	      s.ztemp = "";
 	      s.imode = 0600;
@@ -1016,21 +1118,12 @@ main (int argc, char **argv)
 	      if (zjobid == NULL)
 		uxabort (ftemp ? EX_TEMPFAIL : EX_DATAERR);
 
-	      if (fjobid)
-		printf ("%s\n", zjobid);
+	      if (fXjobid)
+		uxjobid (zjobid);
 
 	      ubuffree (zjobid);
 
-	      if (fcall_any)
-		{
-		  ubuffree (zcall_system);
-		  zcall_system = NULL;
-		}
-	      else
-		{
-		  fcall_any = TRUE;
-		  zcall_system = zbufcpy (sfromsys.uuconf_zname);
-		}
+	      uxcall_system (sfromsys.uuconf_zname);
 
 	      if (fXxqtlocal)
 		{
@@ -1084,7 +1177,7 @@ main (int argc, char **argv)
 		  uxrecord_file (zxqt);
 
 		  fprintf (e, "U %s %s\n", zsysdep_login_name (),
-			   zlocalname);
+			   zXlocalname);
 		  fprintf (e, "F %s %s\n", abtname, zbase);
 		  fprintf (e, "C uucp -C -W -d -g %c %s %s!", bXgrade,
 			   zbase, sXxqtsys.uuconf_zname);
@@ -1111,13 +1204,13 @@ main (int argc, char **argv)
 		}
 	    }
 
-	  (void) uuconf_system_free (puuconf, &sfromsys);
+	  (void) uuconf_system_free (pXuuconf, &sfromsys);
 	}
     }
 
   /* If standard input is to be read from the stdin of uux, we read it
      here into a temporary file and send it to the execute system.  */
-  if (fread_stdin)
+  if (fXread_stdin)
     {
       char *zdata;
       char abtname[CFILE_NAME_LEN];
@@ -1144,6 +1237,8 @@ main (int argc, char **argv)
       if (fclose (e) != 0)
 	ulog (LOG_FATAL, "fclose: %s", strerror (errno));
 
+      (void) fsysdep_spool_share (zdata);
+
       if (fXxqtlocal)
 	uxadd_xqt_line ('I', abtname, (const char *) NULL);
       else
@@ -1157,11 +1252,11 @@ main (int argc, char **argv)
 
   /* If we are returning standard input, or we're putting the status
      in a file, we can't use an E command.  */
-  if (fretstdin)
+  if (fXretstdin)
     uxadd_xqt_line ('B', (const char *) NULL, (const char *) NULL);
 
-  if (zstatus_file != NULL)
-    uxadd_xqt_line ('M', zstatus_file, (const char *) NULL);
+  if (zXstatus_file != NULL)
+    uxadd_xqt_line ('M', zXstatus_file, (const char *) NULL);
 
   /* Get the complete command line, and decide whether the command
      needs to be executed by the shell.  */
@@ -1207,26 +1302,26 @@ main (int argc, char **argv)
       s.bcmd = 'E';
       s.bgrade = bXgrade;
       s.pseq = NULL;
-      s.zuser = zuser;
+      s.zuser = zXuser;
       s.zfrom = zinput_from;
       s.zto = zinput_to;
       s.zoptions = aboptions;
       zoptions = aboptions;
       *zoptions++ = finputcopied ? 'C' : 'c';
-      if (fno_ack)
+      if (fXno_ack)
 	*zoptions++ = 'N';
-      if (ferror_ack)
+      if (fXerror_ack)
 	*zoptions++ = 'Z';
-      if (zrequestor != NULL)
+      if (zXrequestor != NULL)
 	*zoptions++ = 'R';
       if (fneedshell)
 	*zoptions++ = 'e';
       *zoptions = '\0';
       s.ztemp = zinput_temp;
       s.imode = 0666;
-      if (zrequestor == NULL)
-	zrequestor = "\"\"";
-      s.znotify = zrequestor;
+      if (zXrequestor == NULL)
+	zXrequestor = "\"\"";
+      s.znotify = zXrequestor;
       s.cbytes = -1;
       s.zcmd = zfullcmd;
       s.ipos = 0;
@@ -1250,7 +1345,7 @@ main (int argc, char **argv)
   else
     {
       /* Finish up the execute file.  */
-      uxadd_xqt_line ('U', zuser, zXxqtloc);
+      uxadd_xqt_line ('U', zXuser, zXxqtloc);
       if (zinput_from != NULL)
 	{
 	  uxadd_xqt_line ('F', zinput_to, (char *) NULL);
@@ -1259,12 +1354,12 @@ main (int argc, char **argv)
 			   finputcopied ? "C" : "c",
 			   zinput_temp, zforward);
 	}
-      if (fno_ack)
+      if (fXno_ack)
 	uxadd_xqt_line ('N', (const char *) NULL, (const char *) NULL);
-      if (ferror_ack)
+      if (fXerror_ack)
 	uxadd_xqt_line ('Z', (const char *) NULL, (const char *) NULL);
-      if (zrequestor != NULL)
-	uxadd_xqt_line ('R', zrequestor, (const char *) NULL);
+      if (zXrequestor != NULL)
+	uxadd_xqt_line ('R', zXrequestor, (const char *) NULL);
       if (fneedshell)
 	uxadd_xqt_line ('e', (const char *) NULL, (const char *) NULL);
       uxadd_xqt_line ('C', zfullcmd, (const char *) NULL);
@@ -1301,47 +1396,89 @@ main (int argc, char **argv)
 				       &ftemp);
       if (zjobid == NULL)
 	{
+	  if (cXbatch_jobs > 0)
+	    (void) fxbatch_commit ();
 	  ulog_close ();
 	  exit (ftemp ? EX_TEMPFAIL : EX_DATAERR);
 	}
 
-      if (fjobid)
-	printf ("%s\n", zjobid);
+      if (fXjobid)
+	uxjobid (zjobid);
 
       ubuffree (zjobid);
 
-      if (fcall_any)
-	{
-	  ubuffree (zcall_system);
-	  zcall_system = NULL;
-	}
-      else
-	{
-	  fcall_any = TRUE;
-	  zcall_system = zbufcpy (sXxqtsys.uuconf_zname);
-	}
+      uxcall_system (sXxqtsys.uuconf_zname);
     }
 
   if (! fpoll)
     {
       /* If all that worked, make a log file entry.  All log file
 	 reports up to this point went to stderr.  */
-      ulog_to_file (puuconf, TRUE);
+      ulog_to_file (pXuuconf, TRUE);
       ulog_system (sXxqtsys.uuconf_zname);
-      ulog_user (zuser);
+      ulog_user (zXuser);
 
       if (zXnames == NULL)
 	ulog (LOG_NORMAL, "Queuing %s", zfullcmd);
       else
 	ulog (LOG_NORMAL, "Queuing %s (%s)", zfullcmd, zXnames);
 
-      ulog_close ();
+      if (! fXbatch)
+	ulog_close ();
+      else
+	{
+	  ulog_to_file (pXuuconf, FALSE);
+	  ulog_system ((const char *) NULL);
+	}
     }
 
+  if (fXxqtlocal)
+    fXany_local = TRUE;
+
+  /* The files of this command are now queued, and must not be
+     removed if a later command fails.  */
+  cXfiles = 0;
+  xfree ((pointer) pasXcmds);
+  pasXcmds = NULL;
+  cXcmds = 0;
+  ubuffree (zXnames);
+  zXnames = NULL;
+  fXquote_output = FALSE;
+  if (! fXxqtlocal)
+    (void) uuconf_system_free (pXuuconf, &sXxqtsys);
+}
+
+/* Note that work has been queued for a system.  If all the work
+   goes to one system, uucico is told to call just that one;
+   otherwise it is told to call any system with work.  In batch mode
+   this collects the systems of every command in the batch.  */
+
+static void
+uxcall_system (const char *zsystem)
+{
+  if (! fXcall_any)
+    {
+      fXcall_any = TRUE;
+      zXcall_system = zbufcpy (zsystem);
+    }
+  else if (zXcall_system != NULL && strcmp (zXcall_system, zsystem) != 0)
+    {
+      ubuffree (zXcall_system);
+      zXcall_system = NULL;
+    }
+}
+
+/* Start uucico to call the systems we have queued commands for, or
+   uuxqt to run commands queued for the local system.  This clears
+   the record of those systems, ready for the next batch.  */
+
+static void
+uxstart_uucico (boolean fuucico, const char *zconfig)
+{
   if (! fuucico
-      || (zcall_system == NULL && ! fcall_any))
+      || (zXcall_system == NULL && ! fXcall_any))
     {
-      if (fXxqtlocal && fuucico)
+      if (fXany_local && fuucico)
 	{
 	  char *zconfigarg;
 
@@ -1362,14 +1499,14 @@ main (int argc, char **argv)
       const char *zcicoarg;
       char *zconfigarg;
 
-      if (zcall_system == NULL)
+      if (zXcall_system == NULL)
 	zcicoarg = "-r1";
       else
 	{
 	  char *z;
 
-	  z = zbufalc (sizeof "-Cs" + strlen (zcall_system));
-	  sprintf (z, "-Cs%s", zcall_system);
+	  z = zbufalc (sizeof "-Cs" + strlen (zXcall_system));
+	  sprintf (z, "-Cs%s", zXcall_system);
 	  zcicoarg = z;
 	}
 
@@ -1384,10 +1521,182 @@ main (int argc, char **argv)
       (void) fsysdep_run (FALSE, "uucico", zcicoarg, zconfigarg);
     }
 
-  exit (EX_OK);
+  ubuffree (zXcall_system);
+  zXcall_system = NULL;
+  fXcall_any = FALSE;
+  fXany_local = FALSE;
+}
 
-  /* Avoid error about not returning a value.  */
-  return 0;
+/* Report a job id.  In batch mode the ids are held until the batch
+   has been committed.  */
+
+static void
+uxjobid (const char *zjobid)
+{
+  if (! fXbatch)
+    printf ("%s\n", zjobid);
+  else
+    {
+      pXzjobids = (char **) xrealloc ((pointer) pXzjobids,
+				      (cXjobids + 1) * sizeof (char *));
+      pXzjobids[cXjobids] = zbufcpy (zjobid);
+      ++cXjobids;
+    }
+}
+
+/* The largest number of commands we put in a single batch.  */
+#define CBATCH_MAX (1000)
+
+/* Read commands from standard input, one per line.  Each line is a
+   command just as it would be given to uux as arguments; the standard
+   input of the command, if any, must be given with a < redirection.
+   Lines starting with # are ignored.  The commands are committed to
+   disk in batches: a blank line, the end of the input, or CBATCH_MAX
+   commands ends a batch.  This returns FALSE if a batch could not be
+   committed.  */
+
+static boolean
+fxbatch (boolean fuucico, const char *zconfig)
+{
+  char *zline;
+  size_t cline;
+  char **pzfree;
+  int cfreealc;
+  boolean feof;
+  boolean fret;
+
+  zline = NULL;
+  cline = 0;
+  pzfree = NULL;
+  cfreealc = 0;
+  feof = FALSE;
+  fret = TRUE;
+
+  while (! feof && ! FGOT_SIGNAL ())
+    {
+      size_t clen;
+
+      if (getline (&zline, &cline, stdin) <= 0)
+	feof = TRUE;
+      else
+	{
+	  clen = strspn (zline, " \t\n");
+	  if (zline[clen] == '#')
+	    continue;
+	  if (zline[clen] != '\0')
+	    {
+	      char *zstart;
+	      char *zcmd;
+	      char **pzargs;
+	      int cargs, i;
+
+	      if (cXbatch_jobs == 0)
+		{
+		  iXbatch_secs = ixsysdep_time (&iXbatch_micros);
+		  usysdep_spool_batch ();
+		}
+
+	      zstart = zline + clen;
+	      clen = strlen (zstart);
+	      if (zstart[clen - 1] == '\n')
+		zstart[clen - 1] = '\0';
+
+	      uxsplit (zstart, &zcmd, &pzargs, &cargs);
+
+	      /* uxjob changes the arguments in place, so remember
+		 them in order to free them afterward.  */
+	      if (cargs + 1 > cfreealc)
+		{
+		  cfreealc = cargs + 1;
+		  pzfree = (char **) xrealloc ((pointer) pzfree,
+					       cfreealc * sizeof (char *));
+		}
+	      pzfree[0] = zcmd;
+	      memcpy (pzfree + 1, pzargs, cargs * sizeof (char *));
+
+	      uxjob (zcmd, pzargs, cargs);
+
+	      for (i = 0; i <= cargs; i++)
+		ubuffree (pzfree[i]);
+	      xfree ((pointer) pzargs);
+
+	      ++cXbatch_jobs;
+	      if (cXbatch_jobs < CBATCH_MAX)
+		continue;
+	    }
+	}
+
+      if (cXbatch_jobs > 0)
+	{
+	  if (! fxbatch_commit ())
+	    {
+	      fret = FALSE;
+	      break;
+	    }
+	  uxstart_uucico (fuucico, zconfig);
+	}
+    }
+
+  xfree ((pointer) zline);
+  xfree ((pointer) pzfree);
+
+  if (FGOT_SIGNAL ())
+    uxabort (EX_OSERR);
+
+  return fret;
+}
+
+/* Commit the current batch to disk, print the job ids, and log the
+   rate at which commands were queued.  */
+
+static boolean
+fxbatch_commit (void)
+{
+  boolean fret;
+  long isecs, imicros;
+  long imillis;
+  int i;
+
+  fret = fsysdep_spool_commit ();
+
+  isecs = ixsysdep_time (&imicros) - iXbatch_secs;
+  imicros -= iXbatch_micros;
+  if (imicros < 0)
+    {
+      imicros += 1000000;
+      --isecs;
+    }
+  imillis = isecs * 1000 + imicros / 1000;
+
+  ulog_to_file (pXuuconf, TRUE);
+  ulog_system ((const char *) NULL);
+  if (! fret)
+    ulog (LOG_ERROR, "Batch of %d commands may not have reached the disk",
+	  cXbatch_jobs);
+  else if (imillis <= 0)
+    ulog (LOG_NORMAL, "Queued batch of %d command%s", cXbatch_jobs,
+	  cXbatch_jobs == 1 ? "" : "s");
+  else
+    ulog (LOG_NORMAL,
+	  "Queued batch of %d command%s in %ld.%03ld seconds (%ld commands per second)",
+	  cXbatch_jobs, cXbatch_jobs == 1 ? "" : "s",
+	  imillis / 1000, imillis % 1000,
+	  (long) ((cXbatch_jobs * 1000L) / imillis));
+  ulog_to_file (pXuuconf, FALSE);
+
+  /* Only report the job ids once they are safely on disk.  */
+  for (i = 0; i < cXjobids; i++)
+    {
+      if (fret)
+	printf ("%s\n", pXzjobids[i]);
+      ubuffree (pXzjobids[i]);
+    }
+  cXjobids = 0;
+  (void) fflush (stdout);
+
+  cXbatch_jobs = 0;
+
+  return fret;
 }
 
 /* Report command usage.  */
@@ -1410,6 +1719,7 @@ uxhelp (void)
   printf (" -b,--return-stdin: Return standard input with status report\n");
   printf (" -s,--status file: Report completion status to file\n");
   printf (" -j,--jobid: Report job id\n");
+  printf (" -B,--batch: Read commands from standard input, one per line\n");
   printf (" -x,--debug debug: Set debugging level\n");
 #if HAVE_TAYLOR_CONFIG
   printf (" -I,--config file: Set configuration file to use\n");
@@ -1424,6 +1734,7 @@ uxusage (void)
 {
   fprintf (stderr,
 	   "Usage: %s [options] [-] command\n", zProgram);
+  fprintf (stderr, "       %s --batch [options] < commands\n", zProgram);
   fprintf (stderr, "Use %s --help for help\n", zProgram);
   exit (EX_USAGE);
 }
@@ -1647,9 +1958,6 @@ uxcopy_stdin (FILE *e)
 /* Keep track of all files we have created so that we can delete them
    if we get a signal.  The argument will be on the heap.  */
 
-static int cXfiles;
-static const char **pXaz;
-
 static void
 uxrecord_file (const char *zfile)
 {
@@ -1679,7 +1987,13 @@ uxabort (int istat)
   if (eXclose != NULL)
     (void) fclose (eXclose);
   for (i = 0; i < cXfiles; i++)
-    (void) remove (pXaz[i]);
+    (void) isysdep_spool_remove (pXaz[i]);
+
+  /* Commands already queued in this batch stay queued, so make sure
+     they get to the disk.  */
+  if (cXbatch_jobs > 0)
+    (void) fxbatch_commit ();
+
   ulog_close ();
   exit (istat);
 }
@@ -959,6 +959,11 @@ uqdo_xqt_file (pointer puuconf, const char *zfile, const char *zbase, const stru
 			  azQargs[i] = zbufcpy ("-r");
 			}
 		    }
+		  /* The --batch option is not permitted either, since
+		     it would read the files from standard input where
+		     we can not check them.  */
+		  else if (strncmp (azQargs[i] + 2, "b", 1) == 0)
+		    azQargs[i] = zbufcpy ("-r");
 		}
 	      else
 		{
@@ -966,6 +971,9 @@ uqdo_xqt_file (pointer puuconf, const char *zfile, const char *zbase, const stru
 
 		  for (zopts = azQargs[i] + 1; *zopts != '\0'; zopts++)
 		    {
+		      /* Nor is the -B option.  */
+		      if (*zopts == 'B')
+			*zopts = 'r';
 		      /* The -g, -n, and -s options take an argument.  */
 		      if (*zopts == 'g' || *zopts == 'n' || *zopts == 's')
 			{
@@ -1661,10 +1669,10 @@ uqcleanup (const char *zfile, int iflags)
       for (i = 0; i < cQfiles; i++)
 	{
 	  if (azQfiles[i] != NULL)
-	    (void) remove (azQfiles[i]);
+	    (void) isysdep_spool_remove (azQfiles[i]);
 	}
       if ((iflags & REMOVE_QINPUT) != 0)
-	(void) remove (zQinput);
+	(void) isysdep_spool_remove (zQinput);
     }
 
   if (zQunlock_file != NULL)
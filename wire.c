@@ -0,0 +1,583 @@
+/* wire.c
+   Record and replay the data passed over a connection.
+
+   Copyright (C) 2002 Ian Lance Taylor
+
+   This file is part of the Taylor UUCP package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307, USA.
+
+   The author of the program may be contacted at ian@airs.com.
+   */
+
+#include "uucp.h"
+
+#if USE_RCS_ID
+const char wire_rcsid[] = "$Id$";
+#endif
+
+#include <errno.h>
+
+#include "uudefs.h"
+#include "uuconf.h"
+#include "system.h"
+#include "conn.h"
+
+/* A wire trace is a record of everything read from and written to a
+   connection during a conversation.  The file starts with the eight
+   bytes "UUTRACE1" and a byte which is 'C' if the trace was made by
+   the calling system or 'A' if it was made by the answering system.
+   This is followed by a series of records, each of which is
+
+   1 byte: 'R' for data read, 'W' for data written
+   4 bytes: seconds since the trace was started
+   4 bytes: microseconds
+   4 bytes: length of data
+   the data
+
+   All numbers are stored most significant byte first.  A read which
+   timed out is recorded as reading zero bytes.
+
+   A trace may be replayed by a special connection which returns the
+   recorded reads in order, without waiting, and compares whatever is
+   written against the recorded writes.  This lets a conversation be
+   run through the protocol code again without any port.  */
+
+#define ZWMAGIC "UUTRACE1"
+#define CWMAGIC (sizeof ZWMAGIC - 1)
+
+/* The length of a file header and of a record header.  */
+#define CWFILEHDR (CWMAGIC + 1)
+#define CWRECHDR (13)
+
+/* The size of the buffer used when writing a trace.  */
+#define CWBUFSIZE (8192)
+
+/* The connection being traced, or NULL.  */
+struct sconnection *qWtrace_conn;
+
+/* The trace file.  */
+static openfile_t eWtrace = EFILECLOSED;
+
+/* The name of the trace file, for error messages.  */
+static char *zWtrace;
+
+/* When the trace started.  */
+static long iWstart_secs;
+static long iWstart_micros;
+
+/* Data waiting to be written to the trace file.  */
+static char abWbuf[CWBUFSIZE];
+static size_t cWbuf;
+
+static void uwput P((char *z, unsigned long i));
+static unsigned long iwget P((const char *z));
+static boolean fwflush P((void));
+static void uwadd P((const char *z, size_t c));
+static void uwrecord P((int btype, size_t c));
+
+/* Store a number in four bytes.  */
+
+static void
+uwput (char *z, long unsigned int i)
+{
+  z[0] = (char) ((i >> 24) & 0xff);
+  z[1] = (char) ((i >> 16) & 0xff);
+  z[2] = (char) ((i >> 8) & 0xff);
+  z[3] = (char) (i & 0xff);
+}
+
+/* Get a number from four bytes.  */
+
+static unsigned long
+iwget (const char *z)
+{
+  return ((((unsigned long) (z[0] & 0xff)) << 24)
+	  | (((unsigned long) (z[1] & 0xff)) << 16)
+	  | (((unsigned long) (z[2] & 0xff)) << 8)
+	  | ((unsigned long) (z[3] & 0xff)));
+}
+
+/* Write out any buffered trace data.  If this fails, we stop
+   tracing; the conversation itself can carry on.  */
+
+static boolean
+fwflush (void)
+{
+  size_t c;
+
+  c = cWbuf;
+  cWbuf = 0;
+  if (c > 0 && cfilewrite (eWtrace, abWbuf, c) != c)
+    {
+      ulog (LOG_ERROR, "%s: write: %s", zWtrace, strerror (errno));
+      uconn_trace_stop ();
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Add data to the trace file.  */
+
+static void
+uwadd (const char *z, size_t c)
+{
+  while (c > 0 && qWtrace_conn != NULL)
+    {
+      size_t ccopy;
+
+      if (cWbuf >= CWBUFSIZE && ! fwflush ())
+	return;
+      ccopy = CWBUFSIZE - cWbuf;
+      if (ccopy > c)
+	ccopy = c;
+      memcpy (abWbuf + cWbuf, z, ccopy);
+      cWbuf += ccopy;
+      z += ccopy;
+      c -= ccopy;
+    }
+}
+
+/* Start tracing a connection.  */
+
+boolean
+fconn_trace_start (struct sconnection *qconn, const char *zfile, boolean fcaller)
+{
+  char ab[CWFILEHDR];
+
+  if (qWtrace_conn != NULL)
+    uconn_trace_stop ();
+
+  eWtrace = esysdep_user_fopen (zfile, FALSE, TRUE);
+  if (! ffileisopen (eWtrace))
+    return FALSE;
+
+  zWtrace = zbufcpy (zfile);
+  qWtrace_conn = qconn;
+  iWstart_secs = ixsysdep_process_time (&iWstart_micros);
+  cWbuf = 0;
+
+  memcpy (ab, ZWMAGIC, CWMAGIC);
+  ab[CWMAGIC] = fcaller ? 'C' : 'A';
+  uwadd (ab, sizeof ab);
+
+  DEBUG_MESSAGE1 (DEBUG_PORT, "fconn_trace_start: Tracing to %s", zfile);
+
+  return TRUE;
+}
+
+/* Stop tracing.  */
+
+void
+uconn_trace_stop (void)
+{
+  if (qWtrace_conn == NULL)
+    return;
+
+  qWtrace_conn = NULL;
+  if (cWbuf > 0)
+    (void) cfilewrite (eWtrace, abWbuf, cWbuf);
+  cWbuf = 0;
+  if (! ffileclose (eWtrace))
+    ulog (LOG_ERROR, "%s: close: %s", zWtrace, strerror (errno));
+  eWtrace = EFILECLOSED;
+  ubuffree (zWtrace);
+  zWtrace = NULL;
+}
+
+/* Add a record header to the trace.  */
+
+static void
+uwrecord (int btype, size_t c)
+{
+  char ab[CWRECHDR];
+  long isecs, imicros;
+
+  isecs = ixsysdep_process_time (&imicros) - iWstart_secs;
+  imicros -= iWstart_micros;
+  if (imicros < 0)
+    {
+      imicros += 1000000;
+      --isecs;
+    }
+
+  ab[0] = (char) btype;
+  uwput (ab + 1, (unsigned long) isecs);
+  uwput (ab + 5, (unsigned long) imicros);
+  uwput (ab + 9, (unsigned long) c);
+  uwadd (ab, sizeof ab);
+}
+
+/* Add a record to the trace.  This is called by the routines in
+   conn.c for the connection being traced.  */
+
+void
+uconn_trace_data (int btype, const char *z, size_t c)
+{
+  if (qWtrace_conn == NULL)
+    return;
+
+  uwrecord (btype, c);
+  uwadd (z, c);
+}
+
+/* Add a record for data which was written in pieces.  Only the first
+   c bytes are recorded, since not all the pieces may have been
+   written.  */
+
+void
+uconn_trace_iov (const struct sconn_iov *qiov, int ciov, size_t c)
+{
+  int i;
+
+  if (qWtrace_conn == NULL)
+    return;
+
+  uwrecord ('W', c);
+  for (i = 0; i < ciov && c > 0; i++)
+    {
+      size_t cpiece;
+
+      cpiece = qiov[i].clen < c ? qiov[i].clen : c;
+      uwadd (qiov[i].zbuf, cpiece);
+      c -= cpiece;
+    }
+}
+
+/* Replaying a trace.  The whole trace is read into memory.  Reads
+   and writes are matched against the trace separately, each with its
+   own position.  */
+
+struct swreplay
+{
+  /* The name of the trace file.  */
+  char *zfile;
+  /* The contents of the trace file.  */
+  char *zbuf;
+  size_t cbuf;
+  /* The offset of the next record to look at for reads, the offset
+     of the next recorded byte to return, and the number of bytes
+     left in the current read record.  */
+  size_t irecread;
+  size_t iread;
+  size_t cread;
+  /* The same for writes.  */
+  size_t irecwrite;
+  size_t iwrite;
+  size_t cwrite;
+  /* The number of bytes read and written.  */
+  long creadtotal;
+  long cwritetotal;
+  /* The byte at which what we wrote first differed from the trace,
+     or -1.  */
+  long idiffer;
+};
+
+static boolean fwnext P((struct swreplay *q, int btype, size_t *pirec,
+			 size_t *pidata, size_t *pcdata));
+static void uwreplay_free P((struct sconnection *qconn));
+static boolean fwreplay_open P((struct sconnection *qconn, long ibaud,
+				boolean fwait, boolean fuser));
+static boolean fwreplay_close P((struct sconnection *qconn,
+				 pointer puuconf,
+				 struct uuconf_dialer *qdialer,
+				 boolean fsuccess));
+static boolean fwreplay_read P((struct sconnection *qconn, char *zbuf,
+				size_t *pclen, size_t cmin, int ctimeout,
+				boolean freport));
+static boolean fwreplay_write P((struct sconnection *qconn,
+				 const char *zbuf, size_t clen));
+static boolean fwreplay_io P((struct sconnection *qconn,
+			      const char *zwrite, size_t *pcwrite,
+			      char *zread, size_t *pcread));
+static boolean fwreplay_chat P((struct sconnection *qconn,
+				char **pzprog));
+
+static const struct sconncmds sWreplaycmds =
+{
+  uwreplay_free,
+  NULL, /* pflock */
+  NULL, /* pfunlock */
+  fwreplay_open,
+  fwreplay_close,
+  NULL, /* pfdial */
+  fwreplay_read,
+  fwreplay_write,
+  fwreplay_io,
+  NULL, /* pfwritev */
+  NULL, /* pfiov */
+  NULL, /* pfbreak */
+  NULL, /* pfset */
+  NULL, /* pfcarrier */
+  fwreplay_chat,
+  NULL, /* pibaud */
+  NULL, /* pfsendfile */
+  NULL, /* pfrecvfile */
+  NULL /* pftrywrite */
+};
+
+/* Initialize a connection which replays a trace.  */
+
+boolean
+fconn_replay_init (struct sconnection *qconn, const char *zfile, boolean fcaller)
+{
+  openfile_t e;
+  struct swreplay *q;
+  size_t calc;
+  int c;
+
+  e = esysdep_user_fopen (zfile, TRUE, TRUE);
+  if (! ffileisopen (e))
+    return FALSE;
+
+  q = (struct swreplay *) xmalloc (sizeof (struct swreplay));
+  q->zfile = zbufcpy (zfile);
+  calc = CWBUFSIZE;
+  q->zbuf = (char *) xmalloc (calc);
+  q->cbuf = 0;
+  while ((c = cfileread (e, q->zbuf + q->cbuf, calc - q->cbuf)) > 0)
+    {
+      q->cbuf += c;
+      if (q->cbuf == calc)
+	{
+	  calc *= 2;
+	  q->zbuf = (char *) xrealloc ((pointer) q->zbuf, calc);
+	}
+    }
+  if (ffileioerror (e, c))
+    ulog (LOG_ERROR, "%s: read: %s", zfile, strerror (errno));
+  (void) ffileclose (e);
+
+  if (q->cbuf < CWFILEHDR
+      || memcmp (q->zbuf, ZWMAGIC, CWMAGIC) != 0)
+    {
+      ulog (LOG_ERROR, "%s: Not a wire trace", zfile);
+      ubuffree (q->zfile);
+      xfree ((pointer) q->zbuf);
+      xfree ((pointer) q);
+      return FALSE;
+    }
+  if ((q->zbuf[CWMAGIC] == 'C') != fcaller)
+    {
+      ulog (LOG_ERROR, "%s: Trace was made by the %s system", zfile,
+	    fcaller ? "answering" : "calling");
+      ubuffree (q->zfile);
+      xfree ((pointer) q->zbuf);
+      xfree ((pointer) q);
+      return FALSE;
+    }
+
+  q->irecread = CWFILEHDR;
+  q->iread = 0;
+  q->cread = 0;
+  q->irecwrite = CWFILEHDR;
+  q->iwrite = 0;
+  q->cwrite = 0;
+  q->creadtotal = 0;
+  q->cwritetotal = 0;
+  q->idiffer = -1;
+
+  qconn->qcmds = &sWreplaycmds;
+  qconn->psysdep = (pointer) q;
+  qconn->qport = NULL;
+
+  return TRUE;
+}
+
+/* Find the next record of a given type, starting at *pirec.  Set
+   *pidata and *pcdata to the data in the record, and move *pirec past
+   it.  Return FALSE if there are no more records of that type.  */
+
+static boolean
+fwnext (struct swreplay *q, int btype, size_t *pirec, size_t *pidata, size_t *pcdata)
+{
+  while (*pirec + CWRECHDR <= q->cbuf)
+    {
+      const char *z;
+      size_t c;
+
+      z = q->zbuf + *pirec;
+      c = (size_t) iwget (z + 9);
+      if (c > q->cbuf - *pirec - CWRECHDR)
+	break;
+      *pirec += CWRECHDR + c;
+      if (z[0] == btype)
+	{
+	  *pidata = z + CWRECHDR - q->zbuf;
+	  *pcdata = c;
+	  return TRUE;
+	}
+    }
+  return FALSE;
+}
+
+/* Free a replay connection.  */
+
+static void
+uwreplay_free (struct sconnection *qconn)
+{
+  struct swreplay *q;
+
+  q = (struct swreplay *) qconn->psysdep;
+  if (q == NULL)
+    return;
+  ubuffree (q->zfile);
+  xfree ((pointer) q->zbuf);
+  xfree ((pointer) q);
+  qconn->psysdep = NULL;
+}
+
+/* Open a replay connection.  */
+
+/*ARGSUSED*/
+static boolean
+fwreplay_open (struct sconnection *qconn, long int ibaud ATTRIBUTE_UNUSED, boolean fwait ATTRIBUTE_UNUSED, boolean fuser ATTRIBUTE_UNUSED)
+{
+  struct swreplay *q;
+
+  q = (struct swreplay *) qconn->psysdep;
+  ulog_device ("replay");
+  ulog (LOG_NORMAL, "Replaying %s", q->zfile);
+  return TRUE;
+}
+
+/* Close a replay connection, and report how well the replay matched
+   the trace.  */
+
+/*ARGSUSED*/
+static boolean
+fwreplay_close (struct sconnection *qconn, pointer puuconf ATTRIBUTE_UNUSED, struct uuconf_dialer *qdialer ATTRIBUTE_UNUSED, boolean fsuccess ATTRIBUTE_UNUSED)
+{
+  struct swreplay *q;
+
+  q = (struct swreplay *) qconn->psysdep;
+  if (q->idiffer < 0)
+    ulog (LOG_NORMAL, "Replay: read %ld bytes, wrote %ld bytes as traced",
+	  q->creadtotal, q->cwritetotal);
+  else
+    ulog (LOG_NORMAL,
+	  "Replay: read %ld bytes, wrote %ld bytes, differing from trace at byte %ld",
+	  q->creadtotal, q->cwritetotal, q->idiffer);
+  return TRUE;
+}
+
+/* Return the next recorded read.  We never wait.  A read which timed
+   out when the trace was made returns nothing.  */
+
+/*ARGSUSED*/
+static boolean
+fwreplay_read (struct sconnection *qconn, char *zbuf, size_t *pclen, size_t cmin ATTRIBUTE_UNUSED, int ctimeout ATTRIBUTE_UNUSED, boolean freport)
+{
+  struct swreplay *q;
+
+  q = (struct swreplay *) qconn->psysdep;
+
+  if (q->cread == 0)
+    {
+      if (! fwnext (q, 'R', &q->irecread, &q->iread, &q->cread))
+	{
+	  *pclen = 0;
+	  if (freport)
+	    ulog (LOG_ERROR, "End of trace");
+	  return FALSE;
+	}
+      if (q->cread == 0)
+	{
+	  *pclen = 0;
+	  return TRUE;
+	}
+    }
+
+  if (*pclen > q->cread)
+    *pclen = q->cread;
+  memcpy (zbuf, q->zbuf + q->iread, *pclen);
+  q->iread += *pclen;
+  q->cread -= *pclen;
+  q->creadtotal += *pclen;
+
+  return TRUE;
+}
+
+/* Compare written data against the trace.  Once they differ we stop
+   comparing, since everything after that will be out of step.  */
+
+static boolean
+fwreplay_write (struct sconnection *qconn, const char *zbuf, size_t clen)
+{
+  struct swreplay *q;
+  long ipos;
+
+  q = (struct swreplay *) qconn->psysdep;
+
+  ipos = q->cwritetotal;
+  q->cwritetotal += clen;
+
+  while (clen > 0 && q->idiffer < 0)
+    {
+      size_t c, i;
+
+      if (q->cwrite == 0)
+	{
+	  if (! fwnext (q, 'W', &q->irecwrite, &q->iwrite, &q->cwrite))
+	    {
+	      q->idiffer = ipos;
+	      break;
+	    }
+	  continue;
+	}
+
+      c = clen < q->cwrite ? clen : q->cwrite;
+      for (i = 0; i < c; i++)
+	if (zbuf[i] != q->zbuf[q->iwrite + i])
+	  break;
+      if (i < c)
+	{
+	  q->idiffer = ipos + (long) i;
+	  DEBUG_MESSAGE1 (DEBUG_PORT | DEBUG_ABNORMAL,
+			  "fwreplay_write: Differs from trace at byte %ld",
+			  q->idiffer);
+	  break;
+	}
+
+      zbuf += c;
+      clen -= c;
+      ipos += c;
+      q->iwrite += c;
+      q->cwrite -= c;
+    }
+
+  return TRUE;
+}
+
+/* Write data and read data.  Nothing has arrived while we were
+   writing; the protocol will ask for the next recorded read when it
+   wants it.  */
+
+static boolean
+fwreplay_io (struct sconnection *qconn, const char *zwrite, size_t *pcwrite, char *zread ATTRIBUTE_UNUSED, size_t *pcread)
+{
+  *pcread = 0;
+  return fwreplay_write (qconn, zwrite, *pcwrite);
+}
+
+/* There is nothing to run a chat program on.  */
+
+/*ARGSUSED*/
+static boolean
+fwreplay_chat (struct sconnection *qconn ATTRIBUTE_UNUSED, char **pzprog ATTRIBUTE_UNUSED)
+{
+  ulog (LOG_ERROR, "Can't run a chat program while replaying a trace");
+  return FALSE;
+}